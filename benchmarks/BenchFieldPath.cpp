@@ -0,0 +1,157 @@
+#include "FieldPath.h"
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+using std::string;
+
+#include <vector>
+using std::vector;
+
+#include "json.hpp"
+using json = nlohmann::json;
+
+
+// Compares resolving SELECT/WHERE paths with a compiled FieldPath against splitting the dotted
+// path string for every row, which is what the query code did before FieldPath.
+
+
+namespace {
+
+    const size_t object_count = 100000;
+
+
+    const json& getPods(){
+
+        static const json pods = [](){
+            json pods = json::array();
+            for( size_t i = 0; i < object_count; i++ ){
+                pods.push_back({
+                    {"apiVersion", "v1"},
+                    {"kind", "Pod"},
+                    {"metadata", {
+                        {"name", "pod-" + std::to_string(i)},
+                        {"namespace", "namespace-" + std::to_string(i % 20)},
+                        {"labels", { {"app.kubernetes.io/name", "app-" + std::to_string(i % 50)}, {"tier", "web"} }}
+                    }},
+                    {"spec", {
+                        {"nodeName", "node-" + std::to_string(i % 100)},
+                        {"containers", {
+                            { {"name", "app"}, {"image", "registry.example.com/app:" + std::to_string(i % 7)} },
+                            { {"name", "sidecar"}, {"image", "registry.example.com/sidecar:1.0"} }
+                        }}
+                    }},
+                    {"status", { {"phase", i % 10 ? "Running" : "Pending"} }}
+                });
+            }
+            return pods;
+        }();
+
+        return pods;
+
+    }
+
+
+    // the per-row approach: split the path string on every lookup
+    const json* lookupBySplitting( const json& resource, const string& path ){
+
+        const json* current = &resource;
+        string remaining = path;
+
+        while( !remaining.empty() ){
+            if( !current->is_object() ){
+                return nullptr;
+            }
+            const size_t dot_pos = remaining.find(".");
+            const string key = remaining.substr(0, dot_pos);
+            remaining = ( dot_pos == string::npos ) ? "" : remaining.substr(dot_pos + 1);
+            auto it = current->find(key);
+            if( it == current->end() ){
+                return nullptr;
+            }
+            current = &(*it);
+        }
+
+        return current;
+
+    }
+
+
+    const vector<string> select_paths = { "metadata.name", "metadata.namespace", "spec.nodeName", "status.phase" };
+
+}
+
+
+
+static void BM_SelectPaths_StringSplit( benchmark::State& state ){
+
+    const json& pods = getPods();
+
+    for( auto _ : state ){
+        size_t found = 0;
+        for( const json& pod : pods ){
+            for( const string& path : select_paths ){
+                found += lookupBySplitting(pod, path) != nullptr;
+            }
+        }
+        benchmark::DoNotOptimize(found);
+    }
+
+    state.SetItemsProcessed( state.iterations() * pods.size() );
+
+}
+BENCHMARK(BM_SelectPaths_StringSplit)->Unit(benchmark::kMillisecond);
+
+
+
+static void BM_SelectPaths_FieldPath( benchmark::State& state ){
+
+    const json& pods = getPods();
+
+    vector<kubepp::FieldPath> field_paths;
+    for( const string& path : select_paths ){
+        field_paths.push_back( kubepp::FieldPath(path) );
+    }
+
+    for( auto _ : state ){
+        size_t found = 0;
+        for( const json& pod : pods ){
+            for( const auto& field_path : field_paths ){
+                found += field_path.resolve(pod) != nullptr;
+            }
+        }
+        benchmark::DoNotOptimize(found);
+    }
+
+    state.SetItemsProcessed( state.iterations() * pods.size() );
+
+}
+BENCHMARK(BM_SelectPaths_FieldPath)->Unit(benchmark::kMillisecond);
+
+
+
+static void BM_WildcardPath_FieldPath( benchmark::State& state ){
+
+    const json& pods = getPods();
+
+    const kubepp::FieldPath images("spec.containers[*].image");
+    vector<const json*> values;
+
+    for( auto _ : state ){
+        size_t found = 0;
+        for( const json& pod : pods ){
+            values.clear();
+            images.resolveAll(pod, values);
+            found += values.size();
+        }
+        benchmark::DoNotOptimize(found);
+    }
+
+    state.SetItemsProcessed( state.iterations() * pods.size() );
+
+}
+BENCHMARK(BM_WildcardPath_FieldPath)->Unit(benchmark::kMillisecond);
+
+
+
+BENCHMARK_MAIN();
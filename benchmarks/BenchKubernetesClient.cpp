@@ -0,0 +1,184 @@
+#include "KubernetesClient.h"
+#include "ResourceDescription.h"
+#include "ListOptions.h"
+#include "cjson.h"
+
+#include "MockApiServer.h"
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+
+#include <string>
+using std::string;
+
+#include "json.hpp"
+using json = nlohmann::json;
+
+
+// End-to-end client benchmarks against the in-process MockApiServer, so the numbers cover the request,
+// the response parsing and the json conversion without a cluster. The server caches rendered lists,
+// so the time is spent in the client. Each benchmark runs at 1k, 10k and 100k pods.
+
+
+namespace {
+
+    kubepp::mock::MockApiServer& getServer(){
+
+        static kubepp::mock::MockApiServer server;
+        return server;
+
+    }
+
+
+    kubepp::KubernetesClient& getClient(){
+
+        static std::unique_ptr<kubepp::KubernetesClient> client = [](){
+            getServer().useAsKubeconfig();
+            return std::make_unique<kubepp::KubernetesClient>();
+        }();
+
+        return *client;
+
+    }
+
+
+    void setPodCount( size_t count ){
+
+        static size_t current_count = 0;
+
+        if( count != current_count ){
+            getServer().setPods(count);
+            current_count = count;
+        }
+
+    }
+
+
+    // the body of a single list response with every pod, as the apiserver sends it
+    const string& getPodListBody( size_t count ){
+
+        static size_t current_count = 0;
+        static string body;
+
+        if( count != current_count ){
+            json pods = { {"apiVersion", "v1"}, {"kind", "PodList"}, {"metadata", { {"resourceVersion", "1"} }}, {"items", json::array()} };
+            for( size_t i = 0; i < count; i++ ){
+                json pod = kubepp::mock::MockApiServer::makePod( "default", "pod-" + std::to_string(i), i );
+                pod.erase("apiVersion");
+                pod.erase("kind");
+                pods["items"].push_back( std::move(pod) );
+            }
+            body = pods.dump();
+            current_count = count;
+        }
+
+        return body;
+
+    }
+
+}
+
+
+
+static void BM_List( benchmark::State& state ){
+
+    const size_t count = state.range(0);
+    setPodCount(count);
+
+    kubepp::KubernetesClient& client = getClient();
+    const kubepp::ResourceDescription pods( string("Pod") );
+
+    for( auto _ : state ){
+        json list = client.getGenericResources( pods, kubepp::ListOptions() );
+        benchmark::DoNotOptimize(list);
+    }
+
+    state.SetItemsProcessed( state.iterations() * count );
+
+}
+BENCHMARK(BM_List)->Arg(1000)->Arg(10000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+
+
+static void BM_Get( benchmark::State& state ){
+
+    setPodCount( state.range(0) );
+
+    kubepp::KubernetesClient& client = getClient();
+
+    kubepp::ResourceDescription pod( string("Pod") );
+    pod.k8s_namespace = "default";
+    pod.name = "pod-0";
+
+    for( auto _ : state ){
+        json resource = client.getGenericResource(pod);
+        benchmark::DoNotOptimize(resource);
+    }
+
+    state.SetItemsProcessed( state.iterations() );
+
+}
+BENCHMARK(BM_Get)->Arg(1000)->Arg(10000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+
+
+static void BM_SelectStarCrawl( benchmark::State& state ){
+
+    const size_t count = state.range(0);
+    setPodCount(count);
+
+    kubepp::KubernetesClient& client = getClient();
+
+    // discovery of every group version, then a paginated list of each kind
+    for( auto _ : state ){
+        json results = client.runQuery("SELECT * FROM *");
+        benchmark::DoNotOptimize(results);
+    }
+
+    state.SetItemsProcessed( state.iterations() * count );
+
+}
+BENCHMARK(BM_SelectStarCrawl)->Arg(1000)->Arg(10000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+
+
+static void BM_JsonConversion_Cjson( benchmark::State& state ){
+
+    const size_t count = state.range(0);
+    const string& body = getPodListBody(count);
+
+    // what the client does with every json response: parse with cJSON, then convert
+    for( auto _ : state ){
+        kubepp::cjson parsed( body.c_str() );
+        json converted = parsed.toJson();
+        benchmark::DoNotOptimize(converted);
+    }
+
+    state.SetBytesProcessed( state.iterations() * body.size() );
+    state.SetItemsProcessed( state.iterations() * count );
+
+}
+BENCHMARK(BM_JsonConversion_Cjson)->Arg(1000)->Arg(10000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+
+
+static void BM_JsonConversion_Direct( benchmark::State& state ){
+
+    const size_t count = state.range(0);
+    const string& body = getPodListBody(count);
+
+    for( auto _ : state ){
+        json converted = json::parse(body);
+        benchmark::DoNotOptimize(converted);
+    }
+
+    state.SetBytesProcessed( state.iterations() * body.size() );
+    state.SetItemsProcessed( state.iterations() * count );
+
+}
+BENCHMARK(BM_JsonConversion_Direct)->Arg(1000)->Arg(10000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+
+
+BENCHMARK_MAIN();
@@ -0,0 +1,140 @@
+#include "Query.h"
+#include "ResourceDescription.h"
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+using std::string;
+
+#include <vector>
+using std::vector;
+
+#include <sstream>
+
+#include "json.hpp"
+using json = nlohmann::json;
+
+
+// Query parsing and ResourceDescription construction run on every runQuery call. The *_Before benchmarks
+// repeat what the code did before: tokenizing through istringstream into a string per token, and building
+// a temporary json object for ResourceDescription::fromJson.
+
+
+namespace {
+
+    const vector<string> queries = {
+        "SELECT * FROM Pod",
+        "SELECT metadata.name, metadata.namespace, status.phase FROM Pod WHERE metadata.namespace = 'default' AND status.phase = 'Running'",
+        "EXPLAIN ANALYZE SELECT metadata.name,spec.replicas FROM apps/v1:Deployment WHERE metadata.labels.app = ? LIMIT 100"
+    };
+
+
+    vector<string> tokenizeWithStringStreams( const string& query_str ){
+
+        vector<string> tokens;
+        string token;
+        std::istringstream token_stream(query_str);
+
+        while( std::getline(token_stream, token, ' ') ){
+            if( token.find(",") != string::npos ){
+                std::istringstream token_stream2(token);
+                string token2;
+                while( std::getline(token_stream2, token2, ',') ){
+                    tokens.push_back(token2);
+                }
+                continue;
+            }
+            tokens.push_back(token);
+        }
+
+        return tokens;
+
+    }
+
+}
+
+
+
+static void BM_QueryTokenize_Before( benchmark::State& state ){
+
+    const string& query_str = queries[ state.range(0) ];
+
+    for( auto _ : state ){
+        vector<string> tokens = tokenizeWithStringStreams(query_str);
+        benchmark::DoNotOptimize(tokens.data());
+    }
+
+}
+BENCHMARK(BM_QueryTokenize_Before)->DenseRange(0, 2);
+
+
+
+static void BM_QueryParse( benchmark::State& state ){
+
+    const string& query_str = queries[ state.range(0) ];
+
+    for( auto _ : state ){
+        kubepp::Query query(query_str);
+        benchmark::DoNotOptimize(query.select.data());
+    }
+
+}
+BENCHMARK(BM_QueryParse)->DenseRange(0, 2);
+
+
+
+static void BM_ResourceDescriptionFromKind_Before( benchmark::State& state ){
+
+    for( auto _ : state ){
+        json resource = json::object();
+        resource["apiVersion"] = kubepp::ResourceDescription::kind_to_api_group.at("Deployment");
+        resource["kind"] = "Deployment";
+        kubepp::ResourceDescription resource_description(resource);
+        benchmark::DoNotOptimize(resource_description.kind_lower_plural.data());
+    }
+
+}
+BENCHMARK(BM_ResourceDescriptionFromKind_Before);
+
+
+
+static void BM_ResourceDescriptionFromKind( benchmark::State& state ){
+
+    const string resource_str = "Deployment";
+
+    for( auto _ : state ){
+        kubepp::ResourceDescription resource_description(resource_str);
+        benchmark::DoNotOptimize(resource_description.kind_lower_plural.data());
+    }
+
+}
+BENCHMARK(BM_ResourceDescriptionFromKind);
+
+
+
+static void BM_ResourceDescriptionFromApiVersionKind( benchmark::State& state ){
+
+    const string resource_str = "example.com/v1:Widget";
+
+    for( auto _ : state ){
+        kubepp::ResourceDescription resource_description(resource_str);
+        benchmark::DoNotOptimize(resource_description.kind_lower_plural.data());
+    }
+
+}
+BENCHMARK(BM_ResourceDescriptionFromApiVersionKind);
+
+
+
+static void BM_ResourceDescriptionFromJson( benchmark::State& state ){
+
+    // a discovery entry, as used for SELECT * FROM *
+    const json api_resource = { {"apiVersion", "apps/v1"}, {"kind", "Deployment"}, {"name", "deployments"}, {"namespaced", true} };
+
+    for( auto _ : state ){
+        kubepp::ResourceDescription resource_description(api_resource);
+        benchmark::DoNotOptimize(resource_description.kind_lower_plural.data());
+    }
+
+}
+BENCHMARK(BM_ResourceDescriptionFromJson);
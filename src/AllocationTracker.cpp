@@ -0,0 +1,223 @@
+#include "AllocationTracker.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifdef KUBEPP_TRACK_ALLOCATIONS
+extern "C" {
+    #include <cJSON.h>
+}
+#endif
+
+
+namespace kubepp{
+
+
+    namespace{
+
+        constexpr size_t subsystem_count = static_cast<size_t>(AllocationTracker::Subsystem::COUNT);
+
+        // constant-initialized, so they're usable from operator new before any static constructor runs
+        std::atomic<size_t> allocation_counts[subsystem_count] = {};
+        std::atomic<size_t> allocation_bytes[subsystem_count] = {};
+
+        thread_local AllocationTracker::Subsystem current_subsystem = AllocationTracker::Subsystem::OTHER;
+
+    }
+
+
+
+    const AllocationTracker::Counts& AllocationTracker::Snapshot::get( Subsystem subsystem ) const{
+
+        return this->subsystems[ static_cast<size_t>(subsystem) ];
+
+    }
+
+
+
+    AllocationTracker::Snapshot AllocationTracker::Snapshot::operator-( const Snapshot& earlier ) const{
+
+        Snapshot difference;
+
+        for( size_t i = 0; i < subsystem_count; i++ ){
+            difference.subsystems[i].allocations = this->subsystems[i].allocations - earlier.subsystems[i].allocations;
+            difference.subsystems[i].bytes = this->subsystems[i].bytes - earlier.subsystems[i].bytes;
+        }
+
+        return difference;
+
+    }
+
+
+
+    AllocationTracker::Scope::Scope( Subsystem subsystem )
+        :previous(current_subsystem)
+    {
+
+        current_subsystem = subsystem;
+
+    }
+
+
+
+    AllocationTracker::Scope::~Scope(){
+
+        current_subsystem = this->previous;
+
+    }
+
+
+
+    bool AllocationTracker::isEnabled(){
+
+#ifdef KUBEPP_TRACK_ALLOCATIONS
+        return true;
+#else
+        return false;
+#endif
+
+    }
+
+
+
+    AllocationTracker::Snapshot AllocationTracker::snapshot(){
+
+        Snapshot snapshot;
+
+        for( size_t i = 0; i < subsystem_count; i++ ){
+            snapshot.subsystems[i].allocations = allocation_counts[i].load(std::memory_order_relaxed);
+            snapshot.subsystems[i].bytes = allocation_bytes[i].load(std::memory_order_relaxed);
+        }
+
+        return snapshot;
+
+    }
+
+
+
+    const char* AllocationTracker::getSubsystemName( Subsystem subsystem ){
+
+        switch( subsystem ){
+            case Subsystem::CJSON: return "cjson";
+            case Subsystem::RESOURCE_DESCRIPTION: return "ResourceDescription";
+            case Subsystem::QUERY: return "query";
+            default: return "other";
+        }
+
+    }
+
+
+
+    void AllocationTracker::record( Subsystem subsystem, size_t bytes ){
+
+        const size_t index = static_cast<size_t>(subsystem);
+        allocation_counts[index].fetch_add( 1, std::memory_order_relaxed );
+        allocation_bytes[index].fetch_add( bytes, std::memory_order_relaxed );
+
+    }
+
+
+
+    void AllocationTracker::record( size_t bytes ){
+
+        AllocationTracker::record( current_subsystem, bytes );
+
+    }
+
+
+
+#ifdef KUBEPP_TRACK_ALLOCATIONS
+
+    namespace{
+
+        // no header in front of the block: the kubernetes client frees some cJSON strings with plain free()
+        void* cjsonMalloc( size_t size ){
+
+            AllocationTracker::record( AllocationTracker::Subsystem::CJSON, size );
+            return std::malloc(size);
+
+        }
+
+        void cjsonFree( void* pointer ){
+
+            std::free(pointer);
+
+        }
+
+        class CJsonHooksInstaller{
+            public:
+                CJsonHooksInstaller(){
+                    cJSON_Hooks hooks{ cjsonMalloc, cjsonFree };
+                    cJSON_InitHooks(&hooks);
+                }
+        };
+
+        const CJsonHooksInstaller cjson_hooks_installer;
+
+        void* trackedNew( size_t size ){
+
+            AllocationTracker::record(size);
+
+            void* pointer = std::malloc( size ? size : 1 );
+            if( !pointer ){
+                throw std::bad_alloc();
+            }
+            return pointer;
+
+        }
+
+    }
+
+#endif
+
+
+}
+
+
+
+#ifdef KUBEPP_TRACK_ALLOCATIONS
+
+void* operator new( size_t size ){
+    return kubepp::trackedNew(size);
+}
+
+void* operator new[]( size_t size ){
+    return kubepp::trackedNew(size);
+}
+
+void* operator new( size_t size, const std::nothrow_t& ) noexcept{
+    kubepp::AllocationTracker::record(size);
+    return std::malloc( size ? size : 1 );
+}
+
+void* operator new[]( size_t size, const std::nothrow_t& ) noexcept{
+    kubepp::AllocationTracker::record(size);
+    return std::malloc( size ? size : 1 );
+}
+
+void operator delete( void* pointer ) noexcept{
+    std::free(pointer);
+}
+
+void operator delete[]( void* pointer ) noexcept{
+    std::free(pointer);
+}
+
+void operator delete( void* pointer, size_t ) noexcept{
+    std::free(pointer);
+}
+
+void operator delete[]( void* pointer, size_t ) noexcept{
+    std::free(pointer);
+}
+
+void operator delete( void* pointer, const std::nothrow_t& ) noexcept{
+    std::free(pointer);
+}
+
+void operator delete[]( void* pointer, const std::nothrow_t& ) noexcept{
+    std::free(pointer);
+}
+
+#endif
@@ -0,0 +1,75 @@
+#pragma once
+
+
+#include <string>
+using std::string;
+
+#include <array>
+#include <cstddef>
+
+
+namespace kubepp{
+
+
+    /*
+        Allocation counts and bytes per subsystem, for builds configured with -DKUBEPP_TRACK_ALLOCATIONS=ON.
+
+        Tracking builds replace the global operator new and install cJSON_InitHooks. cJSON allocations are always
+        counted as "cjson"; operator new allocations go to the subsystem of the innermost Scope on the calling
+        thread, or "other". Counters are process-wide, so concurrent queries are counted together.
+        In other builds nothing is counted and isEnabled() is false.
+
+            const auto before = AllocationTracker::snapshot();
+            kube_client.runQuery( "SELECT * FROM Pod" );
+            const auto allocated = AllocationTracker::snapshot() - before;
+    */
+    class AllocationTracker{
+
+        public:
+
+            enum class Subsystem{ OTHER, CJSON, RESOURCE_DESCRIPTION, QUERY, COUNT };
+
+            class Counts{
+                public:
+                    size_t allocations = 0;
+                    size_t bytes = 0;
+            };
+
+            class Snapshot{
+                public:
+                    std::array<Counts, static_cast<size_t>(Subsystem::COUNT)> subsystems;
+
+                    const Counts& get( Subsystem subsystem ) const;
+
+                    /* The allocations made between two snapshots. */
+                    Snapshot operator-( const Snapshot& earlier ) const;
+            };
+
+            /* Attributes operator new allocations on this thread to a subsystem until destroyed; scopes nest. */
+            class Scope{
+                public:
+                    Scope( Subsystem subsystem );
+                    ~Scope();
+
+                    Scope( const Scope& ) = delete;
+                    Scope& operator=( const Scope& ) = delete;
+
+                protected:
+                    Subsystem previous;
+            };
+
+            static bool isEnabled();
+
+            static Snapshot snapshot();
+
+            /* "other", "cjson", "ResourceDescription" or "query". */
+            static const char* getSubsystemName( Subsystem subsystem );
+
+            /* Counts an allocation; called by the hooks. */
+            static void record( Subsystem subsystem, size_t bytes );
+            static void record( size_t bytes );
+
+    };
+
+
+}
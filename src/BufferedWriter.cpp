@@ -0,0 +1,93 @@
+#include "BufferedWriter.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include "Tracer.h"
+
+
+namespace kubepp{
+
+
+    BufferedWriter::BufferedWriter( std::ostream& output, size_t buffer_size )
+        :output(output), buffer( buffer_size > 0 ? buffer_size : 1 )
+    {
+
+    }
+
+
+
+    BufferedWriter::~BufferedWriter(){
+
+        // never throw from the destructor; call flush() to see errors
+        this->drain();
+        this->output.flush();
+
+    }
+
+
+
+    void BufferedWriter::write( const string& data ){
+
+        this->write( data.data(), data.size() );
+
+    }
+
+
+
+    void BufferedWriter::write( const char* data, size_t size ){
+
+        this->bytes_written += size;
+
+        // larger than the buffer: skip the copy
+        if( size >= this->buffer.size() ){
+            this->drain();
+            this->output.write( data, size );
+            return;
+        }
+
+        if( this->used + size > this->buffer.size() ){
+            this->drain();
+        }
+
+        std::memcpy( this->buffer.data() + this->used, data, size );
+        this->used += size;
+
+    }
+
+
+
+    void BufferedWriter::flush(){
+
+        this->drain();
+        this->output.flush();
+
+        if( !this->output ){
+            throw std::runtime_error("Failed to write the output.");
+        }
+
+    }
+
+
+
+    size_t BufferedWriter::getBytesWritten() const{
+
+        return this->bytes_written;
+
+    }
+
+
+
+    void BufferedWriter::drain(){
+
+        if( this->used > 0 ){
+            Tracer::Span span( "write", "output" );
+            span.setArg( "bytes", static_cast<double>(this->used) );
+            this->output.write( this->buffer.data(), this->used );
+            this->used = 0;
+        }
+
+    }
+
+
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+
+#include <string>
+using std::string;
+
+#include <vector>
+using std::vector;
+
+#include <ostream>
+
+
+namespace kubepp{
+
+
+    /*
+        Collects small writes into a fixed-size buffer and hands them to the stream in large blocks.
+
+        Exports write one line per object; going through the stream for every line is much slower than
+        one write per megabyte, and the buffer is the only output held in memory.
+    */
+    class BufferedWriter{
+
+        public:
+            BufferedWriter( std::ostream& output, size_t buffer_size = 1 << 20 );
+            ~BufferedWriter();
+
+            BufferedWriter( const BufferedWriter& ) = delete;
+            BufferedWriter& operator=( const BufferedWriter& ) = delete;
+
+            void write( const string& data );
+            void write( const char* data, size_t size );
+
+            /* Writes out the buffer and flushes the stream. Throws if the stream failed. */
+            void flush();
+
+            size_t getBytesWritten() const;
+
+
+        protected:
+            void drain();
+
+            std::ostream& output;
+            vector<char> buffer;
+            size_t used = 0;
+            size_t bytes_written = 0;
+
+    };
+
+
+}
@@ -0,0 +1,417 @@
+#include "ClientMetrics.h"
+
+#include <vector>
+using std::vector;
+
+#include <algorithm>
+#include <functional>
+#include <sstream>
+#include <cstdio>
+
+
+namespace kubepp{
+
+
+    namespace{
+
+        // the path after /api/<version> or /apis/<group>/<version>, split on '/'
+        vector<string> getResourceSegments( const string& path ){
+
+            vector<string> segments;
+            size_t start = 0;
+
+            const size_t query_pos = path.find('?');
+            const string clean_path = path.substr(0, query_pos);
+
+            while( start < clean_path.size() ){
+                size_t end = clean_path.find('/', start);
+                if( end == string::npos ){
+                    end = clean_path.size();
+                }
+                if( end > start ){
+                    segments.push_back( clean_path.substr(start, end - start) );
+                }
+                start = end + 1;
+            }
+
+            size_t prefix_length = 0;
+            if( !segments.empty() && segments[0] == "api" ){
+                prefix_length = 2;
+            }else if( !segments.empty() && segments[0] == "apis" ){
+                prefix_length = 3;
+            }
+
+            if( segments.size() <= prefix_length ){
+                return {};
+            }
+
+            segments.erase( segments.begin(), segments.begin() + prefix_length );
+
+            // namespaced: namespaces/<namespace>/<resource>/...; the namespace itself is namespaces/<name>/...
+            if( segments.size() >= 3 && segments[0] == "namespaces" ){
+                segments.erase( segments.begin(), segments.begin() + 2 );
+            }
+
+            return segments;
+
+        }
+
+
+        string formatNumber( double value ){
+
+            char buffer[32];
+            std::snprintf( buffer, sizeof(buffer), "%.9g", value );
+            return buffer;
+
+        }
+
+
+        void writeLabels( std::ostream& output, const ClientMetrics::Series& series ){
+
+            output << "verb=\"" << ClientMetrics::getVerbName(series.verb) << "\",resource=\"" << series.resource << "\"";
+
+        }
+
+    }
+
+
+
+    void LatencyHistogram::observe( double seconds ){
+
+        size_t bucket = 0;
+        while( bucket < LatencyHistogram::bucket_count && seconds > LatencyHistogram::upper_bounds[bucket] ){
+            bucket++;
+        }
+
+        this->buckets[bucket].fetch_add( 1, std::memory_order_relaxed );
+        this->sum_nanoseconds.fetch_add( static_cast<uint64_t>( std::max(seconds, 0.0) * 1e9 ), std::memory_order_relaxed );
+        this->count.fetch_add( 1, std::memory_order_relaxed );
+
+    }
+
+
+
+    uint64_t LatencyHistogram::getCount() const{
+
+        return this->count.load( std::memory_order_relaxed );
+
+    }
+
+
+
+    double LatencyHistogram::getSum() const{
+
+        return static_cast<double>( this->sum_nanoseconds.load(std::memory_order_relaxed) ) / 1e9;
+
+    }
+
+
+
+    uint64_t LatencyHistogram::getCumulativeCount( size_t bucket ) const{
+
+        uint64_t cumulative = 0;
+        for( size_t i = 0; i <= bucket && i <= LatencyHistogram::bucket_count; i++ ){
+            cumulative += this->buckets[i].load( std::memory_order_relaxed );
+        }
+        return cumulative;
+
+    }
+
+
+
+    ClientMetrics::Call::Call( ClientMetrics& metrics, Verb verb, const string& resource )
+        :series( &metrics.getSeries(verb, resource) ), start( std::chrono::steady_clock::now() )
+    {
+
+        this->series->in_flight.fetch_add( 1, std::memory_order_relaxed );
+
+    }
+
+
+
+    ClientMetrics::Call::~Call(){
+
+        if( !this->finished ){
+            this->finish(0);
+        }
+
+    }
+
+
+
+    void ClientMetrics::Call::finish( long status_code ){
+
+        if( this->finished ){
+            return;
+        }
+        this->finished = true;
+
+        this->series->latency.observe( std::chrono::duration<double>( std::chrono::steady_clock::now() - this->start ).count() );
+        if( status_code == 0 || status_code >= 400 ){
+            this->series->errors.fetch_add( 1, std::memory_order_relaxed );
+        }
+        this->series->in_flight.fetch_sub( 1, std::memory_order_relaxed );
+
+    }
+
+
+
+    ClientMetrics::ClientMetrics(){
+
+        this->overflow.verb = Verb::OTHER;
+        this->overflow.resource = "other";
+
+    }
+
+
+
+    ClientMetrics::~ClientMetrics(){
+
+        for( auto& slot : this->series ){
+            delete slot.load();
+        }
+
+    }
+
+
+
+    ClientMetrics::Series& ClientMetrics::getSeries( Verb verb, const string& resource ){
+
+        const size_t hash = std::hash<string>()(resource) * 31 + static_cast<size_t>(verb);
+
+        Series* added = nullptr;
+
+        for( size_t probe = 0; probe < ClientMetrics::max_series; probe++ ){
+
+            std::atomic<Series*>& slot = this->series[ (hash + probe) % ClientMetrics::max_series ];
+            Series* current = slot.load( std::memory_order_acquire );
+
+            if( !current ){
+                if( !added ){
+                    added = new Series();
+                    added->verb = verb;
+                    added->resource = resource;
+                }
+                // another thread may claim the slot first; then compare with what it stored
+                if( slot.compare_exchange_strong(current, added, std::memory_order_acq_rel, std::memory_order_acquire) ){
+                    return *added;
+                }
+            }
+
+            if( current->verb == verb && current->resource == resource ){
+                delete added;
+                return *current;
+            }
+
+        }
+
+        delete added;
+        return this->overflow;
+
+    }
+
+
+
+    void ClientMetrics::writePrometheus( std::ostream& output ) const{
+
+        vector<const Series*> all_series;
+        for( const auto& slot : this->series ){
+            const Series* current = slot.load( std::memory_order_acquire );
+            if( current ){
+                all_series.push_back(current);
+            }
+        }
+        if( this->overflow.latency.getCount() || this->overflow.in_flight.load() ){
+            all_series.push_back( &this->overflow );
+        }
+
+        std::sort( all_series.begin(), all_series.end(), []( const Series* a, const Series* b ){
+            return a->resource != b->resource ? a->resource < b->resource : a->verb < b->verb;
+        });
+
+        output << "# HELP kubepp_client_request_duration_seconds Latency of apiserver requests made by kubepp, by verb and resource.\n"
+               << "# TYPE kubepp_client_request_duration_seconds histogram\n";
+        for( const Series* current : all_series ){
+            for( size_t bucket = 0; bucket <= LatencyHistogram::bucket_count; bucket++ ){
+                output << "kubepp_client_request_duration_seconds_bucket{";
+                writeLabels( output, *current );
+                output << ",le=\"";
+                if( bucket == LatencyHistogram::bucket_count ){
+                    output << "+Inf";
+                }else{
+                    output << formatNumber( LatencyHistogram::upper_bounds[bucket] );
+                }
+                output << "\"} " << current->latency.getCumulativeCount(bucket) << "\n";
+            }
+            output << "kubepp_client_request_duration_seconds_sum{";
+            writeLabels( output, *current );
+            output << "} " << formatNumber( current->latency.getSum() ) << "\n";
+            output << "kubepp_client_request_duration_seconds_count{";
+            writeLabels( output, *current );
+            output << "} " << current->latency.getCount() << "\n";
+        }
+
+        output << "# HELP kubepp_client_requests_total Apiserver requests made by kubepp, by verb and resource.\n"
+               << "# TYPE kubepp_client_requests_total counter\n";
+        for( const Series* current : all_series ){
+            output << "kubepp_client_requests_total{";
+            writeLabels( output, *current );
+            output << "} " << current->latency.getCount() << "\n";
+        }
+
+        output << "# HELP kubepp_client_request_errors_total Apiserver requests that failed ( no response, or HTTP status >= 400 ), by verb and resource.\n"
+               << "# TYPE kubepp_client_request_errors_total counter\n";
+        for( const Series* current : all_series ){
+            output << "kubepp_client_request_errors_total{";
+            writeLabels( output, *current );
+            output << "} " << current->errors.load( std::memory_order_relaxed ) << "\n";
+        }
+
+        output << "# HELP kubepp_client_request_retries_total Apiserver requests sent again after a failure ( see --retries ), by verb and resource.\n"
+               << "# TYPE kubepp_client_request_retries_total counter\n";
+        for( const Series* current : all_series ){
+            output << "kubepp_client_request_retries_total{";
+            writeLabels( output, *current );
+            output << "} " << current->retries.load( std::memory_order_relaxed ) << "\n";
+        }
+
+        output << "# HELP kubepp_client_requests_in_flight Apiserver requests currently in flight, including open watches, by verb and resource.\n"
+               << "# TYPE kubepp_client_requests_in_flight gauge\n";
+        for( const Series* current : all_series ){
+            output << "kubepp_client_requests_in_flight{";
+            writeLabels( output, *current );
+            output << "} " << current->in_flight.load( std::memory_order_relaxed ) << "\n";
+        }
+
+        const Priority priorities[] = { Priority::INTERACTIVE, Priority::BACKGROUND };
+
+        output << "# HELP kubepp_client_rate_limiter_wait_seconds Time requests waited for the client-side rate limiter, by priority.\n"
+               << "# TYPE kubepp_client_rate_limiter_wait_seconds histogram\n";
+        for( const Priority priority : priorities ){
+            const LatencyHistogram& wait = this->getThrottle(priority).wait;
+            for( size_t bucket = 0; bucket <= LatencyHistogram::bucket_count; bucket++ ){
+                output << "kubepp_client_rate_limiter_wait_seconds_bucket{priority=\"" << ClientMetrics::getPriorityName(priority) << "\",le=\"";
+                if( bucket == LatencyHistogram::bucket_count ){
+                    output << "+Inf";
+                }else{
+                    output << formatNumber( LatencyHistogram::upper_bounds[bucket] );
+                }
+                output << "\"} " << wait.getCumulativeCount(bucket) << "\n";
+            }
+            output << "kubepp_client_rate_limiter_wait_seconds_sum{priority=\"" << ClientMetrics::getPriorityName(priority) << "\"} " << formatNumber( wait.getSum() ) << "\n";
+            output << "kubepp_client_rate_limiter_wait_seconds_count{priority=\"" << ClientMetrics::getPriorityName(priority) << "\"} " << wait.getCount() << "\n";
+        }
+
+        output << "# HELP kubepp_client_rate_limited_requests_total Requests that waited for the client-side rate limiter, by priority.\n"
+               << "# TYPE kubepp_client_rate_limited_requests_total counter\n";
+        for( const Priority priority : priorities ){
+            output << "kubepp_client_rate_limited_requests_total{priority=\"" << ClientMetrics::getPriorityName(priority) << "\"} " << this->getThrottle(priority).throttled.load( std::memory_order_relaxed ) << "\n";
+        }
+
+    }
+
+
+
+    void ClientMetrics::observeThrottle( Priority priority, double wait_seconds ){
+
+        Throttle& throttle = this->throttles[ static_cast<size_t>(priority) ];
+        throttle.wait.observe(wait_seconds);
+        if( wait_seconds > 0.0 ){
+            throttle.throttled.fetch_add( 1, std::memory_order_relaxed );
+        }
+
+    }
+
+
+
+    const ClientMetrics::Throttle& ClientMetrics::getThrottle( Priority priority ) const{
+
+        return this->throttles[ static_cast<size_t>(priority) ];
+
+    }
+
+
+
+    const char* ClientMetrics::getPriorityName( Priority priority ){
+
+        return priority == Priority::BACKGROUND ? "background" : "interactive";
+
+    }
+
+
+
+    string ClientMetrics::toPrometheus() const{
+
+        std::ostringstream output;
+        this->writePrometheus(output);
+        return output.str();
+
+    }
+
+
+
+    ClientMetrics::Verb ClientMetrics::getVerb( const string& method, const string& path, bool watch ){
+
+        if( method == "GET" ){
+            if( watch ){
+                return Verb::WATCH;
+            }
+            // a collection ( list ) has one segment, or two with a namespace's name ( namespaces/<name> is a get )
+            const vector<string> segments = getResourceSegments(path);
+            return segments.size() == 1 ? Verb::LIST : Verb::GET;
+        }
+        if( method == "POST" ){
+            return Verb::CREATE;
+        }
+        if( method == "PUT" ){
+            return Verb::UPDATE;
+        }
+        if( method == "PATCH" ){
+            return Verb::PATCH;
+        }
+        if( method == "DELETE" ){
+            return Verb::DELETE;
+        }
+        return Verb::OTHER;
+
+    }
+
+
+
+    string ClientMetrics::getResource( const string& path ){
+
+        const vector<string> segments = getResourceSegments(path);
+
+        if( segments.empty() ){
+            return "discovery";
+        }
+
+        // <resource>/<name>/<subresource>
+        if( segments.size() >= 3 ){
+            return segments[0] + "/" + segments[2];
+        }
+
+        return segments[0];
+
+    }
+
+
+
+    const char* ClientMetrics::getVerbName( Verb verb ){
+
+        switch( verb ){
+            case Verb::GET: return "get";
+            case Verb::LIST: return "list";
+            case Verb::WATCH: return "watch";
+            case Verb::CREATE: return "create";
+            case Verb::UPDATE: return "update";
+            case Verb::PATCH: return "patch";
+            case Verb::DELETE: return "delete";
+            case Verb::OTHER: return "other";
+        }
+        return "other";
+
+    }
+
+
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+
+#include <string>
+using std::string;
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+
+
+namespace kubepp{
+
+
+    /* A Prometheus-style latency histogram; observe() is lock-free. Bucket bounds are in seconds. */
+    class LatencyHistogram{
+
+        public:
+            static constexpr size_t bucket_count = 12;
+            static constexpr std::array<double, bucket_count> upper_bounds = { 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0, 30.0 };
+
+            void observe( double seconds );
+
+            uint64_t getCount() const;
+            double getSum() const;
+
+            /* Observations <= upper_bounds[bucket]; bucket_count is the +Inf bucket. */
+            uint64_t getCumulativeCount( size_t bucket ) const;
+
+
+        protected:
+            std::array<std::atomic<uint64_t>, bucket_count + 1> buckets{};
+            std::atomic<uint64_t> count{0};
+            std::atomic<uint64_t> sum_nanoseconds{0};
+
+    };
+
+
+
+    /*
+        Latency histograms, request and error counts and in-flight gauges of api calls, per verb and resource
+        ( the plural in the request path, eg. "pods" or "pods/log"; "discovery" for /api and /apis ).
+
+        Recording is lock-free: series live in a fixed open-addressing table and are inserted with compare-and-swap,
+        so the hot path is a hash, a few atomic loads and atomic increments. Past max_series, new series are
+        counted under verb "other", resource "other".
+
+        Time spent waiting for the client-side rate limiter ( see RateLimiter ) is recorded per priority.
+
+        KubernetesClient records into KubernetesClient::getMetrics(); writePrometheus exports it in the Prometheus
+        text format ( see also MetricsServer ).
+    */
+    class ClientMetrics{
+
+        public:
+
+            enum class Verb{ GET, LIST, WATCH, CREATE, UPDATE, PATCH, DELETE, OTHER };
+
+            class Series{
+                public:
+                    Verb verb = Verb::OTHER;
+                    string resource;
+                    LatencyHistogram latency;
+                    std::atomic<uint64_t> errors{0};        // HTTP status 0 ( no response ) or >= 400
+                    std::atomic<uint64_t> retries{0};       // requests sent again after a failure ( see RetryPolicy )
+                    std::atomic<int64_t> in_flight{0};
+            };
+
+            /* Rate limiter buckets: interactive work ( queries, apps ) and background work ( exports ). */
+            enum class Priority{ INTERACTIVE, BACKGROUND };
+
+            class Throttle{
+                public:
+                    LatencyHistogram wait;                  // every acquisition, including those that didn't wait
+                    std::atomic<uint64_t> throttled{0};     // acquisitions that had to wait
+            };
+
+            /* One api call: in flight from construction until finish ( or destruction, which records status 0 ). */
+            class Call{
+                public:
+                    Call( ClientMetrics& metrics, Verb verb, const string& resource );
+                    ~Call();
+
+                    Call( const Call& ) = delete;
+                    Call& operator=( const Call& ) = delete;
+
+                    void finish( long status_code );
+
+                protected:
+                    Series* series;
+                    std::chrono::steady_clock::time_point start;
+                    bool finished = false;
+            };
+
+            ClientMetrics();
+            ~ClientMetrics();
+
+            ClientMetrics( const ClientMetrics& ) = delete;
+            ClientMetrics& operator=( const ClientMetrics& ) = delete;
+
+            /* Finds or adds the series without locking. */
+            Series& getSeries( Verb verb, const string& resource );
+
+            void observeThrottle( Priority priority, double wait_seconds );
+            const Throttle& getThrottle( Priority priority ) const;
+
+            void writePrometheus( std::ostream& output ) const;
+            string toPrometheus() const;
+
+            /* The verb of a request, as the apiserver names it: GET is get, list or watch depending on the path and the watch parameter. */
+            static Verb getVerb( const string& method, const string& path, bool watch = false );
+            static string getResource( const string& path );
+            static const char* getVerbName( Verb verb );
+            static const char* getPriorityName( Priority priority );
+
+            static constexpr size_t max_series = 1024;
+
+
+        protected:
+            std::array<std::atomic<Series*>, max_series> series{};
+            Series overflow;
+            std::array<Throttle, 2> throttles;
+
+    };
+
+
+}
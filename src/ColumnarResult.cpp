@@ -0,0 +1,512 @@
+#include "ColumnarResult.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+#include "json.hpp"
+using json = nlohmann::json;
+
+
+namespace kubepp{
+
+
+    ColumnarResult::Column::Column( const string& name )
+        :name(name)
+    {
+
+    }
+
+
+
+    size_t ColumnarResult::Column::size() const{
+
+        return this->valid.size();
+
+    }
+
+
+
+    bool ColumnarResult::Column::isNull( size_t row ) const{
+
+        return !this->valid[row];
+
+    }
+
+
+
+    json ColumnarResult::Column::at( size_t row ) const{
+
+        if( this->isNull(row) ){
+            return json();
+        }
+
+        switch( this->type ){
+            case Type::BOOL: return json( static_cast<bool>(this->bool_values[row]) );
+            case Type::INT64: return json( this->int_values[row] );
+            case Type::DOUBLE: return json( this->double_values[row] );
+            case Type::STRING: return json( this->string_values[row] );
+            case Type::DICTIONARY: return json( this->dictionary[ this->codes[row] ] );
+            case Type::JSON: return json::parse( this->string_values[row] );
+            case Type::NONE: break;
+        }
+
+        return json();
+
+    }
+
+
+
+    string ColumnarResult::Column::getTypeName() const{
+
+        switch( this->type ){
+            case Type::NONE: return "null";
+            case Type::BOOL: return "bool";
+            case Type::INT64: return "int64";
+            case Type::DOUBLE: return "double";
+            case Type::STRING: return "string";
+            case Type::DICTIONARY: return "dictionary";
+            case Type::JSON: return "json";
+        }
+
+        return "unknown";
+
+    }
+
+
+
+    ColumnarResult::Column::Type ColumnarResult::Column::typeOf( const json& value ) const{
+
+        if( value.is_boolean() ){
+            return Type::BOOL;
+        }
+        if( value.is_number_integer() ){
+            return Type::INT64;
+        }
+        if( value.is_number_float() ){
+            return Type::DOUBLE;
+        }
+        if( value.is_string() ){
+            return Type::DICTIONARY;
+        }
+        return Type::JSON;
+
+    }
+
+
+
+    void ColumnarResult::Column::appendNull(){
+
+        this->valid.push_back(0);
+
+        switch( this->type ){
+            case Type::BOOL: this->bool_values.push_back(0); break;
+            case Type::INT64: this->int_values.push_back(0); break;
+            case Type::DOUBLE: this->double_values.push_back(0.0); break;
+            case Type::STRING: this->string_values.emplace_back(); break;
+            case Type::DICTIONARY: this->codes.push_back(0); break;
+            case Type::JSON: this->string_values.emplace_back(); break;
+            case Type::NONE: break;
+        }
+
+    }
+
+
+
+    void ColumnarResult::Column::setType( Type new_type ){
+
+        // every existing row is null; give each one a slot in the new storage
+
+        const size_t rows = this->size();
+
+        switch( new_type ){
+            case Type::BOOL: this->bool_values.assign(rows, 0); break;
+            case Type::INT64: this->int_values.assign(rows, 0); break;
+            case Type::DOUBLE: this->double_values.assign(rows, 0.0); break;
+            case Type::STRING: this->string_values.assign(rows, ""); break;
+            case Type::DICTIONARY: this->codes.assign(rows, 0); break;
+            case Type::JSON: this->string_values.assign(rows, ""); break;
+            case Type::NONE: break;
+        }
+
+        this->type = new_type;
+
+    }
+
+
+
+    void ColumnarResult::Column::widenTo( Type new_type ){
+
+        const size_t rows = this->size();
+
+        if( this->type == Type::INT64 && new_type == Type::DOUBLE ){
+
+            this->double_values.resize(rows);
+            for( size_t row = 0; row < rows; row++ ){
+                this->double_values[row] = static_cast<double>( this->int_values[row] );
+            }
+            this->int_values = vector<int64_t>();
+
+        }else{
+
+            // anything else falls back to serialized json
+
+            vector<string> json_values(rows);
+            for( size_t row = 0; row < rows; row++ ){
+                if( !this->isNull(row) ){
+                    json_values[row] = this->at(row).dump();
+                }
+            }
+
+            this->bool_values = vector<uint8_t>();
+            this->int_values = vector<int64_t>();
+            this->double_values = vector<double>();
+            this->codes = vector<uint32_t>();
+            this->dictionary = vector<string>();
+            this->dictionary_lookup.clear();
+            this->string_values = std::move(json_values);
+
+        }
+
+        this->type = new_type;
+
+    }
+
+
+
+    void ColumnarResult::Column::append( const json* value ){
+
+        if( value == nullptr || value->is_null() ){
+            this->appendNull();
+            return;
+        }
+
+        const Type value_type = this->typeOf(*value);
+
+        if( this->type == Type::NONE ){
+            this->setType(value_type);
+        }else if( this->type != value_type ){
+            if( this->type == Type::INT64 && value_type == Type::DOUBLE ){
+                this->widenTo(Type::DOUBLE);
+            }else if( this->type == Type::DOUBLE && value_type == Type::INT64 ){
+                // stored as a double
+            }else if( this->type == Type::STRING && value_type == Type::DICTIONARY ){
+                // a compacted string column
+            }else if( this->type != Type::JSON ){
+                this->widenTo(Type::JSON);
+            }
+        }
+
+        this->valid.push_back(1);
+
+        switch( this->type ){
+
+            case Type::BOOL:
+                this->bool_values.push_back( value->get<bool>() ? 1 : 0 );
+                break;
+
+            case Type::INT64:
+                this->int_values.push_back( value->get<int64_t>() );
+                break;
+
+            case Type::DOUBLE:
+                this->double_values.push_back( value->get<double>() );
+                break;
+
+            case Type::STRING:
+                this->string_values.push_back( value->get<string>() );
+                break;
+
+            case Type::DICTIONARY: {
+
+                if( this->dictionary_lookup.empty() && !this->dictionary.empty() ){
+                    for( uint32_t code = 0; code < this->dictionary.size(); code++ ){
+                        this->dictionary_lookup[ this->dictionary[code] ] = code;
+                    }
+                }
+
+                const string& str = value->get_ref<const string&>();
+                auto it = this->dictionary_lookup.find(str);
+                if( it == this->dictionary_lookup.end() ){
+                    const uint32_t code = static_cast<uint32_t>( this->dictionary.size() );
+                    this->dictionary.push_back(str);
+                    it = this->dictionary_lookup.emplace(str, code).first;
+                }
+                this->codes.push_back( it->second );
+                break;
+
+            }
+
+            case Type::JSON:
+                this->string_values.push_back( value->dump() );
+                break;
+
+            case Type::NONE:
+                break;
+
+        }
+
+    }
+
+
+
+    void ColumnarResult::Column::compact( double max_distinct_ratio ){
+
+        this->dictionary_lookup.clear();
+
+        if( this->type != Type::DICTIONARY || this->size() == 0 ){
+            return;
+        }
+
+        if( static_cast<double>( this->dictionary.size() ) <= max_distinct_ratio * static_cast<double>( this->size() ) ){
+            return;
+        }
+
+        const size_t rows = this->size();
+        this->string_values.resize(rows);
+        for( size_t row = 0; row < rows; row++ ){
+            if( !this->isNull(row) ){
+                this->string_values[row] = this->dictionary[ this->codes[row] ];
+            }
+        }
+
+        this->codes = vector<uint32_t>();
+        this->dictionary = vector<string>();
+        this->type = Type::STRING;
+
+    }
+
+
+
+
+    ColumnarResult::ColumnarResult( const vector<string>& column_paths ){
+
+        for( const string& column_path : column_paths ){
+            this->columns.push_back( Column(column_path) );
+            this->column_paths.push_back( FieldPath(column_path) );
+        }
+
+    }
+
+
+
+    void ColumnarResult::append( const json& resource ){
+
+        for( size_t i = 0; i < this->columns.size(); i++ ){
+
+            const FieldPath& column_path = this->column_paths[i];
+
+            if( column_path.hasWildcard() ){
+                const json values = column_path.extract(resource);
+                this->columns[i].append(&values);
+            }else{
+                this->columns[i].append( column_path.resolve(resource) );
+            }
+
+        }
+
+        this->row_count++;
+
+    }
+
+
+
+    void ColumnarResult::finish(){
+
+        for( auto& column : this->columns ){
+            column.compact( this->max_dictionary_ratio );
+        }
+
+    }
+
+
+
+    size_t ColumnarResult::getRowCount() const{
+
+        return this->row_count;
+
+    }
+
+
+
+    const ColumnarResult::Column& ColumnarResult::getColumn( const string& name ) const{
+
+        for( const auto& column : this->columns ){
+            if( column.name == name ){
+                return column;
+            }
+        }
+
+        throw std::runtime_error("The column '" + name + "' is not in the result.");
+
+    }
+
+
+
+    vector<size_t> ColumnarResult::sortIndexes( const string& column_name, bool descending ) const{
+
+        const Column& column = this->getColumn(column_name);
+
+        vector<size_t> indexes( this->row_count );
+        std::iota( indexes.begin(), indexes.end(), 0 );
+
+        // dictionary columns sort the (small) dictionary once and then compare ranks
+        vector<uint32_t> ranks;
+        if( column.type == Column::Type::DICTIONARY ){
+            vector<uint32_t> sorted_codes( column.dictionary.size() );
+            std::iota( sorted_codes.begin(), sorted_codes.end(), 0 );
+            std::sort( sorted_codes.begin(), sorted_codes.end(), [&column]( uint32_t a, uint32_t b ){
+                return column.dictionary[a] < column.dictionary[b];
+            });
+            ranks.resize( sorted_codes.size() );
+            for( uint32_t rank = 0; rank < sorted_codes.size(); rank++ ){
+                ranks[ sorted_codes[rank] ] = rank;
+            }
+        }
+
+        auto less = [&column, &ranks]( size_t a, size_t b ) -> bool{
+            switch( column.type ){
+                case Column::Type::BOOL: return column.bool_values[a] < column.bool_values[b];
+                case Column::Type::INT64: return column.int_values[a] < column.int_values[b];
+                case Column::Type::DOUBLE: return column.double_values[a] < column.double_values[b];
+                case Column::Type::STRING: return column.string_values[a] < column.string_values[b];
+                case Column::Type::JSON: return column.string_values[a] < column.string_values[b];
+                case Column::Type::DICTIONARY: return ranks[ column.codes[a] ] < ranks[ column.codes[b] ];
+                case Column::Type::NONE: return false;
+            }
+            return false;
+        };
+
+        std::stable_sort( indexes.begin(), indexes.end(), [&column, &less, descending]( size_t a, size_t b ){
+            const bool a_null = column.isNull(a);
+            const bool b_null = column.isNull(b);
+            if( a_null || b_null ){
+                return !a_null && b_null;
+            }
+            return descending ? less(b, a) : less(a, b);
+        });
+
+        return indexes;
+
+    }
+
+
+
+    map<string, size_t> ColumnarResult::countBy( const string& column_name ) const{
+
+        const Column& column = this->getColumn(column_name);
+
+        map<string, size_t> counts;
+
+        if( column.type == Column::Type::DICTIONARY ){
+
+            vector<size_t> code_counts( column.dictionary.size(), 0 );
+            for( size_t row = 0; row < column.size(); row++ ){
+                if( !column.isNull(row) ){
+                    code_counts[ column.codes[row] ]++;
+                }
+            }
+            for( size_t code = 0; code < code_counts.size(); code++ ){
+                counts[ column.dictionary[code] ] = code_counts[code];
+            }
+            return counts;
+
+        }
+
+        for( size_t row = 0; row < column.size(); row++ ){
+            if( column.isNull(row) ){
+                continue;
+            }
+            if( column.type == Column::Type::STRING ){
+                counts[ column.string_values[row] ]++;
+            }else if( column.type == Column::Type::JSON ){
+                counts[ column.string_values[row] ]++;
+            }else{
+                counts[ column.at(row).dump() ]++;
+            }
+        }
+
+        return counts;
+
+    }
+
+
+
+    double ColumnarResult::sum( const string& column_name ) const{
+
+        const Column& column = this->getColumn(column_name);
+
+        double total = 0.0;
+
+        if( column.type == Column::Type::INT64 ){
+            for( size_t row = 0; row < column.size(); row++ ){
+                total += static_cast<double>( column.int_values[row] );     // nulls hold 0
+            }
+        }else if( column.type == Column::Type::DOUBLE ){
+            for( size_t row = 0; row < column.size(); row++ ){
+                total += column.double_values[row];
+            }
+        }else if( column.type != Column::Type::NONE ){
+            throw std::runtime_error("The column '" + column_name + "' is not numeric.");
+        }
+
+        return total;
+
+    }
+
+
+
+    json ColumnarResult::asJson() const{
+
+        json result_json = json::object();
+
+        result_json["columns"] = json::array();
+        result_json["row_count"] = this->row_count;
+        result_json["data"] = json::object();
+
+        for( const auto& column : this->columns ){
+
+            result_json["columns"].push_back({ {"name", column.name}, {"type", column.getTypeName()} });
+
+            json values = json::array();
+            for( size_t row = 0; row < column.size(); row++ ){
+                values.push_back( column.at(row) );
+            }
+            result_json["data"][column.name] = std::move(values);
+
+        }
+
+        return result_json;
+
+    }
+
+
+
+    json ColumnarResult::rowsAsJson( const vector<size_t>& row_indexes ) const{
+
+        json rows = json::array();
+
+        auto add_row = [this, &rows]( size_t row ){
+            json row_json = json::object();
+            for( const auto& column : this->columns ){
+                row_json[column.name] = column.at(row);
+            }
+            rows.push_back( std::move(row_json) );
+        };
+
+        if( row_indexes.empty() ){
+            for( size_t row = 0; row < this->row_count; row++ ){
+                add_row(row);
+            }
+        }else{
+            for( const size_t row : row_indexes ){
+                add_row(row);
+            }
+        }
+
+        return rows;
+
+    }
+
+
+}
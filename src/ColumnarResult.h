@@ -0,0 +1,124 @@
+#pragma once
+
+
+#include <string>
+using std::string;
+
+#include <vector>
+using std::vector;
+
+#include <map>
+using std::map;
+
+#include <cstdint>
+#include <unordered_map>
+
+#include "json_fwd.hpp"
+using json = nlohmann::json;
+
+#include "FieldPath.h"
+
+
+namespace kubepp{
+
+
+    /*
+        Query results stored column by column: one typed, contiguous vector per selected path.
+
+        Strings are dictionary-encoded while the result is built; finish() keeps the dictionary only for
+        low-cardinality columns (eg. metadata.namespace, status.phase). Values that don't fit a column's
+        type widen it ( int64 -> double, anything else -> json text ).
+    */
+    class ColumnarResult{
+
+        public:
+
+            class Column{
+
+                public:
+
+                    enum class Type{
+                        NONE,           // no non-null values yet
+                        BOOL,
+                        INT64,
+                        DOUBLE,
+                        STRING,
+                        DICTIONARY,     // codes index into dictionary
+                        JSON            // serialized json text in string_values
+                    };
+
+                    Column( const string& name );
+
+                    string name;
+                    Type type = Type::NONE;
+
+                    vector<uint8_t> valid;          // 0 for null or missing values
+                    vector<uint8_t> bool_values;
+                    vector<int64_t> int_values;
+                    vector<double> double_values;
+                    vector<string> string_values;
+                    vector<uint32_t> codes;
+                    vector<string> dictionary;
+
+                    size_t size() const;
+                    bool isNull( size_t row ) const;
+                    json at( size_t row ) const;
+                    string getTypeName() const;
+
+                    void append( const json* value );
+
+                    /* Turns a dictionary column into a plain string column when most values are distinct. */
+                    void compact( double max_distinct_ratio );
+
+
+                protected:
+                    void appendNull();
+                    void setType( Type new_type );
+                    void widenTo( Type new_type );
+                    Type typeOf( const json& value ) const;
+
+                    std::unordered_map<string, uint32_t> dictionary_lookup;
+
+            };
+
+
+            ColumnarResult( const vector<string>& column_paths );
+
+            /* Appends one row, resolving each column's path against the resource. */
+            void append( const json& resource );
+
+            /* Call once all rows are appended. */
+            void finish();
+
+            size_t getRowCount() const;
+            const Column& getColumn( const string& name ) const;
+
+            /* Row numbers ordered by a column; nulls sort last. */
+            vector<size_t> sortIndexes( const string& column_name, bool descending = false ) const;
+
+            /* Number of rows per distinct value of a column. */
+            map<string, size_t> countBy( const string& column_name ) const;
+
+            /* Sum of a numeric column, ignoring nulls. */
+            double sum( const string& column_name ) const;
+
+            /* {"columns": [{"name","type"}], "row_count": n, "data": {"<name>": [values]}} */
+            json asJson() const;
+
+            /* The rows as an array of objects keyed by column name. */
+            json rowsAsJson( const vector<size_t>& row_indexes = {} ) const;
+
+            vector<Column> columns;
+
+            // fraction of distinct values above which a string column is stored without a dictionary
+            double max_dictionary_ratio = 0.5;
+
+
+        protected:
+            vector<FieldPath> column_paths;
+            size_t row_count = 0;
+
+    };
+
+
+}
@@ -0,0 +1,345 @@
+#include "CompressedOutput.h"
+
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+
+#include <zlib.h>
+
+#include "Tracer.h"
+
+#ifdef KUBEPP_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+
+namespace kubepp{
+
+
+    CompressedOutput::Buffer::Buffer( CompressedOutput& owner )
+        :owner(owner)
+    {
+
+    }
+
+
+
+    std::streamsize CompressedOutput::Buffer::xsputn( const char* data, std::streamsize size ){
+
+        this->owner.append( data, size );
+        return size;
+
+    }
+
+
+
+    CompressedOutput::Buffer::int_type CompressedOutput::Buffer::overflow( int_type ch ){
+
+        if( !traits_type::eq_int_type(ch, traits_type::eof()) ){
+            const char c = traits_type::to_char_type(ch);
+            this->owner.append( &c, 1 );
+        }
+        return traits_type::not_eof(ch);
+
+    }
+
+
+
+    CompressedOutput::CompressedOutput( std::ostream& output, Codec codec, int level )
+        :std::ostream(nullptr), buffer(*this), output(output), codec(codec), level(level)
+    {
+
+        if( !CompressedOutput::isAvailable(codec) ){
+            throw std::runtime_error("kubepp was built without zstd support.");
+        }
+
+        this->rdbuf( &this->buffer );
+        this->pending.reserve( CompressedOutput::chunk_size );
+
+        this->startCodec();
+        this->compression_thread = std::thread( &CompressedOutput::compressChunks, this );
+
+    }
+
+
+
+    CompressedOutput::~CompressedOutput(){
+
+        try{
+            this->finish();
+        }catch( ... ){
+        }
+
+    }
+
+
+
+    CompressedOutput::Codec CompressedOutput::parseCodec( const string& name ){
+
+        if( name == "gzip" || name == "gz" ){
+            return Codec::GZIP;
+        }
+        if( name == "zstd" || name == "zst" ){
+            return Codec::ZSTD;
+        }
+        throw std::runtime_error("Unknown compression '" + name + "'; expected gzip or zstd.");
+
+    }
+
+
+
+    bool CompressedOutput::isAvailable( Codec codec ){
+
+#ifdef KUBEPP_WITH_ZSTD
+        return true;
+#else
+        return codec == Codec::GZIP;
+#endif
+
+    }
+
+
+
+    void CompressedOutput::append( const char* data, size_t size ){
+
+        this->bytes_in += size;
+
+        while( size > 0 ){
+
+            const size_t count = std::min( size, CompressedOutput::chunk_size - this->pending.size() );
+            this->pending.insert( this->pending.end(), data, data + count );
+            data += count;
+            size -= count;
+
+            if( this->pending.size() == CompressedOutput::chunk_size ){
+                vector<char> chunk;
+                chunk.reserve( CompressedOutput::chunk_size );
+                chunk.swap( this->pending );
+                this->enqueue( std::move(chunk) );
+            }
+
+        }
+
+    }
+
+
+
+    void CompressedOutput::enqueue( vector<char>&& chunk ){
+
+        std::unique_lock<std::mutex> lock(this->mutex);
+
+        this->queue_changed.wait( lock, [this]{
+            return this->queue.size() < CompressedOutput::max_queued_chunks || this->error;
+        });
+
+        if( this->error ){
+            std::rethrow_exception(this->error);
+        }
+
+        this->queue.push_back( std::move(chunk) );
+        this->queue_changed.notify_all();
+
+    }
+
+
+
+    void CompressedOutput::finish(){
+
+        if( this->finished ){
+            return;
+        }
+        this->finished = true;
+
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            if( !this->pending.empty() ){
+                this->queue.push_back( std::move(this->pending) );
+                this->pending.clear();
+            }
+            this->closed = true;
+        }
+        this->queue_changed.notify_all();
+
+        this->compression_thread.join();
+        this->endCodec();
+
+        if( this->error ){
+            std::rethrow_exception(this->error);
+        }
+
+        this->output.flush();
+
+    }
+
+
+
+    void CompressedOutput::compressChunks(){
+
+        try{
+
+            while( true ){
+
+                vector<char> chunk;
+                bool last = false;
+
+                {
+                    std::unique_lock<std::mutex> lock(this->mutex);
+                    this->queue_changed.wait( lock, [this]{ return !this->queue.empty() || this->closed; } );
+
+                    if( !this->queue.empty() ){
+                        chunk = std::move( this->queue.front() );
+                        this->queue.pop_front();
+                    }
+                    last = this->closed && this->queue.empty();
+                }
+                this->queue_changed.notify_all();
+
+                this->compressChunk( chunk, last );
+
+                if( last ){
+                    return;
+                }
+
+            }
+
+        }catch( ... ){
+
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->error = std::current_exception();
+            this->queue_changed.notify_all();
+
+        }
+
+    }
+
+
+
+    void CompressedOutput::startCodec(){
+
+        this->compressed.resize( CompressedOutput::chunk_size );
+
+        if( this->codec == Codec::GZIP ){
+
+            z_stream* stream = new z_stream();
+            // 15 window bits + 16 writes a gzip header instead of a zlib one
+            if( deflateInit2( stream, this->level > 0 ? this->level : Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY ) != Z_OK ){
+                delete stream;
+                throw std::runtime_error("Failed to initialize gzip compression.");
+            }
+            this->codec_state = stream;
+            return;
+
+        }
+
+#ifdef KUBEPP_WITH_ZSTD
+        ZSTD_CCtx* context = ZSTD_createCCtx();
+        if( !context ){
+            throw std::runtime_error("Failed to initialize zstd compression.");
+        }
+        ZSTD_CCtx_setParameter( context, ZSTD_c_compressionLevel, this->level > 0 ? this->level : 3 );
+        this->codec_state = context;
+#endif
+
+    }
+
+
+
+    void CompressedOutput::compressChunk( const vector<char>& chunk, bool last ){
+
+        Tracer::Span span( "compress", "output" );
+        span.setArg( "bytes", static_cast<double>( chunk.size() ) );
+
+        if( this->codec == Codec::GZIP ){
+
+            z_stream* stream = static_cast<z_stream*>(this->codec_state);
+            stream->next_in = reinterpret_cast<Bytef*>( const_cast<char*>(chunk.data()) );
+            stream->avail_in = chunk.size();
+
+            const int flush = last ? Z_FINISH : Z_NO_FLUSH;
+            int result = Z_OK;
+
+            do{
+                stream->next_out = reinterpret_cast<Bytef*>( this->compressed.data() );
+                stream->avail_out = this->compressed.size();
+
+                result = deflate( stream, flush );
+                if( result == Z_STREAM_ERROR ){
+                    throw std::runtime_error("gzip compression failed.");
+                }
+
+                const size_t produced = this->compressed.size() - stream->avail_out;
+                this->output.write( this->compressed.data(), produced );
+                this->bytes_out += produced;
+            }while( stream->avail_out == 0 || ( last && result != Z_STREAM_END ) );
+
+        }
+
+#ifdef KUBEPP_WITH_ZSTD
+        if( this->codec == Codec::ZSTD ){
+
+            ZSTD_CCtx* context = static_cast<ZSTD_CCtx*>(this->codec_state);
+            ZSTD_inBuffer input = { chunk.data(), chunk.size(), 0 };
+            const ZSTD_EndDirective mode = last ? ZSTD_e_end : ZSTD_e_continue;
+            size_t remaining = 0;
+
+            do{
+                ZSTD_outBuffer out = { this->compressed.data(), this->compressed.size(), 0 };
+                remaining = ZSTD_compressStream2( context, &out, &input, mode );
+                if( ZSTD_isError(remaining) ){
+                    throw std::runtime_error( string("zstd compression failed: ") + ZSTD_getErrorName(remaining) );
+                }
+                this->output.write( this->compressed.data(), out.pos );
+                this->bytes_out += out.pos;
+            }while( last ? remaining != 0 : input.pos < input.size );
+
+        }
+#endif
+
+        if( !this->output ){
+            throw std::runtime_error("Failed to write the compressed output.");
+        }
+
+    }
+
+
+
+    void CompressedOutput::endCodec(){
+
+        if( !this->codec_state ){
+            return;
+        }
+
+        if( this->codec == Codec::GZIP ){
+            z_stream* stream = static_cast<z_stream*>(this->codec_state);
+            deflateEnd(stream);
+            delete stream;
+        }
+
+#ifdef KUBEPP_WITH_ZSTD
+        if( this->codec == Codec::ZSTD ){
+            ZSTD_freeCCtx( static_cast<ZSTD_CCtx*>(this->codec_state) );
+        }
+#endif
+
+        this->codec_state = nullptr;
+
+    }
+
+
+
+    size_t CompressedOutput::getBytesIn() const{
+
+        return this->bytes_in;
+
+    }
+
+
+
+    size_t CompressedOutput::getBytesOut() const{
+
+        return this->bytes_out;
+
+    }
+
+
+}
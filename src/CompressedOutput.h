@@ -0,0 +1,103 @@
+#pragma once
+
+
+#include <string>
+using std::string;
+
+#include <vector>
+using std::vector;
+
+#include <deque>
+using std::deque;
+
+#include <ostream>
+#include <streambuf>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+
+namespace kubepp{
+
+
+    /*
+        An output stream that compresses everything written to it ( gzip or zstd ) on a background thread.
+
+        Writes are collected into chunks and queued; a compression thread deflates them and writes the result
+        to the underlying stream, so fetching and serializing the next page overlaps with compressing the last
+        one. The queue is bounded, so a slow disk slows the writer down instead of growing memory.
+
+        Call finish() to end the compressed stream; the destructor finishes it too but can't report errors.
+        zstd is only available when kubepp is built with it ( KUBEPP_WITH_ZSTD ).
+    */
+    class CompressedOutput : public std::ostream{
+
+        public:
+            enum class Codec{ GZIP, ZSTD };
+
+            CompressedOutput( std::ostream& output, Codec codec, int level = 0 );
+            ~CompressedOutput();
+
+            CompressedOutput( const CompressedOutput& ) = delete;
+            CompressedOutput& operator=( const CompressedOutput& ) = delete;
+
+            /* Compresses what's left, writes the end of the stream and waits for the compression thread. Throws on errors. */
+            void finish();
+
+            size_t getBytesIn() const;
+            size_t getBytesOut() const;
+
+            /* "gzip" or "zstd". */
+            static Codec parseCodec( const string& name );
+            static bool isAvailable( Codec codec );
+
+
+        protected:
+
+            class Buffer : public std::streambuf{
+                public:
+                    Buffer( CompressedOutput& owner );
+                protected:
+                    std::streamsize xsputn( const char* data, std::streamsize size ) override;
+                    int_type overflow( int_type ch ) override;
+                    CompressedOutput& owner;
+            };
+
+            void append( const char* data, size_t size );
+            void enqueue( vector<char>&& chunk );
+            void compressChunks();
+
+            // codec specific; run on the compression thread
+            void startCodec();
+            void compressChunk( const vector<char>& chunk, bool last );
+            void endCodec();
+
+            Buffer buffer;
+            std::ostream& output;
+            const Codec codec;
+            const int level;
+
+            static constexpr size_t chunk_size = 1 << 20;
+            static constexpr size_t max_queued_chunks = 4;
+
+            vector<char> pending;
+            deque<vector<char>> queue;
+            bool closed = false;
+            bool finished = false;
+            std::exception_ptr error;
+            std::mutex mutex;
+            std::condition_variable queue_changed;
+            std::thread compression_thread;
+
+            size_t bytes_in = 0;
+            size_t bytes_out = 0;
+
+            // z_stream or ZSTD_CCtx, kept opaque so users of this header don't need zlib or zstd
+            void* codec_state = nullptr;
+            vector<char> compressed;
+
+    };
+
+
+}
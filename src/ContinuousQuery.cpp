@@ -0,0 +1,147 @@
+#include "ContinuousQuery.h"
+
+#include <set>
+using std::set;
+
+
+namespace kubepp{
+
+
+    ContinuousQuery::ContinuousQuery( const Query& query, const vector<string>& parameters )
+        :plan(query)
+    {
+
+        this->plan.bind(parameters);
+
+    }
+
+
+
+    string ContinuousQuery::getKey( const json& resource ){
+
+        string key = resource.value("apiVersion", "") + ":" + resource.value("kind", "") + "/";
+
+        if( resource.contains("metadata") && resource["metadata"].is_object() ){
+            key += resource["metadata"].value("namespace", "") + "/" + resource["metadata"].value("name", "");
+        }else{
+            key += "/";
+        }
+
+        return key;
+
+    }
+
+
+
+    json ContinuousQuery::apply( const string& event_type, json& resource ){
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return this->applyLocked( event_type, resource );
+
+    }
+
+
+
+    json ContinuousQuery::applyLocked( const string& event_type, json& resource ){
+
+        const string key = ContinuousQuery::getKey(resource);
+        auto it = this->rows.find(key);
+
+        if( event_type == "DELETED" || !this->plan.matches(resource) ){
+
+            if( it == this->rows.end() ){
+                return json();
+            }
+
+            json delta = { {"type", "DELETED"}, {"key", key}, {"object", std::move(it->second)} };
+            this->rows.erase(it);
+            return delta;
+
+        }
+
+        json row = this->plan.project(resource);
+
+        if( it == this->rows.end() ){
+            this->rows.emplace( key, row );
+            return { {"type", "ADDED"}, {"key", key}, {"object", std::move(row)} };
+        }
+
+        if( it->second == row ){
+            return json();
+        }
+
+        it->second = row;
+        return { {"type", "MODIFIED"}, {"key", key}, {"object", std::move(row)} };
+
+    }
+
+
+
+    vector<json> ContinuousQuery::resync( const ResourceDescription& resource_description, json& items ){
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        vector<json> deltas;
+        set<string> listed_keys;
+
+        if( items.is_array() ){
+            for( json& item : items ){
+                item["apiVersion"] = resource_description.api_group_version;
+                item["kind"] = resource_description.kind;
+                listed_keys.insert( ContinuousQuery::getKey(item) );
+                json delta = this->applyLocked( "ADDED", item );
+                if( !delta.is_null() ){
+                    deltas.push_back( std::move(delta) );
+                }
+            }
+        }
+
+        // rows of this kind that weren't listed have been deleted
+        const string kind_prefix = resource_description.api_group_version + ":" + resource_description.kind + "/";
+
+        for( auto it = this->rows.lower_bound(kind_prefix); it != this->rows.end() && it->first.rfind(kind_prefix, 0) == 0; ){
+            if( listed_keys.count(it->first) ){
+                ++it;
+                continue;
+            }
+            deltas.push_back({ {"type", "DELETED"}, {"key", it->first}, {"object", std::move(it->second)} });
+            it = this->rows.erase(it);
+        }
+
+        return deltas;
+
+    }
+
+
+
+    json ContinuousQuery::getResults() const{
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        json results = json::array();
+        for( const auto& [key, row] : this->rows ){
+            results.push_back(row);
+        }
+        return results;
+
+    }
+
+
+
+    size_t ContinuousQuery::size() const{
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return this->rows.size();
+
+    }
+
+
+
+    const QueryPlan& ContinuousQuery::getPlan() const{
+
+        return this->plan;
+
+    }
+
+
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+
+#include <string>
+using std::string;
+
+#include <vector>
+using std::vector;
+
+#include <map>
+using std::map;
+
+#include <mutex>
+
+#include "json.hpp"
+using json = nlohmann::json;
+
+#include "Query.h"
+#include "QueryPlan.h"
+#include "ResourceDescription.h"
+
+
+namespace kubepp{
+
+
+    /*
+        A live result set for a query, maintained from watch events instead of re-running the query.
+
+        Each change to the result set is reported as a delta:
+            {"type": "ADDED" | "MODIFIED" | "DELETED", "key": "<apiVersion>:<kind>/<namespace>/<name>", "object": <row>}
+        A MODIFIED event that doesn't change the selected columns produces no delta, and an object that stops
+        (or starts) matching the WHERE clause is reported as DELETED (or ADDED).
+
+        Use KubernetesClient::watchQuery to drive it from the apiserver. Methods are thread-safe.
+    */
+    class ContinuousQuery{
+
+        public:
+            ContinuousQuery( const Query& query, const vector<string>& parameters = {} );
+
+            /* Applies one watch event ( ADDED, MODIFIED or DELETED ). Returns the delta, or null if the result set didn't change. */
+            json apply( const string& event_type, json& resource );
+
+            /* Applies a fresh list of one kind: upserts every item and deletes rows of that kind that are gone. */
+            vector<json> resync( const ResourceDescription& resource_description, json& items );
+
+            /* The current result set. */
+            json getResults() const;
+            size_t size() const;
+
+            const QueryPlan& getPlan() const;
+
+            static string getKey( const json& resource );
+
+
+        protected:
+            json applyLocked( const string& event_type, json& resource );
+
+            QueryPlan plan;
+            map<string, json> rows;
+            mutable std::mutex mutex;
+
+    };
+
+
+}
@@ -0,0 +1,236 @@
+#include "FieldPath.h"
+
+#include <stdexcept>
+
+#include "json.hpp"
+using json = nlohmann::json;
+
+
+namespace kubepp{
+
+
+    FieldPath::FieldPath(){
+
+    }
+
+
+
+    FieldPath::FieldPath( const string& path ){
+
+        this->parse(path);
+
+    }
+
+
+
+    void FieldPath::parse( const string& path ){
+
+        this->path = path;
+        this->steps.clear();
+        this->has_wildcard = false;
+
+        size_t position = 0;
+        bool whole_key_next = false;
+
+        while( position < path.size() ){
+
+            if( path[position] == '.' ){
+                position++;
+                continue;
+            }
+
+            Step step;
+
+            if( path[position] == '[' ){
+
+                const size_t close_pos = path.find(']', position);
+                if( close_pos == string::npos ){
+                    throw std::runtime_error("Unterminated '[' in path '" + path + "'.");
+                }
+
+                const string inside = path.substr(position + 1, close_pos - position - 1);
+                position = close_pos + 1;
+
+                if( inside == "*" ){
+                    step.type = Step::Type::WILDCARD;
+                    this->has_wildcard = true;
+                }else if( inside.size() >= 2 && ( inside.front() == '\'' || inside.front() == '"' ) && inside.back() == inside.front() ){
+                    step.type = Step::Type::KEY;
+                    step.key = inside.substr(1, inside.size() - 2);
+                }else if( !inside.empty() && inside.find_first_not_of("0123456789") == string::npos ){
+                    step.type = Step::Type::INDEX;
+                    step.index = std::stoul(inside);
+                }else{
+                    throw std::runtime_error("Invalid subscript '[" + inside + "]' in path '" + path + "'.");
+                }
+
+                this->steps.push_back(step);
+                whole_key_next = false;
+                continue;
+
+            }
+
+            // a plain key runs to the next '.' or '['; after labels/annotations it runs to the next '[' only
+            size_t end_pos = whole_key_next ? path.find('[', position) : path.find_first_of(".[", position);
+            if( end_pos == string::npos ){
+                end_pos = path.size();
+            }
+
+            step.type = Step::Type::KEY;
+            step.key = path.substr(position, end_pos - position);
+            position = end_pos;
+
+            whole_key_next = ( step.key == "labels" || step.key == "annotations" );
+
+            this->steps.push_back(step);
+
+        }
+
+    }
+
+
+
+    const json* FieldPath::resolve( const json& resource ) const{
+
+        if( this->has_wildcard ){
+            return nullptr;
+        }
+
+        const json* current = &resource;
+
+        for( const Step& step : this->steps ){
+
+            if( step.type == Step::Type::KEY ){
+                if( !current->is_object() ){
+                    return nullptr;
+                }
+                auto it = current->find(step.key);
+                if( it == current->end() ){
+                    return nullptr;
+                }
+                current = &(*it);
+            }else{
+                if( !current->is_array() || step.index >= current->size() ){
+                    return nullptr;
+                }
+                current = &(*current)[step.index];
+            }
+
+        }
+
+        return current;
+
+    }
+
+
+
+    void FieldPath::resolveAll( const json& resource, vector<const json*>& values ) const{
+
+        if( !this->has_wildcard ){
+            const json* value = this->resolve(resource);
+            if( value ){
+                values.push_back(value);
+            }
+            return;
+        }
+
+        this->resolveFrom( resource, 0, values );
+
+    }
+
+
+
+    void FieldPath::resolveFrom( const json& current, size_t step_index, vector<const json*>& values ) const{
+
+        if( step_index == this->steps.size() ){
+            values.push_back(&current);
+            return;
+        }
+
+        const Step& step = this->steps[step_index];
+
+        switch( step.type ){
+
+            case Step::Type::KEY: {
+                if( !current.is_object() ){
+                    return;
+                }
+                auto it = current.find(step.key);
+                if( it != current.end() ){
+                    this->resolveFrom( *it, step_index + 1, values );
+                }
+                return;
+            }
+
+            case Step::Type::INDEX:
+                if( current.is_array() && step.index < current.size() ){
+                    this->resolveFrom( current[step.index], step_index + 1, values );
+                }
+                return;
+
+            case Step::Type::WILDCARD:
+                if( current.is_array() || current.is_object() ){
+                    for( const auto& element : current ){
+                        this->resolveFrom( element, step_index + 1, values );
+                    }
+                }
+                return;
+
+        }
+
+    }
+
+
+
+    json FieldPath::extract( const json& resource ) const{
+
+        if( !this->has_wildcard ){
+            const json* value = this->resolve(resource);
+            return value ? *value : json();
+        }
+
+        vector<const json*> values;
+        this->resolveFrom( resource, 0, values );
+
+        json extracted = json::array();
+        for( const json* value : values ){
+            extracted.push_back(*value);
+        }
+        return extracted;
+
+    }
+
+
+
+    bool FieldPath::hasWildcard() const{
+
+        return this->has_wildcard;
+
+    }
+
+
+
+    bool FieldPath::empty() const{
+
+        return this->steps.empty();
+
+    }
+
+
+
+    const string& FieldPath::asString() const{
+
+        return this->path;
+
+    }
+
+
+
+    const vector<FieldPath::Step>& FieldPath::getSteps() const{
+
+        return this->steps;
+
+    }
+
+
+}
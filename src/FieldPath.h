@@ -0,0 +1,66 @@
+#pragma once
+
+
+#include <string>
+using std::string;
+
+#include <vector>
+using std::vector;
+
+#include "json_fwd.hpp"
+using json = nlohmann::json;
+
+
+namespace kubepp{
+
+
+    /*
+        A SELECT or WHERE path compiled once into object keys, array indexes and wildcards.
+
+        "spec.containers[*].image", "spec.containers[0].name", "metadata.labels.app.kubernetes.io/name" and
+        "metadata.annotations['example.com/owner']" are all valid. Keys under labels and annotations may contain
+        dots, so the rest of the path after them is taken as one key.
+    */
+    class FieldPath{
+
+        public:
+
+            class Step{
+                public:
+                    enum class Type{ KEY, INDEX, WILDCARD };
+                    Type type = Type::KEY;
+                    string key;
+                    size_t index = 0;
+            };
+
+            FieldPath();
+            FieldPath( const string& path );
+
+            /* The value at this path, or nullptr if it's missing. Paths with wildcards return nullptr; use resolveAll. */
+            const json* resolve( const json& resource ) const;
+
+            /* Every value at this path, expanding wildcards. */
+            void resolveAll( const json& resource, vector<const json*>& values ) const;
+
+            /* A copy of the value; with wildcards, an array of every matching value. Missing values are null. */
+            json extract( const json& resource ) const;
+
+            bool hasWildcard() const;
+            bool empty() const;
+
+            const string& asString() const;
+            const vector<Step>& getSteps() const;
+
+
+        protected:
+            void parse( const string& path );
+            void resolveFrom( const json& current, size_t step_index, vector<const json*>& values ) const;
+
+            string path;
+            vector<Step> steps;
+            bool has_wildcard = false;
+
+    };
+
+
+}
@@ -0,0 +1,324 @@
+#include "HttpSession.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <strings.h>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+#include <openssl/ssl.h>
+
+#include "spdlog/spdlog.h"
+
+
+namespace kubepp{
+
+
+    namespace{
+
+        std::atomic<bool> connection_reuse_enabled{true};
+
+
+        /* TLS sessions and DNS lookups shared by every session; connections stay per handle, as libcurl can't share them between threads safely. */
+        class SharedCache{
+            public:
+                SharedCache(){
+                    this->share = curl_share_init();
+                    if( !this->share ){
+                        throw std::runtime_error("Cannot create a curl share handle.");
+                    }
+                    curl_share_setopt( this->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION );
+                    curl_share_setopt( this->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS );
+                    curl_share_setopt( this->share, CURLSHOPT_LOCKFUNC, SharedCache::lock );
+                    curl_share_setopt( this->share, CURLSHOPT_UNLOCKFUNC, SharedCache::unlock );
+                    curl_share_setopt( this->share, CURLSHOPT_USERDATA, this );
+                }
+
+                ~SharedCache(){
+                    curl_share_cleanup( this->share );
+                }
+
+                CURLSH* share = nullptr;
+
+            protected:
+                static void lock( CURL*, curl_lock_data data, curl_lock_access, void* user_data ){
+                    static_cast<SharedCache*>(user_data)->mutexes[data].lock();
+                }
+
+                static void unlock( CURL*, curl_lock_data data, void* user_data ){
+                    static_cast<SharedCache*>(user_data)->mutexes[data].unlock();
+                }
+
+                std::array<std::mutex, CURL_LOCK_DATA_LAST> mutexes;
+        };
+
+
+        SharedCache& getSharedCache(){
+            static SharedCache shared_cache;
+            return shared_cache;
+        }
+
+
+        // like the c client's writeDataCallback
+        size_t onData( char* data, size_t size, size_t count, void* user_data ){
+
+            apiClient_t* client = static_cast<apiClient_t*>(user_data);
+            const size_t received = size * count;
+
+            void* grown = realloc( client->dataReceived, client->dataReceivedLen + received + 1 );
+            if( !grown ){
+                return 0;
+            }
+            client->dataReceived = grown;
+            memcpy( static_cast<char*>(client->dataReceived) + client->dataReceivedLen, data, received );
+            client->dataReceivedLen += received;
+            static_cast<char*>(client->dataReceived)[client->dataReceivedLen] = '\0';
+
+            if( client->data_callback_func ){
+                client->data_callback_func( &client->dataReceived, &client->dataReceivedLen );
+            }
+
+            return received;
+
+        }
+
+
+        /* What the header callback learns about a transfer. */
+        class HeaderContext{
+            public:
+                CURL* handle = nullptr;
+                HttpSession::Transfer* transfer = nullptr;
+                bool tls_session_reused = false;
+        };
+
+
+        // whether the transfer's connection resumed a TLS session; only known with the OpenSSL backend, and only during the transfer
+        bool isTlsSessionReused( CURL* handle ){
+
+            curl_tlssessioninfo* tls_info = nullptr;
+            if( curl_easy_getinfo( handle, CURLINFO_TLS_SSL_PTR, &tls_info ) != CURLE_OK || !tls_info ){
+                return false;
+            }
+            if( tls_info->backend != CURLSSLBACKEND_OPENSSL || !tls_info->internals ){
+                return false;
+            }
+            return SSL_session_reused( static_cast<SSL*>(tls_info->internals) ) == 1;
+
+        }
+
+
+        // reads Retry-After ( delay-seconds or an HTTP-date ), which 429s from the apiserver's filters carry instead of a Status body
+        size_t onHeader( char* data, size_t size, size_t count, void* user_data ){
+
+            HeaderContext* context = static_cast<HeaderContext*>(user_data);
+            HttpSession::Transfer* transfer = context->transfer;
+            const size_t received = size * count;
+            const string line( data, received );
+
+            // the status line of another response ( after a 100 Continue ) starts its headers over
+            if( line.rfind("HTTP/", 0) == 0 ){
+                transfer->retry_after_seconds = 0.0;
+                context->tls_session_reused = isTlsSessionReused( context->handle );
+                return received;
+            }
+
+            static const string header_name = "retry-after:";
+            if( line.size() <= header_name.size() || strncasecmp( line.c_str(), header_name.c_str(), header_name.size() ) != 0 ){
+                return received;
+            }
+
+            const size_t value_start = line.find_first_not_of( " \t", header_name.size() );
+            const size_t value_end = line.find_last_not_of( " \t\r\n" );
+            if( value_start == string::npos || value_end == string::npos || value_end < value_start ){
+                return received;
+            }
+            const string value = line.substr( value_start, value_end - value_start + 1 );
+
+            char* parsed_end = nullptr;
+            const double seconds = std::strtod( value.c_str(), &parsed_end );
+            if( parsed_end == value.c_str() + value.size() ){
+                transfer->retry_after_seconds = std::max( seconds, 0.0 );
+            }else{
+                const time_t date = curl_getdate( value.c_str(), NULL );
+                if( date >= 0 ){
+                    transfer->retry_after_seconds = std::max( std::difftime( date, std::time(NULL) ), 0.0 );
+                }
+            }
+
+            return received;
+
+        }
+
+    }
+
+
+
+    HttpSession::HttpSession( bool reuse_connections )
+        :reuse_connections(reuse_connections)
+    {
+
+        this->handle = curl_easy_init();
+        if( !this->handle ){
+            throw std::runtime_error("Cannot create a curl handle.");
+        }
+
+    }
+
+
+
+    HttpSession::~HttpSession(){
+
+        curl_easy_cleanup( this->handle );
+
+    }
+
+
+
+    HttpSession::Transfer HttpSession::perform( apiClient_t* client, const string& method, const string& path, const string& query, const string& accept, const string& body, const string& content_type ){
+
+        if( this->busy ){
+            HttpSession nested_session( this->reuse_connections );
+            return nested_session.perform( client, method, path, query, accept, body, content_type );
+        }
+
+        this->busy = true;
+        std::shared_ptr<void> busy_scope( nullptr, [this]( void* ){ this->busy = false; } );
+
+        // options start over for every request; the connections, TLS sessions and DNS entries stay
+        curl_easy_reset( this->handle );
+
+        const string url = string(client->basePath) + path + ( query.empty() ? "" : "?" + query );
+        curl_easy_setopt( this->handle, CURLOPT_URL, url.c_str() );
+        curl_easy_setopt( this->handle, CURLOPT_NOSIGNAL, 1L );
+
+        if( method != "GET" ){
+            curl_easy_setopt( this->handle, CURLOPT_CUSTOMREQUEST, method.c_str() );
+        }
+        if( !body.empty() ){
+            curl_easy_setopt( this->handle, CURLOPT_POSTFIELDS, body.c_str() );
+            curl_easy_setopt( this->handle, CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>( body.size() ) );
+        }
+
+        std::unique_ptr<curl_slist, decltype(&curl_slist_free_all)> headers( nullptr, curl_slist_free_all );
+        auto addHeader = [&headers]( const string& header ){
+            headers.reset( curl_slist_append( headers.release(), header.c_str() ) );
+        };
+        addHeader( "Accept: " + accept );
+        addHeader( "Content-Type: " + content_type );
+
+        listEntry_t* entry = NULL;
+        list_ForEach( entry, client->apiKeys_BearerToken ){
+            const keyValuePair_t* pair = static_cast<const keyValuePair_t*>(entry->data);
+            if( pair->key && pair->value ){
+                addHeader( string(pair->key) + ": " + static_cast<const char*>(pair->value) );
+            }
+        }
+        curl_easy_setopt( this->handle, CURLOPT_HTTPHEADER, headers.get() );
+
+        if( client->sslConfig ){
+            if( client->sslConfig->clientCertFile ){
+                curl_easy_setopt( this->handle, CURLOPT_SSLCERT, client->sslConfig->clientCertFile );
+            }
+            if( client->sslConfig->clientKeyFile ){
+                curl_easy_setopt( this->handle, CURLOPT_SSLKEY, client->sslConfig->clientKeyFile );
+            }
+            if( client->sslConfig->CACertFile ){
+                curl_easy_setopt( this->handle, CURLOPT_CAINFO, client->sslConfig->CACertFile );
+            }
+            const bool verify = client->sslConfig->insecureSkipTlsVerify != 1;
+            curl_easy_setopt( this->handle, CURLOPT_SSL_VERIFYPEER, verify ? 1L : 0L );
+            curl_easy_setopt( this->handle, CURLOPT_SSL_VERIFYHOST, verify ? 2L : 0L );
+        }
+
+        if( this->reuse_connections ){
+            curl_easy_setopt( this->handle, CURLOPT_SHARE, getSharedCache().share );
+            curl_easy_setopt( this->handle, CURLOPT_TCP_KEEPALIVE, 1L );
+        }else{
+            curl_easy_setopt( this->handle, CURLOPT_FRESH_CONNECT, 1L );
+            curl_easy_setopt( this->handle, CURLOPT_FORBID_REUSE, 1L );
+        }
+
+        Transfer transfer;
+        HeaderContext header_context;
+        header_context.handle = this->handle;
+        header_context.transfer = &transfer;
+
+        curl_easy_setopt( this->handle, CURLOPT_WRITEFUNCTION, onData );
+        curl_easy_setopt( this->handle, CURLOPT_WRITEDATA, client );
+        curl_easy_setopt( this->handle, CURLOPT_HEADERFUNCTION, onHeader );
+        curl_easy_setopt( this->handle, CURLOPT_HEADERDATA, &header_context );
+
+        if( client->progress_func ){
+            curl_easy_setopt( this->handle, CURLOPT_XFERINFOFUNCTION, client->progress_func );
+            curl_easy_setopt( this->handle, CURLOPT_XFERINFODATA, client->progress_data );
+            curl_easy_setopt( this->handle, CURLOPT_NOPROGRESS, 0L );
+        }
+
+        const CURLcode result = curl_easy_perform( this->handle );
+
+        // a watch stopped by its progress callback still got its response
+        client->response_code = 0;
+        if( result == CURLE_OK || result == CURLE_ABORTED_BY_CALLBACK ){
+            curl_easy_getinfo( this->handle, CURLINFO_RESPONSE_CODE, &client->response_code );
+        }else{
+            spdlog::debug("{} {} failed: {}", method, path, curl_easy_strerror(result));
+        }
+
+        curl_easy_getinfo( this->handle, CURLINFO_NUM_CONNECTS, &transfer.connections );
+
+        if( transfer.connections > 0 ){
+            // from the start of the request to the end of the TLS ( or, for http, TCP ) handshake; 0 if there was no TLS handshake
+            curl_off_t handshake_us = 0;
+            curl_easy_getinfo( this->handle, CURLINFO_APPCONNECT_TIME_T, &handshake_us );
+            if( handshake_us > 0 ){
+                // a connection that resumed a shared session skipped the certificate exchange
+                transfer.tls_resumptions = header_context.tls_session_reused ? 1 : 0;
+                transfer.tls_handshakes = transfer.connections - transfer.tls_resumptions;
+            }else{
+                curl_easy_getinfo( this->handle, CURLINFO_CONNECT_TIME_T, &handshake_us );
+            }
+            transfer.handshake_ms = static_cast<double>(handshake_us) / 1000.0;
+        }
+
+        return transfer;
+
+    }
+
+
+
+    HttpSession& HttpSession::getThreadSession(){
+
+        thread_local std::unique_ptr<HttpSession> session;
+
+        const bool reuse_connections = HttpSession::isConnectionReuseEnabled();
+        if( !session || session->reuse_connections != reuse_connections ){
+            session = std::make_unique<HttpSession>(reuse_connections);
+        }
+
+        return *session;
+
+    }
+
+
+
+    void HttpSession::setConnectionReuse( bool enabled ){
+
+        connection_reuse_enabled.store( enabled, std::memory_order_relaxed );
+
+    }
+
+
+
+    bool HttpSession::isConnectionReuseEnabled(){
+
+        return connection_reuse_enabled.load( std::memory_order_relaxed );
+
+    }
+
+
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+extern "C" {
+    #include <apiClient.h>
+}
+
+#include <string>
+using std::string;
+
+#include <vector>
+using std::vector;
+
+
+namespace kubepp{
+
+
+    /*
+        Sends apiserver requests on a persistent curl handle, in place of apiClient_invoke, which creates and cleans up a
+        handle per request and so opens a new connection ( a TCP and TLS handshake ) for every call.
+
+        Each thread has its own session ( getThreadSession ), since a curl handle can't be used by two threads at once; its
+        connections are kept alive between requests. TLS sessions and DNS lookups are shared by every session in the process,
+        so a thread's first connection resumes a TLS session instead of a full handshake. With connection reuse disabled
+        ( --no-connection-reuse ), every request opens and closes its own connection, like apiClient_invoke.
+    */
+    class HttpSession{
+
+        public:
+            /* What a request cost in connection setup. */
+            class Transfer{
+                public:
+                    long connections = 0;           // new connections opened ( 0 when one was reused )
+                    long tls_handshakes = 0;        // full TLS handshakes of the new connections
+                    long tls_resumptions = 0;       // new connections that resumed a TLS session instead ( known with OpenSSL builds of libcurl only )
+                    double handshake_ms = 0.0;      // DNS, TCP and TLS setup of the new connections
+                    double retry_after_seconds = 0.0;   // the response's Retry-After header, or 0
+            };
+
+            HttpSession( bool reuse_connections = true );
+            ~HttpSession();
+
+            HttpSession( const HttpSession& ) = delete;
+            HttpSession& operator=( const HttpSession& ) = delete;
+
+            /*
+                Sends a request the way apiClient_invoke does, with the client's base path, bearer token and TLS settings: the body
+                is appended to client->dataReceived ( calling client->data_callback_func ), client->progress_func is called during the
+                transfer and client->response_code is set ( 0 if there was no response ). query is already url-encoded.
+            */
+            Transfer perform( apiClient_t* client, const string& method, const string& path, const string& query, const string& accept, const string& body = "", const string& content_type = "application/json" );
+
+            /* The calling thread's session; recreated if connection reuse was switched since. */
+            static HttpSession& getThreadSession();
+
+            static void setConnectionReuse( bool enabled );
+            static bool isConnectionReuseEnabled();
+
+
+        protected:
+            CURL* handle = nullptr;
+            bool reuse_connections;
+            bool busy = false;      // in perform; a request made from a callback ( eg. on a watch event ) gets a handle of its own
+
+    };
+
+
+}
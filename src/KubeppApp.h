@@ -15,6 +15,8 @@ using std::string;
 #include "apps/CustomResourceApp.h"
 #include "apps/PodApp.h"
 #include "apps/ExportApp.h"
+#include "apps/QueryApp.h"
+#include "apps/BenchApp.h"
 
 
 
@@ -40,6 +42,8 @@ namespace kubepp {
             apps::CustomResourceApp crs_app;
             apps::PodApp pod_app;
             apps::ExportApp export_app;
+            apps::QueryApp query_app;
+            apps::BenchApp bench_app;
             
     };
 
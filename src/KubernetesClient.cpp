@@ -10,7 +10,9 @@ extern "C" {
     #include <CustomObjectsAPI.h>
 }
 
+#include <exception>
 #include <stdexcept>
+#include <cctype>
 #include <fmt/core.h>
 
 #include "spdlog/spdlog.h"
@@ -30,6 +32,15 @@ using std::tuple;
 #include "json.hpp"
 
 #include "cjson.h"
+#include "ContinuousQuery.h"
+#include "Protobuf.h"
+#include "Tracer.h"
+#include "AllocationTracker.h"
+#include "RetryPolicy.h"
+
+#include <thread>
+#include <mutex>
+#include <algorithm>
 
 
 namespace kubepp{
@@ -45,7 +56,8 @@ namespace kubepp{
 
         //fmt::print("The detected base path: {}\n", detected_base_path);
 
-        this->api_client = std::shared_ptr<apiClient_t>( apiClient_create_with_base_path(detected_base_path, sslConfig, apiKeys), apiClient_free);
+        this->api_client = this->createApiClient();
+        this->client_stats.max_requests = KubernetesClient::max_recorded_requests;
         
         //this->api_client = std::shared_ptr<apiClient_t>( apiClient_create(), apiClient_free);
         if (!this->api_client) {
@@ -54,6 +66,14 @@ namespace kubepp{
 
     }
 
+    std::shared_ptr<apiClient_t> KubernetesClient::createApiClient() const{
+
+        return std::shared_ptr<apiClient_t>( apiClient_create_with_base_path(detected_base_path, sslConfig, apiKeys), apiClient_free);
+
+    }
+
+
+
     KubernetesClient::~KubernetesClient(){
 
         //apiClient_free(apiClient); called from the shared_ptr custom deleter
@@ -71,6 +91,8 @@ namespace kubepp{
 
     vector<string> KubernetesClient::getNamespaceNames() const{
 
+        this->throttle();
+
         std::shared_ptr<v1_namespace_list_t> namespace_list( 
                                                 CoreV1API_listNamespace(
                                                     const_cast<apiClient_t*>(api_client.get()), 
@@ -115,6 +137,8 @@ namespace kubepp{
 
         json logs = json::object();
 
+        this->throttle();
+
         char* log_string = CoreV1API_readNamespacedPodLog(
                                         const_cast<apiClient_t*>(api_client.get()), 
                                         const_cast<char*>(pod_name.c_str()),   /*name */
@@ -149,12 +173,7 @@ namespace kubepp{
 
 
 
-    json KubernetesClient::createGenericResource( const ResourceDescription& resource_description, const json& resource ) const{
-
-        json response = json::object();
-
-        const string resource_string = resource.dump();
-
+    json KubernetesClient::createGenericResourceOnce( const ResourceDescription& resource_description, const json& resource ) const{
 
         //check to see if the kind is specified
         if( !resource.contains("kind") || !resource["kind"].is_string() || resource["kind"].get<string>().empty() ){
@@ -166,405 +185,218 @@ namespace kubepp{
             throw std::runtime_error("The resource must have a 'apiVersion' field that is a non-empty string.");
         }
 
-
-        auto generic_client = this->createGenericClient(resource_description);
-
-
-        if( resource_description.k8s_namespace.empty() ){
-
-            //cluster-scoped custom resource
-
-            std::shared_ptr<char> api_response(
-                                                Generic_createResource(
-                                                    generic_client.get(), 
-                                                    resource_string.c_str()
-                                                ),
-                                                free
-                                            );
-
-            if( api_response ){
-                cjson cjson_response(api_response.get());
-                if( cjson_response ){
-                    response = cjson_response.toJson();
-                }
-                
-            }
-
-        }else{
-
-
-            //namespace-scoped custom resource
-
-            std::shared_ptr<char> api_response(
-                                                Generic_createNamespacedResource(
-                                                    generic_client.get(), 
-                                                    resource_description.k8s_namespace.c_str(), 
-                                                    resource_string.c_str()
-                                                ),
-                                                free
-                                            );
-
-            if( api_response ){
-                cjson cjson_response(api_response.get());
-                if( cjson_response ){
-                    response = cjson_response.toJson();
-                }                
-            }
-
-        }
-
-        return response;
+        return this->invokeApiOnce( this->api_client.get(), "POST", resource_description.getCollectionPath(), {}, "application/json", resource.dump() );
 
     }
 
 
 
 
-    json KubernetesClient::deleteGenericResource( const ResourceDescription& resource_description, const json& resource ) const{
-
-        json response = json::object();
+    json KubernetesClient::deleteGenericResourceOnce( const ResourceDescription& resource_description, const json& resource ) const{
 
         //check to see if the name is specified
         if( !resource.contains("metadata") || !resource["metadata"].contains("name") || !resource["metadata"]["name"].is_string() || resource["metadata"]["name"].get<string>().empty() ){
             throw std::runtime_error("The resource must have a 'metadata.name' field that is a non-empty string.");
         }
 
+        return this->invokeApiOnce( this->api_client.get(), "DELETE", resource_description.getResourcePath(), {}, "application/json" );
 
-        auto generic_client = this->createGenericClient(resource_description);
+    }
 
 
-        if( resource_description.k8s_namespace.empty() ){
 
-            //cluster-scoped custom resource
 
-            std::shared_ptr<char> api_response(
-                                                Generic_deleteResource(
-                                                    generic_client.get(), 
-                                                    resource_description.name.c_str()
-                                                ),
-                                                free
-                                            );
+    json KubernetesClient::getGenericResourceOnce( const ResourceDescription& resource_description ) const{
 
-            if( api_response ){
-                cjson cjson_response(api_response.get());
-                if( cjson_response ){
-                    response = cjson_response.toJson();
-                }
-                
-            }
+        return this->invokeApiOnce( this->api_client.get(), "GET", resource_description.getResourcePath(), {}, "application/json" );
 
-        }else{
+    }
 
-            //namespace-scoped custom resource
 
-            std::shared_ptr<char> api_response(
-                                                Generic_deleteNamespacedResource(
-                                                    generic_client.get(), 
-                                                    resource_description.k8s_namespace.c_str(), 
-                                                    resource_description.name.c_str()
-                                                ),
-                                                free
-                                            );
 
-            if( api_response ){
 
-                cjson cjson_response(api_response.get());
-                if( cjson_response ){
-                    response = cjson_response.toJson();
-                }
+    json KubernetesClient::getGenericResourcesOnce( const ResourceDescription& resource_description ) const{
 
-            }
+        return this->invokeApiOnce( this->api_client.get(), "GET", resource_description.getCollectionPath(), {}, "application/json" );
+
+    }
 
-        }
 
-        return response;
 
-    }
 
+    json KubernetesClient::replaceGenericResourceOnce( const ResourceDescription& resource_description, const json& resource ) const{
 
+        //check to see if the kind is specified
+        if( !resource.contains("kind") || !resource["kind"].is_string() || resource["kind"].get<string>().empty() ){
+            throw std::runtime_error("The resource must have a 'kind' field that is a non-empty string.");
+        }
 
+        //check to see if the apiVersion is specified
+        if( !resource.contains("apiVersion") || !resource["apiVersion"].is_string() || resource["apiVersion"].get<string>().empty() ){
+            throw std::runtime_error("The resource must have a 'apiVersion' field that is a non-empty string.");
+        }
 
-    json KubernetesClient::getGenericResource( const ResourceDescription& resource_description ) const{
+        return this->invokeApiOnce( this->api_client.get(), "PUT", resource_description.getResourcePath(), {}, "application/json", resource.dump() );
 
-        json response = json::object();
+    }
 
-        auto generic_client = this->createGenericClient(resource_description);
 
-        if( resource_description.k8s_namespace.empty() ){
 
-            //cluster-scoped custom resource
+    json KubernetesClient::patchGenericResourceOnce( const ResourceDescription& resource_description, const json& patch ) const{
 
-            std::shared_ptr<char> api_response(
-                                                Generic_readResource(
-                                                    generic_client.get(), 
-                                                    resource_description.name.c_str()
-                                                ),
-                                                free
-                                            );
+        // Kubernetes also takes application/merge-patch+json, application/strategic-merge-patch+json and application/apply-patch+yaml
+        return this->invokeApiOnce( this->api_client.get(), "PATCH", resource_description.getResourcePath(), {}, "application/json", patch.dump(), "application/json-patch+json" );
 
-            if( api_response ){
-                cjson cjson_response(api_response.get());
-                if( cjson_response ){
-                    response = cjson_response.toJson();
-                }
-                
-            }
+    }
 
-        }else{
 
-            //namespace-scoped custom resource
 
-            std::shared_ptr<char> api_response(
-                                                Generic_readNamespacedResource(
-                                                    generic_client.get(), 
-                                                    resource_description.k8s_namespace.c_str(), 
-                                                    resource_description.name.c_str()
-                                                ),
-                                                free
-                                            );
 
-            if( api_response ){
+    json KubernetesClient::createGenericResource( const ResourceDescription& resource_description, const json& resource ) const{
 
-                cjson cjson_response(api_response.get());
-                if( cjson_response ){
-                    response = cjson_response.toJson();
-                }
+        // with generateName, a retry after a lost response could create a second object
+        string name;
+        if( resource.contains("metadata") && resource["metadata"].is_object() && resource["metadata"].contains("name") && resource["metadata"]["name"].is_string() ){
+            name = resource["metadata"]["name"].get<string>();
+        }
 
+        size_t attempts = 0;
+        json response = this->sendWithRetries( this->api_client.get(), ClientMetrics::Verb::CREATE, resource_description.kind_lower_plural, name.empty() ? RetryPolicy::Idempotency::UNPROCESSED_ONLY : RetryPolicy::Idempotency::IDEMPOTENT, [&](){
+            attempts++;
+            return this->createGenericResourceOnce( resource_description, resource );
+        });
+
+        // AlreadyExists on a retry: the attempt whose response was lost created it
+        if( attempts > 1 && this->api_client->response_code == 409 && response.value("reason", "") == "AlreadyExists" ){
+            ResourceDescription created = resource_description;
+            created.name = name;
+            json existing = this->getGenericResource(created);
+            if( this->api_client->response_code == 200 ){
+                return existing;
             }
-
         }
 
         return response;
 
-
     }
 
 
 
+    json KubernetesClient::deleteGenericResource( const ResourceDescription& resource_description, const json& resource ) const{
 
-    json KubernetesClient::getGenericResources( const ResourceDescription& resource_description ) const{
-
-        json response = json::array();
-
-        auto generic_client = this->createGenericClient(resource_description);
-
-        if( resource_description.k8s_namespace.empty() ){
-
-            //cluster-scoped custom resource
+        return this->sendWithRetries( this->api_client.get(), ClientMetrics::Verb::DELETE, resource_description.kind_lower_plural, RetryPolicy::Idempotency::IDEMPOTENT, [&](){
+            return this->deleteGenericResourceOnce( resource_description, resource );
+        });
 
-            std::shared_ptr<char> api_response(
-                                                Generic_list(
-                                                    generic_client.get()
-                                                ),
-                                                free
-                                            );
+    }
 
-            if( api_response ){
-                cjson cjson_response(api_response.get());
-                if( cjson_response ){
-                    response = cjson_response.toJson();
-                }
-                
-            }
 
-        }else{
 
-            //namespace-scoped custom resource
+    json KubernetesClient::getGenericResource( const ResourceDescription& resource_description ) const{
 
-            std::shared_ptr<char> api_response(
-                                                Generic_listNamespaced(
-                                                    generic_client.get(), 
-                                                    resource_description.k8s_namespace.c_str()
-                                                ),
-                                                free
-                                            );
+        return this->sendWithRetries( this->api_client.get(), ClientMetrics::Verb::GET, resource_description.kind_lower_plural, RetryPolicy::Idempotency::IDEMPOTENT, [&](){
+            return this->getGenericResourceOnce(resource_description);
+        });
 
-            if( api_response ){
+    }
 
-                cjson cjson_response(api_response.get());
-                if( cjson_response ){
-                    response = cjson_response.toJson();
-                }
 
-            }
 
-        }
+    json KubernetesClient::getGenericResources( const ResourceDescription& resource_description ) const{
 
-        return response;
+        return this->sendWithRetries( this->api_client.get(), ClientMetrics::Verb::LIST, resource_description.kind_lower_plural, RetryPolicy::Idempotency::IDEMPOTENT, [&](){
+            return this->getGenericResourcesOnce(resource_description);
+        });
 
     }
 
 
 
-
     json KubernetesClient::replaceGenericResource( const ResourceDescription& resource_description, const json& resource ) const{
 
-        json response = json::object();
-
-
-        //check to see if the kind is specified
-        if( !resource.contains("kind") || !resource["kind"].is_string() || resource["kind"].get<string>().empty() ){
-            throw std::runtime_error("The resource must have a 'kind' field that is a non-empty string.");
-        }
-
-        //check to see if the apiVersion is specified
-        if( !resource.contains("apiVersion") || !resource["apiVersion"].is_string() || resource["apiVersion"].get<string>().empty() ){
-            throw std::runtime_error("The resource must have a 'apiVersion' field that is a non-empty string.");
-        }
-
-        const string resource_string = resource.dump();
-
+        return this->sendWithRetries( this->api_client.get(), ClientMetrics::Verb::UPDATE, resource_description.kind_lower_plural, RetryPolicy::Idempotency::IDEMPOTENT, [&](){
+            return this->replaceGenericResourceOnce( resource_description, resource );
+        });
 
+    }
 
-        auto generic_client = this->createGenericClient(resource_description);
-
-
-        if( resource_description.k8s_namespace.empty() ){
-
-            //cluster-scoped custom resource
-
-            std::shared_ptr<char> api_response(
-                                                Generic_replaceResource(
-                                                    generic_client.get(),
-                                                    resource_description.name.c_str(),
-                                                    resource_string.c_str()
-                                                ),
-                                                free
-                                            );
-
-            if( api_response ){
-                cjson cjson_response(api_response.get());
-                if( cjson_response ){
-                    response = cjson_response.toJson();
-                }
-                
-            }
 
-        }else{
 
-            //namespace-scoped custom resource
+    json KubernetesClient::patchGenericResource( const ResourceDescription& resource_description, const json& patch ) const{
 
-            std::shared_ptr<char> api_response(
-                                                Generic_replaceNamespacedResource(
-                                                    generic_client.get(), 
-                                                    resource_description.k8s_namespace.c_str(),
-                                                    resource_description.name.c_str(),
-                                                    resource_string.c_str()
-                                                ),
-                                                free
-                                            );
+        // a json-patch isn't idempotent ( eg. appending to a list ), so only requests the apiserver didn't process are retried
+        return this->sendWithRetries( this->api_client.get(), ClientMetrics::Verb::PATCH, resource_description.kind_lower_plural, RetryPolicy::Idempotency::UNPROCESSED_ONLY, [&](){
+            return this->patchGenericResourceOnce( resource_description, patch );
+        });
 
-            if( api_response ){
+    }
 
-                cjson cjson_response(api_response.get());
-                if( cjson_response ){
-                    response = cjson_response.toJson();
-                }
 
-            }
 
-        }
+    namespace{
 
-        return response;
+        // the Retry-After header of the thread's last response ( see callApi ), next to client->response_code
+        thread_local double last_retry_after_seconds = 0.0;
 
     }
 
 
 
-    json KubernetesClient::patchGenericResource( const ResourceDescription& resource_description, const json& patch ) const{
+    json KubernetesClient::sendWithRetries( const apiClient_t* client, ClientMetrics::Verb verb, const string& resource, RetryPolicy::Idempotency idempotency, const std::function<json()>& send ) const{
 
-        json response = json::object();
+        for( size_t retry = 1; ; retry++ ){
 
-        const string patch_string = patch.dump();
+            last_retry_after_seconds = 0.0;
+            json response = send();
+            const long status_code = client->response_code;
+            const double retry_after_seconds = std::max( last_retry_after_seconds, RetryPolicy::getRetryAfter(response) );
 
+            if( retry > this->retry_policy.max_retries || !this->retry_policy.shouldRetry(status_code, idempotency) ){
+                return response;
+            }
 
-        auto generic_client = this->createGenericClient(resource_description);
+            const std::chrono::milliseconds delay = this->retry_policy.getDelay( retry, retry_after_seconds );
+            if( delay.count() < 0 ){
+                return response;
+            }
 
-        /*
-        
-        const char *patchBody = "[{\"op\": \"replace\", \"path\": \"/metadata/labels/foo\", \"value\": \"qux\" }]";
-        list_t *contentType = list_createList();
-        // Kubernetes supports multiple content types:
-        list_addElement(contentType, "application/json-patch+json");
-        // list_addElement(contentType, "application/merge-patch+json");
-        // list_addElement(contentType, "application/strategic-merge-patch+json");
-        // list_addElement(contentType, "application/apply-patch+yaml");
-        list_freeList(contentType);
-        free(patch);
+            RetryBudget* retry_budget = this->getRetryBudget();
+            if( retry_budget && !retry_budget->tryConsume() ){
+                spdlog::warn("The query's retry budget is spent; not retrying {} {} (HTTP {}).", ClientMetrics::getVerbName(verb), resource, status_code);
+                return response;
+            }
 
-        */
+            spdlog::debug("{} {} failed (HTTP {}); retry {} of {} in {} ms.", ClientMetrics::getVerbName(verb), resource, status_code, retry, this->retry_policy.max_retries, delay.count());
 
+            KubernetesClient::getMetrics().getSeries(verb, resource).retries.fetch_add( 1, std::memory_order_relaxed );
+            this->recordRetry();
 
-        const string patch_content_type = "application/json-patch+json";// "application/merge-patch+json";
+            Tracer::Span backoff_span("retry backoff");
+            backoff_span.setArg( "status", static_cast<double>(status_code) );
+            std::this_thread::sleep_for(delay);
 
-        //create a list_t* for the content-type, wrapped in shared_ptr
-        std::shared_ptr<list_t> patch_content_type_list( list_createList(), list_freeList );
-        list_addElement(patch_content_type_list.get(), (void*)patch_content_type.c_str());
-        
+        }
 
-        if( resource_description.k8s_namespace.empty() ){
-
-            //cluster-scoped custom resource
-
-            std::shared_ptr<char> api_response(
-                                                Generic_patchResource(
-                                                    generic_client.get(), 
-                                                    resource_description.name.c_str(),
-                                                    patch_string.c_str(),
-                                                    NULL, /* queryParameters */
-                                                    NULL, /* headerParameters */
-                                                    NULL, /* formParameters */
-                                                    NULL, /* headerType */
-                                                    const_cast<list_t*>(patch_content_type_list.get())  /* contentType */
-                                                ),
-                                                free
-                                            );
+    }
 
-            if( api_response ){
-                cjson cjson_response(api_response.get());
-                if( cjson_response ){
-                    response = cjson_response.toJson();
-                }                
-            }
 
 
-        }else{
+    void KubernetesClient::setRetryPolicy( const RetryPolicy& retry_policy ){
 
-            //namespace-scoped custom resource
-
-            std::shared_ptr<char> api_response(
-                                                Generic_patchNamespacedResource(
-                                                    generic_client.get(), 
-                                                    resource_description.k8s_namespace.c_str(),
-                                                    resource_description.name.c_str(),
-                                                    patch_string.c_str(),
-                                                    NULL, /* queryParameters */
-                                                    NULL, /* headerParameters */
-                                                    NULL, /* formParameters */
-                                                    NULL, /* headerType */
-                                                    const_cast<list_t*>(patch_content_type_list.get())  /* contentType */
-                                                ),
-                                                free
-                                            );
+        this->retry_policy = retry_policy;
 
-            if( api_response ){
+    }
 
-                cjson cjson_response(api_response.get());
-                if( cjson_response ){
-                    response = cjson_response.toJson();
-                }
 
-            }
 
-        }
+    const RetryPolicy& KubernetesClient::getRetryPolicy() const{
 
-        return response;
+        return this->retry_policy;
 
     }
 
 
 
-
     set<string> KubernetesClient::resolveNamespaces( const vector<string>& k8s_namespaces ) const{
 
         // if "all" is in the list, then get all namespaces
@@ -697,8 +529,20 @@ namespace kubepp{
 
 
         // add all of the CRDs APIs
+            vector<ResourceDescription>* incomplete_lists = this->getIncompleteLists();
+            const size_t incomplete_before = incomplete_lists ? incomplete_lists->size() : 0;
+
             json crds = this->runQuery("SELECT * FROM CustomResourceDefinition");
 
+            // without every CRD, any group version may be missing
+            if( incomplete_lists && incomplete_lists->size() > incomplete_before ){
+                // the default ResourceDescription is core v1; any group version is an empty one
+                ResourceDescription any_group_version;
+                any_group_version.api_version = "";
+                any_group_version.api_group_version = "";
+                incomplete_lists->push_back(any_group_version);
+            }
+
             //cout << crds;
 
             //return crds;
@@ -736,7 +580,7 @@ namespace kubepp{
 
                 //cout << "api_version=" << resource_description.api_version << " api_group=" << resource_description.api_group << " api_group_version=" << resource_description.api_group_version << endl;
                 
-                json these_results = this->getGenericResources(resource_description);
+                json these_results = this->getGenericResources( resource_description, ListOptions() );
 
                 if( these_results.contains("resources") && these_results["resources"].is_array() ){
 
@@ -745,6 +589,16 @@ namespace kubepp{
                         results.push_back(result);
                     }
 
+                }else if( these_results.value("code", 0) != 404 ){
+
+                    // a group version that isn't served is a 404; any other failure leaves out kinds that exist
+                    spdlog::warn("Discovering {} failed ({}); its kinds are missing.", resource_description.api_group_version, these_results.empty() ? "no response" : "HTTP " + std::to_string( these_results.value("code", 0) ));
+                    if( incomplete_lists ){
+                        ResourceDescription group_version;
+                        group_version.api_group_version = resource_description.api_group_version;
+                        incomplete_lists->push_back(group_version);
+                    }
+
                 }
 
             }
@@ -755,85 +609,1286 @@ namespace kubepp{
 
 
 
-    std::shared_ptr<genericClient_t> KubernetesClient::createGenericClient( const ResourceDescription& resource_description ) const{
+    json KubernetesClient::runQuery( const Query& query ) const{
+
+        QueryStats stats;
 
-        std::shared_ptr<genericClient_t> generic_client( 
-                            genericClient_create( 
-                                api_client.get(), 
-                                resource_description.api_group.c_str(),
-                                resource_description.api_version.c_str(),
-                                resource_description.kind_lower_plural.c_str()
-                            ), 
-                            genericClient_free 
-                        );
+        auto start = QueryStats::clock::now();
+        const QueryPlan plan(query);
+        stats.addStageTime( "plan", start );
+
+        return this->executePlan( query, plan, stats );
 
-        return generic_client;
-        
     }
 
 
 
-    json KubernetesClient::runQuery( const Query& query ) const{
+    json KubernetesClient::runQuery( const string& query_str, const vector<string>& parameters ) const{
 
-        json results = json::array();
+        QueryStats stats;
 
-        for( const string& from : query.from ){
+        // on a cache miss this includes planning
+        auto start = QueryStats::clock::now();
+        auto prepared_query = this->prepareQuery(query_str);
+        stats.addStageTime( "parse", start );
 
-            if( from == "*" ){
+        start = QueryStats::clock::now();
+        const QueryPlan plan = prepared_query->bind(parameters);
+        stats.addStageTime( "bind", start );
 
-                json api_resources = this->getApiResources();  //lots of requests
+        return this->executePlan( prepared_query->query, plan, stats );
+
+    }
 
-                for( json api_resource : api_resources ){
-                    ResourceDescription resource_description(api_resource);
-                    json these_results = this->getGenericResources(resource_description);
-                    if( these_results.contains("items") && these_results["items"].is_array() ){
-                        for( json result : these_results["items"] ){
-                            result["apiVersion"] = resource_description.api_group_version;
-                            result["kind"] = resource_description.kind;
-                            results.push_back(result);
-                        }
-                    }
-                }
 
-                /*
 
-                for( const auto& pair : ResourceDescription::kind_to_api_group ){
- 
-                    json these_results = this->getGenericResources( pair.first );
+    json KubernetesClient::runQuery( const char* query_str, const vector<string>& parameters ) const{
 
-                    ResourceDescription resource_description( pair.first );
+        return this->runQuery( string(query_str), parameters );
 
-                    if( these_results.contains("items") && these_results["items"].is_array() ){
-                        for( json result : these_results["items"] ){
-                            result["apiVersion"] = resource_description.api_group_version;
-                            result["kind"] = resource_description.kind;
-                            results.push_back(result);
+    }
+
+
+
+    json KubernetesClient::runQuery( const PreparedQuery& prepared_query, const vector<string>& parameters ) const{
+
+        QueryStats stats;
+
+        auto start = QueryStats::clock::now();
+        const QueryPlan plan = prepared_query.bind(parameters);
+        stats.addStageTime( "bind", start );
+
+        return this->executePlan( prepared_query.query, plan, stats );
+
+    }
+
+
+
+    std::shared_ptr<const PreparedQuery> KubernetesClient::prepareQuery( const string& query_str ) const{
+
+        return this->query_cache.get(query_str);
+
+    }
+
+
+
+    namespace{
+
+        class QueryScopeEntry{
+            public:
+                const KubernetesClient* client;
+                QueryStats* stats;
+                RetryBudget* retry_budget;
+                vector<ResourceDescription>* incomplete_lists;
+        };
+
+        // per thread, so queries run at the same time on a shared client don't record into each other's stats or spend each other's budget
+        thread_local vector<QueryScopeEntry> query_scopes;
+
+        const QueryScopeEntry* findQueryScope( const KubernetesClient* client ){
+
+            for( auto scope = query_scopes.rbegin(); scope != query_scopes.rend(); ++scope ){
+                if( scope->client == client ){
+                    return &*scope;
+                }
+            }
+
+            return nullptr;
+
+        }
+
+        /*
+            Marks the calling thread as running a query on the client until destroyed, with its retry budget and, for EXPLAIN ANALYZE,
+            its stats; for streamQuery, the kinds that weren't listed completely go to incomplete_lists. A query run inside another on
+            the same client ( eg. discovery's CRD list ) shares the outer budget, stats and incomplete lists.
+        */
+        class QueryScope{
+            public:
+                QueryScope( const KubernetesClient* client, size_t retries, QueryStats* stats = nullptr, vector<ResourceDescription>* incomplete_lists = nullptr )
+                    :budget(retries)
+                {
+                    QueryScopeEntry entry{ client, stats, &this->budget, incomplete_lists };
+                    if( const QueryScopeEntry* outer = findQueryScope(client) ){
+                        entry.retry_budget = outer->retry_budget;
+                        if( entry.stats == nullptr ){
+                            entry.stats = outer->stats;
+                        }
+                        if( entry.incomplete_lists == nullptr ){
+                            entry.incomplete_lists = outer->incomplete_lists;
                         }
                     }
+                    query_scopes.push_back(entry);
+                }
 
+                ~QueryScope(){
+                    query_scopes.pop_back();
                 }
-                */
 
-            }else{
+            protected:
+                RetryBudget budget;
+        };
 
-                json these_results = this->getGenericResources( from );
+    }
 
-                ResourceDescription resource_description(from);
 
-                if( these_results.contains("items") && these_results["items"].is_array() ){
-                    for( json result : these_results["items"] ){
-                        result["apiVersion"] = resource_description.api_group_version;
-                        result["kind"] = resource_description.kind;
-                        results.push_back(result);
-                    }
-                }
 
-            }
-            
+    QueryStats* KubernetesClient::getQueryStats() const{
+
+        const QueryScopeEntry* scope = findQueryScope(this);
+        return scope ? scope->stats : nullptr;
+
+    }
+
+
+
+    RetryBudget* KubernetesClient::getRetryBudget() const{
 
+        const QueryScopeEntry* scope = findQueryScope(this);
+        return scope ? scope->retry_budget : nullptr;
+
+    }
+
+
+
+    vector<ResourceDescription>* KubernetesClient::getIncompleteLists() const{
+
+        const QueryScopeEntry* scope = findQueryScope(this);
+        return scope ? scope->incomplete_lists : nullptr;
+
+    }
+
+
+
+    json KubernetesClient::executePlan( const Query& query, const QueryPlan& plan, QueryStats& stats ) const{
+
+        Tracer::Span span("query");
+        span.setArg( "query", query.asString() );
+
+        QueryScope query_scope( this, this->retry_policy.query_retries );
+
+        const AllocationTracker::Snapshot allocations_before = AllocationTracker::snapshot();
+
+        if( !query.explain ){
+            json results = this->runPlan(plan);
+            this->recordAllocations( query.asString(), AllocationTracker::snapshot() - allocations_before, stats );
+            return results;
         }
 
-        return results;
+        json explanation = json::object();
+
+        explanation["query"] = query.asString();
+        explanation["plan"] = this->explainPlan(plan);
+
+        if( query.analyze ){
+
+            {
+                QueryScope analyze_scope( this, this->retry_policy.query_retries, &stats );
+                this->runPlan(plan);
+            }
+
+            this->recordAllocations( query.asString(), AllocationTracker::snapshot() - allocations_before, stats );
+            explanation["analysis"] = stats.asJson();
+
+        }
+
+        return explanation;
+
+    }
+
+
+
+    json KubernetesClient::explainPlan( const QueryPlan& plan ) const{
+
+        json plan_json = json::object();
+
+        const string k8s_namespace = plan.getNamespace();
+        ListOptions options = plan.getListOptions();
+        options.limit = this->page_size;
+
+        string query_string;
+        for( const auto& [key, value] : this->getListQueryParameters(options) ){
+            query_string += ( query_string.empty() ? "?" : "&" ) + key + "=" + this->urlEncode(value);
+        }
+
+        plan_json["kinds"] = json::array();
+
+        if( plan.all_kinds ){
+            plan_json["kinds"].push_back({
+                {"kind", "*"},
+                {"discovery", "1 CustomResourceDefinition list, then 1 request per API group version"},
+                {"endpoint", k8s_namespace.empty() ? "1 list per discovered kind" : "1 list per discovered namespaced kind"}
+            });
+        }
+
+        for( ResourceDescription target : plan.targets ){
+            target.k8s_namespace = k8s_namespace;
+            plan_json["kinds"].push_back({
+                {"kind", target.kind},
+                {"apiVersion", target.api_group_version},
+                {"endpoint", "GET " + target.getCollectionPath() + query_string}
+            });
+        }
+
+        plan_json["namespace"] = k8s_namespace;
+        plan_json["metadata_only"] = options.metadata_only;
+        plan_json["labelSelector"] = options.label_selector;
+        plan_json["fieldSelector"] = options.field_selector;
+
+        plan_json["client_filters"] = json::array();
+        for( const auto& predicate : plan.predicates ){
+            if( predicate.pushdown == QueryPredicate::PushdownTarget::CLIENT_FILTER ){
+                plan_json["client_filters"].push_back( predicate.path + " " + predicate.op + " " + predicate.value );
+            }
+        }
+
+        if( this->page_size > 0 ){
+            plan_json["pagination"] = "limit=" + std::to_string(this->page_size) + " per request, following continue tokens";
+        }else{
+            plan_json["pagination"] = "none; 1 list request per kind";
+        }
+        plan_json["concurrency"] = 1;
+
+        if( plan.all_kinds ){
+            plan_json["api_calls"] = "depends on discovery";
+        }else{
+            // a minimum when paginating
+            plan_json["api_calls"] = plan.targets.size();
+        }
+
+        plan_json["predicates"] = plan.asJson()["predicates"];
+
+        return plan_json;
+
+    }
+
+
+
+    json KubernetesClient::runPlan( const QueryPlan& plan ) const{
+
+        json results = json::array();
+
+        this->runPlan( plan, [&results, &plan]( json& resource ){
+            results.push_back( plan.project(resource) );
+        });
+
+        return results;
+
+    }
+
+
+
+    void KubernetesClient::runPlan( const QueryPlan& plan, const std::function<void(json&)>& on_resource ) const{
+
+        if( plan.all_kinds ){
+
+            auto start = QueryStats::clock::now();
+            json api_resources;
+            {
+                Tracer::Span discovery_span("discovery");
+                api_resources = this->getApiResources();  //lots of requests
+            }
+            if( QueryStats* query_stats = this->getQueryStats() ){
+                query_stats->addStageTime( "discovery", start );
+            }
+
+            for( json api_resource : api_resources ){
+
+                // a namespace pushdown can't match cluster-scoped kinds
+                if( !plan.getNamespace().empty() && api_resource.contains("namespaced") && api_resource["namespaced"].is_boolean() && !api_resource["namespaced"].get<bool>() ){
+                    continue;
+                }
+
+                // subresources ( pods/log ) and kinds that can't be listed ( TokenReview ) would only fail
+                if( api_resource.value("name", "").find('/') != string::npos ){
+                    continue;
+                }
+                if( api_resource.contains("verbs") && api_resource["verbs"].is_array() && std::find( api_resource["verbs"].begin(), api_resource["verbs"].end(), "list" ) == api_resource["verbs"].end() ){
+                    continue;
+                }
+
+                this->listPlanTarget( plan, ResourceDescription(api_resource), on_resource );
+
+            }
+
+        }
+
+        for( const ResourceDescription& target : plan.targets ){
+
+            this->listPlanTarget( plan, target, on_resource );
+
+        }
+
+    }
+
+
+
+    namespace{
+
+        // metadata.uid, or namespace/name for objects without one
+        string getObjectKey( const json& object ){
+
+            const auto metadata_it = object.find("metadata");
+            if( metadata_it == object.end() || !metadata_it->is_object() ){
+                return "";
+            }
+
+            const string uid = metadata_it->value("uid", "");
+            if( !uid.empty() ){
+                return uid;
+            }
+
+            return metadata_it->value("namespace", "") + "/" + metadata_it->value("name", "");
+
+        }
+
+    }
+
+
+
+    void KubernetesClient::listPlanTarget( const QueryPlan& plan, ResourceDescription resource_description, const std::function<void(json&)>& on_resource ) const{
+
+        resource_description.k8s_namespace = plan.getNamespace();
+
+        // one page at a time, so only a page of objects is held in memory
+
+        ListOptions options = plan.getListOptions();
+        options.limit = this->page_size;
+
+        Tracer::Span list_span( "list " + resource_description.kind );
+        list_span.setArg( "apiVersion", resource_description.api_group_version );
+
+        // when a continue token expires ( 410 ) the list starts over at the current resourceVersion; the apiserver lists in key
+        // ( namespace/name ) order, so the restarted list skips what sorts up to the last key already listed instead of
+        // remembering every key delivered
+        string list_position;
+        size_t restarts = 0;
+        bool restart = false;
+
+        do{
+
+            restart = false;
+
+            auto start = QueryStats::clock::now();
+            json page;
+            {
+                Tracer::Span page_span("page");
+                page_span.setArg( "continue", options.continue_token );
+                page = this->getGenericResources( resource_description, options );
+            }
+            if( QueryStats* query_stats = this->getQueryStats() ){
+                query_stats->addStageTime( "list", start );
+            }
+
+            start = QueryStats::clock::now();
+
+            if( page.contains("items") && page["items"].is_array() ){
+
+                if( QueryStats* query_stats = this->getQueryStats() ){
+                    query_stats->objects_scanned += page["items"].size();
+                }
+
+                // filter, then hand over the matches, so a trace separates matching from what the caller does with the rows;
+                // the caller's allocations ( serialization, columns ) aren't the query's
+                vector<json*> matches;
+                {
+                    AllocationTracker::Scope allocation_scope( AllocationTracker::Subsystem::QUERY );
+                    Tracer::Span filter_span("filter");
+                    filter_span.setArg( "objects", static_cast<double>( page["items"].size() ) );
+                    for( json& result : page["items"] ){
+                        if( !plan.matches(result) ){
+                            continue;
+                        }
+                        if( restarts > 0 && getObjectKey(result) <= list_position ){
+                            continue;
+                        }
+                        result["apiVersion"] = resource_description.api_group_version;
+                        result["kind"] = resource_description.kind;
+                        matches.push_back(&result);
+                    }
+                }
+
+                if( this->page_size > 0 && !page["items"].empty() ){
+                    list_position = std::max( list_position, getObjectKey( page["items"].back() ) );
+                }
+
+                Tracer::Span deliver_span("deliver");
+                deliver_span.setArg( "rows", static_cast<double>( matches.size() ) );
+                for( json* result : matches ){
+                    on_resource(*result);
+                }
+                if( QueryStats* query_stats = this->getQueryStats() ){
+                    query_stats->objects_returned += matches.size();
+                }
+
+            }else if( page.value("kind", "") == "Status" && page.value("code", 0) == 410 && !options.continue_token.empty() && restarts < KubernetesClient::max_list_restarts ){
+
+                restarts++;
+                restart = true;
+                spdlog::warn("The list of {} expired before it was complete; listing it again ({} of {}).", resource_description.kind, restarts, KubernetesClient::max_list_restarts);
+
+            }else if( page.value("kind", "") == "Status" && page.value("code", 0) == 410 ){
+
+                spdlog::warn("The list of {} expired before it was complete; its results are partial.", resource_description.kind);
+                if( vector<ResourceDescription>* incomplete_lists = this->getIncompleteLists() ){
+                    incomplete_lists->push_back(resource_description);
+                }
+
+            }else if( page.value("kind", "") == "Status" || page.empty() ){
+
+                // after retries; the query goes on with the other kinds
+                spdlog::warn("Listing {} failed ({}); its results are missing.", resource_description.kind, page.empty() ? "no response" : "HTTP " + std::to_string( page.value("code", 0) ) + ": " + page.value("message", ""));
+                if( vector<ResourceDescription>* incomplete_lists = this->getIncompleteLists() ){
+                    incomplete_lists->push_back(resource_description);
+                }
+
+            }
+
+            if( QueryStats* query_stats = this->getQueryStats() ){
+                query_stats->addStageTime( "filter", start );
+            }
+
+            options.continue_token = "";
+            if( page.contains("metadata") && page["metadata"].is_object() && page["metadata"].contains("continue") && page["metadata"]["continue"].is_string() ){
+                options.continue_token = page["metadata"]["continue"].get<string>();
+            }
+            if( restart ){
+                options.continue_token = "";
+            }
+
+        }while( restart || !options.continue_token.empty() );
+
+    }
+
+
+
+    vector<ResourceDescription> KubernetesClient::streamQuery( const string& query_str, const std::function<void(json& row)>& on_row, const vector<string>& parameters ) const{
+
+        Tracer::Span span("query");
+        span.setArg( "query", query_str );
+
+        vector<ResourceDescription> incomplete_lists;
+        QueryScope query_scope( this, this->retry_policy.query_retries, nullptr, &incomplete_lists );
+
+        const AllocationTracker::Snapshot allocations_before = AllocationTracker::snapshot();
+
+        auto prepared_query = this->prepareQuery(query_str);
+        const QueryPlan plan = prepared_query->bind(parameters);
+
+        this->runPlan( plan, [&plan, &on_row]( json& resource ){
+            json row = plan.project(resource);
+            on_row(row);
+        });
+
+        QueryStats stats;
+        this->recordAllocations( query_str, AllocationTracker::snapshot() - allocations_before, stats );
+
+        return incomplete_lists;
+
+    }
+
+
+
+    void KubernetesClient::setPageSize( size_t page_size ){
+
+        this->page_size = page_size;
+
+    }
+
+
+
+    void KubernetesClient::setProtobuf( bool enabled ){
+
+        this->protobuf_enabled = enabled;
+
+    }
+
+
+
+    ColumnarResult KubernetesClient::runColumnarQuery( const string& query_str, const vector<string>& parameters ) const{
+
+        auto prepared_query = this->prepareQuery(query_str);
+
+        vector<string> column_paths;
+        for( const string& select : prepared_query->query.select ){
+            if( select == "*" ){
+                throw std::runtime_error("A columnar query needs explicit SELECT paths, eg. \"SELECT metadata.namespace, status.phase FROM Pod\".");
+            }
+            if( !select.empty() ){
+                column_paths.push_back(select);
+            }
+        }
+
+        if( column_paths.empty() ){
+            throw std::runtime_error("A columnar query needs at least one SELECT path.");
+        }
+
+        ColumnarResult result(column_paths);
+
+        QueryScope query_scope( this, this->retry_policy.query_retries );
+
+        // rows go straight into the columns; the full objects are dropped as each list is consumed
+        this->runPlan( prepared_query->bind(parameters), [&result]( json& resource ){
+            result.append(resource);
+        });
+
+        result.finish();
+
+        return result;
+
+    }
+
+
+
+    namespace{
+
+        // The c client's streaming callbacks take no user data, so each watching thread points this at its stream.
+
+        class WatchStream{
+            public:
+                string buffer;
+                string resource_version;
+                bool expired = false;       // 410 Gone; the watch must re-list
+                std::atomic<bool>* stopped = nullptr;
+                std::function<void(json&)> on_event;
+        };
+
+        thread_local WatchStream* current_watch_stream = nullptr;
+
+
+        void onWatchData( void** data, long* data_length ){
+
+            WatchStream* stream = current_watch_stream;
+
+            if( stream == nullptr || *data == nullptr ){
+                return;
+            }
+
+            stream->buffer.append( static_cast<const char*>(*data), static_cast<size_t>(*data_length) );
+
+            // consume what was received so the client doesn't keep accumulating the stream
+            free(*data);
+            *data = NULL;
+            *data_length = 0;
+
+            size_t line_start = 0;
+            size_t line_end;
+
+            while( (line_end = stream->buffer.find('\n', line_start)) != string::npos ){
+
+                const string line = stream->buffer.substr(line_start, line_end - line_start);
+                line_start = line_end + 1;
+
+                if( line.empty() || stream->expired ){
+                    continue;
+                }
+
+                json event = json::parse( line, nullptr, false );
+                if( event.is_discarded() || !event.is_object() ){
+                    spdlog::warn("Discarding a malformed watch event.");
+                    continue;
+                }
+
+                stream->on_event(event);
+
+            }
+
+            stream->buffer.erase(0, line_start);
+
+        }
+
+
+        int onWatchProgress( void* progress_data, curl_off_t, curl_off_t, curl_off_t, curl_off_t ){
+
+            // a non-zero return aborts the transfer
+            const WatchStream* stream = static_cast<const WatchStream*>(progress_data);
+            return ( stream->expired || stream->stopped->load() ) ? 1 : 0;
+
+        }
+
+    }
+
+
+
+    void KubernetesClient::watchQuery( ContinuousQuery& continuous_query, const std::function<bool(const json& delta)>& on_delta ) const{
+
+        const QueryPlan& plan = continuous_query.getPlan();
+
+        if( plan.all_kinds ){
+            throw std::runtime_error("Watching 'FROM *' is not supported; name the kinds to watch.");
+        }
+
+        std::atomic<bool> stopped{false};
+        std::mutex delta_mutex;
+
+        auto deliver = [&stopped, &delta_mutex, &on_delta]( const vector<json>& deltas ){
+            std::lock_guard<std::mutex> lock(delta_mutex);
+            for( const json& delta : deltas ){
+                if( stopped.load() ){
+                    return;
+                }
+                if( !on_delta(delta) ){
+                    stopped.store(true);
+                }
+            }
+        };
+
+        if( plan.targets.size() == 1 ){
+            this->watchTarget( const_cast<apiClient_t*>(this->api_client.get()), continuous_query, plan.targets.front(), deliver, stopped );
+            return;
+        }
+
+        // one watch stream per kind, each on its own thread and client; the first to fail stops the others
+        vector<std::shared_ptr<apiClient_t>> clients;
+        vector<std::thread> threads;
+        std::exception_ptr failure;
+        std::mutex failure_mutex;
+
+        for( const ResourceDescription& target : plan.targets ){
+            clients.push_back( this->createApiClient() );
+            apiClient_t* client = clients.back().get();
+            threads.emplace_back( [this, client, &continuous_query, target, &deliver, &stopped, &failure, &failure_mutex](){
+                try{
+                    this->watchTarget( client, continuous_query, target, deliver, stopped );
+                }catch( ... ){
+                    std::lock_guard<std::mutex> lock(failure_mutex);
+                    if( !failure ){
+                        failure = std::current_exception();
+                    }
+                    stopped.store(true);
+                }
+            });
+        }
+
+        for( auto& thread : threads ){
+            thread.join();
+        }
+
+        if( failure ){
+            std::rethrow_exception(failure);
+        }
+
+    }
+
+
+
+    void KubernetesClient::watchTarget( apiClient_t* client, ContinuousQuery& continuous_query, ResourceDescription resource_description, const std::function<void(const vector<json>&)>& deliver, std::atomic<bool>& stopped ) const{
+
+        const QueryPlan& plan = continuous_query.getPlan();
+        resource_description.k8s_namespace = plan.getNamespace();
+
+        const string path = resource_description.getCollectionPath();
+        const ListOptions options = plan.getListOptions();
+        const vector<pair<string, string>> selector_parameters = this->getListQueryParameters(options);
+
+        while( !stopped.load() ){
+
+            // list, then reconcile the result set with it
+
+            json list = this->invokeApi( client, "GET", path, selector_parameters, this->getListAccept(resource_description, options) );
+
+            if( !list.contains("items") ){
+                // invokeApi has already retried what's worth retrying; a 401, 403 or 404 won't go away by listing again
+                if( !this->retry_policy.shouldRetry( client->response_code, RetryPolicy::Idempotency::IDEMPOTENT ) ){
+                    throw std::runtime_error( fmt::format("Listing {} failed (HTTP {}): {}", resource_description.kind, client->response_code, list.value("message", "no message")) );
+                }
+                spdlog::warn("Listing {} failed (HTTP {}); retrying.", resource_description.kind, client->response_code);
+                std::this_thread::sleep_for( std::chrono::seconds(1) );
+                continue;
+            }
+
+            deliver( continuous_query.resync( resource_description, list["items"] ) );
+
+            WatchStream stream;
+            stream.stopped = &stopped;
+            stream.resource_version = list["metadata"].value("resourceVersion", "");
+
+            stream.on_event = [&]( json& event ){
+
+                const string type = event.value("type", "");
+                json& object = event["object"];
+
+                if( object.is_object() && object.contains("metadata") && object["metadata"].is_object() ){
+                    const string resource_version = object["metadata"].value("resourceVersion", "");
+                    if( !resource_version.empty() && type != "ERROR" ){
+                        stream.resource_version = resource_version;
+                    }
+                }
+
+                if( type == "ERROR" ){
+                    if( object.value("code", 0) == 410 ){
+                        stream.expired = true;
+                    }else{
+                        spdlog::warn("Watch error for {}: {}", resource_description.kind, object.value("message", ""));
+                    }
+                    return;
+                }
+
+                if( type == "BOOKMARK" ){
+                    return;
+                }
+
+                object["apiVersion"] = resource_description.api_group_version;
+                object["kind"] = resource_description.kind;
+
+                json delta = continuous_query.apply( type, object );
+                if( !delta.is_null() ){
+                    deliver( { delta } );
+                }
+
+            };
+
+
+            // watch from the listed version until the stream expires or we're stopped
+
+            while( !stopped.load() && !stream.expired ){
+
+                vector<pair<string, string>> watch_parameters = selector_parameters;
+                watch_parameters.push_back( {"watch", "true"} );
+                watch_parameters.push_back( {"allowWatchBookmarks", "true"} );
+                watch_parameters.push_back( {"resourceVersion", stream.resource_version} );
+
+                client->data_callback_func = onWatchData;
+                client->progress_func = onWatchProgress;
+                client->progress_data = &stream;
+                current_watch_stream = &stream;
+
+                this->callApi( client, "GET", path, watch_parameters, this->getListAccept(resource_description, options, true) );
+
+                current_watch_stream = nullptr;
+                client->data_callback_func = NULL;
+                client->progress_func = NULL;
+                client->progress_data = NULL;
+
+                if( client->dataReceived ){
+                    free(client->dataReceived);
+                    client->dataReceived = NULL;
+                    client->dataReceivedLen = 0;
+                }
+                stream.buffer.clear();
+
+                // the apiserver ends watches after a timeout; a 410 re-lists, errors that retrying can't fix stop the watch
+                // and anything else is retried after a pause
+                if( client->response_code == 410 ){
+                    stream.expired = true;
+                }
+                if( client->response_code != 200 && !stopped.load() && !stream.expired ){
+                    if( !this->retry_policy.shouldRetry( client->response_code, RetryPolicy::Idempotency::IDEMPOTENT ) ){
+                        throw std::runtime_error( fmt::format("Watching {} failed (HTTP {}).", resource_description.kind, client->response_code) );
+                    }
+                    spdlog::warn("Watch of {} ended with HTTP {}; resuming.", resource_description.kind, client->response_code);
+                    std::this_thread::sleep_for( std::chrono::seconds(1) );
+                }
+
+            }
+
+        }
+
+    }
+
+
+
+    long KubernetesClient::watchResources( const ResourceDescription& resource_description, const ListOptions& options, const string& resource_version, int timeout_seconds, const std::function<bool(json& event)>& on_event ) const{
+
+        apiClient_t* client = const_cast<apiClient_t*>(this->api_client.get());
+
+        std::atomic<bool> stopped{false};
+
+        WatchStream stream;
+        stream.stopped = &stopped;
+        stream.on_event = [&]( json& event ){
+            if( !stopped.load() && !on_event(event) ){
+                stopped.store(true);
+            }
+        };
+
+        vector<pair<string, string>> watch_parameters = this->getListQueryParameters(options);
+        watch_parameters.push_back( {"watch", "true"} );
+        watch_parameters.push_back( {"timeoutSeconds", std::to_string(timeout_seconds)} );
+        if( !resource_version.empty() ){
+            watch_parameters.push_back( {"resourceVersion", resource_version} );
+        }
+
+        client->data_callback_func = onWatchData;
+        client->progress_func = onWatchProgress;
+        client->progress_data = &stream;
+        current_watch_stream = &stream;
+
+        this->callApi( client, "GET", resource_description.getCollectionPath(), watch_parameters, this->getListAccept(resource_description, options, true) );
+
+        current_watch_stream = nullptr;
+        client->data_callback_func = NULL;
+        client->progress_func = NULL;
+        client->progress_data = NULL;
+
+        if( client->dataReceived ){
+            free(client->dataReceived);
+            client->dataReceived = NULL;
+            client->dataReceivedLen = 0;
+        }
+
+        // stopping aborts the transfer, which isn't a failure of the watch
+        return stopped.load() ? 200 : client->response_code;
+
+    }
+
+
+
+    json KubernetesClient::getGenericResources( const ResourceDescription& resource_description, const ListOptions& options ) const{
+
+        return this->invokeApi( "GET", resource_description.getCollectionPath(), this->getListQueryParameters(options), this->getListAccept(resource_description, options) );
+
+    }
+
+
+
+    json KubernetesClient::getResourceTable( const ResourceDescription& resource_description, const ListOptions& options ) const{
+
+        json table;
+
+        this->streamResourceTable( resource_description, options, [&table]( json& page ){
+
+            if( table.is_null() ){
+                table = {
+                    {"apiVersion", page.value("apiVersion", "meta.k8s.io/v1")},
+                    {"kind", "Table"},
+                    {"columnDefinitions", page.contains("columnDefinitions") ? page["columnDefinitions"] : json::array()},
+                    {"rows", json::array()}
+                };
+            }
+
+            if( page.contains("rows") && page["rows"].is_array() ){
+                for( json& row : page["rows"] ){
+                    table["rows"].push_back( std::move(row) );
+                }
+            }
+
+        });
+
+        return table;
+
+    }
+
+
+
+    void KubernetesClient::streamResourceTable( const ResourceDescription& resource_description, const ListOptions& options, const std::function<void(json& page)>& on_page ) const{
+
+        const string accept = "application/json;as=Table;v=v1;g=meta.k8s.io, application/json";
+
+        ListOptions page_options = options;
+        if( page_options.limit == 0 ){
+            page_options.limit = this->page_size;
+        }
+
+        do{
+
+            vector<pair<string, string>> query_parameters = this->getListQueryParameters(page_options);
+            query_parameters.push_back( {"includeObject", "Metadata"} );
+
+            json page = this->invokeApi( "GET", resource_description.getCollectionPath(), query_parameters, accept );
+
+            if( page.value("kind", "") != "Table" ){
+                if( page.value("kind", "") == "Status" ){
+                    throw std::runtime_error( "Failed to list " + resource_description.kind + ": " + page.value("message", "") );
+                }
+                throw std::runtime_error( "The apiserver didn't return a Table for " + resource_description.kind + "." );
+            }
+
+            page_options.continue_token = "";
+            if( page.contains("metadata") && page["metadata"].is_object() && page["metadata"].contains("continue") && page["metadata"]["continue"].is_string() ){
+                page_options.continue_token = page["metadata"]["continue"].get<string>();
+            }
+
+            on_page(page);
+
+        }while( !page_options.continue_token.empty() );
+
+    }
+
+
+
+    string KubernetesClient::getListAccept( const ResourceDescription& resource_description, const ListOptions& options, bool watch ) const{
+
+        if( options.metadata_only ){
+            return watch ? "application/json;as=PartialObjectMetadata;v=v1;g=meta.k8s.io, application/json" : "application/json;as=PartialObjectMetadataList;v=v1;g=meta.k8s.io, application/json";
+        }
+
+        // watch streams are framed differently in protobuf
+        if( !watch && this->protobuf_enabled && ProtobufDecoder::isSupported(resource_description) ){
+            return "application/vnd.kubernetes.protobuf, application/json";
+        }
+
+        return "application/json";
+
+    }
+
+
+
+    vector<pair<string, string>> KubernetesClient::getListQueryParameters( const ListOptions& options ) const{
+
+        vector<pair<string, string>> query_parameters;
+
+        if( !options.label_selector.empty() ){
+            query_parameters.push_back( {"labelSelector", options.label_selector} );
+        }
+
+        if( !options.field_selector.empty() ){
+            query_parameters.push_back( {"fieldSelector", options.field_selector} );
+        }
+
+        if( options.limit > 0 ){
+            query_parameters.push_back( {"limit", std::to_string(options.limit)} );
+        }
+
+        if( !options.continue_token.empty() ){
+            query_parameters.push_back( {"continue", options.continue_token} );
+        }
+
+        return query_parameters;
+
+    }
+
+
+
+    json KubernetesClient::invokeApi( const string& method, const string& path, const vector<pair<string, string>>& query_parameters, const string& accept ) const{
+
+        return this->invokeApi( const_cast<apiClient_t*>(this->api_client.get()), method, path, query_parameters, accept );
+
+    }
+
+
+
+    json KubernetesClient::invokeApi( apiClient_t* client, const string& method, const string& path, const vector<pair<string, string>>& query_parameters, const string& accept ) const{
+
+        const bool watch = std::any_of( query_parameters.begin(), query_parameters.end(), []( const pair<string, string>& parameter ){
+            return parameter.first == "watch";
+        });
+
+        return this->sendWithRetries( client, ClientMetrics::getVerb(method, path, watch), ClientMetrics::getResource(path), method == "GET" ? RetryPolicy::Idempotency::IDEMPOTENT : RetryPolicy::Idempotency::UNPROCESSED_ONLY, [&](){
+            return this->invokeApiOnce( client, method, path, query_parameters, accept );
+        });
+
+    }
+
+
+
+    json KubernetesClient::invokeApiOnce( apiClient_t* client, const string& method, const string& path, const vector<pair<string, string>>& query_parameters, const string& accept, const string& body, const string& content_type ) const{
+
+        json response = json::object();
+
+        auto fetch_start = QueryStats::clock::now();
+
+        {
+            Tracer::Span fetch_span("fetch");
+            fetch_span.setArg( "path", path );
+            this->callApi( client, method, path, query_parameters, accept, body, content_type );
+        }
+
+        auto parse_start = QueryStats::clock::now();
+        auto convert_start = parse_start;
+        const size_t bytes_received = client->dataReceived ? static_cast<size_t>(client->dataReceivedLen) : 0;
+
+        if( client->dataReceived ){
+
+            // the apiserver answers in json when it can't encode the kind as protobuf
+            if( ProtobufDecoder::isProtobuf( client->dataReceived, bytes_received ) ){
+                Tracer::Span decode_span("protobuf decode");
+                decode_span.setArg( "bytes", static_cast<double>(bytes_received) );
+                try{
+                    response = ProtobufDecoder::decode( client->dataReceived, bytes_received );
+                }catch( const std::exception& e ){
+                    free(client->dataReceived);
+                    client->dataReceived = NULL;
+                    client->dataReceivedLen = 0;
+                    throw std::runtime_error( "Failed to decode the protobuf response from " + path + ": " + e.what() );
+                }
+                convert_start = QueryStats::clock::now();
+            }else{
+                cjson cjson_response = [&](){
+                    Tracer::Span parse_span("cJSON parse");
+                    parse_span.setArg( "bytes", static_cast<double>(bytes_received) );
+                    return cjson( static_cast<const char*>(client->dataReceived) );
+                }();
+                convert_start = QueryStats::clock::now();
+                if( cjson_response ){
+                    Tracer::Span convert_span("json convert");
+                    response = cjson_response.toJson();
+                }
+            }
+
+            free(client->dataReceived);
+            client->dataReceived = NULL;
+            client->dataReceivedLen = 0;
+
+        }
+
+        const auto convert_end = QueryStats::clock::now();
+
+        this->recordRequest(
+            method,
+            path,
+            client->response_code,
+            bytes_received,
+            std::chrono::duration<double, std::milli>( parse_start - fetch_start ).count(),
+            std::chrono::duration<double, std::milli>( convert_start - parse_start ).count(),
+            std::chrono::duration<double, std::milli>( convert_end - convert_start ).count()
+        );
+
+        return response;
+
+    }
+
+
+
+    namespace{
+
+        QueryStats process_stats;
+        std::mutex process_stats_mutex;
+    }
+
+
+
+    void KubernetesClient::recordRequest( const string& method, const string& path, long status_code, size_t bytes, double fetch_ms, double parse_ms, double convert_ms ) const{
+
+        if( QueryStats* query_stats = this->getQueryStats() ){
+            query_stats->addRequest( method, path, status_code, bytes, fetch_ms, parse_ms, convert_ms );
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(this->stats_mutex);
+            this->client_stats.addRequest( method, path, status_code, bytes, fetch_ms, parse_ms, convert_ms );
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(process_stats_mutex);
+            process_stats.max_requests = KubernetesClient::max_recorded_requests;
+            process_stats.addRequest( method, path, status_code, bytes, fetch_ms, parse_ms, convert_ms );
+        }
+
+    }
+
+
+
+    void KubernetesClient::recordRetry() const{
+
+        if( QueryStats* query_stats = this->getQueryStats() ){
+            query_stats->retries++;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(this->stats_mutex);
+            this->client_stats.retries++;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(process_stats_mutex);
+            process_stats.retries++;
+        }
+
+    }
+
+
+
+    void KubernetesClient::recordConnections( const HttpSession::Transfer& transfer ) const{
+
+        if( QueryStats* query_stats = this->getQueryStats() ){
+            query_stats->addConnections( transfer.connections, transfer.tls_handshakes, transfer.tls_resumptions, transfer.handshake_ms );
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(this->stats_mutex);
+            this->client_stats.addConnections( transfer.connections, transfer.tls_handshakes, transfer.tls_resumptions, transfer.handshake_ms );
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(process_stats_mutex);
+            process_stats.addConnections( transfer.connections, transfer.tls_handshakes, transfer.tls_resumptions, transfer.handshake_ms );
+        }
+
+    }
+
+
+
+    void KubernetesClient::throttle() const{
+
+        const double wait_seconds = this->rate_limiter->acquire(this->priority);
+
+        if( wait_seconds <= 0.0 ){
+            return;
+        }
+
+        if( QueryStats* query_stats = this->getQueryStats() ){
+            query_stats->addThrottle( wait_seconds * 1000.0 );
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(this->stats_mutex);
+            this->client_stats.addThrottle( wait_seconds * 1000.0 );
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(process_stats_mutex);
+            process_stats.addThrottle( wait_seconds * 1000.0 );
+        }
+
+    }
+
+
+
+    void KubernetesClient::recordAllocations( const string& query_str, const AllocationTracker::Snapshot& allocated, QueryStats& stats ) const{
+
+        if( !AllocationTracker::isEnabled() ){
+            return;
+        }
+
+        QueryStats allocation_stats;
+        string summary;
+
+        for( size_t i = 0; i < allocated.subsystems.size(); i++ ){
+            const auto subsystem = static_cast<AllocationTracker::Subsystem>(i);
+            const AllocationTracker::Counts& counts = allocated.get(subsystem);
+            allocation_stats.addAllocations( AllocationTracker::getSubsystemName(subsystem), counts.allocations, counts.bytes );
+            summary += fmt::format( " {}: {} allocations, {} bytes;", AllocationTracker::getSubsystemName(subsystem), counts.allocations, counts.bytes );
+        }
+
+        spdlog::debug( "Allocations for '{}':{}", query_str, summary );
+
+        stats.merge(allocation_stats);
+
+        {
+            std::lock_guard<std::mutex> lock(this->stats_mutex);
+            this->client_stats.merge(allocation_stats);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(process_stats_mutex);
+            process_stats.merge(allocation_stats);
+        }
+
+    }
+
+
+
+    QueryStats KubernetesClient::getStats() const{
+
+        std::lock_guard<std::mutex> lock(this->stats_mutex);
+        return this->client_stats;
+
+    }
+
+
+
+    void KubernetesClient::resetStats(){
+
+        std::lock_guard<std::mutex> lock(this->stats_mutex);
+        this->client_stats = QueryStats();
+        this->client_stats.max_requests = KubernetesClient::max_recorded_requests;
+
+    }
+
+
+
+    ClientMetrics& KubernetesClient::getMetrics(){
+
+        static ClientMetrics metrics;
+        return metrics;
+
+    }
+
+
+
+    std::shared_ptr<RateLimiter> KubernetesClient::getRateLimiter(){
+
+        static std::shared_ptr<RateLimiter> rate_limiter = std::make_shared<RateLimiter>( &KubernetesClient::getMetrics() );
+        return rate_limiter;
+
+    }
+
+
+
+    RetryPolicy& KubernetesClient::getDefaultRetryPolicy(){
+
+        static RetryPolicy retry_policy;
+        return retry_policy;
+
+    }
+
+
+
+    void KubernetesClient::setRateLimiter( std::shared_ptr<RateLimiter> rate_limiter ){
+
+        if( !rate_limiter ){
+            throw std::runtime_error("The rate limiter can't be null.");
+        }
+        this->rate_limiter = std::move(rate_limiter);
+
+    }
+
+
+
+    void KubernetesClient::setPriority( RateLimiter::Priority priority ){
+
+        this->priority = priority;
+
+    }
+
+
+
+    QueryStats KubernetesClient::getProcessStats(){
+
+        std::lock_guard<std::mutex> lock(process_stats_mutex);
+        return process_stats;
+
+    }
+
+
+
+    void KubernetesClient::callApi( apiClient_t* client, const string& method, const string& path, const vector<pair<string, string>>& query_parameters, const string& accept, const string& body, const string& content_type ) const{
+
+        string query;
+        for( const auto& [key, value] : query_parameters ){
+            if( !query.empty() ){
+                query += '&';
+            }
+            query += key + "=" + this->urlEncode(value);
+        }
+
+        const bool watch = std::any_of( query_parameters.begin(), query_parameters.end(), []( const pair<string, string>& parameter ){
+            return parameter.first == "watch" && ( parameter.second == "true" || parameter.second == "1" );
+        });
+        this->throttle();
+        ClientMetrics::Call call( KubernetesClient::getMetrics(), ClientMetrics::getVerb(method, path, watch), ClientMetrics::getResource(path) );
+
+        const HttpSession::Transfer transfer = HttpSession::getThreadSession().perform( client, method, path, query, accept, body, content_type );
+
+        call.finish( client->response_code );
+        last_retry_after_seconds = transfer.retry_after_seconds;
+
+        if( transfer.connections > 0 ){
+            this->recordConnections(transfer);
+        }
+
+    }
+
+
+
+    string KubernetesClient::urlEncode( const string& value ) const{
+
+        static const char hex_digits[] = "0123456789ABCDEF";
+
+        string encoded;
+        encoded.reserve( value.size() );
+
+        for( const unsigned char c : value ){
+            if( std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~' ){
+                encoded += static_cast<char>(c);
+            }else{
+                encoded += '%';
+                encoded += hex_digits[c >> 4];
+                encoded += hex_digits[c & 0x0F];
+            }
+        }
+
+        return encoded;
 
     }
 
@@ -2,7 +2,6 @@
 
 extern "C" {
     #include <apiClient.h>
-    #include <generic.h>
 }
 
 #include <string>
@@ -15,6 +14,12 @@ using std::vector;
 using std::set;
 
 #include <memory>
+#include <functional>
+#include <atomic>
+#include <mutex>
+
+#include <utility>
+using std::pair;
 
 #include "json_fwd.hpp"
 using json = nlohmann::json;
@@ -22,11 +27,24 @@ using json = nlohmann::json;
 
 #include "ResourceDescription.h"
 #include "Query.h"
+#include "QueryPlan.h"
+#include "QueryCache.h"
+#include "QueryStats.h"
+#include "ListOptions.h"
+#include "ColumnarResult.h"
+#include "ClientMetrics.h"
+#include "RateLimiter.h"
+#include "AllocationTracker.h"
+#include "RetryPolicy.h"
+#include "HttpSession.h"
 
 
 namespace kubepp{
 
 
+    class ContinuousQuery;
+
+
     class KubernetesClient{
 
         public:
@@ -40,15 +58,86 @@ namespace kubepp{
             json deleteResources( const json& resources ) const;
 
 
+            /* Runs a query. "EXPLAIN SELECT ..." returns the plan instead; "EXPLAIN ANALYZE SELECT ..." runs it and returns the plan with its measurements.*/
             json runQuery( const Query& query ) const;
 
+            /* Runs a query through the prepared-query cache. '?' placeholders in the WHERE clause are filled from the parameters, in order.*/
+            json runQuery( const string& query_str, const vector<string>& parameters = {} ) const;
+            json runQuery( const char* query_str, const vector<string>& parameters = {} ) const;
+            json runQuery( const PreparedQuery& prepared_query, const vector<string>& parameters = {} ) const;
+
+            /*
+                Runs a query and hands each row to on_row as soon as its page arrives, instead of collecting the results. Returns the kinds
+                that couldn't be listed completely ( after retries ); an empty kind is a whole API group version whose discovery failed,
+                and an empty kind and apiVersion means the CustomResourceDefinitions, and so any group version, may be missing.
+            */
+            vector<ResourceDescription> streamQuery( const string& query_str, const std::function<void(json& row)>& on_row, const vector<string>& parameters = {} ) const;
+
+            /* Lists are fetched in pages of this many objects (limit/continue); 0 fetches each list in one response. Defaults to 500.*/
+            void setPageSize( size_t page_size );
+
+            /* Totals and per-request measurements ( endpoint, status, bytes, network, parse and conversion time ) of this client's api calls.*/
+            QueryStats getStats() const;
+            void resetStats();
+
+            /* The same, summed over every KubernetesClient in the process ( the --stats flag ).*/
+            static QueryStats getProcessStats();
+
+            /* Latency histograms, request and error counts and in-flight gauges of every api call in the process, per verb and resource ( Prometheus: getMetrics().toPrometheus() ).*/
+            static ClientMetrics& getMetrics();
+
+            /* The rate limiter shared by every KubernetesClient in the process ( --qps, --burst, --background-qps, --background-burst ); unlimited by default.*/
+            static std::shared_ptr<RateLimiter> getRateLimiter();
+
+            /* The retry policy of KubernetesClients created from now on ( --retries ).*/
+            static RetryPolicy& getDefaultRetryPolicy();
+
+            /* Every request first takes a token from this client's rate limiter; getRateLimiter() unless set.*/
+            void setRateLimiter( std::shared_ptr<RateLimiter> rate_limiter );
+
+            /* The rate limiter bucket of this client's requests; exports run as BACKGROUND. Defaults to INTERACTIVE.*/
+            void setPriority( RateLimiter::Priority priority );
+
+            /* When failed requests are retried ( see RetryPolicy ); set with --retries.*/
+            void setRetryPolicy( const RetryPolicy& retry_policy );
+            const RetryPolicy& getRetryPolicy() const;
+
+            /* Lists of kinds with a protobuf schema ( see ProtobufDecoder ) are requested as protobuf, with json as the fallback. Enabled by default.*/
+            void setProtobuf( bool enabled );
+
+            /* Runs a query into typed columns, one per SELECT path ( eg. "SELECT metadata.namespace, status.phase FROM Pod" ). SELECT * is not supported.*/
+            ColumnarResult runColumnarQuery( const string& query_str, const vector<string>& parameters = {} ) const;
+
+            /*
+                Lists the query's kinds, then keeps the continuous query up to date from watch events, calling on_delta for every change to its result set.
+                Expired watches are resumed, or re-listed on 410 Gone. Blocks until on_delta returns false. FROM * is not supported.
+                A list or watch failing with an error that retrying can't fix ( eg. 401, 403 or 404; see RetryPolicy ) stops every kind's watch and throws.
+            */
+            void watchQuery( ContinuousQuery& continuous_query, const std::function<bool(const json& delta)>& on_delta ) const;
+
+            /*
+                One watch request on a collection: events ( {"type": ..., "object": ...} ) after resource_version ( empty: the current objects as ADDED events first )
+                go to on_event until it returns false or the apiserver ends the watch after timeout_seconds. Returns the HTTP status.
+            */
+            long watchResources( const ResourceDescription& resource_description, const ListOptions& options, const string& resource_version, int timeout_seconds, const std::function<bool(json& event)>& on_event ) const;
+
+            /* Parses and plans a query once. The result is cached (LRU) by the query text.*/
+            std::shared_ptr<const PreparedQuery> prepareQuery( const string& query_str ) const;
+
 
             json createGenericResource( const ResourceDescription& resource_description, const json& resource ) const;
             json deleteGenericResource( const ResourceDescription& resource_description, const json& resource ) const;
             json getGenericResource( const ResourceDescription& resource_description ) const;
             json getGenericResources( const ResourceDescription& resource_description ) const;
+            json getGenericResources( const ResourceDescription& resource_description, const ListOptions& options ) const;   // options.metadata_only lists PartialObjectMetadata
+
+            /* Lists as a server-side Table ( meta.k8s.io/v1 ): the printed columns and each row's metadata instead of full objects. Pages are merged.*/
+            json getResourceTable( const ResourceDescription& resource_description, const ListOptions& options = ListOptions() ) const;
+
+            /* The same, handing each page's Table to on_page as it arrives ( see TableWriter ), so only one page is held in memory.*/
+            void streamResourceTable( const ResourceDescription& resource_description, const ListOptions& options, const std::function<void(json& page)>& on_page ) const;
 
-            //doesn't work yet; needs this fix applied in the c client:
+            //works
             json replaceGenericResource( const ResourceDescription& resource_description, const json& resource ) const;
 
             //works
@@ -74,7 +163,84 @@ namespace kubepp{
             /* Deletes a single resource. Accepts an object. Returns the json response. Prefer using deleteResources instead of this method.*/
             json deleteResource( const json& resource ) const;
             
-            std::shared_ptr<genericClient_t> createGenericClient( const ResourceDescription& resource_description ) const;
+            json executePlan( const Query& query, const QueryPlan& plan, QueryStats& stats ) const;
+            json explainPlan( const QueryPlan& plan ) const;
+            json runPlan( const QueryPlan& plan ) const;
+            void runPlan( const QueryPlan& plan, const std::function<void(json&)>& on_resource ) const;
+            void listPlanTarget( const QueryPlan& plan, ResourceDescription resource_description, const std::function<void(json&)>& on_resource ) const;
+
+            void watchTarget( apiClient_t* client, ContinuousQuery& continuous_query, ResourceDescription resource_description, const std::function<void(const vector<json>&)>& deliver, std::atomic<bool>& stopped ) const;
+
+            /* Calls the apiserver directly, for requests that the generic client can't express (eg. query parameters).*/
+            json invokeApi( const string& method, const string& path, const vector<pair<string, string>>& query_parameters = {}, const string& accept = "application/json" ) const;
+            json invokeApi( apiClient_t* client, const string& method, const string& path, const vector<pair<string, string>>& query_parameters = {}, const string& accept = "application/json" ) const;
+            json invokeApiOnce( apiClient_t* client, const string& method, const string& path, const vector<pair<string, string>>& query_parameters, const string& accept, const string& body = "", const string& content_type = "application/json" ) const;
+
+            // single attempts of the generic client calls; the public methods retry them
+            json createGenericResourceOnce( const ResourceDescription& resource_description, const json& resource ) const;
+            json deleteGenericResourceOnce( const ResourceDescription& resource_description, const json& resource ) const;
+            json getGenericResourceOnce( const ResourceDescription& resource_description ) const;
+            json getGenericResourcesOnce( const ResourceDescription& resource_description ) const;
+            json replaceGenericResourceOnce( const ResourceDescription& resource_description, const json& resource ) const;
+            json patchGenericResourceOnce( const ResourceDescription& resource_description, const json& patch ) const;
+
+            /* Sends until the response isn't worth retrying, the retries or the query's retry budget are spent; returns the last response.*/
+            json sendWithRetries( const apiClient_t* client, ClientMetrics::Verb verb, const string& resource, RetryPolicy::Idempotency idempotency, const std::function<json()>& send ) const;
+
+            /* Sends the request on the thread's HttpSession; the response is left in client->dataReceived for the caller to consume.*/
+            void callApi( apiClient_t* client, const string& method, const string& path, const vector<pair<string, string>>& query_parameters, const string& accept = "application/json", const string& body = "", const string& content_type = "application/json" ) const;
+
+            /* A new apiClient_t on the loaded kubeconfig; each thread that makes requests needs its own.*/
+            std::shared_ptr<apiClient_t> createApiClient() const;
+
+            string urlEncode( const string& value ) const;
+            vector<pair<string, string>> getListQueryParameters( const ListOptions& options ) const;
+
+            /* The Accept header for a list or watch: PartialObjectMetadata for metadata-only options, then protobuf where supported, then json.*/
+            string getListAccept( const ResourceDescription& resource_description, const ListOptions& options, bool watch = false ) const;
+
+            mutable QueryCache query_cache;
+
+            size_t page_size = 500;
+            bool protobuf_enabled = true;
+
+            /* The stats of the EXPLAIN ANALYZE query this client is running on the calling thread, or null.*/
+            QueryStats* getQueryStats() const;
+
+            /* Records one api call in the query, client and process stats.*/
+            void recordRequest( const string& method, const string& path, long status_code, size_t bytes, double fetch_ms, double parse_ms, double convert_ms ) const;
+
+            /* Waits for the rate limiter and records the time throttled in the query, client and process stats.*/
+            void throttle() const;
+
+            std::shared_ptr<RateLimiter> rate_limiter = KubernetesClient::getRateLimiter();
+            RateLimiter::Priority priority = RateLimiter::Priority::INTERACTIVE;
+
+            /* Records a retry in the query, client and process stats.*/
+            void recordRetry() const;
+
+            /* Records the connections a request opened in the query, client and process stats.*/
+            void recordConnections( const HttpSession::Transfer& transfer ) const;
+
+            RetryPolicy retry_policy = KubernetesClient::getDefaultRetryPolicy();
+
+            /* The retry budget of the query this client is running on the calling thread, or null.*/
+            RetryBudget* getRetryBudget() const;
+
+            /* Where the streamQuery running on the calling thread collects the kinds it couldn't list completely, or null.*/
+            vector<ResourceDescription>* getIncompleteLists() const;
+
+            /* Records a query's allocations per subsystem in the query, client and process stats; only in allocation-tracking builds.*/
+            void recordAllocations( const string& query_str, const AllocationTracker::Snapshot& allocated, QueryStats& stats ) const;
+
+            mutable QueryStats client_stats;
+            mutable std::mutex stats_mutex;
+
+            // per-request entries kept by the client and process stats; the totals are always complete
+            static constexpr size_t max_recorded_requests = 10000;
+
+            // times a list is started over after its continue token expired, before its results are left partial
+            static constexpr size_t max_list_restarts = 3;
 
 
             std::shared_ptr<apiClient_t> api_client;
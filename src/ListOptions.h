@@ -0,0 +1,32 @@
+#pragma once
+
+
+#include <string>
+using std::string;
+
+
+namespace kubepp{
+
+
+    /* Optional parameters for listing a collection. Empty fields are not sent. */
+    class ListOptions{
+
+        public:
+            string label_selector;
+            string field_selector;
+
+            // pagination; a limit of 0 lists everything in one response
+            size_t limit = 0;
+            string continue_token;
+
+            // request PartialObjectMetadataList: only apiVersion, kind and metadata of each item
+            bool metadata_only = false;
+
+            bool empty() const{
+                return this->label_selector.empty() && this->field_selector.empty() && this->limit == 0 && this->continue_token.empty() && !this->metadata_only;
+            }
+
+    };
+
+
+}
@@ -0,0 +1,150 @@
+#include "MetricsServer.h"
+
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+
+namespace kubepp{
+
+
+    MetricsServer::MetricsServer( const ClientMetrics& metrics, int port, const string& address )
+        :metrics(metrics)
+    {
+
+        this->listen_fd = ::socket( AF_INET, SOCK_STREAM, 0 );
+        if( this->listen_fd < 0 ){
+            throw std::runtime_error( string("Cannot create the metrics socket: ") + std::strerror(errno) );
+        }
+
+        const int enable = 1;
+        ::setsockopt( this->listen_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable) );
+
+        sockaddr_in socket_address{};
+        socket_address.sin_family = AF_INET;
+        socket_address.sin_port = htons( static_cast<uint16_t>(port) );
+        if( ::inet_pton(AF_INET, address.c_str(), &socket_address.sin_addr) != 1 ){
+            ::close(this->listen_fd);
+            throw std::runtime_error( "Invalid metrics address '" + address + "'." );
+        }
+
+        if( ::bind(this->listen_fd, reinterpret_cast<sockaddr*>(&socket_address), sizeof(socket_address)) != 0 || ::listen(this->listen_fd, 16) != 0 ){
+            const string error = std::strerror(errno);
+            ::close(this->listen_fd);
+            throw std::runtime_error( "Cannot serve metrics on " + address + ":" + std::to_string(port) + ": " + error );
+        }
+
+        socklen_t address_length = sizeof(socket_address);
+        ::getsockname( this->listen_fd, reinterpret_cast<sockaddr*>(&socket_address), &address_length );
+        this->port = ntohs(socket_address.sin_port);
+
+        this->server_thread = std::thread( &MetricsServer::serve, this );
+
+    }
+
+
+
+    MetricsServer::~MetricsServer(){
+
+        this->stopping = true;
+
+        // wakes accept()
+        ::shutdown( this->listen_fd, SHUT_RDWR );
+        if( this->server_thread.joinable() ){
+            this->server_thread.join();
+        }
+        ::close( this->listen_fd );
+
+    }
+
+
+
+    int MetricsServer::getPort() const{
+
+        return this->port;
+
+    }
+
+
+
+    void MetricsServer::serve(){
+
+        while( !this->stopping ){
+
+            const int fd = ::accept( this->listen_fd, nullptr, nullptr );
+            if( fd < 0 ){
+                if( errno == EINTR ){
+                    continue;
+                }
+                return;
+            }
+
+            // scrapes are rare and small; one at a time, and a stalled client can't hold the thread for long
+            timeval timeout{ 5, 0 };
+            ::setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout) );
+            ::setsockopt( fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout) );
+
+            this->respond(fd);
+            ::close(fd);
+
+        }
+
+    }
+
+
+
+    void MetricsServer::respond( int fd ) const{
+
+        string request;
+        char buffer[4096];
+
+        while( request.find("\r\n\r\n") == string::npos && request.size() < 65536 ){
+            const ssize_t received = ::recv( fd, buffer, sizeof(buffer), 0 );
+            if( received <= 0 ){
+                return;
+            }
+            request.append( buffer, received );
+        }
+
+        const string request_line = request.substr( 0, request.find("\r\n") );
+
+        string status = "200 OK";
+        string content_type = "text/plain; version=0.0.4; charset=utf-8";
+        string body;
+
+        if( request_line.rfind("GET /metrics ", 0) == 0 || request_line.rfind("GET /metrics?", 0) == 0 ){
+            body = this->metrics.toPrometheus();
+        }else if( request_line.rfind("GET ", 0) == 0 ){
+            status = "404 Not Found";
+            content_type = "text/plain; charset=utf-8";
+            body = "Metrics are served at /metrics.\n";
+        }else{
+            status = "405 Method Not Allowed";
+            content_type = "text/plain; charset=utf-8";
+        }
+
+        const string response = "HTTP/1.1 " + status + "\r\n"
+                                "Content-Type: " + content_type + "\r\n"
+                                "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                                "Connection: close\r\n"
+                                "\r\n" + body;
+
+        size_t sent = 0;
+        while( sent < response.size() ){
+            const ssize_t written = ::send( fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL );
+            if( written <= 0 ){
+                return;
+            }
+            sent += written;
+        }
+
+    }
+
+
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+
+#include <string>
+using std::string;
+
+#include <thread>
+#include <atomic>
+
+#include "ClientMetrics.h"
+
+
+namespace kubepp{
+
+
+    /*
+        Serves ClientMetrics in the Prometheus text format at GET /metrics, on a background thread, until destroyed.
+        Binds to 127.0.0.1 by default; port 0 picks a free port ( see getPort ).
+    */
+    class MetricsServer{
+
+        public:
+            MetricsServer( const ClientMetrics& metrics, int port, const string& address = "127.0.0.1" );
+            ~MetricsServer();
+
+            MetricsServer( const MetricsServer& ) = delete;
+            MetricsServer& operator=( const MetricsServer& ) = delete;
+
+            int getPort() const;
+
+
+        protected:
+            void serve();
+            void respond( int fd ) const;
+
+            const ClientMetrics& metrics;
+            int listen_fd = -1;
+            int port = 0;
+            std::atomic<bool> stopping{false};
+            std::thread server_thread;
+
+    };
+
+
+}
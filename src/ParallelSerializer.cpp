@@ -0,0 +1,151 @@
+#include "ParallelSerializer.h"
+
+#include <vector>
+using std::vector;
+
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <algorithm>
+
+#include "json.hpp"
+using json = nlohmann::json;
+
+#include "Tracer.h"
+
+
+namespace kubepp{
+
+
+    void ParallelSerializer::write( const json& value, std::ostream& output, int indent, size_t thread_count ){
+
+        Tracer::Span span( "serialize", "output" );
+        span.setArg( "elements", static_cast<double>( value.is_array() ? value.size() : 1 ) );
+
+        if( !value.is_array() || value.size() < ParallelSerializer::min_parallel_size ){
+            output << value.dump(indent);
+            return;
+        }
+
+        if( thread_count == 0 ){
+            thread_count = std::max( 1u, std::thread::hardware_concurrency() );
+        }
+
+        const size_t element_count = value.size();
+        const size_t shard_count = ( element_count + ParallelSerializer::shard_size - 1 ) / ParallelSerializer::shard_size;
+        thread_count = std::min( thread_count, shard_count );
+
+        if( thread_count == 1 ){
+            output << value.dump(indent);
+            return;
+        }
+
+        // "[\n" + elements joined by ",\n" + "\n]" when pretty, "[" + elements joined by "," + "]" when compact
+        const string separator = ( indent < 0 ) ? "," : ",\n";
+
+        vector<string> shards( shard_count );
+        vector<bool> ready( shard_count, false );
+        std::atomic<size_t> next_shard{0};
+        std::exception_ptr error;
+        std::mutex mutex;
+        std::condition_variable shard_ready;
+
+        auto worker = [&](){
+            try{
+                while( true ){
+
+                    const size_t shard = next_shard++;
+                    if( shard >= shard_count ){
+                        return;
+                    }
+
+                    const size_t begin = shard * ParallelSerializer::shard_size;
+                    const size_t end = std::min( begin + ParallelSerializer::shard_size, element_count );
+
+                    Tracer::Span shard_span( "serialize shard", "output" );
+
+                    // the serializer behind json::dump, told that each element is one level deep
+                    string buffer;
+                    nlohmann::detail::serializer<json> serializer( nlohmann::detail::output_adapter<char, string>(buffer), ' ', json::error_handler_t::strict );
+
+                    for( size_t position = begin; position < end; position++ ){
+                        if( position > 0 ){
+                            buffer += separator;
+                        }
+                        if( indent < 0 ){
+                            serializer.dump( value[position], false, false, 0 );
+                        }else{
+                            buffer.append( indent, ' ' );
+                            serializer.dump( value[position], true, false, indent, indent );
+                        }
+                    }
+
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        shards[shard] = std::move(buffer);
+                        ready[shard] = true;
+                    }
+                    shard_ready.notify_all();
+
+                }
+            }catch( ... ){
+                std::lock_guard<std::mutex> lock(mutex);
+                if( !error ){
+                    error = std::current_exception();
+                }
+                // stop the other workers and wake the writer
+                next_shard = shard_count;
+                shard_ready.notify_all();
+            }
+        };
+
+        vector<std::thread> workers;
+        for( size_t i = 0; i < thread_count; i++ ){
+            workers.emplace_back(worker);
+        }
+
+        output << ( indent < 0 ? "[" : "[\n" );
+
+        for( size_t shard = 0; shard < shard_count; shard++ ){
+
+            string buffer;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                shard_ready.wait( lock, [&]{ return ready[shard] || error; } );
+                if( error ){
+                    break;
+                }
+                buffer = std::move(shards[shard]);
+            }
+
+            output.write( buffer.data(), buffer.size() );
+
+        }
+
+        for( auto& worker_thread : workers ){
+            worker_thread.join();
+        }
+
+        if( error ){
+            std::rethrow_exception(error);
+        }
+
+        output << ( indent < 0 ? "]" : "\n]" );
+
+    }
+
+
+
+    string ParallelSerializer::dump( const json& value, int indent, size_t thread_count ){
+
+        std::ostringstream output;
+        ParallelSerializer::write( value, output, indent, thread_count );
+        return output.str();
+
+    }
+
+
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+
+#include <string>
+using std::string;
+
+#include <ostream>
+
+#include "json_fwd.hpp"
+using json = nlohmann::json;
+
+
+namespace kubepp{
+
+
+    /*
+        Serializes large json arrays on several threads.
+
+        The array is cut into contiguous shards, each shard is formatted into its own buffer by a worker thread,
+        and the buffers are written in order as soon as they're ready. The output is byte for byte what
+        json::dump( indent ) produces. Anything that isn't a large array is dumped on the calling thread.
+    */
+    class ParallelSerializer{
+
+        public:
+            /* indent -1 is compact output; thread_count 0 uses every hardware thread. */
+            static void write( const json& value, std::ostream& output, int indent = -1, size_t thread_count = 0 );
+            static string dump( const json& value, int indent = -1, size_t thread_count = 0 );
+
+            // arrays smaller than this aren't worth the threads
+            static constexpr size_t min_parallel_size = 1024;
+
+            // elements per shard; small enough to balance the threads, large enough to amortize the hand-off
+            static constexpr size_t shard_size = 512;
+
+    };
+
+
+}
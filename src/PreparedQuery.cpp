@@ -0,0 +1,24 @@
+#include "PreparedQuery.h"
+
+
+namespace kubepp{
+
+
+    PreparedQuery::PreparedQuery( const string& query_str )
+        :query_str(query_str), query(query_str), plan(query)
+    {
+
+    }
+
+
+
+    QueryPlan PreparedQuery::bind( const vector<string>& parameters ) const{
+
+        QueryPlan bound_plan = this->plan;
+        bound_plan.bind(parameters);
+        return bound_plan;
+
+    }
+
+
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+
+#include <string>
+using std::string;
+
+#include <vector>
+using std::vector;
+
+#include "Query.h"
+#include "QueryPlan.h"
+
+
+namespace kubepp{
+
+
+    /*
+        A query that has been parsed and planned once.
+        Use '?' placeholders in the WHERE clause ( eg. "SELECT * FROM Pod WHERE metadata.namespace = ?" ) and bind the values per execution.
+    */
+    class PreparedQuery{
+
+        public:
+            PreparedQuery( const string& query_str );
+
+            /* Returns a copy of the plan with the placeholders filled in. */
+            QueryPlan bind( const vector<string>& parameters = {} ) const;
+
+            const string query_str;
+            const Query query;
+            const QueryPlan plan;
+
+    };
+
+
+}
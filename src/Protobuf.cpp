@@ -0,0 +1,634 @@
+#include "Protobuf.h"
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+
+#include "json.hpp"
+using json = nlohmann::json;
+
+
+namespace kubepp{
+
+
+    ProtobufReader::ProtobufReader( const uint8_t* data, size_t size )
+        :position(data), end(data + size)
+    {
+
+    }
+
+
+
+    ProtobufReader::ProtobufReader( string_view data )
+        :ProtobufReader( reinterpret_cast<const uint8_t*>(data.data()), data.size() )
+    {
+
+    }
+
+
+
+    bool ProtobufReader::next(){
+
+        if( this->position >= this->end ){
+            return false;
+        }
+
+        const uint64_t tag = this->readVarint();
+        this->field_number = static_cast<uint32_t>( tag >> 3 );
+        this->wire_type = static_cast<WireType>( tag & 0x7 );
+
+        return true;
+
+    }
+
+
+
+    uint32_t ProtobufReader::getFieldNumber() const{
+
+        return this->field_number;
+
+    }
+
+
+
+    ProtobufReader::WireType ProtobufReader::getWireType() const{
+
+        return this->wire_type;
+
+    }
+
+
+
+    uint64_t ProtobufReader::readVarint(){
+
+        uint64_t value = 0;
+
+        for( int shift = 0; shift < 64; shift += 7 ){
+            if( this->position >= this->end ){
+                throw std::runtime_error("Truncated protobuf varint.");
+            }
+            const uint8_t byte = *this->position++;
+            value |= static_cast<uint64_t>( byte & 0x7f ) << shift;
+            if( !(byte & 0x80) ){
+                return value;
+            }
+        }
+
+        throw std::runtime_error("Invalid protobuf varint.");
+
+    }
+
+
+
+    string_view ProtobufReader::readBytes(){
+
+        const uint64_t size = this->readVarint();
+
+        if( size > static_cast<uint64_t>( this->end - this->position ) ){
+            throw std::runtime_error("Truncated protobuf field.");
+        }
+
+        string_view bytes( reinterpret_cast<const char*>(this->position), size );
+        this->position += size;
+        return bytes;
+
+    }
+
+
+
+    void ProtobufReader::skip(){
+
+        size_t size = 0;
+
+        switch( this->wire_type ){
+            case VARINT:
+                this->readVarint();
+                return;
+            case LENGTH_DELIMITED:
+                this->readBytes();
+                return;
+            case FIXED64:
+                size = 8;
+                break;
+            case FIXED32:
+                size = 4;
+                break;
+            default:
+                throw std::runtime_error("Unsupported protobuf wire type " + std::to_string(this->wire_type) + ".");
+        }
+
+        if( size > static_cast<size_t>( this->end - this->position ) ){
+            throw std::runtime_error("Truncated protobuf field.");
+        }
+        this->position += size;
+
+    }
+
+
+
+    namespace{
+
+        using Field = ProtobufDecoder::Field;
+        using Type = ProtobufDecoder::Field::Type;
+        using WireType = ProtobufReader::WireType;
+
+        // the helpers the generated schemas are written with
+
+        Field field( const string& name, Type type = Type::STRING ){
+            Field f;
+            f.name = name;
+            f.type = type;
+            return f;
+        }
+
+        Field repeated( const string& name, Type type = Type::STRING ){
+            Field f = field(name, type);
+            f.repeated = true;
+            return f;
+        }
+
+        Field message( const string& name, const string& message_name, bool is_repeated = false ){
+            Field f = field(name, Type::MESSAGE);
+            f.message = message_name;
+            f.repeated = is_repeated;
+            return f;
+        }
+
+        Field messageMap( const string& name, const string& message_name ){
+            Field f = field(name, Type::MESSAGE_MAP);
+            f.message = message_name;
+            return f;
+        }
+
+        Field keepZero( Field f ){
+            f.omit_empty = false;
+            return f;
+        }
+
+        Field embedded( Field f ){
+            f.embedded = true;
+            return f;
+        }
+
+
+        void expectWireType( const ProtobufReader& reader, WireType wire_type, const string& what ){
+            if( reader.getWireType() != wire_type ){
+                throw std::runtime_error("Protobuf field " + std::to_string( reader.getFieldNumber() ) + " of " + what + " has wire type " + std::to_string( reader.getWireType() ) + ", expected " + std::to_string(wire_type) + ".");
+            }
+        }
+
+        // resource.Quantity { string = 1 }, which is a string in json
+        string readQuantity( string_view data ){
+            string quantity;
+            ProtobufReader reader(data);
+            while( reader.next() ){
+                if( reader.getFieldNumber() == 1 ){
+                    expectWireType( reader, WireType::LENGTH_DELIMITED, "resource.Quantity" );
+                    quantity = string( reader.readBytes() );
+                }else{
+                    reader.skip();
+                }
+            }
+            return quantity;
+        }
+
+        // the digits of a fraction, without trailing zeros ( "5" for 500 of 1000 )
+        string formatFraction( uint64_t fraction, int digits ){
+            string text = std::to_string(fraction);
+            text.insert( 0, digits - text.size(), '0' );
+            text.erase( text.find_last_not_of('0') + 1 );
+            return text.empty() ? "" : "." + text;
+        }
+
+    }
+
+
+
+    const map<string, ProtobufDecoder::Schema>& ProtobufDecoder::getSchemas(){
+
+        static const map<string, Schema> schemas = [](){
+
+            // generated from the generated.proto files of k8s.io/apimachinery and k8s.io/api
+            map<string, Schema> schemas = {
+                #include "ProtobufSchemas.inc"
+            };
+
+            // errors come back as a Status in the negotiated encoding
+            schemas["v1.Status"] = schemas.at("meta.Status");
+
+            return schemas;
+
+        }();
+
+        return schemas;
+
+    }
+
+
+
+    bool ProtobufDecoder::isProtobuf( const void* data, size_t size ){
+
+        return data && size >= sizeof(ProtobufDecoder::magic) && std::memcmp( data, ProtobufDecoder::magic, sizeof(ProtobufDecoder::magic) ) == 0;
+
+    }
+
+
+
+    bool ProtobufDecoder::isSupported( const ResourceDescription& resource_description ){
+
+        const string message = resource_description.api_group_version + "." + resource_description.kind;
+        const auto& schemas = ProtobufDecoder::getSchemas();
+
+        return schemas.count(message) && schemas.count(message + "List");
+
+    }
+
+
+
+    json ProtobufDecoder::decode( const void* data, size_t size ){
+
+        if( !ProtobufDecoder::isProtobuf(data, size) ){
+            throw std::runtime_error("The response is not a kubernetes protobuf message.");
+        }
+
+        const size_t magic_size = sizeof(ProtobufDecoder::magic);
+        ProtobufReader envelope( static_cast<const uint8_t*>(data) + magic_size, size - magic_size );
+
+        // runtime.Unknown
+        string api_version;
+        string kind;
+        string_view raw;
+        string content_encoding;
+
+        while( envelope.next() ){
+            switch( envelope.getFieldNumber() ){
+                case 1: {
+                    expectWireType( envelope, WireType::LENGTH_DELIMITED, "runtime.Unknown" );
+                    ProtobufReader type_meta( envelope.readBytes() );
+                    while( type_meta.next() ){
+                        if( type_meta.getFieldNumber() == 1 || type_meta.getFieldNumber() == 2 ){
+                            expectWireType( type_meta, WireType::LENGTH_DELIMITED, "runtime.TypeMeta" );
+                            ( type_meta.getFieldNumber() == 1 ? api_version : kind ) = string( type_meta.readBytes() );
+                        }else{
+                            type_meta.skip();
+                        }
+                    }
+                    break;
+                }
+                case 2:
+                    expectWireType( envelope, WireType::LENGTH_DELIMITED, "runtime.Unknown" );
+                    raw = envelope.readBytes();
+                    break;
+                case 3:
+                    expectWireType( envelope, WireType::LENGTH_DELIMITED, "runtime.Unknown" );
+                    content_encoding = string( envelope.readBytes() );
+                    break;
+                default:
+                    envelope.skip();
+            }
+        }
+
+        if( !content_encoding.empty() ){
+            throw std::runtime_error("Unsupported protobuf content encoding '" + content_encoding + "'.");
+        }
+
+        json object = ProtobufDecoder::decodeMessage( raw, api_version + "." + kind );
+        object["apiVersion"] = api_version;
+        object["kind"] = kind;
+
+        return object;
+
+    }
+
+
+
+    json ProtobufDecoder::decodeMessage( string_view data, const string& message ){
+
+        const auto& schemas = ProtobufDecoder::getSchemas();
+        auto schema_it = schemas.find(message);
+
+        if( schema_it == schemas.end() ){
+            throw std::runtime_error("No protobuf schema for " + message + ".");
+        }
+
+        const Schema& schema = schema_it->second;
+        json object = json::object();
+
+        ProtobufReader reader(data);
+
+        while( reader.next() ){
+
+            auto field_it = schema.find( reader.getFieldNumber() );
+            if( field_it == schema.end() ){
+                reader.skip();
+                continue;
+            }
+
+            const Field& field = field_it->second;
+
+            // a mismatch means the schema and the apiserver disagree about the field; reading it anyway would misread the rest
+            expectWireType( reader, ProtobufDecoder::getWireType(field), message + " ( " + field.name + " )" );
+
+            if( field.type == Type::STRING_MAP || field.type == Type::BYTES_MAP || field.type == Type::QUANTITY_MAP || field.type == Type::MESSAGE_MAP ){
+                ProtobufDecoder::decodeMapEntry( reader.readBytes(), field, object[field.name] );
+                continue;
+            }
+
+            json value = ProtobufDecoder::decodeField( reader, field );
+
+            if( field.embedded ){
+                for( auto& [key, embedded_value] : value.items() ){
+                    object[key] = std::move(embedded_value);
+                }
+            }else if( field.repeated ){
+                object[field.name].push_back( std::move(value) );
+            }else if( !value.is_null() || field.type == Type::TIME || field.type == Type::MICRO_TIME ){
+                // a zero metav1.Time is written as an empty message, and is null in json ( eg. a pod template's creationTimestamp )
+                object[field.name] = std::move(value);
+            }
+
+        }
+
+        return object;
+
+    }
+
+
+
+    json ProtobufDecoder::decodeField( ProtobufReader& reader, const Field& field ){
+
+        // zero values of omitempty fields return null, so they're left out like in json
+        switch( field.type ){
+
+            case Type::STRING: {
+                string_view value = reader.readBytes();
+                if( value.empty() && !field.repeated && field.omit_empty ){
+                    return json();
+                }
+                return string(value);
+            }
+
+            case Type::BYTES: {
+                string_view value = reader.readBytes();
+                if( value.empty() && field.omit_empty ){
+                    return json();
+                }
+                return ProtobufDecoder::base64Encode(value);
+            }
+
+            case Type::BOOL: {
+                // like every non-pointer field, omitempty bools are written even when false ( hostNetwork )
+                const bool value = reader.readVarint() != 0;
+                return ( !value && field.omit_empty ) ? json() : json(value);
+            }
+
+            case Type::INT32: {
+                const int32_t value = static_cast<int32_t>( static_cast<int64_t>( reader.readVarint() ) );
+                return ( value == 0 && field.omit_empty ) ? json() : json(value);
+            }
+
+            case Type::INT64: {
+                const int64_t value = static_cast<int64_t>( reader.readVarint() );
+                return ( value == 0 && field.omit_empty ) ? json() : json(value);
+            }
+
+            case Type::MESSAGE:
+                return ProtobufDecoder::decodeMessage( reader.readBytes(), field.message );
+
+            case Type::TIME:
+            case Type::MICRO_TIME: {
+                const string time = ProtobufDecoder::formatTime( reader.readBytes(), field.type == Type::MICRO_TIME );
+                return time.empty() ? json() : json(time);
+            }
+
+            case Type::DURATION:
+                return ProtobufDecoder::formatDuration( reader.readBytes() );
+
+            case Type::QUANTITY: {
+                const string quantity = readQuantity( reader.readBytes() );
+                return quantity.empty() ? json() : json(quantity);
+            }
+
+            case Type::INT_OR_STRING: {
+                // intstr.IntOrString { type = 1 ( 0 int, 1 string ), intVal = 2, strVal = 3 }; 0 is a meaningful int ( eg. maxUnavailable )
+                int64_t type = 0;
+                int32_t int_value = 0;
+                string string_value;
+                ProtobufReader int_or_string( reader.readBytes() );
+                while( int_or_string.next() ){
+                    switch( int_or_string.getFieldNumber() ){
+                        case 1:
+                            expectWireType( int_or_string, WireType::VARINT, "intstr.IntOrString" );
+                            type = static_cast<int64_t>( int_or_string.readVarint() );
+                            break;
+                        case 2:
+                            expectWireType( int_or_string, WireType::VARINT, "intstr.IntOrString" );
+                            int_value = static_cast<int32_t>( static_cast<int64_t>( int_or_string.readVarint() ) );
+                            break;
+                        case 3:
+                            expectWireType( int_or_string, WireType::LENGTH_DELIMITED, "intstr.IntOrString" );
+                            string_value = string( int_or_string.readBytes() );
+                            break;
+                        default:
+                            int_or_string.skip();
+                    }
+                }
+                return type == 1 ? json(string_value) : json(int_value);
+            }
+
+            case Type::RAW_JSON: {
+                // FieldsV1 and RawExtension: { raw = 1 } holding json
+                ProtobufReader raw_message( reader.readBytes() );
+                while( raw_message.next() ){
+                    if( raw_message.getFieldNumber() == 1 ){
+                        expectWireType( raw_message, WireType::LENGTH_DELIMITED, "runtime.RawExtension" );
+                        string_view raw = raw_message.readBytes();
+                        return json::parse( raw.begin(), raw.end() );
+                    }
+                    raw_message.skip();
+                }
+                return json();
+            }
+
+            default:
+                reader.skip();
+                return json();
+
+        }
+
+    }
+
+
+
+    void ProtobufDecoder::decodeMapEntry( string_view data, const Field& field, json& object ){
+
+        // each map entry is a message { key = 1, value = 2 }
+        ProtobufReader entry(data);
+        string key;
+        string_view value;
+
+        while( entry.next() ){
+            if( entry.getFieldNumber() == 1 || entry.getFieldNumber() == 2 ){
+                expectWireType( entry, WireType::LENGTH_DELIMITED, "the map entry " + field.name );
+                if( entry.getFieldNumber() == 1 ){
+                    key = string( entry.readBytes() );
+                }else{
+                    value = entry.readBytes();
+                }
+            }else{
+                entry.skip();
+            }
+        }
+
+        switch( field.type ){
+            case Type::BYTES_MAP:
+                object[key] = ProtobufDecoder::base64Encode(value);
+                break;
+            case Type::QUANTITY_MAP:
+                object[key] = readQuantity(value);
+                break;
+            case Type::MESSAGE_MAP:
+                object[key] = ProtobufDecoder::decodeMessage( value, field.message );
+                break;
+            default:
+                object[key] = string(value);
+        }
+
+    }
+
+
+
+    ProtobufReader::WireType ProtobufDecoder::getWireType( const Field& field ){
+
+        switch( field.type ){
+            case Type::BOOL:
+            case Type::INT32:
+            case Type::INT64:
+                return WireType::VARINT;
+            default:
+                return WireType::LENGTH_DELIMITED;
+        }
+
+    }
+
+
+
+    string ProtobufDecoder::formatTime( string_view data, bool micro ){
+
+        // meta.Time and meta.MicroTime { seconds = 1, nanos = 2 }; Time's json carries second precision, MicroTime's microseconds
+        int64_t seconds = 0;
+        int64_t nanos = 0;
+
+        ProtobufReader reader(data);
+        while( reader.next() ){
+            if( reader.getFieldNumber() == 1 || reader.getFieldNumber() == 2 ){
+                expectWireType( reader, WireType::VARINT, "meta.Time" );
+                ( reader.getFieldNumber() == 1 ? seconds : nanos ) = static_cast<int64_t>( reader.readVarint() );
+            }else{
+                reader.skip();
+            }
+        }
+
+        if( seconds == 0 && nanos == 0 ){
+            return "";
+        }
+
+        const std::time_t time = static_cast<std::time_t>(seconds);
+        std::tm utc{};
+        gmtime_r( &time, &utc );
+
+        char buffer[40];
+        const size_t size = std::strftime( buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &utc );
+        if( micro ){
+            std::snprintf( buffer + size, sizeof(buffer) - size, ".%06dZ", static_cast<int>( nanos / 1000 ) );
+        }else{
+            std::snprintf( buffer + size, sizeof(buffer) - size, "Z" );
+        }
+        return buffer;
+
+    }
+
+
+
+    string ProtobufDecoder::formatDuration( string_view data ){
+
+        // meta.Duration { duration = 1 } in nanoseconds, in json as Go formats a time.Duration ( "1h0m0s", "1.5s", "250ms" )
+        int64_t nanoseconds = 0;
+
+        ProtobufReader reader(data);
+        while( reader.next() ){
+            if( reader.getFieldNumber() == 1 ){
+                expectWireType( reader, WireType::VARINT, "meta.Duration" );
+                nanoseconds = static_cast<int64_t>( reader.readVarint() );
+            }else{
+                reader.skip();
+            }
+        }
+
+        if( nanoseconds == 0 ){
+            return "0s";
+        }
+
+        string text = nanoseconds < 0 ? "-" : "";
+        const uint64_t value = nanoseconds < 0 ? 0 - static_cast<uint64_t>(nanoseconds) : static_cast<uint64_t>(nanoseconds);
+
+        if( value < 1000 ){
+            return text + std::to_string(value) + "ns";
+        }
+        if( value < 1000000 ){
+            return text + std::to_string(value / 1000) + formatFraction( value % 1000, 3 ) + "µs";
+        }
+        if( value < 1000000000 ){
+            return text + std::to_string(value / 1000000) + formatFraction( value % 1000000, 6 ) + "ms";
+        }
+
+        const uint64_t hours = value / 3600000000000ULL;
+        const uint64_t minutes = value / 60000000000ULL % 60;
+        const uint64_t seconds_ns = value % 60000000000ULL;
+
+        if( hours > 0 ){
+            text += std::to_string(hours) + "h";
+        }
+        if( hours > 0 || minutes > 0 ){
+            text += std::to_string(minutes) + "m";
+        }
+        return text + std::to_string(seconds_ns / 1000000000) + formatFraction( seconds_ns % 1000000000, 9 ) + "s";
+
+    }
+
+
+
+    string ProtobufDecoder::base64Encode( string_view data ){
+
+        static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+        string encoded;
+        encoded.reserve( ( data.size() + 2 ) / 3 * 4 );
+
+        size_t i = 0;
+        for( ; i + 2 < data.size(); i += 3 ){
+            const uint32_t chunk = ( static_cast<uint8_t>(data[i]) << 16 ) | ( static_cast<uint8_t>(data[i + 1]) << 8 ) | static_cast<uint8_t>(data[i + 2]);
+            encoded += alphabet[ (chunk >> 18) & 0x3f ];
+            encoded += alphabet[ (chunk >> 12) & 0x3f ];
+            encoded += alphabet[ (chunk >> 6) & 0x3f ];
+            encoded += alphabet[ chunk & 0x3f ];
+        }
+
+        if( i < data.size() ){
+            uint32_t chunk = static_cast<uint8_t>(data[i]) << 16;
+            if( i + 1 < data.size() ){
+                chunk |= static_cast<uint8_t>(data[i + 1]) << 8;
+            }
+            encoded += alphabet[ (chunk >> 18) & 0x3f ];
+            encoded += alphabet[ (chunk >> 12) & 0x3f ];
+            encoded += ( i + 1 < data.size() ) ? alphabet[ (chunk >> 6) & 0x3f ] : '=';
+            encoded += '=';
+        }
+
+        return encoded;
+
+    }
+
+
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+
+#include <string>
+using std::string;
+
+#include <string_view>
+using std::string_view;
+
+#include <vector>
+using std::vector;
+
+#include <map>
+using std::map;
+
+#include <cstdint>
+
+#include "json_fwd.hpp"
+using json = nlohmann::json;
+
+#include "ResourceDescription.h"
+
+
+namespace kubepp{
+
+
+    /* Reads protobuf wire format: a sequence of ( field number, wire type, value ). */
+    class ProtobufReader{
+
+        public:
+            enum WireType{ VARINT = 0, FIXED64 = 1, LENGTH_DELIMITED = 2, FIXED32 = 5 };
+
+            ProtobufReader( const uint8_t* data, size_t size );
+            ProtobufReader( string_view data );
+
+            /* Reads the next field's tag; false at the end of the message. */
+            bool next();
+
+            uint32_t getFieldNumber() const;
+            WireType getWireType() const;
+
+            uint64_t readVarint();
+            string_view readBytes();
+            void skip();
+
+
+        protected:
+            const uint8_t* position;
+            const uint8_t* end;
+            uint32_t field_number = 0;
+            WireType wire_type = VARINT;
+
+    };
+
+
+
+    /*
+        Decodes the apiserver's protobuf encoding ( application/vnd.kubernetes.protobuf ) into the same json the
+        apiserver would have sent.
+
+        A response is the 4 byte magic "k8s\0" followed by a runtime.Unknown envelope holding the apiVersion, the
+        kind and the encoded object. Decoding is driven by a table of message schemas ( field number, json name,
+        type ) generated from the upstream generated.proto files ( src/ProtobufSchemas.inc, tools/ProtobufSchemaGenerator.cpp ),
+        which covers the core/v1 and apps/v1 kinds; everything else, including CRDs, stays on json. The apiserver
+        writes every non-pointer field, so zero values of omitempty ( "+optional" ) fields are omitted, like its json;
+        set Go pointers ( eg. immutable: false ) are kept. A field whose wire type doesn't
+        match its schema fails the decode rather than being misread.
+    */
+    class ProtobufDecoder{
+
+        public:
+
+            class Field{
+                public:
+                    enum class Type{
+                        STRING, BYTES, BOOL, INT32, INT64, MESSAGE,
+                        STRING_MAP, BYTES_MAP, QUANTITY_MAP, MESSAGE_MAP,
+                        TIME, MICRO_TIME, DURATION, QUANTITY, INT_OR_STRING, RAW_JSON
+                    };
+
+                    string name;
+                    Type type = Type::STRING;
+                    bool repeated = false;
+                    string message;             // for MESSAGE and MESSAGE_MAP fields
+                    bool omit_empty = true;     // false for fields json always carries and for Go pointers, so their zero values are kept
+                    bool embedded = false;      // an inline Go struct: its fields are merged into the parent object
+            };
+
+            using Schema = map<uint32_t, Field>;
+
+            /* Whether a response starts with the protobuf magic; the apiserver may still answer in json. */
+            static bool isProtobuf( const void* data, size_t size );
+
+            /* Whether lists of this kind can be requested as protobuf. */
+            static bool isSupported( const ResourceDescription& resource_description );
+
+            /* Decodes a complete response ( magic and envelope ). Throws for kinds without a schema. */
+            static json decode( const void* data, size_t size );
+
+            /* Decodes one message with a registered schema ( eg. "v1.ConfigMap", "meta.ObjectMeta" ). */
+            static json decodeMessage( string_view data, const string& message );
+
+            static const map<string, Schema>& getSchemas();
+
+            static constexpr char magic[4] = { 'k', '8', 's', '\0' };
+
+
+        protected:
+            static json decodeField( ProtobufReader& reader, const Field& field );
+            static void decodeMapEntry( string_view data, const Field& field, json& object );
+            static ProtobufReader::WireType getWireType( const Field& field );
+            static string formatTime( string_view data, bool micro = false );
+            static string formatDuration( string_view data );
+            static string base64Encode( string_view data );
+
+    };
+
+
+}
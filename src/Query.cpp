@@ -1,6 +1,7 @@
 #include "Query.h"
 
-#include <sstream>
+#include <string_view>
+using std::string_view;
 
 #include "json.hpp"
 using json = nlohmann::json;
@@ -31,27 +32,36 @@ namespace kubepp{
 
         this->clear();
 
-        // split the query string into tokens
-        vector<string> tokens;
-        string token;
-        std::istringstream token_stream(query_str);
+        // split the query string into tokens; views into query_str, so only the tokens kept in a clause are copied
+        vector<string_view> tokens;
+        tokens.reserve(16);
+
+        // split the string by space or comma ( like getline: empty tokens between delimiters are kept, a trailing one isn't );
+        // quoted values ( 'foo bar', "a,b" ) stay in one token with their spaces and commas
+        const auto split = []( string_view str, char delimiter, auto&& on_token ){
+            size_t start = 0;
+            for( size_t i = Query::findUnquoted(str, delimiter); i != string_view::npos; i = Query::findUnquoted(str, delimiter, start) ){
+                on_token( str.substr(start, i - start) );
+                start = i + 1;
+            }
+            if( start < str.size() ){
+                on_token( str.substr(start) );
+            }
+        };
 
-        // split the string by space or comma
-        while( std::getline(token_stream, token, ' ') ){
+        split( query_str, ' ', [&]( string_view token ){
 
             // if has comma, split again
-            if( token.find(",") != string::npos ){
-                std::istringstream token_stream2(token);
-                string token2;
-                while( std::getline(token_stream2, token2, ',') ){
+            if( token.find(',') != string_view::npos ){
+                split( token, ',', [&]( string_view token2 ){
                     tokens.push_back(token2);
-                }
-                continue;
+                });
+                return;
             }
 
             tokens.push_back(token);
 
-        }
+        });
 
 
 
@@ -65,8 +75,16 @@ namespace kubepp{
         bool having_flag = false;
         bool order_by_flag = false;
 
-        for( auto& t : tokens ){
+        for( const string_view t : tokens ){
 
+            if( t == "EXPLAIN" || t == "explain" ){
+                this->explain = true;
+                continue;
+            }
+            if( (t == "ANALYZE" || t == "analyze") && this->explain && !select_flag && this->select.empty() ){
+                this->analyze = true;
+                continue;
+            }
             if( t == "SELECT" || t == "select" ){
                 select_flag = true;
                 continue;
@@ -97,32 +115,36 @@ namespace kubepp{
                 continue;
             }
             if( t == "LIMIT" || t == "limit" ){
+                // the limit's value isn't part of the clause before it
+                where_flag = false;
+                group_by_flag = false;
+                having_flag = false;
                 order_by_flag = false;
-                this->limit.push_back( tokens.back() );
+                this->limit.push_back( string(tokens.back()) );
                 continue;
             }
             if( t == "OFFSET" || t == "offset" ){
-                this->offset.push_back( tokens.back() );
+                this->offset.push_back( string(tokens.back()) );
                 continue;
             }
 
             if( select_flag ){
-                this->select.push_back(t);
+                this->select.emplace_back(t);
             }
             if( from_flag ){
-                this->from.push_back(t);
+                this->from.emplace_back(t);
             }
             if( where_flag ){
-                this->where.push_back(t);
+                this->where.emplace_back(t);
             }
             if( group_by_flag ){
-                this->group_by.push_back(t);
+                this->group_by.emplace_back(t);
             }
             if( having_flag ){
-                this->having.push_back(t);
+                this->having.emplace_back(t);
             }
             if( order_by_flag ){
-                this->order_by.push_back(t);
+                this->order_by.emplace_back(t);
             }
 
         }        
@@ -142,6 +164,8 @@ namespace kubepp{
         this->order_by.clear();
         this->limit.clear();
         this->offset.clear();
+        this->explain = false;
+        this->analyze = false;
 
     }
 
@@ -151,7 +175,13 @@ namespace kubepp{
 
         //put commas between the elements of the vectors; ensure that the last element does not have a comma after it
 
-        string query_str = "SELECT ";
+        string query_str = "";
+
+        if( this->explain ){
+            query_str += this->analyze ? "EXPLAIN ANALYZE " : "EXPLAIN ";
+        }
+
+        query_str += "SELECT ";
         query_str += this->implodeString(this->select, ", ");
 
         if( !this->from.empty() ){
@@ -206,12 +236,33 @@ namespace kubepp{
         query_json["order_by"] = this->order_by;
         query_json["limit"] = this->limit;
         query_json["offset"] = this->offset;
+        query_json["explain"] = this->explain;
+        query_json["analyze"] = this->analyze;
 
         return query_json;
 
     }
 
 
+    size_t Query::findUnquoted( string_view str, char c, size_t pos ){
+
+        char quote = 0;
+        for( size_t i = pos; i < str.size(); i++ ){
+            if( quote ){
+                if( str[i] == quote ){
+                    quote = 0;
+                }
+            }else if( str[i] == '\'' || str[i] == '"' ){
+                quote = str[i];
+            }else if( str[i] == c ){
+                return i;
+            }
+        }
+        return string_view::npos;
+
+    }
+
+
     string Query::implodeString( const vector<string>& vec, const string& delimiter ) const{
 
         string str = "";
@@ -7,6 +7,8 @@ using std::string;
 #include <vector>
 using std::vector;
 
+#include <string_view>
+
 #include "json_fwd.hpp"
 using json = nlohmann::json;
 
@@ -32,9 +34,16 @@ namespace kubepp{
             vector<string> limit;
             vector<string> offset;
 
+            // "EXPLAIN SELECT ..." returns the plan instead of the results; "EXPLAIN ANALYZE SELECT ..." also runs it and reports timings
+            bool explain = false;
+            bool analyze = false;
+
             string asString() const;
             json asJson() const;
 
+            /* The position of the first c at or after pos ( which isn't in a quote ) that isn't in a quoted value ( 'foo bar', "a,b" ), or npos. */
+            static size_t findUnquoted( std::string_view str, char c, size_t pos = 0 );
+
 
         protected:
             string implodeString( const vector<string>& vec, const string& delimiter ) const;
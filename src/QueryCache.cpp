@@ -0,0 +1,90 @@
+#include "QueryCache.h"
+
+
+namespace kubepp{
+
+
+    QueryCache::QueryCache( size_t capacity )
+        :capacity(capacity)
+    {
+
+    }
+
+
+
+    std::shared_ptr<const PreparedQuery> QueryCache::get( const string& query_str ){
+
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+
+            auto it = this->index.find(query_str);
+            if( it != this->index.end() ){
+                this->hits++;
+                this->entries.splice( this->entries.begin(), this->entries, it->second );
+                return this->entries.front();
+            }
+            this->misses++;
+        }
+
+        // parse outside the lock; a concurrent miss on the same text just prepares it twice
+        auto prepared_query = std::make_shared<const PreparedQuery>(query_str);
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        auto it = this->index.find(query_str);
+        if( it != this->index.end() ){
+            this->entries.splice( this->entries.begin(), this->entries, it->second );
+            return this->entries.front();
+        }
+
+        this->entries.push_front(prepared_query);
+        this->index[query_str] = this->entries.begin();
+
+        while( this->entries.size() > this->capacity && !this->entries.empty() ){
+            this->index.erase( this->entries.back()->query_str );
+            this->entries.pop_back();
+        }
+
+        return prepared_query;
+
+    }
+
+
+
+    void QueryCache::clear(){
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->entries.clear();
+        this->index.clear();
+
+    }
+
+
+
+    size_t QueryCache::size() const{
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return this->entries.size();
+
+    }
+
+
+
+    size_t QueryCache::getHits() const{
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return this->hits;
+
+    }
+
+
+
+    size_t QueryCache::getMisses() const{
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return this->misses;
+
+    }
+
+
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+
+#include <string>
+using std::string;
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "PreparedQuery.h"
+
+
+namespace kubepp{
+
+
+    /*
+        A thread-safe LRU cache of prepared queries, keyed by the query text.
+        Entries are shared, so a query that is evicted while it is running stays valid.
+    */
+    class QueryCache{
+
+        public:
+            QueryCache( size_t capacity = 256 );
+
+            /* Returns the cached PreparedQuery for this text, parsing and planning it on a miss. */
+            std::shared_ptr<const PreparedQuery> get( const string& query_str );
+
+            void clear();
+
+            size_t size() const;
+            size_t getHits() const;
+            size_t getMisses() const;
+
+
+        protected:
+            using entry_list = std::list<std::shared_ptr<const PreparedQuery>>;
+
+            size_t capacity;
+            size_t hits = 0;
+            size_t misses = 0;
+
+            entry_list entries;     // most recently used first
+            std::unordered_map<string, entry_list::iterator> index;
+
+            mutable std::mutex mutex;
+
+    };
+
+
+}
@@ -0,0 +1,430 @@
+#include "QueryPlan.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <cctype>
+
+#include "json.hpp"
+using json = nlohmann::json;
+
+
+namespace kubepp{
+
+
+    bool QueryPredicate::isParameter() const{
+
+        return this->parameter_index >= 0;
+
+    }
+
+
+
+    string QueryPredicate::labelKey() const{
+
+        const auto& steps = this->field_path.getSteps();
+
+        if( steps.size() != 3 || steps[0].key != "metadata" || steps[1].key != "labels" || steps[2].type != FieldPath::Step::Type::KEY ){
+            return "";
+        }
+
+        return steps[2].key;
+
+    }
+
+
+
+    bool QueryPredicate::matches( const json& resource ) const{
+
+        // with wildcards, '=' matches when any value is equal and '!=' when none is
+
+        bool equal = false;
+
+        auto is_equal = [this]( const json* value ){
+            if( value == nullptr || value->is_null() ){
+                return false;
+            }
+            if( value->is_string() ){
+                return value->get_ref<const string&>() == this->value;
+            }
+            return value->dump() == this->value;
+        };
+
+        if( this->field_path.hasWildcard() ){
+            vector<const json*> values;
+            this->field_path.resolveAll( resource, values );
+            for( const json* value : values ){
+                if( is_equal(value) ){
+                    equal = true;
+                    break;
+                }
+            }
+        }else{
+            equal = is_equal( this->field_path.resolve(resource) );
+        }
+
+        if( this->op == "!=" ){
+            return !equal;
+        }
+        return equal;
+
+    }
+
+
+
+    json QueryPredicate::asJson() const{
+
+        json predicate_json = json::object();
+
+        predicate_json["path"] = this->path;
+        predicate_json["op"] = this->op;
+        predicate_json["value"] = this->isParameter() ? json() : json(this->value);
+        if( this->isParameter() ){
+            predicate_json["parameter"] = this->parameter_index;
+        }
+
+        switch( this->pushdown ){
+            case PushdownTarget::NAMESPACE: predicate_json["pushdown"] = "namespace"; break;
+            case PushdownTarget::FIELD_SELECTOR: predicate_json["pushdown"] = "fieldSelector"; break;
+            case PushdownTarget::LABEL_SELECTOR: predicate_json["pushdown"] = "labelSelector"; break;
+            case PushdownTarget::CLIENT_FILTER: predicate_json["pushdown"] = "client"; break;
+        }
+
+        return predicate_json;
+
+    }
+
+
+
+
+    QueryPlan::QueryPlan( const Query& query ){
+
+        for( const string& select : query.select ){
+
+            if( select.empty() ){
+                continue;
+            }
+
+            if( select == "*" ){
+                this->select_paths.clear();
+                break;
+            }
+
+            this->select_paths.push_back( FieldPath(select) );
+
+        }
+
+        for( const string& from : query.from ){
+
+            if( from.empty() ){
+                continue;
+            }
+
+            if( from == "*" ){
+                this->all_kinds = true;
+                continue;
+            }
+
+            this->targets.push_back( ResourceDescription(from) );
+
+        }
+
+        this->parseWhere( query.where );
+
+        this->metadata_only = !this->select_paths.empty();
+        for( const FieldPath& select_path : this->select_paths ){
+            this->metadata_only = this->metadata_only && QueryPlan::isMetadataPath(select_path);
+        }
+        for( const auto& predicate : this->predicates ){
+            this->metadata_only = this->metadata_only && QueryPlan::isMetadataPath(predicate.field_path);
+        }
+
+    }
+
+
+
+    bool QueryPlan::isMetadataPath( const FieldPath& path ){
+
+        const auto& steps = path.getSteps();
+        return !steps.empty() && steps[0].type == FieldPath::Step::Type::KEY && steps[0].key == "metadata";
+
+    }
+
+
+
+    void QueryPlan::parseWhere( const vector<string>& where_tokens ){
+
+        // conditions are joined with AND; each condition is "path op value", with or without spaces around the operator
+
+        vector<string> conditions;
+        string condition;
+
+        for( const string& token : where_tokens ){
+
+            if( token.empty() ){
+                continue;
+            }
+
+            if( token == "AND" || token == "and" ){
+                if( !condition.empty() ){
+                    conditions.push_back(condition);
+                }
+                condition.clear();
+                continue;
+            }
+
+            if( token == "OR" || token == "or" ){
+                throw std::runtime_error("OR is not supported in WHERE clauses.");
+            }
+
+            condition += token;
+
+        }
+
+        if( !condition.empty() ){
+            conditions.push_back(condition);
+        }
+
+
+        bool namespace_pushed = false;
+
+        for( const string& condition_str : conditions ){
+
+            QueryPredicate predicate = this->parsePredicate(condition_str);
+
+            if( predicate.path == "metadata.namespace" && predicate.op == "=" && !namespace_pushed ){
+                predicate.pushdown = QueryPredicate::PushdownTarget::NAMESPACE;
+                namespace_pushed = true;
+            }else if( predicate.path == "metadata.namespace" || predicate.path == "metadata.name" ){
+                // the only field selectors every kind supports
+                predicate.pushdown = QueryPredicate::PushdownTarget::FIELD_SELECTOR;
+            }else if( !predicate.labelKey().empty() ){
+                predicate.pushdown = QueryPredicate::PushdownTarget::LABEL_SELECTOR;
+            }
+
+            // parameters are checked when they're bound
+            if( !predicate.isParameter() && !QueryPlan::canPushDown(predicate) ){
+                predicate.pushdown = QueryPredicate::PushdownTarget::CLIENT_FILTER;
+            }
+
+            this->predicates.push_back(predicate);
+
+        }
+
+    }
+
+
+
+    QueryPredicate QueryPlan::parsePredicate( const string& condition ){
+
+        QueryPredicate predicate;
+
+        // the operator ( '=', '==' or '!=' ) is at the first '=' outside a quoted value, so a value like 'a!=b' stays whole
+        size_t op_pos = Query::findUnquoted( condition, '=' );
+        size_t op_size = 1;
+
+        if( op_pos != string::npos && op_pos > 0 && condition[op_pos - 1] == '!' ){
+            op_pos--;
+            op_size = 2;
+        }else if( op_pos != string::npos && condition.compare(op_pos, 2, "==") == 0 ){
+            op_size = 2;
+        }
+
+        if( op_pos == string::npos || op_pos == 0 ){
+            throw std::runtime_error("Unsupported WHERE condition: '" + condition + "'. Conditions must be in the format 'path = value' or 'path != value'.");
+        }
+
+        predicate.path = condition.substr(0, op_pos);
+        predicate.field_path = FieldPath(predicate.path);
+        predicate.op = ( condition.substr(op_pos, op_size) == "!=" ) ? "!=" : "=";
+
+        string value = condition.substr(op_pos + op_size);
+
+        if( !value.empty() && value.back() == ';' ){
+            value.pop_back();
+        }
+
+        if( value == "?" ){
+            predicate.parameter_index = static_cast<int>(this->parameter_count++);
+        }else if( value.size() >= 2 && ( value.front() == '\'' || value.front() == '"' ) && value.back() == value.front() ){
+            value = value.substr(1, value.size() - 2);
+        }
+
+        predicate.value = predicate.isParameter() ? "" : value;
+
+        return predicate;
+
+    }
+
+
+
+    bool QueryPlan::canPushDown( const QueryPredicate& predicate ){
+
+        const string& value = predicate.value;
+
+        switch( predicate.pushdown ){
+
+            case QueryPredicate::PushdownTarget::NAMESPACE:
+                // a DNS label; anything else would change the request path
+                return !value.empty() && std::all_of( value.begin(), value.end(), []( unsigned char c ){
+                    return std::islower(c) || std::isdigit(c) || c == '-';
+                });
+
+            case QueryPredicate::PushdownTarget::FIELD_SELECTOR:
+                // ',' separates terms, '=' and '!' are operators
+                return value.find_first_of(",=!\\") == string::npos;
+
+            case QueryPredicate::PushdownTarget::LABEL_SELECTOR:
+                // label values are alphanumerics, '-', '_' and '.'; anything else could add terms or operators
+                return value.size() <= 63 && std::all_of( value.begin(), value.end(), []( unsigned char c ){
+                    return std::isalnum(c) || c == '-' || c == '_' || c == '.';
+                });
+
+            case QueryPredicate::PushdownTarget::CLIENT_FILTER:
+                break;
+
+        }
+
+        return true;
+
+    }
+
+
+
+    void QueryPlan::bind( const vector<string>& parameters ){
+
+        if( parameters.size() != this->parameter_count ){
+            throw std::runtime_error("The query expects " + std::to_string(this->parameter_count) + " parameters, but " + std::to_string(parameters.size()) + " were bound.");
+        }
+
+        for( auto& predicate : this->predicates ){
+            if( predicate.isParameter() ){
+                predicate.value = parameters[predicate.parameter_index];
+                if( !QueryPlan::canPushDown(predicate) ){
+                    predicate.pushdown = QueryPredicate::PushdownTarget::CLIENT_FILTER;
+                }
+            }
+        }
+
+    }
+
+
+
+    bool QueryPlan::matches( const json& resource ) const{
+
+        for( const auto& predicate : this->predicates ){
+            if( predicate.pushdown == QueryPredicate::PushdownTarget::CLIENT_FILTER && !predicate.matches(resource) ){
+                return false;
+            }
+        }
+
+        return true;
+
+    }
+
+
+
+    bool QueryPlan::matchesAll( const json& resource ) const{
+
+        for( const auto& predicate : this->predicates ){
+            if( !predicate.matches(resource) ){
+                return false;
+            }
+        }
+
+        return true;
+
+    }
+
+
+
+    json QueryPlan::project( json& resource ) const{
+
+        if( this->select_paths.empty() ){
+            return std::move(resource);
+        }
+
+        json row = json::object();
+
+        for( const FieldPath& select_path : this->select_paths ){
+            row[select_path.asString()] = select_path.extract(resource);
+        }
+
+        return row;
+
+    }
+
+
+
+    string QueryPlan::getNamespace() const{
+
+        for( const auto& predicate : this->predicates ){
+            if( predicate.pushdown == QueryPredicate::PushdownTarget::NAMESPACE ){
+                return predicate.value;
+            }
+        }
+
+        return "";
+
+    }
+
+
+
+    ListOptions QueryPlan::getListOptions() const{
+
+        ListOptions options;
+        options.metadata_only = this->metadata_only;
+
+        for( const auto& predicate : this->predicates ){
+
+            if( predicate.pushdown == QueryPredicate::PushdownTarget::FIELD_SELECTOR ){
+                if( !options.field_selector.empty() ){
+                    options.field_selector += ",";
+                }
+                options.field_selector += predicate.path + predicate.op + predicate.value;
+            }
+
+            if( predicate.pushdown == QueryPredicate::PushdownTarget::LABEL_SELECTOR ){
+                if( !options.label_selector.empty() ){
+                    options.label_selector += ",";
+                }
+                options.label_selector += predicate.labelKey() + predicate.op + predicate.value;
+            }
+
+        }
+
+        return options;
+
+    }
+
+
+
+    json QueryPlan::asJson() const{
+
+        json plan_json = json::object();
+
+        plan_json["select"] = json::array();
+        for( const auto& select_path : this->select_paths ){
+            plan_json["select"].push_back( select_path.asString() );
+        }
+
+        plan_json["all_kinds"] = this->all_kinds;
+        plan_json["metadata_only"] = this->metadata_only;
+
+        plan_json["targets"] = json::array();
+        for( const auto& target : this->targets ){
+            plan_json["targets"].push_back( target.api_group_version + ":" + target.kind );
+        }
+
+        plan_json["predicates"] = json::array();
+        for( const auto& predicate : this->predicates ){
+            plan_json["predicates"].push_back( predicate.asJson() );
+        }
+
+        plan_json["parameter_count"] = this->parameter_count;
+
+        return plan_json;
+
+    }
+
+
+}
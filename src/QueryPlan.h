@@ -0,0 +1,106 @@
+#pragma once
+
+
+#include <string>
+using std::string;
+
+#include <vector>
+using std::vector;
+
+#include "json_fwd.hpp"
+using json = nlohmann::json;
+
+#include "Query.h"
+#include "ResourceDescription.h"
+#include "ListOptions.h"
+#include "FieldPath.h"
+
+
+namespace kubepp{
+
+
+    /*
+        A single condition from a WHERE clause ( eg. "metadata.namespace = 'default'" ).
+        The value may be a '?' placeholder that is filled in when the plan is bound.
+    */
+    class QueryPredicate{
+
+        public:
+
+            enum class PushdownTarget{
+                NAMESPACE,          // listed from the namespaced endpoint
+                FIELD_SELECTOR,     // sent to the apiserver as a fieldSelector
+                LABEL_SELECTOR,     // sent to the apiserver as a labelSelector
+                CLIENT_FILTER       // evaluated against each returned object
+            };
+
+            string path;
+            FieldPath field_path;
+            string op;
+            string value;
+            int parameter_index = -1;
+            PushdownTarget pushdown = PushdownTarget::CLIENT_FILTER;
+
+            bool isParameter() const;
+            bool matches( const json& resource ) const;
+
+            // path relative to metadata.labels ( eg. "app.kubernetes.io/name" )
+            string labelKey() const;
+
+            json asJson() const;
+
+    };
+
+
+
+    /*
+        The parsed form of a Query: the resources to list and the pushdown decision for every WHERE predicate.
+        Building a plan is independent of the parameter values, so a plan can be prepared once and bound many times.
+    */
+    class QueryPlan{
+
+        public:
+            QueryPlan( const Query& query );
+
+            /* Fills the '?' placeholders, in order of appearance. Throws if the count doesn't match. */
+            void bind( const vector<string>& parameters );
+
+            /* Evaluates the predicates that could not be pushed down to the apiserver. */
+            bool matches( const json& resource ) const;
+
+            /* Evaluates every predicate, pushed down or not; for sources without an apiserver, like snapshots. */
+            bool matchesAll( const json& resource ) const;
+
+            /* The SELECT paths of a matching resource, keyed by path; SELECT * returns the resource unchanged. */
+            json project( json& resource ) const;
+
+            /* The options for listing one target; the namespace is applied to the ResourceDescription by the caller. */
+            ListOptions getListOptions() const;
+            string getNamespace() const;
+
+            json asJson() const;
+
+            vector<ResourceDescription> targets;
+            bool all_kinds = false;     // "FROM *"
+
+            vector<FieldPath> select_paths;     // empty for SELECT *
+
+            // SELECT and WHERE only touch metadata.*, so lists can skip spec, status and data
+            bool metadata_only = false;
+
+            vector<QueryPredicate> predicates;
+            size_t parameter_count = 0;
+
+
+        protected:
+            void parseWhere( const vector<string>& where_tokens );
+            QueryPredicate parsePredicate( const string& condition );
+            static bool isMetadataPath( const FieldPath& path );
+
+            /* Whether the value can go into the predicate's selector or namespace as is; other values are filtered client-side. */
+            static bool canPushDown( const QueryPredicate& predicate );
+
+    };
+
+
+}
@@ -0,0 +1,205 @@
+#include "QueryStats.h"
+
+#include "json.hpp"
+using json = nlohmann::json;
+
+
+namespace kubepp{
+
+
+    void QueryStats::addStageTime( const string& stage, clock::time_point start ){
+
+        const double elapsed_ms = QueryStats::millisecondsSince(start);
+
+        for( auto& stage_time : this->stages ){
+            if( stage_time.first == stage ){
+                stage_time.second += elapsed_ms;
+                return;
+            }
+        }
+
+        this->stages.push_back( {stage, elapsed_ms} );
+
+    }
+
+
+
+    void QueryStats::addRequest( const string& method, const string& path, long status_code, size_t bytes, double fetch_ms, double parse_ms, double convert_ms ){
+
+        this->api_calls++;
+        this->bytes_received += bytes;
+        this->fetch_ms += fetch_ms;
+        this->parse_ms += parse_ms;
+        this->convert_ms += convert_ms;
+        this->decode_ms += parse_ms + convert_ms;
+
+        if( status_code == 0 || status_code >= 400 ){
+            this->error_responses++;
+        }
+
+        if( this->max_requests == 0 || this->requests.size() < this->max_requests ){
+            Request request;
+            request.method = method;
+            request.endpoint = path;
+            request.status_code = status_code;
+            request.bytes = bytes;
+            request.fetch_ms = fetch_ms;
+            request.parse_ms = parse_ms;
+            request.convert_ms = convert_ms;
+            this->requests.push_back( std::move(request) );
+        }
+
+    }
+
+
+
+    void QueryStats::addThrottle( double wait_ms ){
+
+        this->throttled_requests++;
+        this->throttled_ms += wait_ms;
+
+    }
+
+
+
+    void QueryStats::addConnections( size_t connections, size_t tls_handshakes, size_t tls_resumptions, double handshake_ms ){
+
+        this->connections_opened += connections;
+        this->tls_handshakes += tls_handshakes;
+        this->tls_resumptions += tls_resumptions;
+        this->handshake_ms += handshake_ms;
+
+    }
+
+
+
+    void QueryStats::addAllocations( const string& subsystem, size_t allocations, size_t bytes ){
+
+        for( auto& subsystem_allocations : this->allocations ){
+            if( subsystem_allocations.subsystem == subsystem ){
+                subsystem_allocations.allocations += allocations;
+                subsystem_allocations.bytes += bytes;
+                return;
+            }
+        }
+
+        Allocations subsystem_allocations;
+        subsystem_allocations.subsystem = subsystem;
+        subsystem_allocations.allocations = allocations;
+        subsystem_allocations.bytes = bytes;
+        this->allocations.push_back(subsystem_allocations);
+
+    }
+
+
+
+    void QueryStats::merge( const QueryStats& other ){
+
+        for( const auto& stage_time : other.stages ){
+            bool found = false;
+            for( auto& own_stage_time : this->stages ){
+                if( own_stage_time.first == stage_time.first ){
+                    own_stage_time.second += stage_time.second;
+                    found = true;
+                    break;
+                }
+            }
+            if( !found ){
+                this->stages.push_back(stage_time);
+            }
+        }
+
+        this->api_calls += other.api_calls;
+        this->bytes_received += other.bytes_received;
+        this->fetch_ms += other.fetch_ms;
+        this->parse_ms += other.parse_ms;
+        this->convert_ms += other.convert_ms;
+        this->decode_ms += other.decode_ms;
+        this->error_responses += other.error_responses;
+        this->throttled_requests += other.throttled_requests;
+        this->throttled_ms += other.throttled_ms;
+        this->retries += other.retries;
+        this->connections_opened += other.connections_opened;
+        this->tls_handshakes += other.tls_handshakes;
+        this->tls_resumptions += other.tls_resumptions;
+        this->handshake_ms += other.handshake_ms;
+        this->objects_scanned += other.objects_scanned;
+        this->objects_returned += other.objects_returned;
+
+        for( const auto& request : other.requests ){
+            if( this->max_requests != 0 && this->requests.size() >= this->max_requests ){
+                break;
+            }
+            this->requests.push_back(request);
+        }
+
+        for( const auto& subsystem_allocations : other.allocations ){
+            this->addAllocations( subsystem_allocations.subsystem, subsystem_allocations.allocations, subsystem_allocations.bytes );
+        }
+
+    }
+
+
+
+    json QueryStats::asJson() const{
+
+        json stats_json = json::object();
+
+        stats_json["stages_ms"] = json::object();
+        for( const auto& stage_time : this->stages ){
+            stats_json["stages_ms"][stage_time.first] = stage_time.second;
+        }
+
+        stats_json["api_calls"] = this->api_calls;
+        stats_json["bytes_received"] = this->bytes_received;
+        stats_json["fetch_ms"] = this->fetch_ms;
+        stats_json["parse_ms"] = this->parse_ms;
+        stats_json["convert_ms"] = this->convert_ms;
+        stats_json["decode_ms"] = this->decode_ms;
+        stats_json["error_responses"] = this->error_responses;
+        stats_json["throttled_requests"] = this->throttled_requests;
+        stats_json["throttled_ms"] = this->throttled_ms;
+        stats_json["retries"] = this->retries;
+        stats_json["connections_opened"] = this->connections_opened;
+        stats_json["tls_handshakes"] = this->tls_handshakes;
+        stats_json["tls_resumptions"] = this->tls_resumptions;
+        stats_json["handshake_ms"] = this->handshake_ms;
+        stats_json["objects_scanned"] = this->objects_scanned;
+        stats_json["objects_returned"] = this->objects_returned;
+        stats_json["requests"] = json::array();
+        for( const auto& request : this->requests ){
+            stats_json["requests"].push_back({
+                {"method", request.method},
+                {"endpoint", request.endpoint},
+                {"status", request.status_code},
+                {"bytes", request.bytes},
+                {"fetch_ms", request.fetch_ms},
+                {"parse_ms", request.parse_ms},
+                {"convert_ms", request.convert_ms}
+            });
+        }
+
+        if( !this->allocations.empty() ){
+            stats_json["allocations"] = json::object();
+            for( const auto& subsystem_allocations : this->allocations ){
+                stats_json["allocations"][subsystem_allocations.subsystem] = {
+                    {"allocations", subsystem_allocations.allocations},
+                    {"bytes", subsystem_allocations.bytes}
+                };
+            }
+        }
+
+        return stats_json;
+
+    }
+
+
+
+    double QueryStats::millisecondsSince( clock::time_point start ){
+
+        return std::chrono::duration<double, std::milli>( clock::now() - start ).count();
+
+    }
+
+
+}
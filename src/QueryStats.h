@@ -0,0 +1,104 @@
+#pragma once
+
+
+#include <string>
+using std::string;
+
+#include <vector>
+using std::vector;
+
+#include <utility>
+using std::pair;
+
+#include <chrono>
+
+#include "json_fwd.hpp"
+using json = nlohmann::json;
+
+
+namespace kubepp{
+
+
+    /*
+        Measurements collected while running an EXPLAIN ANALYZE query, and per KubernetesClient ( see KubernetesClient::getStats ).
+        Stage times are wall times in milliseconds; fetch ( network ), parse ( cJSON or protobuf ) and convert
+        ( cJSON to nlohmann ) times are summed over every request. decode is parse + convert.
+    */
+    class QueryStats{
+
+        public:
+
+            using clock = std::chrono::steady_clock;
+
+            class Request{
+                public:
+                    string method;
+                    string endpoint;
+                    long status_code = 0;
+                    size_t bytes = 0;
+                    double fetch_ms = 0.0;
+                    double parse_ms = 0.0;
+                    double convert_ms = 0.0;
+            };
+
+            class Allocations{
+                public:
+                    string subsystem;
+                    size_t allocations = 0;
+                    size_t bytes = 0;
+            };
+
+            /* Adds the time since 'start' to a stage; stages are reported in the order they were first recorded. */
+            void addStageTime( const string& stage, clock::time_point start );
+
+            void addRequest( const string& method, const string& path, long status_code, size_t bytes, double fetch_ms, double parse_ms, double convert_ms );
+
+            /* Adds a request that waited for the client-side rate limiter. */
+            void addThrottle( double wait_ms );
+
+            /* Adds the connections a request had to open ( see HttpSession ). */
+            void addConnections( size_t connections, size_t tls_handshakes, size_t tls_resumptions, double handshake_ms );
+
+            /* Adds allocations made by a subsystem ( see AllocationTracker ). */
+            void addAllocations( const string& subsystem, size_t allocations, size_t bytes );
+
+            /* Adds another set of measurements to this one. */
+            void merge( const QueryStats& other );
+
+            json asJson() const;
+
+            vector<pair<string, double>> stages;
+
+            size_t api_calls = 0;
+            size_t bytes_received = 0;
+            double fetch_ms = 0.0;
+            double parse_ms = 0.0;
+            double convert_ms = 0.0;
+            double decode_ms = 0.0;
+            size_t error_responses = 0;     // HTTP status 0 ( no response ) or >= 400
+            size_t throttled_requests = 0;  // waited for the client-side rate limiter ( see RateLimiter )
+            double throttled_ms = 0.0;
+            size_t retries = 0;             // requests sent again after a failure ( see RetryPolicy )
+            size_t connections_opened = 0;  // the rest of the api calls reused a kept-alive connection ( see HttpSession )
+            size_t tls_handshakes = 0;      // full handshakes; the rest of the new https connections resumed a TLS session
+            size_t tls_resumptions = 0;
+            double handshake_ms = 0.0;
+
+            size_t objects_scanned = 0;
+            size_t objects_returned = 0;
+
+            // only the first max_requests are kept individually; the totals include every request
+            vector<Request> requests;
+            size_t max_requests = 0;    // 0 keeps them all
+
+            // per subsystem; only in allocation-tracking builds ( KUBEPP_TRACK_ALLOCATIONS )
+            vector<Allocations> allocations;
+
+
+        protected:
+            static double millisecondsSince( clock::time_point start );
+
+    };
+
+
+}
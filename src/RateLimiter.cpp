@@ -0,0 +1,149 @@
+#include "RateLimiter.h"
+
+#include <algorithm>
+#include <thread>
+
+
+namespace kubepp{
+
+
+    TokenBucket::TokenBucket( double qps, double burst ){
+
+        this->configure( qps, burst );
+
+    }
+
+
+
+    void TokenBucket::configure( double qps, double burst ){
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        this->qps = std::max( qps, 0.0 );
+        this->burst = std::max( burst, 1.0 );
+        this->tokens = this->burst;
+        this->updated = clock::now();
+
+    }
+
+
+
+    void TokenBucket::refill( clock::time_point now ){
+
+        if( now > this->updated ){
+            const double elapsed_seconds = std::chrono::duration<double>( now - this->updated ).count();
+            this->tokens = std::min( this->burst, this->tokens + elapsed_seconds * this->qps );
+            this->updated = now;
+        }
+
+    }
+
+
+
+    TokenBucket::clock::duration TokenBucket::acquire(){
+
+        clock::duration wait = clock::duration::zero();
+
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+
+            if( this->qps <= 0.0 ){
+                return wait;
+            }
+
+            this->refill( clock::now() );
+            this->tokens -= 1.0;
+
+            // reserve the token: it's due once the deficit has been refilled
+            if( this->tokens < 0.0 ){
+                wait = std::chrono::duration_cast<clock::duration>( std::chrono::duration<double>( -this->tokens / this->qps ) );
+            }
+        }
+
+        if( wait > clock::duration::zero() ){
+            std::this_thread::sleep_for(wait);
+        }
+
+        return wait;
+
+    }
+
+
+
+    bool TokenBucket::tryAcquire(){
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        if( this->qps <= 0.0 ){
+            return true;
+        }
+
+        this->refill( clock::now() );
+
+        if( this->tokens < 1.0 ){
+            return false;
+        }
+
+        this->tokens -= 1.0;
+        return true;
+
+    }
+
+
+
+    double TokenBucket::getQps() const{
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return this->qps;
+
+    }
+
+
+
+    double TokenBucket::getBurst() const{
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return this->burst;
+
+    }
+
+
+
+    RateLimiter::RateLimiter( ClientMetrics* metrics )
+        :metrics(metrics)
+    {
+
+    }
+
+
+
+    void RateLimiter::configure( Priority priority, double qps, double burst ){
+
+        this->getBucket(priority).configure( qps, burst );
+
+    }
+
+
+
+    double RateLimiter::acquire( Priority priority ){
+
+        const double wait_seconds = std::chrono::duration<double>( this->getBucket(priority).acquire() ).count();
+
+        if( this->metrics ){
+            this->metrics->observeThrottle( priority, wait_seconds );
+        }
+
+        return wait_seconds;
+
+    }
+
+
+
+    TokenBucket& RateLimiter::getBucket( Priority priority ){
+
+        return priority == Priority::BACKGROUND ? this->background : this->interactive;
+
+    }
+
+
+}
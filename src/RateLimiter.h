@@ -0,0 +1,84 @@
+#pragma once
+
+
+#include <chrono>
+#include <mutex>
+
+#include "ClientMetrics.h"
+
+
+namespace kubepp{
+
+
+    /*
+        A token bucket: qps tokens are added per second, up to burst; each request takes one. A request that finds the bucket
+        empty reserves the next token and sleeps until it's due, so waiting requests are served in order without polling.
+        A qps of 0 ( the default ) never waits. Thread-safe.
+    */
+    class TokenBucket{
+
+        public:
+            using clock = std::chrono::steady_clock;
+
+            TokenBucket( double qps = 0.0, double burst = 1.0 );
+
+            /* Changes the rate; the bucket starts full. A burst below 1 is taken as 1. */
+            void configure( double qps, double burst );
+
+            /* Takes a token, sleeping until one is available. Returns the time waited. */
+            clock::duration acquire();
+
+            /* Takes a token only if one is available now. */
+            bool tryAcquire();
+
+            double getQps() const;
+            double getBurst() const;
+
+
+        protected:
+            /* Refills for the time since the last update; needs the mutex. */
+            void refill( clock::time_point now );
+
+            mutable std::mutex mutex;
+            double qps;
+            double burst;
+            double tokens;      // negative while requests are waiting for reserved tokens
+            clock::time_point updated;
+
+    };
+
+
+
+    /*
+        Client-side rate limiting of apiserver requests, with separate token buckets for interactive work ( queries, apps ) and
+        background work ( exports ), so a long export can't use up the budget of interactive queries on a shared apiserver.
+
+        KubernetesClient takes a token before every request from KubernetesClient::getRateLimiter() ( shared by the process, set
+        with --qps, --burst, --background-qps and --background-burst ) or its own ( setRateLimiter ), in the bucket of its priority
+        ( setPriority ). Both buckets are unlimited by default. Waits are recorded in the metrics ( see ClientMetrics::Throttle ).
+    */
+    class RateLimiter{
+
+        public:
+            using Priority = ClientMetrics::Priority;
+
+            /* metrics may be null. */
+            RateLimiter( ClientMetrics* metrics = nullptr );
+
+            void configure( Priority priority, double qps, double burst );
+
+            /* Waits for a token of the priority's bucket. Returns the seconds waited. */
+            double acquire( Priority priority );
+
+            TokenBucket& getBucket( Priority priority );
+
+
+        protected:
+            ClientMetrics* metrics;
+            TokenBucket interactive;
+            TokenBucket background;
+
+    };
+
+
+}
@@ -4,8 +4,11 @@
 using json = nlohmann::json;
 
 #include <map>
+#include <algorithm>
 #include <string>
 
+#include "AllocationTracker.h"
+
 
 namespace kubepp{
 
@@ -94,39 +97,32 @@ namespace kubepp{
 
     void ResourceDescription::fromJson( const json& resource ){
 
+        AllocationTracker::Scope allocation_scope( AllocationTracker::Subsystem::RESOURCE_DESCRIPTION );
+
         if( !resource.is_object() ){
             throw std::runtime_error("The resource must be a JSON object.");
         }
 
         // ensure that the resource has a 'apiVersion' field
-        if( !resource.contains("apiVersion") || !resource["apiVersion"].is_string() || resource["apiVersion"].get<string>().empty() ){
+        auto api_version_it = resource.find("apiVersion");
+        if( api_version_it == resource.end() || !api_version_it->is_string() || api_version_it->get_ref<const string&>().empty() ){
             throw std::runtime_error("The resource must have a 'apiVersion' field that is a non-empty string.");
         }
-        this->api_group_version = resource["apiVersion"].get<string>();
 
 
         // ensure that the resource has a 'kind' field
-        if( !resource.contains("kind") || !resource["kind"].is_string() || resource["kind"].get<string>().empty() ){
+        auto kind_it = resource.find("kind");
+        if( kind_it == resource.end() || !kind_it->is_string() || kind_it->get_ref<const string&>().empty() ){
             throw std::runtime_error("The resource must have a 'kind' field that is a non-empty string.");
         }
-        this->kind = resource["kind"].get<string>();
 
-        if( resource.contains("name") && resource["name"].is_string() && !resource["name"].get<string>().empty() ){
-            this->name = resource["name"].get<string>();
-            this->kind_lower_plural = this->name;
+        // discovery entries carry the plural as 'name'
+        auto name_it = resource.find("name");
+        if( name_it != resource.end() && name_it->is_string() && !name_it->get_ref<const string&>().empty() ){
+            this->name = name_it->get<string>();
+            this->setGroupVersionKind( api_version_it->get_ref<const string&>(), kind_it->get_ref<const string&>(), this->name );
         }else{
-            this->kind_lower_plural = this->toLower(kind) + "s";
-        }        
- 
-        this->api_group = this->api_group_version.substr(0, this->api_group_version.find("/"));
-        this->api_version = this->api_group_version.substr(this->api_group_version.find("/")+1);
-
-        if( ResourceDescription::kind_to_api_group.count(this->kind) ){
-            const string looked_up_api_group = ResourceDescription::kind_to_api_group.at(this->kind);
-            if( looked_up_api_group == "v1" ){
-                // the core api resources have an empty api_group
-                this->api_group = "";
-            }
+            this->setGroupVersionKind( api_version_it->get_ref<const string&>(), kind_it->get_ref<const string&>() );
         }
 
         // get the name and namespace
@@ -141,10 +137,57 @@ namespace kubepp{
 
     }
 
-    string ResourceDescription::toLower( const string& str ) const{
-        string lower_str = str;
-        std::transform(lower_str.begin(), lower_str.end(), lower_str.begin(), ::tolower);
-        return lower_str;
+    string ResourceDescription::getCollectionPath() const{
+
+        string path = this->api_group.empty() ? "/api/" + this->api_version : "/apis/" + this->api_group + "/" + this->api_version;
+
+        if( !this->k8s_namespace.empty() ){
+            path += "/namespaces/" + this->k8s_namespace;
+        }
+
+        // without a kind, this is the discovery document of the group version
+        if( this->kind_lower_plural.empty() ){
+            return path;
+        }
+
+        return path + "/" + this->kind_lower_plural;
+
+    }
+
+
+
+    string ResourceDescription::getResourcePath() const{
+
+        return this->getCollectionPath() + "/" + this->name;
+
+    }
+
+
+
+    void ResourceDescription::setGroupVersionKind( const string& api_group_version, const string& kind, const string& kind_lower_plural ){
+
+        this->api_group_version = api_group_version;
+        this->kind = kind;
+
+        if( kind_lower_plural.empty() ){
+            this->kind_lower_plural.reserve( kind.size() + 1 );
+            this->kind_lower_plural = kind;
+            std::transform(this->kind_lower_plural.begin(), this->kind_lower_plural.end(), this->kind_lower_plural.begin(), ::tolower);
+            this->kind_lower_plural += 's';
+        }else{
+            this->kind_lower_plural = kind_lower_plural;
+        }
+
+        const size_t slash_pos = api_group_version.find('/');
+        this->api_group = api_group_version.substr(0, slash_pos);
+        this->api_version = api_group_version.substr(slash_pos + 1);
+
+        // the core api resources have an empty api_group
+        auto api_group_it = ResourceDescription::kind_to_api_group.find(kind);
+        if( api_group_it != ResourceDescription::kind_to_api_group.end() && api_group_it->second == "v1" ){
+            this->api_group = "";
+        }
+
     }
 
 
@@ -156,18 +199,15 @@ namespace kubepp{
             throw std::runtime_error("The resource string must be a non-empty string.");
         }
 
-        json resource = json::object();
+        AllocationTracker::Scope allocation_scope( AllocationTracker::Subsystem::RESOURCE_DESCRIPTION );
 
-        if( ResourceDescription::kind_to_api_group.count(resource_str) ){
+        auto api_group_it = ResourceDescription::kind_to_api_group.find(resource_str);
 
-            //search by Kind only
+        if( api_group_it != ResourceDescription::kind_to_api_group.end() ){
 
-            const string looked_up_api_group = ResourceDescription::kind_to_api_group.at(resource_str);
-            
-            resource["apiVersion"] = looked_up_api_group;
-            resource["kind"] = resource_str;
+            //search by Kind only
 
-            this->fromJson(resource);
+            this->setGroupVersionKind( api_group_it->second, resource_str );
 
         }else{
 
@@ -182,10 +222,14 @@ namespace kubepp{
             const string api_group_version = resource_str.substr(0, colon_pos);
             const string kind = resource_str.substr(colon_pos+1);
 
-            resource["apiVersion"] = api_group_version;
-            resource["kind"] = kind;
-            
-            this->fromJson(resource);
+            if( api_group_version.empty() ){
+                throw std::runtime_error("The resource must have a 'apiVersion' field that is a non-empty string.");
+            }
+            if( kind.empty() ){
+                throw std::runtime_error("The resource must have a 'kind' field that is a non-empty string.");
+            }
+
+            this->setGroupVersionKind( api_group_version, kind );
 
         }
 
@@ -26,6 +26,12 @@ namespace kubepp{
 
             void fromJson( const json& resource );
 
+            /* The REST path of the collection ( eg. "/apis/apps/v1/namespaces/default/deployments" ). */
+            string getCollectionPath() const;
+
+            /* The REST path of the named object in the collection. */
+            string getResourcePath() const;
+
             string api_group;
             string api_version;
             string api_group_version;
@@ -39,7 +45,8 @@ namespace kubepp{
 
         private:
             
-            string toLower( const string& str ) const;
+            /* Sets the group, version, kind and plural ( the lowercase kind + "s" unless given ). Shared by fromJson and the string constructor, which doesn't build a json object. */
+            void setGroupVersionKind( const string& api_group_version, const string& kind, const string& kind_lower_plural = "" );
            
             
 
@@ -0,0 +1,105 @@
+#include "RetryPolicy.h"
+
+#include <algorithm>
+#include <random>
+
+#include "json.hpp"
+using json = nlohmann::json;
+
+
+namespace kubepp{
+
+
+    bool RetryPolicy::shouldRetry( long status_code, Idempotency idempotency ) const{
+
+        if( status_code == 429 ){
+            return true;
+        }
+
+        if( idempotency != Idempotency::IDEMPOTENT ){
+            return false;
+        }
+
+        return status_code == 0 || status_code == 500 || status_code == 502 || status_code == 503 || status_code == 504;
+
+    }
+
+
+
+    std::chrono::milliseconds RetryPolicy::getDelay( size_t retry, double retry_after_seconds ) const{
+
+        thread_local std::mt19937_64 random_engine{ std::random_device{}() };
+
+        if( retry_after_seconds > static_cast<double>( this->max_retry_after.count() ) ){
+            return std::chrono::milliseconds(-1);
+        }
+
+        // full jitter: uniform in [0, min(max_delay, initial_delay * 2^(retry - 1))]
+        double ceiling_ms = static_cast<double>( this->initial_delay.count() );
+        for( size_t i = 1; i < retry && ceiling_ms < this->max_delay.count(); i++ ){
+            ceiling_ms *= 2.0;
+        }
+        ceiling_ms = std::min( ceiling_ms, static_cast<double>( this->max_delay.count() ) );
+
+        const double jittered_ms = std::uniform_real_distribution<double>( 0.0, ceiling_ms )( random_engine );
+
+        return std::chrono::milliseconds( static_cast<int64_t>( std::max( jittered_ms, retry_after_seconds * 1000.0 ) ) );
+
+    }
+
+
+
+    double RetryPolicy::getRetryAfter( const json& response ){
+
+        if( !response.is_object() || response.value("kind", "") != "Status" ){
+            return 0.0;
+        }
+
+        auto details_it = response.find("details");
+        if( details_it == response.end() || !details_it->is_object() ){
+            return 0.0;
+        }
+
+        auto retry_after_it = details_it->find("retryAfterSeconds");
+        if( retry_after_it == details_it->end() || !retry_after_it->is_number() ){
+            return 0.0;
+        }
+
+        return std::max( retry_after_it->get<double>(), 0.0 );
+
+    }
+
+
+
+    RetryBudget::RetryBudget( size_t retries )
+        :remaining(retries)
+    {
+
+    }
+
+
+
+    bool RetryBudget::tryConsume(){
+
+        size_t current = this->remaining.load( std::memory_order_relaxed );
+
+        while( current > 0 ){
+            if( this->remaining.compare_exchange_weak( current, current - 1, std::memory_order_relaxed ) ){
+                return true;
+            }
+        }
+
+        return false;
+
+    }
+
+
+
+    size_t RetryBudget::getRemaining() const{
+
+        return this->remaining.load( std::memory_order_relaxed );
+
+    }
+
+
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+
+#include "json_fwd.hpp"
+using json = nlohmann::json;
+
+
+namespace kubepp{
+
+
+    /*
+        When and how long to wait before retrying a failed api call.
+
+        A 429 ( eg. API Priority and Fairness rejecting the request ) was never processed, so every verb retries it. No response
+        and 500, 502, 503 and 504 only retry idempotent requests: reads, replaces and deletes. A create retries them only with a
+        fixed metadata.name, and a 409 AlreadyExists on the retry means the first attempt went through ( see
+        KubernetesClient::createGenericResource ); patches and generateName creates don't, so they can't be applied twice.
+
+        Delays grow exponentially from initial_delay, with full jitter, capped at max_delay. A Retry-After header ( which the
+        apiserver's 429s carry with a plain text body ) or a Status with details.retryAfterSeconds waits at least that long;
+        longer than max_retry_after isn't retried.
+    */
+    class RetryPolicy{
+
+        public:
+            enum class Idempotency{ IDEMPOTENT, UNPROCESSED_ONLY };
+
+            size_t max_retries = 4;         // per request; 0 disables retries
+            std::chrono::milliseconds initial_delay{250};
+            std::chrono::milliseconds max_delay{10000};
+            std::chrono::seconds max_retry_after{60};
+            size_t query_retries = 50;      // per query, over all of its requests ( see RetryBudget )
+
+            bool shouldRetry( long status_code, Idempotency idempotency ) const;
+
+            /* The delay before retry 'retry' ( from 1 ), at least retry_after_seconds; negative if the apiserver asked for more than max_retry_after. */
+            std::chrono::milliseconds getDelay( size_t retry, double retry_after_seconds = 0.0 ) const;
+
+            /* details.retryAfterSeconds of a Status, or 0. */
+            static double getRetryAfter( const json& response );
+
+    };
+
+
+
+    /* Retries left for one query; shared by its requests. */
+    class RetryBudget{
+
+        public:
+            RetryBudget( size_t retries );
+
+            /* Takes one retry; false once the budget is spent. */
+            bool tryConsume();
+
+            size_t getRemaining() const;
+
+
+        protected:
+            std::atomic<size_t> remaining;
+
+    };
+
+
+}
@@ -0,0 +1,644 @@
+#include "Snapshot.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "json.hpp"
+using json = nlohmann::json;
+
+#include "Query.h"
+#include "ContinuousQuery.h"
+
+
+namespace kubepp{
+
+
+    namespace{
+
+        void appendU32( string& out, uint32_t value ){
+            for( int i = 0; i < 4; i++ ){
+                out.push_back( static_cast<char>( (value >> (8 * i)) & 0xff ) );
+            }
+        }
+
+        void appendU64( string& out, uint64_t value ){
+            for( int i = 0; i < 8; i++ ){
+                out.push_back( static_cast<char>( (value >> (8 * i)) & 0xff ) );
+            }
+        }
+
+    }
+
+
+
+    string Snapshot::getKey( const string& kind, const string& k8s_namespace, const string& name, const string& api_version, const string& uid, const string& resource_version ){
+
+        string key;
+        key.reserve( kind.size() + k8s_namespace.size() + name.size() + api_version.size() + uid.size() + resource_version.size() + 5 );
+        key += kind;
+        key += '\0';
+        key += k8s_namespace;
+        key += '\0';
+        key += name;
+        key += '\0';
+        key += api_version;
+        key += '\0';
+        key += uid;
+        key += '\0';
+        key += resource_version;
+        return key;
+
+    }
+
+
+
+    SnapshotWriter::SnapshotWriter( std::ostream& output, Snapshot::Encoding encoding )
+        :writer(output), encoding(encoding)
+    {
+
+        string header( Snapshot::magic, sizeof(Snapshot::magic) );
+        appendU32( header, Snapshot::version );
+        appendU32( header, static_cast<uint32_t>(encoding) );
+
+        this->writer.write(header);
+        this->offset = header.size();
+
+    }
+
+
+
+    void SnapshotWriter::add( const json& resource ){
+
+        if( this->finished ){
+            throw std::runtime_error("The snapshot is already finished.");
+        }
+
+        if( !resource.is_object() || !resource.contains("metadata") || !resource["metadata"].is_object() ){
+            throw std::runtime_error("Only objects with metadata can be added to a snapshot.");
+        }
+
+        const json& metadata = resource["metadata"];
+
+        IndexEntry entry;
+        entry.key = Snapshot::getKey( resource.value("kind", ""), metadata.value("namespace", ""), metadata.value("name", ""), resource.value("apiVersion", ""), metadata.value("uid", ""), metadata.value("resourceVersion", "") );
+        entry.offset = this->offset;
+
+        this->encoded.clear();
+        if( this->encoding == Snapshot::Encoding::MESSAGE_PACK ){
+            json::to_msgpack( resource, this->encoded );
+        }else{
+            json::to_cbor( resource, this->encoded );
+        }
+
+        entry.size = static_cast<uint32_t>( this->encoded.size() );
+        this->writer.write( reinterpret_cast<const char*>(this->encoded.data()), this->encoded.size() );
+        this->offset += this->encoded.size();
+
+        this->index.push_back( std::move(entry) );
+
+    }
+
+
+
+    void SnapshotWriter::finish(){
+
+        if( this->finished ){
+            return;
+        }
+        this->finished = true;
+
+        std::sort( this->index.begin(), this->index.end(), []( const IndexEntry& a, const IndexEntry& b ){
+            return a.key < b.key;
+        });
+
+        const uint64_t index_offset = this->offset;
+        const uint64_t keys_offset = index_offset + this->index.size() * Snapshot::index_entry_size;
+
+        string index_bytes;
+        index_bytes.reserve( this->index.size() * Snapshot::index_entry_size );
+        uint64_t key_offset = 0;
+
+        for( const IndexEntry& entry : this->index ){
+            appendU64( index_bytes, entry.offset );
+            appendU32( index_bytes, entry.size );
+            appendU32( index_bytes, static_cast<uint32_t>(entry.key.size()) );
+            appendU64( index_bytes, key_offset );
+            key_offset += entry.key.size();
+        }
+        this->writer.write(index_bytes);
+
+        for( const IndexEntry& entry : this->index ){
+            this->writer.write(entry.key);
+        }
+
+        string footer;
+        appendU64( footer, index_offset );
+        appendU64( footer, this->index.size() );
+        appendU64( footer, keys_offset );
+        footer.append( Snapshot::magic, sizeof(Snapshot::magic) );
+        this->writer.write(footer);
+
+        this->writer.flush();
+
+    }
+
+
+
+    size_t SnapshotWriter::size() const{
+
+        return this->index.size();
+
+    }
+
+
+
+    SnapshotReader::SnapshotReader( const string& path )
+        :path(path)
+    {
+
+        const int fd = ::open( path.c_str(), O_RDONLY );
+        if( fd < 0 ){
+            throw std::runtime_error("Failed to open the snapshot '" + path + "'.");
+        }
+
+        struct stat file_stat;
+        if( ::fstat(fd, &file_stat) != 0 ){
+            ::close(fd);
+            throw std::runtime_error("Failed to stat the snapshot '" + path + "'.");
+        }
+
+        this->data_size = static_cast<size_t>(file_stat.st_size);
+
+        if( this->data_size < Snapshot::header_size + Snapshot::footer_size ){
+            ::close(fd);
+            throw std::runtime_error("'" + path + "' is not a kubepp snapshot.");
+        }
+
+        void* mapped = ::mmap( nullptr, this->data_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        ::close(fd);
+
+        if( mapped == MAP_FAILED ){
+            throw std::runtime_error("Failed to map the snapshot '" + path + "'.");
+        }
+        this->data = static_cast<const uint8_t*>(mapped);
+
+        const uint64_t footer_offset = this->data_size - Snapshot::footer_size;
+
+        if( std::memcmp( this->data, Snapshot::magic, sizeof(Snapshot::magic) ) != 0 || std::memcmp( this->data + footer_offset + 24, Snapshot::magic, sizeof(Snapshot::magic) ) != 0 ){
+            ::munmap( const_cast<uint8_t*>(this->data), this->data_size );
+            throw std::runtime_error("'" + path + "' is not a kubepp snapshot, or it is truncated.");
+        }
+
+        this->version = this->readU32(8);
+        if( this->version < 1 || this->version > Snapshot::version ){
+            ::munmap( const_cast<uint8_t*>(this->data), this->data_size );
+            throw std::runtime_error("The snapshot '" + path + "' has unsupported version " + std::to_string(this->version) + ".");
+        }
+
+        this->encoding = static_cast<Snapshot::Encoding>( this->readU32(12) );
+        this->index_offset = this->readU64( footer_offset );
+        this->object_count = this->readU64( footer_offset + 8 );
+        this->keys_offset = this->readU64( footer_offset + 16 );
+
+        if( this->encoding != Snapshot::Encoding::CBOR && this->encoding != Snapshot::Encoding::MESSAGE_PACK ){
+            ::munmap( const_cast<uint8_t*>(this->data), this->data_size );
+            throw std::runtime_error("The snapshot '" + path + "' has unknown encoding " + std::to_string(this->readU32(12)) + ".");
+        }
+
+        if( this->index_offset < Snapshot::header_size || this->index_offset > footer_offset || this->object_count > ( footer_offset - this->index_offset ) / Snapshot::index_entry_size
+            || this->index_offset + this->object_count * Snapshot::index_entry_size != this->keys_offset ){
+            ::munmap( const_cast<uint8_t*>(this->data), this->data_size );
+            throw std::runtime_error("The index of the snapshot '" + path + "' is corrupt.");
+        }
+
+        // every payload lies between the header and the index and every key in the keys region, so no read leaves the map
+        const uint64_t keys_size = footer_offset - this->keys_offset;
+        for( uint64_t position = 0; position < this->object_count; position++ ){
+
+            const uint64_t entry_offset = this->index_offset + position * Snapshot::index_entry_size;
+            const uint64_t payload_offset = this->readU64( entry_offset );
+            const uint64_t payload_size = this->readU32( entry_offset + 8 );
+            const uint64_t key_size = this->readU32( entry_offset + 12 );
+            const uint64_t key_offset = this->readU64( entry_offset + 16 );
+
+            if( payload_offset < Snapshot::header_size || payload_offset > this->index_offset || payload_size > this->index_offset - payload_offset
+                || key_offset > keys_size || key_size > keys_size - key_offset ){
+                ::munmap( const_cast<uint8_t*>(this->data), this->data_size );
+                throw std::runtime_error("Index entry " + std::to_string(position) + " of the snapshot '" + path + "' points outside its region; the snapshot is corrupt.");
+            }
+
+        }
+
+        // objects are read in index order, which is mostly not file order
+        ::madvise( const_cast<uint8_t*>(this->data), this->data_size, MADV_RANDOM );
+
+    }
+
+
+
+    SnapshotReader::~SnapshotReader(){
+
+        if( this->data ){
+            ::munmap( const_cast<uint8_t*>(this->data), this->data_size );
+        }
+
+    }
+
+
+
+    uint64_t SnapshotReader::readU64( uint64_t offset ) const{
+
+        uint64_t value = 0;
+        for( int i = 7; i >= 0; i-- ){
+            value = (value << 8) | this->data[offset + i];
+        }
+        return value;
+
+    }
+
+
+
+    uint32_t SnapshotReader::readU32( uint64_t offset ) const{
+
+        uint32_t value = 0;
+        for( int i = 3; i >= 0; i-- ){
+            value = (value << 8) | this->data[offset + i];
+        }
+        return value;
+
+    }
+
+
+
+    size_t SnapshotReader::size() const{
+
+        return this->object_count;
+
+    }
+
+
+
+    uint32_t SnapshotReader::getVersion() const{
+
+        return this->version;
+
+    }
+
+
+
+    string_view SnapshotReader::getKey( size_t position ) const{
+
+        const uint64_t entry_offset = this->index_offset + position * Snapshot::index_entry_size;
+        const uint32_t key_size = this->readU32( entry_offset + 12 );
+        const uint64_t key_offset = this->keys_offset + this->readU64( entry_offset + 16 );
+
+        return string_view( reinterpret_cast<const char*>(this->data + key_offset), key_size );
+
+    }
+
+
+
+    vector<string_view> SnapshotReader::getKeyFields( size_t position ) const{
+
+        vector<string_view> fields;
+        string_view key = this->getKey(position);
+
+        while( true ){
+            const size_t separator = key.find('\0');
+            if( separator == string_view::npos ){
+                break;
+            }
+            fields.push_back( key.substr(0, separator) );
+            key.remove_prefix( separator + 1 );
+        }
+        fields.push_back(key);
+
+        // so every KeyField can be indexed
+        if( fields.size() <= Snapshot::RESOURCE_VERSION ){
+            fields.resize( Snapshot::RESOURCE_VERSION + 1 );
+        }
+
+        return fields;
+
+    }
+
+
+
+    json SnapshotReader::get( size_t position ) const{
+
+        if( position >= this->object_count ){
+            throw std::runtime_error("Position " + std::to_string(position) + " is out of range of the snapshot '" + this->path + "'.");
+        }
+
+        const uint64_t entry_offset = this->index_offset + position * Snapshot::index_entry_size;
+        const uint64_t payload_offset = this->readU64( entry_offset );
+        const uint32_t payload_size = this->readU32( entry_offset + 8 );
+
+        const uint8_t* begin = this->data + payload_offset;
+        const uint8_t* end = begin + payload_size;
+
+        if( this->encoding == Snapshot::Encoding::MESSAGE_PACK ){
+            return json::from_msgpack( begin, end );
+        }
+        return json::from_cbor( begin, end );
+
+    }
+
+
+
+    std::pair<size_t, size_t> SnapshotReader::findRange( const string& prefix ) const{
+
+        // first key >= prefix
+        size_t low = 0;
+        size_t high = this->object_count;
+        while( low < high ){
+            const size_t middle = low + (high - low) / 2;
+            if( this->getKey(middle) < prefix ){
+                low = middle + 1;
+            }else{
+                high = middle;
+            }
+        }
+        const size_t begin = low;
+
+        // first key after begin that doesn't start with prefix
+        high = this->object_count;
+        while( low < high ){
+            const size_t middle = low + (high - low) / 2;
+            if( this->getKey(middle).substr(0, prefix.size()) == prefix ){
+                low = middle + 1;
+            }else{
+                high = middle;
+            }
+        }
+
+        return { begin, low };
+
+    }
+
+
+
+    size_t SnapshotReader::findPosition( const string& kind, const string& k8s_namespace, const string& name, const string& api_version ) const{
+
+        string prefix = kind;
+        prefix += '\0';
+        prefix += k8s_namespace;
+        prefix += '\0';
+        prefix += name;
+        prefix += '\0';
+        prefix += api_version;
+        prefix += '\0';
+
+        auto [begin, end] = this->findRange(prefix);
+        return ( begin == end ) ? SnapshotReader::npos : begin;
+
+    }
+
+
+
+    json SnapshotReader::find( const string& kind, const string& k8s_namespace, const string& name ) const{
+
+        string prefix = kind;
+        prefix += '\0';
+        prefix += k8s_namespace;
+        prefix += '\0';
+        prefix += name;
+        prefix += '\0';
+
+        auto [begin, end] = this->findRange(prefix);
+        if( begin == end ){
+            return json();
+        }
+        return this->get(begin);
+
+    }
+
+
+
+    void SnapshotReader::forEach( const string& kind, const string& k8s_namespace, const std::function<bool(json&)>& on_resource ) const{
+
+        string prefix = kind;
+        prefix += '\0';
+        if( !k8s_namespace.empty() ){
+            prefix += k8s_namespace;
+            prefix += '\0';
+        }
+
+        auto [begin, end] = this->findRange(prefix);
+
+        for( size_t position = begin; position < end; position++ ){
+            json resource = this->get(position);
+            if( !on_resource(resource) ){
+                return;
+            }
+        }
+
+    }
+
+
+
+    void SnapshotReader::runPlan( const QueryPlan& plan, const std::function<void(json&)>& on_resource ) const{
+
+        const string k8s_namespace = plan.getNamespace();
+
+        auto scan = [&]( size_t begin, size_t end, const string& api_version ){
+            for( size_t position = begin; position < end; position++ ){
+
+                const vector<string_view> fields = this->getKeyFields(position);
+
+                // the namespace and apiVersion are checked on the index before decoding
+                if( !k8s_namespace.empty() && fields[Snapshot::NAMESPACE] != k8s_namespace ){
+                    continue;
+                }
+                if( !api_version.empty() && fields[Snapshot::API_VERSION] != api_version ){
+                    continue;
+                }
+
+                json resource = this->get(position);
+                if( plan.matchesAll(resource) ){
+                    on_resource(resource);
+                }
+
+            }
+        };
+
+        if( plan.all_kinds ){
+            scan( 0, this->object_count, "" );
+            return;
+        }
+
+        for( const ResourceDescription& target : plan.targets ){
+
+            string prefix = target.kind;
+            prefix += '\0';
+            if( !k8s_namespace.empty() ){
+                prefix += k8s_namespace;
+                prefix += '\0';
+            }
+
+            auto [begin, end] = this->findRange(prefix);
+            scan( begin, end, target.api_group_version );
+
+        }
+
+    }
+
+
+
+    json SnapshotReader::runQuery( const string& query_str, const vector<string>& parameters ) const{
+
+        Query query(query_str);
+        QueryPlan plan(query);
+        plan.bind(parameters);
+
+        if( query.explain ){
+            return {
+                {"query", query.asJson()},
+                {"plan", plan.asJson()},
+                {"source", this->path}
+            };
+        }
+
+        json results = json::array();
+
+        this->runPlan( plan, [&plan, &results]( json& resource ){
+            results.push_back( plan.project(resource) );
+        });
+
+        return results;
+
+    }
+
+
+
+    void SnapshotReader::streamQuery( const string& query_str, const std::function<void(json& row)>& on_row, const vector<string>& parameters ) const{
+
+        Query query(query_str);
+        QueryPlan plan(query);
+        plan.bind(parameters);
+
+        this->runPlan( plan, [&plan, &on_row]( json& resource ){
+            json row = plan.project(resource);
+            on_row(row);
+        });
+
+    }
+
+
+
+    SnapshotComparison::SnapshotComparison( const SnapshotReader& snapshot )
+        :snapshot(snapshot), seen( snapshot.size(), false )
+    {
+
+        if( snapshot.getVersion() < 2 ){
+            throw std::runtime_error("The snapshot was written by an older kubepp ( format version " + std::to_string(snapshot.getVersion()) + " ) without uids and resourceVersions in its index, so changes can't be compared with it; take a new snapshot.");
+        }
+
+    }
+
+
+
+    vector<json> SnapshotComparison::compare( json& resource ){
+
+        vector<json> deltas;
+
+        if( !resource.is_object() || !resource.contains("metadata") || !resource["metadata"].is_object() ){
+            return deltas;
+        }
+
+        const json& metadata = resource["metadata"];
+        const string uid = metadata.value("uid", "");
+        const string resource_version = metadata.value("resourceVersion", "");
+
+        const size_t position = this->snapshot.findPosition( resource.value("kind", ""), metadata.value("namespace", ""), metadata.value("name", ""), resource.value("apiVersion", "") );
+
+        string type = "ADDED";
+
+        if( position != SnapshotReader::npos ){
+
+            this->seen[position] = true;
+            const vector<string_view> fields = this->snapshot.getKeyFields(position);
+
+            if( fields[Snapshot::UID] != uid ){
+                deltas.push_back( this->getDeletedDelta(position) );
+            }else if( fields[Snapshot::RESOURCE_VERSION] != resource_version ){
+                type = "MODIFIED";
+            }else{
+                this->unchanged++;
+                return deltas;
+            }
+
+        }
+
+        if( type == "ADDED" ){
+            this->added++;
+        }else{
+            this->modified++;
+        }
+
+        json delta = { {"type", type}, {"key", ContinuousQuery::getKey(resource)} };
+        delta["object"] = std::move(resource);
+        deltas.push_back( std::move(delta) );
+
+        return deltas;
+
+    }
+
+
+
+    vector<json> SnapshotComparison::getDeleted( const vector<ResourceDescription>& incomplete_lists ) const{
+
+        vector<json> deltas;
+
+        for( size_t position = 0; position < this->seen.size(); position++ ){
+
+            if( this->seen[position] ){
+                continue;
+            }
+
+            if( !incomplete_lists.empty() ){
+                const vector<string_view> fields = this->snapshot.getKeyFields(position);
+                const bool incomplete = std::any_of( incomplete_lists.begin(), incomplete_lists.end(), [&fields]( const ResourceDescription& incomplete_list ){
+                    return ( incomplete_list.api_group_version.empty() || incomplete_list.api_group_version == fields[Snapshot::API_VERSION] )
+                        && ( incomplete_list.kind.empty() || incomplete_list.kind == fields[Snapshot::KIND] );
+                });
+                if( incomplete ){
+                    continue;
+                }
+            }
+
+            deltas.push_back( this->getDeletedDelta(position) );
+
+        }
+
+        return deltas;
+
+    }
+
+
+
+    json SnapshotComparison::getDeletedDelta( size_t position ) const{
+
+        const vector<string_view> fields = this->snapshot.getKeyFields(position);
+
+        json metadata = { {"name", fields[Snapshot::NAME]}, {"uid", fields[Snapshot::UID]}, {"resourceVersion", fields[Snapshot::RESOURCE_VERSION]} };
+        if( !fields[Snapshot::NAMESPACE].empty() ){
+            metadata["namespace"] = fields[Snapshot::NAMESPACE];
+        }
+
+        json object = { {"apiVersion", fields[Snapshot::API_VERSION]}, {"kind", fields[Snapshot::KIND]}, {"metadata", std::move(metadata)} };
+
+        json delta = { {"type", "DELETED"}, {"key", ContinuousQuery::getKey(object)} };
+        delta["object"] = std::move(object);
+        return delta;
+
+    }
+
+
+}
@@ -0,0 +1,200 @@
+#pragma once
+
+
+#include <string>
+using std::string;
+
+#include <vector>
+using std::vector;
+
+#include <string_view>
+using std::string_view;
+
+#include <ostream>
+#include <memory>
+#include <functional>
+#include <cstdint>
+
+#include "json_fwd.hpp"
+using json = nlohmann::json;
+
+#include "BufferedWriter.h"
+#include "QueryPlan.h"
+#include "ResourceDescription.h"
+
+
+namespace kubepp{
+
+
+    /*
+        A binary snapshot of cluster objects that can be queried without re-parsing it.
+
+        Layout ( little-endian ):
+            header      "KUBEPPSS", u32 version, u32 encoding ( 1 = CBOR, 2 = MessagePack )
+            payloads    every object, encoded on its own
+            index       per object: u64 payload offset, u32 payload size, u32 key size, u64 key offset
+            keys        "<kind>\0<namespace>\0<name>\0<apiVersion>\0<uid>\0<resourceVersion>" for every object
+            footer      u64 index offset, u64 object count, u64 keys offset, "KUBEPPSS"
+
+        The index is sorted by key, so a kind, a kind in a namespace, or a single object is a binary search,
+        and an object can be compared with the cluster ( uid, resourceVersion ) without decoding it.
+        Only the footer is written after the payloads, so a snapshot can be streamed to a pipe.
+        Version 1 keys end at the apiVersion; they can be queried, but not compared with the cluster.
+    */
+    class Snapshot{
+
+        public:
+            enum class Encoding : uint32_t{ CBOR = 1, MESSAGE_PACK = 2 };
+
+            static constexpr char magic[8] = { 'K', 'U', 'B', 'E', 'P', 'P', 'S', 'S' };
+            static constexpr uint32_t version = 2;
+            static constexpr size_t header_size = 16;
+            static constexpr size_t index_entry_size = 24;
+            static constexpr size_t footer_size = 32;
+
+            /* The index key of an object; kind, namespace and name sort first so they can be searched by prefix. */
+            static string getKey( const string& kind, const string& k8s_namespace, const string& name, const string& api_version, const string& uid = "", const string& resource_version = "" );
+
+            // positions of the fields in SnapshotReader::getKeyFields
+            enum KeyField{ KIND = 0, NAMESPACE, NAME, API_VERSION, UID, RESOURCE_VERSION };
+
+    };
+
+
+
+    /* Writes a snapshot, one object at a time. Only the index keys are kept in memory. */
+    class SnapshotWriter{
+
+        public:
+            SnapshotWriter( std::ostream& output, Snapshot::Encoding encoding = Snapshot::Encoding::CBOR );
+
+            /* Appends an object; it needs apiVersion, kind and metadata.name. */
+            void add( const json& resource );
+
+            /* Writes the index and the footer. Nothing can be added afterwards. */
+            void finish();
+
+            size_t size() const;
+
+
+        protected:
+
+            class IndexEntry{
+                public:
+                    string key;
+                    uint64_t offset = 0;
+                    uint32_t size = 0;
+            };
+
+            BufferedWriter writer;
+            const Snapshot::Encoding encoding;
+            vector<IndexEntry> index;
+            vector<uint8_t> encoded;
+            uint64_t offset = 0;
+            bool finished = false;
+
+    };
+
+
+
+    /*
+        Reads a snapshot through a read-only memory map. Opening it checks the header, the footer and that every index entry
+        points inside the file; objects are decoded when they're accessed, and only the ones a query's kinds and namespace select.
+    */
+    class SnapshotReader{
+
+        public:
+            SnapshotReader( const string& path );
+            ~SnapshotReader();
+
+            SnapshotReader( const SnapshotReader& ) = delete;
+            SnapshotReader& operator=( const SnapshotReader& ) = delete;
+
+            size_t size() const;
+
+            /* The format version the snapshot was written in ( see Snapshot::version ). */
+            uint32_t getVersion() const;
+
+            /* Decodes the object at an index position. */
+            json get( size_t position ) const;
+
+            /* The object, or null if the snapshot doesn't have it. */
+            json find( const string& kind, const string& k8s_namespace, const string& name ) const;
+
+            /* Decodes every object of a kind, optionally in one namespace; return false from on_resource to stop. */
+            void forEach( const string& kind, const string& k8s_namespace, const std::function<bool(json&)>& on_resource ) const;
+
+            /* Runs a query against the snapshot instead of an apiserver: every WHERE predicate is evaluated locally. */
+            json runQuery( const string& query_str, const vector<string>& parameters = {} ) const;
+
+            /* The same, handing each row to on_row as it's decoded instead of collecting the results. EXPLAIN is ignored. */
+            void streamQuery( const string& query_str, const std::function<void(json& row)>& on_row, const vector<string>& parameters = {} ) const;
+
+            /* The object's position in the index, or npos if the snapshot doesn't have it. */
+            size_t findPosition( const string& kind, const string& k8s_namespace, const string& name, const string& api_version ) const;
+            static constexpr size_t npos = static_cast<size_t>(-1);
+
+            /* The key fields of an index position ( see Snapshot::KeyField ), without decoding the object. */
+            vector<string_view> getKeyFields( size_t position ) const;
+
+
+        protected:
+            string_view getKey( size_t position ) const;
+            uint64_t readU64( uint64_t offset ) const;
+            uint32_t readU32( uint64_t offset ) const;
+
+            // the index positions whose key starts with the prefix
+            std::pair<size_t, size_t> findRange( const string& prefix ) const;
+
+            void runPlan( const QueryPlan& plan, const std::function<void(json&)>& on_resource ) const;
+
+            string path;
+            const uint8_t* data = nullptr;
+            size_t data_size = 0;
+
+            Snapshot::Encoding encoding = Snapshot::Encoding::CBOR;
+            uint32_t version = Snapshot::version;
+            uint64_t index_offset = 0;
+            uint64_t object_count = 0;
+            uint64_t keys_offset = 0;
+
+    };
+
+
+
+    /*
+        Compares live objects with a snapshot by uid and resourceVersion, producing the changes since it was taken:
+            {"type": "ADDED" | "MODIFIED" | "DELETED", "key": "<apiVersion>:<kind>/<namespace>/<name>", "object": <object>}
+        A recreated object ( same name, new uid ) is reported as DELETED followed by ADDED. Deleted objects carry
+        only apiVersion, kind and metadata, taken from the snapshot index. Version 1 snapshots don't index uids and
+        resourceVersions, so they're rejected.
+    */
+    class SnapshotComparison{
+
+        public:
+            SnapshotComparison( const SnapshotReader& snapshot );
+
+            /* The changes for one live object: none, one, or two for a recreated object. */
+            vector<json> compare( json& resource );
+
+            /*
+                Objects in the snapshot that compare() hasn't seen. Call once, after every live object. Objects of the incomplete kinds
+                ( see KubernetesClient::streamQuery; an empty kind or apiVersion matches any ) may just not have been listed, so they're left out.
+            */
+            vector<json> getDeleted( const vector<ResourceDescription>& incomplete_lists = {} ) const;
+
+            size_t added = 0;
+            size_t modified = 0;
+            size_t unchanged = 0;
+
+
+        protected:
+            json getDeletedDelta( size_t position ) const;
+
+            const SnapshotReader& snapshot;
+            vector<bool> seen;
+
+    };
+
+
+}
@@ -0,0 +1,351 @@
+#include "TableFormatter.h"
+
+#include <algorithm>
+#include <cctype>
+#include <ctime>
+
+#include "json.hpp"
+using json = nlohmann::json;
+
+
+namespace kubepp{
+
+
+    TableFormatter::TableFormatter( std::ostream& output, const vector<string>& headers, size_t window_size )
+        :output(output), headers(headers), window_size( window_size > 0 ? window_size : 1 )
+    {
+
+        for( const string& header : headers ){
+            this->widths.push_back( header.size() );
+        }
+
+    }
+
+
+
+    void TableFormatter::addRow( const vector<string>& cells ){
+
+        this->window.push_back(cells);
+
+        if( this->window.size() >= this->window_size ){
+            this->flushWindow();
+        }
+
+    }
+
+
+
+    void TableFormatter::finish(){
+
+        this->flushWindow();
+
+        if( !this->header_written ){
+            this->writeRow( this->headers );
+            this->header_written = true;
+        }
+
+        this->output.flush();
+
+    }
+
+
+
+    void TableFormatter::flushWindow(){
+
+        for( const auto& row : this->window ){
+            for( size_t column = 0; column < row.size() && column < this->widths.size(); column++ ){
+                this->widths[column] = std::max( this->widths[column], row[column].size() );
+            }
+        }
+
+        if( !this->header_written && !this->window.empty() ){
+            this->writeRow( this->headers );
+            this->header_written = true;
+        }
+
+        for( const auto& row : this->window ){
+            this->writeRow(row);
+        }
+
+        this->window.clear();
+
+    }
+
+
+
+    void TableFormatter::writeRow( const vector<string>& cells ){
+
+        string line;
+
+        for( size_t column = 0; column < this->widths.size(); column++ ){
+
+            const string& cell = ( column < cells.size() ) ? cells[column] : "";
+            line += cell;
+
+            // no padding after the last column
+            if( column + 1 < this->widths.size() ){
+                line.append( this->widths[column] - std::min(cell.size(), this->widths[column]) + 3, ' ' );
+            }
+
+        }
+
+        this->output << line << '\n';
+
+    }
+
+
+
+    vector<TableFormatter::Column> TableFormatter::getKindColumns( const string& kind ){
+
+        auto column = []( const string& header, const string& path, Column::Format format = Column::Format::VALUE ){
+            Column c;
+            c.header = header;
+            c.path = FieldPath(path);
+            c.format = format;
+            return c;
+        };
+
+        const Column name_column = column("NAME", "metadata.name");
+        const Column namespace_column = column("NAMESPACE", "metadata.namespace");
+        const Column age_column = column("AGE", "metadata.creationTimestamp", Column::Format::AGE);
+
+        if( kind == "Pod" ){
+            return { namespace_column, name_column, column("STATUS", "status.phase"), column("NODE", "spec.nodeName"), column("IP", "status.podIP"), age_column };
+        }
+        if( kind == "Node" ){
+            return { name_column, column("VERSION", "status.nodeInfo.kubeletVersion"), column("OS-IMAGE", "status.nodeInfo.osImage"), column("RUNTIME", "status.nodeInfo.containerRuntimeVersion"), age_column };
+        }
+        if( kind == "Deployment" || kind == "StatefulSet" || kind == "ReplicaSet" ){
+            return { namespace_column, name_column, column("DESIRED", "spec.replicas"), column("READY", "status.readyReplicas"), column("AVAILABLE", "status.availableReplicas"), age_column };
+        }
+        if( kind == "DaemonSet" ){
+            return { namespace_column, name_column, column("DESIRED", "status.desiredNumberScheduled"), column("READY", "status.numberReady"), column("AVAILABLE", "status.numberAvailable"), age_column };
+        }
+        if( kind == "Service" ){
+            return { namespace_column, name_column, column("TYPE", "spec.type"), column("CLUSTER-IP", "spec.clusterIP"), age_column };
+        }
+        if( kind == "Namespace" ){
+            return { name_column, column("STATUS", "status.phase"), age_column };
+        }
+        if( kind == "Event" ){
+            return { namespace_column, column("TYPE", "type"), column("REASON", "reason"), column("OBJECT", "involvedObject.name"), column("MESSAGE", "message") };
+        }
+
+        // mixed or unknown kinds
+        return { column("KIND", "kind"), namespace_column, name_column, age_column };
+
+    }
+
+
+
+    vector<TableFormatter::Column> TableFormatter::getSelectColumns( const vector<FieldPath>& select_paths ){
+
+        vector<Column> columns;
+
+        for( const FieldPath& select_path : select_paths ){
+            Column column;
+            column.header = select_path.asString();
+            std::transform( column.header.begin(), column.header.end(), column.header.begin(), ::toupper );
+            column.row_key = select_path.asString();
+            columns.push_back(column);
+        }
+
+        return columns;
+
+    }
+
+
+
+    vector<string> TableFormatter::getHeaders( const vector<Column>& columns ){
+
+        vector<string> headers;
+        for( const Column& column : columns ){
+            headers.push_back( column.header );
+        }
+        return headers;
+
+    }
+
+
+
+    vector<string> TableFormatter::getCells( const vector<Column>& columns, const json& resource ){
+
+        vector<string> cells;
+        cells.reserve( columns.size() );
+
+        for( const Column& column : columns ){
+
+            string cell;
+
+            if( !column.row_key.empty() ){
+                auto it = resource.find( column.row_key );
+                cell = ( it != resource.end() ) ? TableFormatter::cellToString(*it) : "";
+            }else if( column.path.hasWildcard() ){
+                cell = TableFormatter::cellToString( column.path.extract(resource) );
+            }else{
+                const json* value = column.path.resolve(resource);
+                cell = value ? TableFormatter::cellToString(*value) : "";
+            }
+
+            if( column.format == Column::Format::AGE ){
+                cell = TableFormatter::formatAge(cell);
+            }
+
+            cells.push_back( cell.empty() ? "<none>" : cell );
+
+        }
+
+        return cells;
+
+    }
+
+
+
+    string TableFormatter::formatAge( const string& timestamp ){
+
+        std::tm created{};
+        if( timestamp.empty() || !strptime( timestamp.c_str(), "%Y-%m-%dT%H:%M:%S", &created ) ){
+            return "";
+        }
+
+        const long long seconds = static_cast<long long>( std::time(nullptr) - timegm(&created) );
+
+        if( seconds < 0 ){
+            return "0s";
+        }
+        if( seconds < 120 ){
+            return std::to_string(seconds) + "s";
+        }
+        if( seconds < 2 * 3600 ){
+            return std::to_string(seconds / 60) + "m";
+        }
+        if( seconds < 2 * 86400 ){
+            return std::to_string(seconds / 3600) + "h";
+        }
+        return std::to_string(seconds / 86400) + "d";
+
+    }
+
+
+
+    string TableFormatter::cellToString( const json& cell ){
+
+        if( cell.is_string() ){
+            return cell.get<string>();
+        }
+
+        if( cell.is_null() ){
+            return "";
+        }
+
+        return cell.dump();
+
+    }
+
+
+
+    void TableFormatter::writeTable( const json& table, std::ostream& output ){
+
+        TableWriter writer(output);
+        writer.addPage(table);
+        writer.finish();
+
+    }
+
+
+
+    TableWriter::TableWriter( std::ostream& output )
+        :output(output)
+    {
+
+    }
+
+
+
+    void TableWriter::addPage( const json& page ){
+
+        const json empty_rows = json::array();
+        const json& rows = ( page.contains("rows") && page["rows"].is_array() ) ? page["rows"] : empty_rows;
+
+        if( !this->formatter ){
+            if( !this->has_columns && page.contains("columnDefinitions") && page["columnDefinitions"].is_array() ){
+                this->setColumns( page["columnDefinitions"] );
+            }
+            if( rows.empty() ){
+                return;
+            }
+            this->start(rows);
+        }
+
+        for( const json& row : rows ){
+
+            vector<string> cells;
+
+            if( this->namespaced ){
+                const json* metadata = ( row.contains("object") && row["object"].contains("metadata") ) ? &row["object"]["metadata"] : nullptr;
+                cells.push_back( metadata ? metadata->value("namespace", "") : "" );
+            }
+
+            for( const size_t index : this->cell_indexes ){
+                cells.push_back( ( row.contains("cells") && index < row["cells"].size() ) ? TableFormatter::cellToString( row["cells"][index] ) : "" );
+            }
+
+            this->formatter->addRow(cells);
+
+        }
+
+    }
+
+
+
+    void TableWriter::finish(){
+
+        if( !this->formatter ){
+            this->start( json::array() );
+        }
+
+        this->formatter->finish();
+
+    }
+
+
+
+    void TableWriter::setColumns( const json& column_definitions ){
+
+        for( size_t i = 0; i < column_definitions.size(); i++ ){
+            const json& column = column_definitions[i];
+            if( column.value("priority", 0) != 0 ){
+                continue;
+            }
+            string header = column.value("name", "");
+            std::transform( header.begin(), header.end(), header.begin(), ::toupper );
+            this->headers.push_back(header);
+            this->cell_indexes.push_back(i);
+        }
+
+        this->has_columns = true;
+
+    }
+
+
+
+    void TableWriter::start( const json& rows ){
+
+        // rows listed with includeObject=Metadata carry their namespace
+        for( const json& row : rows ){
+            if( row.contains("object") && row["object"].contains("metadata") && row["object"]["metadata"].contains("namespace") ){
+                this->namespaced = true;
+                break;
+            }
+        }
+
+        if( this->namespaced ){
+            this->headers.insert( this->headers.begin(), "NAMESPACE" );
+        }
+
+        this->formatter = std::make_unique<TableFormatter>( this->output, this->headers );
+
+    }
+
+
+}
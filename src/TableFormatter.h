@@ -0,0 +1,115 @@
+#pragma once
+
+
+#include <string>
+using std::string;
+
+#include <vector>
+using std::vector;
+
+#include <ostream>
+#include <memory>
+
+#include "json_fwd.hpp"
+using json = nlohmann::json;
+
+#include "FieldPath.h"
+
+
+namespace kubepp{
+
+
+    /*
+        Prints rows as left-aligned text columns separated by three spaces, like kubectl get.
+
+        Rows are printed as they're added: column widths are taken from a look-ahead window of rows, and they only
+        grow afterwards, so the first rows of a long listing appear immediately. A later row wider than its
+        window shifts only the columns after it.
+    */
+    class TableFormatter{
+
+        public:
+
+            /* A column of a resource listing: a path into the object, printed as is or as an age ( "5d", "3h" ). */
+            class Column{
+                public:
+                    enum class Format{ VALUE, AGE };
+
+                    string header;
+                    FieldPath path;
+                    string row_key;     // set instead of path for query rows, which are keyed by the SELECT path
+                    Format format = Format::VALUE;
+            };
+
+            TableFormatter( std::ostream& output, const vector<string>& headers, size_t window_size = 64 );
+
+            void addRow( const vector<string>& cells );
+
+            /* Prints the rows still in the window. */
+            void finish();
+
+            /* The default columns of a kind ( Pod, Node, Deployment, ... ); NAMESPACE, NAME and AGE for the rest. */
+            static vector<Column> getKindColumns( const string& kind );
+
+            /* One column per SELECT path, for rows projected by a query ( keyed by path ). */
+            static vector<Column> getSelectColumns( const vector<FieldPath>& select_paths );
+
+            static vector<string> getHeaders( const vector<Column>& columns );
+            static vector<string> getCells( const vector<Column>& columns, const json& resource );
+
+            /* Prints a meta.k8s.io Table in one piece ( see TableWriter ). */
+            static void writeTable( const json& table, std::ostream& output );
+
+            /* The text of a json cell: strings as is, null as empty, anything else dumped. */
+            static string cellToString( const json& cell );
+
+            /* Time since an RFC 3339 timestamp, in its largest unit ( "45s", "12m", "3h", "5d" ). */
+            static string formatAge( const string& timestamp );
+
+
+        protected:
+            void flushWindow();
+            void writeRow( const vector<string>& cells );
+
+            std::ostream& output;
+            vector<string> headers;
+            vector<vector<string>> window;
+            const size_t window_size;
+            vector<size_t> widths;
+            bool header_written = false;
+
+    };
+
+
+
+    /*
+        Prints a meta.k8s.io Table listed in pages ( see KubernetesClient::streamResourceTable ) as the pages arrive: the priority 0
+        columns, with a NAMESPACE column when the rows carry their object's namespace. The columns are taken from the first page
+        with rows, since a kind's rows either all have a namespace or none do.
+    */
+    class TableWriter{
+
+        public:
+            TableWriter( std::ostream& output );
+
+            void addPage( const json& page );
+
+            /* Prints the rows still in the formatter's window; only the header if there were no rows. */
+            void finish();
+
+
+        protected:
+            void setColumns( const json& column_definitions );
+            void start( const json& rows );
+
+            std::ostream& output;
+            std::unique_ptr<TableFormatter> formatter;
+            vector<string> headers;
+            vector<size_t> cell_indexes;
+            bool has_columns = false;
+            bool namespaced = false;
+
+    };
+
+
+}
@@ -0,0 +1,249 @@
+#include "Tracer.h"
+
+#include <atomic>
+#include <mutex>
+#include <fstream>
+#include <stdexcept>
+
+#include <unistd.h>
+#if defined(__APPLE__)
+    #include <pthread.h>
+#else
+    #include <sys/syscall.h>
+#endif
+
+#include "json.hpp"
+using json = nlohmann::json;
+
+
+namespace kubepp{
+
+
+    namespace{
+
+        class TraceEvent{
+            public:
+                string name;
+                const char* category;
+                int64_t timestamp_us;
+                int64_t duration_us;
+                int thread_id;
+                vector<pair<string, string>> args;
+        };
+
+        std::atomic<bool> tracing_enabled{false};
+        std::mutex events_mutex;
+        vector<TraceEvent> events;
+
+        // timestamps are relative to the first start(), so they stay small in the viewer
+        std::chrono::steady_clock::time_point trace_epoch = std::chrono::steady_clock::now();
+
+        int64_t toMicroseconds( std::chrono::steady_clock::duration duration ){
+
+            return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+
+        }
+
+    }
+
+
+
+    Tracer::Span::Span( const char* name, const char* category )
+        :category(category)
+    {
+
+        if( tracing_enabled.load(std::memory_order_relaxed) ){
+            this->recording = true;
+            this->name = name;
+            this->start = std::chrono::steady_clock::now();
+        }
+
+    }
+
+
+
+    Tracer::Span::Span( const string& name, const char* category )
+        :category(category)
+    {
+
+        if( tracing_enabled.load(std::memory_order_relaxed) ){
+            this->recording = true;
+            this->name = name;
+            this->start = std::chrono::steady_clock::now();
+        }
+
+    }
+
+
+
+    Tracer::Span::~Span(){
+
+        if( !this->recording ){
+            return;
+        }
+
+        const auto end = std::chrono::steady_clock::now();
+
+        TraceEvent event;
+        event.name = std::move(this->name);
+        event.category = this->category;
+        event.timestamp_us = toMicroseconds( this->start - trace_epoch );
+        event.duration_us = toMicroseconds( end - this->start );
+        event.thread_id = Tracer::getThreadId();
+        event.args = std::move(this->args);
+
+        std::lock_guard<std::mutex> lock(events_mutex);
+        events.push_back( std::move(event) );
+
+    }
+
+
+
+    void Tracer::Span::setArg( const string& key, const string& value ){
+
+        if( this->recording ){
+            this->args.emplace_back( key, json(value).dump() );
+        }
+
+    }
+
+
+
+    void Tracer::Span::setArg( const string& key, double value ){
+
+        if( this->recording ){
+            this->args.emplace_back( key, json(value).dump() );
+        }
+
+    }
+
+
+
+    bool Tracer::Span::isRecording() const{
+
+        return this->recording;
+
+    }
+
+
+
+    void Tracer::start(){
+
+        std::lock_guard<std::mutex> lock(events_mutex);
+        events.clear();
+        trace_epoch = std::chrono::steady_clock::now();
+        tracing_enabled.store(true);
+
+    }
+
+
+
+    void Tracer::stop(){
+
+        tracing_enabled.store(false);
+
+    }
+
+
+
+    bool Tracer::isEnabled(){
+
+        return tracing_enabled.load(std::memory_order_relaxed);
+
+    }
+
+
+
+    void Tracer::write( std::ostream& output ){
+
+        const int process_id = static_cast<int>( ::getpid() );
+
+        std::lock_guard<std::mutex> lock(events_mutex);
+
+        output << "{\"traceEvents\":[";
+
+        bool first = true;
+        for( const TraceEvent& event : events ){
+
+            output << ( first ? "\n" : ",\n" );
+            first = false;
+
+            output << "{\"name\":" << json(event.name).dump()
+                   << ",\"cat\":\"" << event.category << "\""
+                   << ",\"ph\":\"X\""
+                   << ",\"ts\":" << event.timestamp_us
+                   << ",\"dur\":" << event.duration_us
+                   << ",\"pid\":" << process_id
+                   << ",\"tid\":" << event.thread_id;
+
+            if( !event.args.empty() ){
+                output << ",\"args\":{";
+                for( size_t i = 0; i < event.args.size(); i++ ){
+                    output << ( i ? "," : "" ) << json(event.args[i].first).dump() << ":" << event.args[i].second;
+                }
+                output << "}";
+            }
+
+            output << "}";
+
+        }
+
+        output << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+    }
+
+
+
+    void Tracer::writeFile( const string& path ){
+
+        std::ofstream output( path, std::ios::trunc );
+        if( !output ){
+            throw std::runtime_error( "Cannot write the trace to '" + path + "'." );
+        }
+
+        Tracer::write(output);
+
+        if( !output ){
+            throw std::runtime_error( "Failed to write the trace to '" + path + "'." );
+        }
+
+    }
+
+
+
+    size_t Tracer::getEventCount(){
+
+        std::lock_guard<std::mutex> lock(events_mutex);
+        return events.size();
+
+    }
+
+
+
+    void Tracer::clear(){
+
+        std::lock_guard<std::mutex> lock(events_mutex);
+        events.clear();
+
+    }
+
+
+
+    int Tracer::getThreadId(){
+
+        thread_local const int thread_id = [](){
+#if defined(__APPLE__)
+            uint64_t id = 0;
+            pthread_threadid_np( nullptr, &id );
+            return static_cast<int>(id);
+#else
+            return static_cast<int>( ::syscall(SYS_gettid) );
+#endif
+        }();
+
+        return thread_id;
+
+    }
+
+
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+
+#include <string>
+using std::string;
+
+#include <vector>
+using std::vector;
+
+#include <utility>
+using std::pair;
+
+#include <chrono>
+#include <ostream>
+
+
+namespace kubepp{
+
+
+    /*
+        Optional tracing of query execution as Chrome trace-event json ( open it in chrome://tracing or ui.perfetto.dev ).
+
+        runQuery, streamQuery and exports record spans for discovery, each kind's list, page fetches, cJSON or protobuf
+        parsing, nlohmann conversion, filtering, row delivery and serialization, with the process and OS thread ids.
+        Tracing is off by default; a disabled Span costs one relaxed atomic load.
+
+            Tracer::start();
+            kube_client.runQuery( "SELECT * FROM Pod" );
+            Tracer::writeFile( "query.trace.json" );
+    */
+    class Tracer{
+
+        public:
+
+            /* A complete ( "X" ) event from construction to destruction, on the calling thread. */
+            class Span{
+                public:
+                    Span( const char* name, const char* category = "query" );
+                    Span( const string& name, const char* category = "query" );
+                    ~Span();
+
+                    Span( const Span& ) = delete;
+                    Span& operator=( const Span& ) = delete;
+
+                    /* Shown in the event's args; ignored when tracing is off. */
+                    void setArg( const string& key, const string& value );
+                    void setArg( const string& key, double value );
+
+                    bool isRecording() const;
+
+                protected:
+                    bool recording = false;
+                    string name;
+                    const char* category;
+                    std::chrono::steady_clock::time_point start;
+                    vector<pair<string, string>> args;     // values are json
+            };
+
+            /* Starts recording, discarding earlier events. */
+            static void start();
+            static void stop();
+            static bool isEnabled();
+
+            /* {"traceEvents": [...], "displayTimeUnit": "ms"} */
+            static void write( std::ostream& output );
+            static void writeFile( const string& path );
+
+            static size_t getEventCount();
+            static void clear();
+
+            /* The OS id of the calling thread, as recorded in the events. */
+            static int getThreadId();
+
+    };
+
+
+}
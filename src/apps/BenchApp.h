@@ -0,0 +1,565 @@
+#pragma once
+
+
+#include <string>
+using std::string;
+
+#include <stdexcept>
+
+#include <vector>
+using std::vector;
+
+#include <map>
+using std::map;
+
+#include <iostream>
+using std::cout;
+using std::endl;
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "KubernetesClient.h"
+#include "ListOptions.h"
+#include "ResourceDescription.h"
+
+#include "json.hpp"
+using json = nlohmann::json;
+
+
+namespace kubepp::apps {
+
+    /*
+        Load generator: runs streams of get, list, watch or patch requests through KubernetesClient for a fixed duration, then prints
+        each stream's achieved rate, error rate and latency percentiles as json.
+
+        A stream is "verb[,kind=Pod][,qps=10][,concurrency=1][,namespace=...][,name=...][,limit=500][,timeout=30]", eg.
+            kubepp bench --duration 30 --stream list,kind=Pod,qps=20,concurrency=4 --stream get,kind=apps/v1:Deployment,qps=100
+
+        qps is the stream's target rate, shared by its workers ( 0: as fast as they can ). Each worker has its own client and connection.
+        With a qps, latency_ms is measured from when each request was due, so a slow apiserver that holds the workers back shows up in
+        it ( rather than as fewer, fast requests ); service_time_ms is measured from when it was actually sent, and unsent counts the
+        requests that were due before the end but never sent.
+        get and patch cycle through the named object or up to 100 listed ones. patch sets the kubepp.io/bench annotation, so it writes to the cluster.
+        watch holds 'concurrency' watches open, each re-established after 'timeout' seconds; it reports events instead of latencies.
+    */
+    class BenchApp {
+
+        public:
+
+            class Stream{
+                public:
+                    string verb;
+                    string kind = "Pod";
+                    string k8s_namespace;
+                    bool namespace_set = false;
+                    string name;
+                    double qps = 10.0;
+                    size_t concurrency = 1;
+                    size_t limit = 500;
+                    int timeout_seconds = 30;
+
+                    string spec;
+
+                    static Stream parse( const string& spec ){
+
+                        Stream stream;
+                        stream.spec = spec;
+
+                        size_t start = 0;
+                        while( start <= spec.size() ){
+
+                            size_t end = spec.find(',', start);
+                            if( end == string::npos ){
+                                end = spec.size();
+                            }
+                            const string field = spec.substr(start, end - start);
+                            start = end + 1;
+
+                            if( field.empty() ){
+                                continue;
+                            }
+
+                            const size_t equals_pos = field.find('=');
+                            const string key = equals_pos == string::npos ? "verb" : field.substr(0, equals_pos);
+                            const string value = equals_pos == string::npos ? field : field.substr(equals_pos + 1);
+
+                            try{
+                                if( key == "verb" ){
+                                    stream.verb = value;
+                                }else if( key == "kind" ){
+                                    stream.kind = value;
+                                }else if( key == "namespace" ){
+                                    stream.k8s_namespace = value;
+                                    stream.namespace_set = true;
+                                }else if( key == "name" ){
+                                    stream.name = value;
+                                }else if( key == "qps" ){
+                                    stream.qps = std::stod(value);
+                                }else if( key == "concurrency" ){
+                                    stream.concurrency = std::stoul(value);
+                                }else if( key == "limit" ){
+                                    stream.limit = std::stoul(value);
+                                }else if( key == "timeout" ){
+                                    stream.timeout_seconds = std::stoi(value);
+                                }else{
+                                    throw std::runtime_error("unknown field '" + key + "'");
+                                }
+                            }catch( const std::logic_error& ){
+                                throw std::runtime_error("Invalid value '" + value + "' for " + key + " in stream '" + spec + "'.");
+                            }catch( const std::runtime_error& e ){
+                                throw std::runtime_error("Invalid stream '" + spec + "': " + e.what() + ".");
+                            }
+
+                        }
+
+                        if( stream.verb != "get" && stream.verb != "list" && stream.verb != "watch" && stream.verb != "patch" ){
+                            throw std::runtime_error("Invalid stream '" + spec + "': the verb must be get, list, watch or patch.");
+                        }
+                        if( stream.concurrency == 0 || stream.qps < 0.0 || stream.timeout_seconds <= 0 ){
+                            throw std::runtime_error("Invalid stream '" + spec + "': concurrency and timeout must be positive and qps can't be negative.");
+                        }
+
+                        return stream;
+
+                    }
+            };
+
+
+            /* Runs the streams concurrently for duration_seconds and prints the report. namespace is the default for namespaced kinds. */
+            void run( const vector<string>& stream_specs, double duration_seconds, const string& k8s_namespace = "default" ){
+
+                cout << this->runStreams( stream_specs, duration_seconds, k8s_namespace ).dump(4) << endl;
+
+            }
+
+
+            json runStreams( const vector<string>& stream_specs, double duration_seconds, const string& k8s_namespace = "default" ){
+
+                if( stream_specs.empty() ){
+                    throw std::runtime_error("Give at least one --stream, eg. --stream list,kind=Pod,qps=10.");
+                }
+
+                vector<std::unique_ptr<StreamRun>> runs;
+
+                {
+                    KubernetesClient kube_client;
+                    for( const string& spec : stream_specs ){
+                        auto stream_run = std::make_unique<StreamRun>();
+                        stream_run->stream = Stream::parse(spec);
+                        if( !stream_run->stream.namespace_set ){
+                            stream_run->stream.k8s_namespace = k8s_namespace;
+                        }
+                        this->prepare( kube_client, *stream_run );
+                        runs.push_back( std::move(stream_run) );
+                    }
+                }
+
+                const auto start = clock::now();
+                const auto deadline = start + std::chrono::duration_cast<clock::duration>( std::chrono::duration<double>(duration_seconds) );
+
+                vector<std::thread> workers;
+                for( auto& stream_run : runs ){
+                    for( size_t worker_index = 0; worker_index < stream_run->stream.concurrency; worker_index++ ){
+                        workers.emplace_back( [this, &stream_run, worker_index, start, deadline](){
+                            try{
+                                this->runWorker( *stream_run, worker_index, start, deadline );
+                            }catch( const std::exception& e ){
+                                std::cerr << "A worker of stream '" << stream_run->stream.spec << "' stopped: " << e.what() << endl;
+                            }
+                        });
+                    }
+                }
+
+                for( auto& worker : workers ){
+                    worker.join();
+                }
+
+                const double elapsed_seconds = std::chrono::duration<double>( clock::now() - start ).count();
+
+                json report = json::object();
+                report["duration_s"] = elapsed_seconds;
+                report["streams"] = json::array();
+
+                for( auto& stream_run : runs ){
+                    report["streams"].push_back( this->getStreamReport( *stream_run, elapsed_seconds ) );
+                }
+
+                return report;
+
+            }
+
+
+        protected:
+
+            using clock = std::chrono::steady_clock;
+
+            class StreamRun{
+                public:
+                    Stream stream;
+                    ResourceDescription resource_description;
+                    vector<string> names;
+
+                    std::mutex mutex;
+                    vector<double> latencies_ms;        // from the scheduled send time
+                    vector<double> service_times_ms;    // from the actual send time
+                    size_t requests = 0;
+                    size_t unsent = 0;
+                    size_t errors = 0;
+                    size_t events = 0;
+                    map<string, size_t> status_counts;
+
+                    std::atomic<size_t> patch_counter{0};
+            };
+
+
+            /* Resolves the kind through discovery ( plural, scope ) and, for get and patch without a name, lists up to 100 objects to cycle through. */
+            void prepare( KubernetesClient& kube_client, StreamRun& stream_run ){
+
+                Stream& stream = stream_run.stream;
+
+                const ResourceDescription kind_description( stream.kind );
+
+                ResourceDescription group_version = kind_description;
+                group_version.kind_lower_plural = "";
+                group_version.k8s_namespace = "";
+
+                json discovery = kube_client.getGenericResources( group_version, ListOptions() );
+
+                bool found = false;
+                if( discovery.contains("resources") && discovery["resources"].is_array() ){
+                    for( json api_resource : discovery["resources"] ){
+                        const string name = api_resource.value("name", "");
+                        if( api_resource.value("kind", "") != kind_description.kind || name.empty() || name.find('/') != string::npos ){
+                            continue;
+                        }
+                        api_resource["apiVersion"] = kind_description.api_group_version;
+                        stream_run.resource_description = ResourceDescription(api_resource);
+                        stream_run.resource_description.name = "";
+                        if( api_resource.contains("namespaced") && api_resource["namespaced"].is_boolean() && !api_resource["namespaced"].get<bool>() ){
+                            stream.k8s_namespace = "";
+                        }
+                        found = true;
+                        break;
+                    }
+                }
+
+                if( !found ){
+                    throw std::runtime_error("The apiserver doesn't serve " + kind_description.api_group_version + " " + kind_description.kind + ".");
+                }
+
+                stream_run.resource_description.k8s_namespace = stream.k8s_namespace;
+
+                if( stream.verb != "get" && stream.verb != "patch" ){
+                    return;
+                }
+
+                if( !stream.name.empty() ){
+                    stream_run.names.push_back( stream.name );
+                }else{
+                    ListOptions options;
+                    options.limit = 100;
+                    options.metadata_only = true;
+                    json list = kube_client.getGenericResources( stream_run.resource_description, options );
+                    if( list.contains("items") && list["items"].is_array() ){
+                        for( const json& item : list["items"] ){
+                            stream_run.names.push_back( item["metadata"].value("name", "") );
+                        }
+                    }
+                }
+
+                if( stream_run.names.empty() ){
+                    throw std::runtime_error("There are no " + kind_description.kind + " objects" + ( stream.k8s_namespace.empty() ? "" : " in " + stream.k8s_namespace ) + " for stream '" + stream.spec + "'; give one with name=.");
+                }
+
+            }
+
+
+            void runWorker( StreamRun& stream_run, size_t worker_index, clock::time_point start, clock::time_point deadline ){
+
+                const Stream& stream = stream_run.stream;
+
+                KubernetesClient kube_client;
+
+                if( stream.verb == "watch" ){
+                    this->runWatchWorker( kube_client, stream_run, deadline );
+                    return;
+                }
+
+                // the stream's rate is split over its workers, which start staggered across one interval
+                const clock::duration interval = stream.qps > 0.0
+                    ? std::chrono::duration_cast<clock::duration>( std::chrono::duration<double>( static_cast<double>(stream.concurrency) / stream.qps ) )
+                    : clock::duration::zero();
+                clock::time_point next_send = start + interval * worker_index / stream.concurrency;
+
+                vector<double> latencies_ms;
+                vector<double> service_times_ms;
+                size_t requests = 0;
+                size_t unsent = 0;
+                size_t errors = 0;
+                map<string, size_t> status_counts;
+
+                size_t name_index = worker_index;
+
+                while( true ){
+
+                    // a request is due at next_send whether or not the previous one has returned yet; when the worker is behind,
+                    // the time it waited counts towards the request's latency
+                    clock::time_point scheduled_send;
+
+                    if( interval > clock::duration::zero() ){
+                        if( next_send >= deadline ){
+                            break;
+                        }
+                        if( clock::now() >= deadline ){
+                            for( ; next_send < deadline; next_send += interval ){
+                                unsent++;
+                            }
+                            break;
+                        }
+                        std::this_thread::sleep_until(next_send);
+                        scheduled_send = next_send;
+                        next_send += interval;
+                    }else if( clock::now() >= deadline ){
+                        break;
+                    }
+
+                    ResourceDescription resource_description = stream_run.resource_description;
+                    if( !stream_run.names.empty() ){
+                        resource_description.name = stream_run.names[ name_index++ % stream_run.names.size() ];
+                    }
+
+                    const auto request_start = clock::now();
+                    if( interval == clock::duration::zero() ){
+                        scheduled_send = request_start;
+                    }
+                    json response;
+                    string status;
+
+                    try{
+                        response = this->send( kube_client, stream_run, resource_description );
+                        status = BenchApp::getStatus(response);
+                    }catch( const std::exception& ){
+                        status = "exception";
+                    }
+
+                    const auto request_end = clock::now();
+                    latencies_ms.push_back( std::chrono::duration<double, std::milli>( request_end - scheduled_send ).count() );
+                    service_times_ms.push_back( std::chrono::duration<double, std::milli>( request_end - request_start ).count() );
+                    requests++;
+                    status_counts[status]++;
+                    if( status != "ok" ){
+                        errors++;
+                    }
+
+                }
+
+                std::lock_guard<std::mutex> lock(stream_run.mutex);
+                stream_run.latencies_ms.insert( stream_run.latencies_ms.end(), latencies_ms.begin(), latencies_ms.end() );
+                stream_run.service_times_ms.insert( stream_run.service_times_ms.end(), service_times_ms.begin(), service_times_ms.end() );
+                stream_run.requests += requests;
+                stream_run.unsent += unsent;
+                stream_run.errors += errors;
+                for( const auto& [status, count] : status_counts ){
+                    stream_run.status_counts[status] += count;
+                }
+
+            }
+
+
+            json send( KubernetesClient& kube_client, StreamRun& stream_run, const ResourceDescription& resource_description ){
+
+                const Stream& stream = stream_run.stream;
+
+                if( stream.verb == "get" ){
+                    return kube_client.getGenericResource(resource_description);
+                }
+
+                if( stream.verb == "list" ){
+                    ListOptions options;
+                    options.limit = stream.limit;
+                    return kube_client.getGenericResources( resource_description, options );
+                }
+
+                // a json-patch of one annotation, which leaves the object's other annotations alone
+                const string value = std::to_string( stream_run.patch_counter.fetch_add(1) );
+                const json patch = json::array({
+                    { {"op", "add"}, {"path", "/metadata/annotations/kubepp.io~1bench"}, {"value", value} }
+                });
+                json response = kube_client.patchGenericResource( resource_description, patch );
+
+                // json-patch can't add a key to a missing annotations map; create the map once
+                if( BenchApp::getStatus(response) == "422" ){
+                    const json create_annotations = json::array({
+                        { {"op", "add"}, {"path", "/metadata/annotations"}, {"value", { {"kubepp.io/bench", value} }} }
+                    });
+                    response = kube_client.patchGenericResource( resource_description, create_annotations );
+                }
+
+                return response;
+
+            }
+
+
+            void runWatchWorker( KubernetesClient& kube_client, StreamRun& stream_run, clock::time_point deadline ){
+
+                const Stream& stream = stream_run.stream;
+
+                size_t requests = 0;
+                size_t errors = 0;
+                size_t events = 0;
+                map<string, size_t> status_counts;
+
+                // watch from the collection's current version, so the initial ADDED events aren't counted as load; again after an ERROR ( eg. 410 Gone )
+                const auto getResourceVersion = [&](){
+                    ListOptions list_options;
+                    list_options.limit = 1;
+                    list_options.metadata_only = true;
+                    json list = kube_client.getGenericResources( stream_run.resource_description, list_options );
+                    if( list.contains("metadata") && list["metadata"].is_object() ){
+                        return list["metadata"].value("resourceVersion", "");
+                    }
+                    return string();
+                };
+
+                string resource_version;
+
+                while( clock::now() < deadline ){
+
+                    if( resource_version.empty() ){
+                        try{
+                            resource_version = getResourceVersion();
+                        }catch( const std::exception& ){
+                        }
+                        if( resource_version.empty() ){
+                            requests++;
+                            errors++;
+                            status_counts["list failed"]++;
+                            std::this_thread::sleep_for( std::chrono::milliseconds(100) );
+                            continue;
+                        }
+                    }
+
+                    const int remaining_seconds = static_cast<int>( std::chrono::ceil<std::chrono::seconds>( deadline - clock::now() ).count() );
+
+                    long status_code = 0;
+                    try{
+                        status_code = kube_client.watchResources( stream_run.resource_description, ListOptions(), resource_version, std::max( 1, std::min( stream.timeout_seconds, remaining_seconds ) ), [&]( json& event ){
+                            const string type = event.value("type", "");
+                            if( type == "ERROR" ){
+                                resource_version = "";
+                                return false;
+                            }
+                            if( event.contains("object") && event["object"].is_object() && event["object"].contains("metadata") ){
+                                resource_version = event["object"]["metadata"].value("resourceVersion", resource_version);
+                            }
+                            events++;
+                            return clock::now() < deadline;
+                        });
+                    }catch( const std::exception& ){
+                        status_code = 0;
+                    }
+
+                    requests++;
+                    const string status = ( status_code >= 200 && status_code < 300 ) ? "ok" : std::to_string(status_code);
+                    status_counts[status]++;
+                    if( status != "ok" ){
+                        errors++;
+                        std::this_thread::sleep_for( std::chrono::milliseconds(100) );
+                    }
+
+                }
+
+                std::lock_guard<std::mutex> lock(stream_run.mutex);
+                stream_run.requests += requests;
+                stream_run.errors += errors;
+                stream_run.events += events;
+                for( const auto& [status, count] : status_counts ){
+                    stream_run.status_counts[status] += count;
+                }
+
+            }
+
+
+            /* "ok", the Status code ( eg. "429" ) of a failed request, or "0" when there was no response. */
+            static string getStatus( const json& response ){
+
+                if( response.is_null() || ( response.is_object() && response.empty() ) ){
+                    return "0";
+                }
+
+                if( response.is_object() && response.value("kind", "") == "Status" && response.value("status", "") == "Failure" ){
+                    return std::to_string( response.value("code", 0) );
+                }
+
+                return "ok";
+
+            }
+
+
+            json getStreamReport( StreamRun& stream_run, double elapsed_seconds ) const{
+
+                json report = json::object();
+                report["stream"] = stream_run.stream.spec;
+                report["verb"] = stream_run.stream.verb;
+                report["kind"] = stream_run.resource_description.kind;
+                report["target_qps"] = stream_run.stream.qps;
+                report["concurrency"] = stream_run.stream.concurrency;
+                report["requests"] = stream_run.requests;
+                report["errors"] = stream_run.errors;
+                report["error_rate"] = stream_run.requests ? static_cast<double>(stream_run.errors) / stream_run.requests : 0.0;
+                report["achieved_qps"] = elapsed_seconds > 0.0 ? stream_run.requests / elapsed_seconds : 0.0;
+                report["status_counts"] = stream_run.status_counts;
+
+                if( stream_run.stream.verb == "watch" ){
+                    report["events"] = stream_run.events;
+                    report["events_per_second"] = elapsed_seconds > 0.0 ? stream_run.events / elapsed_seconds : 0.0;
+                    return report;
+                }
+
+                report["unsent"] = stream_run.unsent;
+                report["latency_ms"] = BenchApp::getPercentiles( stream_run.latencies_ms );
+                report["service_time_ms"] = BenchApp::getPercentiles( stream_run.service_times_ms );
+
+                return report;
+
+            }
+
+
+            /* min, mean, p50 to p999 and max of the latencies, which are sorted in place. */
+            static json getPercentiles( vector<double>& latencies ){
+
+                std::sort( latencies.begin(), latencies.end() );
+
+                const auto percentile = [&latencies]( double fraction ){
+                    if( latencies.empty() ){
+                        return 0.0;
+                    }
+                    const size_t index = static_cast<size_t>( fraction * ( latencies.size() - 1 ) + 0.5 );
+                    return latencies[ std::min( index, latencies.size() - 1 ) ];
+                };
+
+                double total_ms = 0.0;
+                for( double latency_ms : latencies ){
+                    total_ms += latency_ms;
+                }
+
+                return {
+                    {"min", latencies.empty() ? 0.0 : latencies.front()},
+                    {"mean", latencies.empty() ? 0.0 : total_ms / latencies.size()},
+                    {"p50", percentile(0.50)},
+                    {"p90", percentile(0.90)},
+                    {"p99", percentile(0.99)},
+                    {"p999", percentile(0.999)},
+                    {"max", latencies.empty() ? 0.0 : latencies.back()}
+                };
+
+            }
+
+    };
+
+}
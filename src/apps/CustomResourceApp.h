@@ -10,6 +10,7 @@ using std::cout;
 using std::endl;
 
 #include "KubernetesClient.h"
+#include "ParallelSerializer.h"
 
 #include "json.hpp"
 using json = nlohmann::json;
@@ -42,7 +43,8 @@ namespace kubepp::apps {
 
                 json response = kube_client.createResources( cr );
 
-                cout << response.dump(4) << endl;
+                ParallelSerializer::write( response, cout, 4 );
+                cout << endl;
                                 
             }
 
@@ -63,7 +65,8 @@ namespace kubepp::apps {
 
                 json response = kube_client.deleteResources( cr );
 
-                cout << response.dump(4) << endl;
+                ParallelSerializer::write( response, cout, 4 );
+                cout << endl;
                                 
             }
 
@@ -74,7 +77,8 @@ namespace kubepp::apps {
 
                 json response = kube_client.runQuery( "SELECT * FROM stable.example.com/v1:CronTab" );
 
-                cout << response.dump(4) << endl;
+                ParallelSerializer::write( response, cout, 4 );
+                cout << endl;
                 
             }
 
@@ -9,6 +9,7 @@ using std::cout;
 using std::endl;
 
 #include "KubernetesClient.h"
+#include "ParallelSerializer.h"
 
 #include "json.hpp"
 using json = nlohmann::json;
@@ -67,7 +68,8 @@ namespace kubepp::apps {
 
                 json response = kube_client.createResources( crd );
 
-                cout << response.dump(4) << endl;
+                ParallelSerializer::write( response, cout, 4 );
+                cout << endl;
                                 
             }
 
@@ -87,7 +89,8 @@ namespace kubepp::apps {
 
                 json response = kube_client.deleteResources( crd );
 
-                cout << response.dump(4) << endl;
+                ParallelSerializer::write( response, cout, 4 );
+                cout << endl;
                                 
             }
 
@@ -96,7 +99,8 @@ namespace kubepp::apps {
 
                 KubernetesClient kube_client;
                 json crds = kube_client.runQuery( "SELECT * FROM CustomResourceDefinition" );
-                cout << crds.dump(4) << endl;
+                ParallelSerializer::write( crds, cout, 4 );
+                cout << endl;
 
             }
 
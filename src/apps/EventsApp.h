@@ -9,6 +9,7 @@ using std::cout;
 using std::endl;
 
 #include "KubernetesClient.h"
+#include "ParallelSerializer.h"
 
 #include "json.hpp"
 using json = nlohmann::json;
@@ -26,7 +27,8 @@ namespace kubepp::apps {
 
                 json response = kube_client.runQuery( "SELECT * FROM Event" );
 
-                cout << response.dump(4) << endl;
+                ParallelSerializer::write( response, cout, 4 );
+                cout << endl;
 
                 
             }
@@ -6,9 +6,23 @@ using std::string;
 
 #include <iostream>
 using std::cout;
+using std::cerr;
 using std::endl;
 
+#include <stdexcept>
+#include <memory>
+
+#include <vector>
+using std::vector;
+
 #include "KubernetesClient.h"
+#include "ParallelSerializer.h"
+#include "BufferedWriter.h"
+#include "CompressedOutput.h"
+#include "Snapshot.h"
+
+#include "json.hpp"
+using json = nlohmann::json;
 
 
 namespace kubepp::apps {
@@ -17,19 +31,110 @@ namespace kubepp::apps {
 
         public:
 
-            void exportAllResources(){
-
+            /*
+                format "json" prints one array; "ndjson" streams one object per line as each page arrives, so memory doesn't grow with the cluster.
+                format "snapshot" streams the binary snapshot format ( see Snapshot.h ) that `kubepp query --snapshot` reads.
+                compression "gzip" or "zstd" compresses the output on a separate thread while the next pages are fetched.
+                With a since_snapshot path only the changes since that snapshot are written, one ADDED, MODIFIED or DELETED delta per line
+                ( format "ndjson" only ).
+                A streamed export ( ndjson, snapshot, or changes ) in which some kinds couldn't be listed completely is finished, then throws;
+                the changes leave out deletions of those kinds, which may only be missing from the listing.
+            */
+            void exportAllResources( const string& format = "json", const string& compression = "", const string& since_snapshot = "" ){
+
+                if( format != "json" && format != "ndjson" && format != "snapshot" ){
+                    throw std::runtime_error("Unknown export format '" + format + "'; expected json, ndjson or snapshot.");
+                }
+
+                if( format == "snapshot" && !compression.empty() ){
+                    throw std::runtime_error("Snapshots are memory-mapped when they're read, so they can't be compressed.");
+                }
+
+                if( !since_snapshot.empty() && format != "ndjson" ){
+                    throw std::runtime_error("Changes since a snapshot are written as ndjson deltas; use --format ndjson with --since.");
+                }
+
+                // bulk crawls take from the background rate limiter bucket, leaving the interactive one to queries
                 KubernetesClient kube_client;
-                json all_resources = kube_client.runQuery( "SELECT * FROM *" );
-                cout << all_resources.dump(4) << endl;
+                kube_client.setPriority( RateLimiter::Priority::BACKGROUND );
+
+                std::unique_ptr<CompressedOutput> compressed_output;
+                if( !compression.empty() ){
+                    compressed_output = std::make_unique<CompressedOutput>( cout, CompressedOutput::parseCodec(compression) );
+                }
+                std::ostream& output = compressed_output ? *compressed_output : cout;
+
+                vector<ResourceDescription> incomplete_lists;
+
+                if( !since_snapshot.empty() ){
+
+                    SnapshotReader snapshot(since_snapshot);
+                    SnapshotComparison comparison(snapshot);
+                    BufferedWriter writer(output);
+
+                    auto write_deltas = [&writer]( const vector<json>& deltas ){
+                        for( const json& delta : deltas ){
+                            writer.write( delta.dump() );
+                            writer.write( "\n", 1 );
+                        }
+                    };
+
+                    incomplete_lists = kube_client.streamQuery( "SELECT * FROM *", [&]( json& resource ){
+                        write_deltas( comparison.compare(resource) );
+                    });
+
+                    const vector<json> deleted = comparison.getDeleted(incomplete_lists);
+                    write_deltas(deleted);
+                    writer.flush();
+
+                    cerr << comparison.added << " added, " << comparison.modified << " modified, " << deleted.size() << " deleted, " << comparison.unchanged << " unchanged since " << since_snapshot << endl;
+
+                }else if( format == "ndjson" ){
+
+                    BufferedWriter writer(output);
+                    incomplete_lists = kube_client.streamQuery( "SELECT * FROM *", [&writer]( json& resource ){
+                        writer.write( resource.dump() );
+                        writer.write( "\n", 1 );
+                    });
+                    writer.flush();
+
+                }else if( format == "snapshot" ){
+
+                    SnapshotWriter writer(output);
+                    incomplete_lists = kube_client.streamQuery( "SELECT * FROM *", [&writer]( json& resource ){
+                        writer.add(resource);
+                    });
+                    writer.finish();
+
+                }else{
+
+                    json all_resources = kube_client.runQuery( "SELECT * FROM *" );
+                    ParallelSerializer::write( all_resources, output, 4 );
+                    output << endl;
+
+                }
+
+                if( compressed_output ){
+                    compressed_output->finish();
+                }
+
+                if( !incomplete_lists.empty() ){
+                    string kinds;
+                    for( const ResourceDescription& incomplete_list : incomplete_lists ){
+                        kinds += ( kinds.empty() ? "" : ", " ) + ( incomplete_list.api_group_version.empty() ? string("CustomResourceDefinitions") : incomplete_list.api_group_version + ( incomplete_list.kind.empty() ? "" : " " + incomplete_list.kind ) );
+                    }
+                    throw std::runtime_error("The export is incomplete; these kinds couldn't be listed: " + kinds + ".");
+                }
 
             }
 
             void exportApiResources(){
 
                 KubernetesClient kube_client;
+                kube_client.setPriority( RateLimiter::Priority::BACKGROUND );
                 json all_kinds = kube_client.getApiResources();
-                cout << all_kinds.dump(4) << endl;
+                ParallelSerializer::write( all_kinds, cout, 4 );
+                cout << endl;
 
             }
 
@@ -9,6 +9,7 @@ using std::cout;
 using std::endl;
 
 #include "KubernetesClient.h"
+#include "ParallelSerializer.h"
 
 
 namespace kubepp::apps {
@@ -21,7 +22,8 @@ namespace kubepp::apps {
 
                 KubernetesClient kube_client;
                 auto logs = kube_client.getPodLogs( "kube-system", "svclb-traefik-06f20d2a-684jx", "lb-tcp-80" );
-                cout << logs.dump(4) << endl;
+                ParallelSerializer::write( logs, cout, 4 );
+                cout << endl;
                 
             }
 
@@ -9,6 +9,8 @@ using std::cout;
 using std::endl;
 
 #include "KubernetesClient.h"
+#include "ParallelSerializer.h"
+#include "TableFormatter.h"
 
 #include "json.hpp"
 using json = nlohmann::json;
@@ -20,15 +22,24 @@ namespace kubepp::apps {
 
         public:
 
-            void run(){
+            /* output "table" prints the apiserver's columns ( like kubectl get nodes ); "json" prints the full objects.*/
+            void run( const string& output = "table" ){
 
                 KubernetesClient kube_client;
 
-                json response = kube_client.runQuery( "SELECT * FROM Node" );
+                if( output == "json" ){
+                    json response = kube_client.runQuery( "SELECT * FROM Node" );
+                    ParallelSerializer::write( response, cout, 4 );
+                    cout << endl;
+                    return;
+                }
 
-                cout << response.dump(4) << endl;
+                TableWriter writer(cout);
+                kube_client.streamResourceTable( ResourceDescription( string("Node") ), ListOptions(), [&writer]( json& page ){
+                    writer.addPage(page);
+                });
+                writer.finish();
 
-                
             }
 
     };
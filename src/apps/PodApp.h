@@ -9,6 +9,8 @@ using std::cout;
 using std::endl;
 
 #include "KubernetesClient.h"
+#include "ParallelSerializer.h"
+#include "TableFormatter.h"
 
 #include "json.hpp"
 using json = nlohmann::json;
@@ -48,7 +50,8 @@ namespace kubepp::apps {
 
                 json response = kube_client.createResources( pod_sample );
 
-                cout << response.dump(4) << endl;
+                ParallelSerializer::write( response, cout, 4 );
+                cout << endl;
                 
             }
 
@@ -68,18 +71,30 @@ namespace kubepp::apps {
 
                 json response = kube_client.deleteResources( pod_sample );
 
-                cout << response.dump(4) << endl;
+                ParallelSerializer::write( response, cout, 4 );
+                cout << endl;
                 
             }
 
 
-            void displayPods(){
+            /* output "table" prints the apiserver's columns ( like kubectl get pods -A ); "json" prints the full objects.*/
+            void displayPods( const string& output = "table" ){
 
                 KubernetesClient kube_client;
 
-                json response = kube_client.runQuery( "SELECT * FROM Pod" );
+                if( output == "json" ){
+                    json response = kube_client.runQuery( "SELECT * FROM Pod" );
+                    ParallelSerializer::write( response, cout, 4 );
+                    cout << endl;
+                    return;
+                }
 
-                cout << response.dump(4) << endl;
+                // each page is printed as it arrives
+                TableWriter writer(cout);
+                kube_client.streamResourceTable( ResourceDescription( string("Pod") ), ListOptions(), [&writer]( json& page ){
+                    writer.addPage(page);
+                });
+                writer.finish();
 
             }
 
@@ -109,7 +124,8 @@ namespace kubepp::apps {
 
                 json response = kube_client.replaceGenericResource( resource_description, pod_sample );
 
-                cout << response.dump(4) << endl;
+                ParallelSerializer::write( response, cout, 4 );
+                cout << endl;
 
             }
 
@@ -144,7 +160,8 @@ namespace kubepp::apps {
 
                 json response = kube_client.patchGenericResource( resource_description, patch );
 
-                cout << response.dump(4) << endl;
+                ParallelSerializer::write( response, cout, 4 );
+                cout << endl;
 
 
                 // // Original Pod JSON
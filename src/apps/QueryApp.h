@@ -0,0 +1,120 @@
+#pragma once
+
+
+#include <string>
+using std::string;
+
+#include <stdexcept>
+
+#include <vector>
+using std::vector;
+
+#include <iostream>
+using std::cout;
+using std::endl;
+
+#include "KubernetesClient.h"
+#include "ParallelSerializer.h"
+#include "ContinuousQuery.h"
+#include "Snapshot.h"
+#include "TableFormatter.h"
+
+#include "json.hpp"
+using json = nlohmann::json;
+
+
+namespace kubepp::apps {
+
+    class QueryApp {
+
+        public:
+
+            /*
+                With a snapshot path the query runs against that file ( see `kubepp export resources --format snapshot` ) instead of the cluster.
+                output "table" prints aligned columns as rows arrive: the SELECT paths, or the kind's default columns for SELECT *.
+            */
+            void run( const string& query_str, bool explain = false, bool analyze = false, const string& snapshot_path = "", const string& output = "json" ){
+
+                if( output == "table" && !explain && !analyze ){
+                    this->runTable( query_str, snapshot_path );
+                    return;
+                }
+
+                if( !snapshot_path.empty() ){
+
+                    if( analyze ){
+                        throw std::runtime_error("--analyze is not supported for snapshots.");
+                    }
+
+                    SnapshotReader snapshot(snapshot_path);
+                    json response = snapshot.runQuery( ( explain ? "EXPLAIN " : "" ) + query_str );
+                    ParallelSerializer::write( response, cout, 4 );
+                    cout << endl;
+                    return;
+
+                }
+
+                KubernetesClient kube_client;
+
+                string prefix = "";
+                if( analyze ){
+                    prefix = "EXPLAIN ANALYZE ";
+                }else if( explain ){
+                    prefix = "EXPLAIN ";
+                }
+
+                json response = kube_client.runQuery( prefix + query_str );
+
+                ParallelSerializer::write( response, cout, 4 );
+                cout << endl;
+
+            }
+
+
+            void runTable( const string& query_str, const string& snapshot_path ){
+
+                const QueryPlan plan{ Query(query_str) };
+
+                vector<TableFormatter::Column> columns;
+                if( !plan.select_paths.empty() ){
+                    columns = TableFormatter::getSelectColumns( plan.select_paths );
+                }else{
+                    columns = TableFormatter::getKindColumns( ( plan.targets.size() == 1 && !plan.all_kinds ) ? plan.targets[0].kind : "" );
+                }
+
+                TableFormatter formatter( cout, TableFormatter::getHeaders(columns) );
+
+                if( !snapshot_path.empty() ){
+                    SnapshotReader snapshot(snapshot_path);
+                    snapshot.streamQuery( query_str, [&]( json& row ){
+                        formatter.addRow( TableFormatter::getCells(columns, row) );
+                    });
+                }else{
+                    KubernetesClient kube_client;
+                    kube_client.streamQuery( query_str, [&]( json& row ){
+                        formatter.addRow( TableFormatter::getCells(columns, row) );
+                    });
+                }
+
+                formatter.finish();
+
+            }
+
+
+            /* Prints the initial result set and then every change to it, one json delta per line. Runs until interrupted. */
+            void watch( const string& query_str ){
+
+                KubernetesClient kube_client;
+
+                ContinuousQuery continuous_query( query_str );
+
+                kube_client.watchQuery( continuous_query, []( const json& delta ){
+                    cout << delta.dump() << endl;
+                    return true;
+                });
+
+            }
+
+    };
+
+}
\ No newline at end of file
@@ -9,6 +9,7 @@ using std::cout;
 using std::endl;
 
 #include "KubernetesClient.h"
+#include "ParallelSerializer.h"
 
 
 namespace kubepp::apps {
@@ -21,7 +22,8 @@ namespace kubepp::apps {
 
                 KubernetesClient kube_client;
                 json workloads = kube_client.runQuery( "SELECT * FROM Pod, Deployment, stable.example.com/v1:CronTab" );
-                cout << workloads.dump(4) << endl;
+                ParallelSerializer::write( workloads, cout, 4 );
+                cout << endl;
                
             }
 
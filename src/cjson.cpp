@@ -3,6 +3,8 @@
 #include "json.hpp"
 using json = nlohmann::json;
 
+#include "AllocationTracker.h"
+
 
 
 namespace kubepp{
@@ -32,6 +34,7 @@ namespace kubepp{
     }
 
     cjson::cjson( const json& json_obj ){
+        AllocationTracker::Scope allocation_scope( AllocationTracker::Subsystem::CJSON );
         const string json_str = json_obj.dump();
         this->cjson_ptr = std::shared_ptr<cJSON>( cJSON_Parse( json_str.c_str() ), cJSON_Delete );
     }
@@ -61,6 +64,7 @@ namespace kubepp{
     }
 
     cjson& cjson::operator=( const json& json_obj ){
+        AllocationTracker::Scope allocation_scope( AllocationTracker::Subsystem::CJSON );
         const string json_str = json_obj.dump();
         this->cjson_ptr = std::shared_ptr<cJSON>( cJSON_Parse( json_str.c_str() ), cJSON_Delete );
         return *this;
@@ -74,6 +78,7 @@ namespace kubepp{
         if( !this->cjson_ptr.get() ){
             return json();
         }
+        AllocationTracker::Scope allocation_scope( AllocationTracker::Subsystem::CJSON );
         std::shared_ptr<char> json_string_ptr( cJSON_PrintUnformatted( this->cjson_ptr.get() ), cJSON_free );
         return json::parse( json_string_ptr.get() );
     }
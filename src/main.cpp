@@ -1,6 +1,11 @@
 #include "KubeppApp.h"
 #include <CLI/CLI.hpp>
 #include <iostream>
+#include <memory>
+
+#include "MetricsServer.h"
+#include "Tracer.h"
+#include "HttpSession.h"
 
 
 int main(int argc, char **argv) {
@@ -15,6 +20,30 @@ int main(int argc, char **argv) {
     CLI::App app{"Kubepp - Connecting to Kubernetes."};
     app.require_subcommand(1);
 
+    bool show_stats = false;
+    app.add_flag("--stats", show_stats, "Print the api calls made ( endpoint, status, bytes, network, parse and conversion time ) to stderr when done.");
+
+    string trace_path;
+    app.add_option("--trace", trace_path, "Write Chrome trace-event json spans ( discovery, lists, page fetches, parsing, conversion, filtering, serialization ) to this file when done; open it in chrome://tracing or ui.perfetto.dev.");
+
+    double qps = 0.0;
+    double burst = 10.0;
+    double background_qps = 0.0;
+    double background_burst = 10.0;
+    app.add_option("--qps", qps, "Limit the api calls of queries and apps to this many per second ( a client-side token bucket; 0 is unlimited ).")->check(CLI::NonNegativeNumber);
+    app.add_option("--burst", burst, "Allow bursts of this many api calls above --qps.")->check(CLI::PositiveNumber);
+    app.add_option("--background-qps", background_qps, "Limit the api calls of exports to this many per second, in a bucket separate from --qps ( 0 is unlimited ).")->check(CLI::NonNegativeNumber);
+    app.add_option("--background-burst", background_burst, "Allow bursts of this many export api calls above --background-qps.")->check(CLI::PositiveNumber);
+
+    size_t retries = kubepp::KubernetesClient::getDefaultRetryPolicy().max_retries;
+    app.add_option("--retries", retries, "Retry an api call this many times after a 429 ( after its retryAfterSeconds ) or, for idempotent calls, a 5xx or no response, with jittered exponential backoff ( 0 disables retries ).")->check(CLI::NonNegativeNumber);
+
+    bool no_connection_reuse = false;
+    app.add_flag("--no-connection-reuse", no_connection_reuse, "Open a new connection ( and TLS handshake ) for every api call instead of keeping connections alive; compare connections_opened and tls_handshakes in --stats.");
+
+    int metrics_port = -1;
+    app.add_option("--metrics-port", metrics_port, "Serve api call latency histograms, counts and in-flight gauges in the Prometheus text format at http://127.0.0.1:<port>/metrics while the command runs ( eg. with query --watch ).")->check(CLI::Range(0, 65535));
+
 
     // Events command
 
@@ -32,6 +61,8 @@ int main(int argc, char **argv) {
 
     // Nodes command
         CLI::App *nodes_app = app.add_subcommand("nodes", "Manage nodes.");
+        string nodes_output = "table";
+        nodes_app->add_option("-o,--output", nodes_output, "table prints the apiserver's columns; json prints the full objects.")->check(CLI::IsMember({"table", "json"}));
 
     // CRDs command
         CLI::App *crds_app = app.add_subcommand("crds", "Manage custom resource definitions.");
@@ -50,19 +81,66 @@ int main(int argc, char **argv) {
         CLI::App *pod_create_app = pod_app->add_subcommand("create", "Creates a sample pod.");
         CLI::App *pod_delete_app = pod_app->add_subcommand("delete", "Deletes the a sample pod.");
         CLI::App *pod_list_app = pod_app->add_subcommand("list", "Lists the pods.");
+        string pod_list_output = "table";
+        pod_list_app->add_option("-o,--output", pod_list_output, "table prints the apiserver's columns; json prints the full objects.")->check(CLI::IsMember({"table", "json"}));
         CLI::App *pod_replace_app = pod_app->add_subcommand("replace", "Replaces the a sample pod.");
         CLI::App *pod_patch_app = pod_app->add_subcommand("patch", "Patches the a sample pod.");
 
     // Export command
         CLI::App *export_app = app.add_subcommand("export", "Export resources.");
         CLI::App *export_resources_app = export_app->add_subcommand("resources", "Export all resources.");
+        string export_format = "json";
+        export_resources_app->add_option("--format", export_format, "json prints one array; ndjson streams one object per line with memory independent of cluster size; snapshot writes the binary format read by 'kubepp query --snapshot'.")->check(CLI::IsMember({"json", "ndjson", "snapshot"}));
+        string export_compression;
+        export_resources_app->add_option("--compress", export_compression, "Compress the output with gzip or zstd on a background thread, eg. --compress zstd > all_resources.ndjson.zst")->check(CLI::IsMember({"gzip", "zstd"}));
+        string export_since;
+        export_resources_app->add_option("--since", export_since, "Only write what was added, modified or deleted since a snapshot ('--format snapshot'), one json delta per line; requires --format ndjson.")->check(CLI::ExistingFile);
         CLI::App *export_api_app = export_app->add_subcommand("api", "Export api resources.");
 
+    // Query command
+        CLI::App *query_app = app.add_subcommand("query", "Run a query, eg. \"SELECT * FROM Pod WHERE metadata.namespace = 'default'\".");
+        string query_str;
+        bool query_explain = false;
+        bool query_analyze = false;
+        bool query_watch = false;
+        string query_snapshot;
+        string query_output = "json";
+        query_app->add_option("query", query_str, "The query to run.")->required();
+        query_app->add_flag("--explain", query_explain, "Print the plan instead of the results: kinds, endpoints, selectors, pagination and concurrency.");
+        query_app->add_flag("--watch", query_watch, "Keep the result set live from watch events and print each change as a json delta per line.");
+        query_app->add_option("--snapshot", query_snapshot, "Query a snapshot file written by 'kubepp export resources --format snapshot' instead of the cluster.")->check(CLI::ExistingFile)->excludes("--watch");
+        query_app->add_option("-o,--output", query_output, "json prints the result set; table prints aligned columns as rows arrive.")->check(CLI::IsMember({"json", "table"}));
+        query_app->add_flag("--analyze", query_analyze, "Run the query and report the plan with stage timings, bytes received and objects scanned versus returned (implies --explain).");
+
+    // Bench command
+        CLI::App *bench_app = app.add_subcommand("bench", "Load the apiserver with get, list, watch and patch streams and report rates, error rates and latency percentiles.");
+        vector<string> bench_streams;
+        double bench_duration = 10.0;
+        string bench_namespace = "default";
+        bench_app->add_option("--stream", bench_streams, "A stream: verb[,kind=Pod][,qps=10][,concurrency=1][,namespace=...][,name=...][,limit=500][,timeout=30]; verb is get, list, watch or patch ( patch writes the kubepp.io/bench annotation ). Repeat for a mix.")->required();
+        bench_app->add_option("--duration", bench_duration, "Seconds to run.")->check(CLI::PositiveNumber);
+        bench_app->add_option("--namespace", bench_namespace, "The namespace of streams without namespace= ( cluster-scoped kinds ignore it ).");
+
 
     // parse the command line arguments
 
         CLI11_PARSE(app, argc, argv);
 
+        if( !trace_path.empty() ){
+            kubepp::Tracer::start();
+        }
+
+        kubepp::KubernetesClient::getRateLimiter()->configure( kubepp::RateLimiter::Priority::INTERACTIVE, qps, burst );
+        kubepp::KubernetesClient::getRateLimiter()->configure( kubepp::RateLimiter::Priority::BACKGROUND, background_qps, background_burst );
+        kubepp::KubernetesClient::getDefaultRetryPolicy().max_retries = retries;
+        kubepp::HttpSession::setConnectionReuse( !no_connection_reuse );
+
+        std::unique_ptr<kubepp::MetricsServer> metrics_server;
+        if( metrics_port >= 0 ){
+            metrics_server = std::make_unique<kubepp::MetricsServer>( kubepp::KubernetesClient::getMetrics(), metrics_port );
+            std::cerr << "Serving metrics at http://127.0.0.1:" << metrics_server->getPort() << "/metrics" << std::endl;
+        }
+
         // Events command
 
             if( *events_app ){
@@ -90,7 +168,7 @@ int main(int argc, char **argv) {
 
             else if( *nodes_app ){
 
-                kubepp_app.nodes_app.run();
+                kubepp_app.nodes_app.run(nodes_output);
 
             }
 
@@ -138,7 +216,7 @@ int main(int argc, char **argv) {
 
             }else if( *pod_list_app ){
 
-                kubepp_app.pod_app.displayPods();
+                kubepp_app.pod_app.displayPods(pod_list_output);
 
             }else if( *pod_replace_app ){
 
@@ -154,7 +232,7 @@ int main(int argc, char **argv) {
 
             else if( *export_resources_app ){
 
-                kubepp_app.export_app.exportAllResources();
+                kubepp_app.export_app.exportAllResources(export_format, export_compression, export_since);
 
             }else if( *export_api_app ){
 
@@ -162,6 +240,35 @@ int main(int argc, char **argv) {
 
             }
 
+        // Query command
+
+            else if( *query_app ){
+
+                if( query_watch ){
+                    kubepp_app.query_app.watch( query_str );
+                }else{
+                    kubepp_app.query_app.run( query_str, query_explain, query_analyze, query_snapshot, query_output );
+                }
+
+            }
+
+        // Bench command
+
+            else if( *bench_app ){
+
+                kubepp_app.bench_app.run( bench_streams, bench_duration, bench_namespace );
+
+            }
+
+        if( !trace_path.empty() ){
+            kubepp::Tracer::stop();
+            kubepp::Tracer::writeFile(trace_path);
+        }
+
+        if( show_stats ){
+            std::cerr << kubepp::KubernetesClient::getProcessStats().asJson().dump(4) << std::endl;
+        }
+
     return 0;
 
 }
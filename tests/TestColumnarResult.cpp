@@ -0,0 +1,150 @@
+#include "ColumnarResult.h"
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <stdexcept>
+
+#include "json.hpp"
+using json = nlohmann::json;
+
+using kubepp::ColumnarResult;
+using Type = kubepp::ColumnarResult::Column::Type;
+
+
+static json makePod( const std::string& name, const std::string& k8s_namespace, const json& restarts, const json& ready ){
+
+    json pod = { {"metadata", { {"name", name}, {"namespace", k8s_namespace} }}, {"status", json::object()} };
+    if( !restarts.is_null() ){
+        pod["status"]["restarts"] = restarts;
+    }
+    if( !ready.is_null() ){
+        pod["status"]["ready"] = ready;
+    }
+    return pod;
+
+}
+
+
+
+TEST(ColumnarResultTest, StoresTypedColumns) {
+
+    ColumnarResult result({ "metadata.name", "status.restarts", "status.ready", "status.missing" });
+    result.append( makePod("web-0", "default", 3, true) );
+    result.append( makePod("web-1", "default", nullptr, false) );
+    result.append( makePod("dns", "kube-system", 0, nullptr) );
+    result.finish();
+
+    ASSERT_EQ(result.getRowCount(), 3u);
+
+    const auto& restarts = result.getColumn("status.restarts");
+    EXPECT_EQ(restarts.type, Type::INT64);
+    EXPECT_EQ(restarts.int_values, (std::vector<int64_t>{ 3, 0, 0 }));
+    EXPECT_TRUE(restarts.isNull(1));
+    EXPECT_TRUE(restarts.at(1).is_null());
+    EXPECT_EQ(restarts.at(2), 0);
+
+    const auto& ready = result.getColumn("status.ready");
+    EXPECT_EQ(ready.type, Type::BOOL);
+    EXPECT_EQ(ready.at(0), true);
+    EXPECT_EQ(ready.at(1), false);
+    EXPECT_TRUE(ready.isNull(2));
+
+    // a column that's null everywhere has no type
+    const auto& missing = result.getColumn("status.missing");
+    EXPECT_EQ(missing.type, Type::NONE);
+    EXPECT_EQ(missing.size(), 3u);
+    EXPECT_EQ(missing.getTypeName(), "null");
+
+    EXPECT_DOUBLE_EQ(result.sum("status.restarts"), 3.0);
+    EXPECT_THROW(result.sum("status.ready"), std::runtime_error);
+    EXPECT_THROW(result.getColumn("spec"), std::runtime_error);
+
+    // nulls sort last either way
+    EXPECT_EQ(result.sortIndexes("status.restarts"), (std::vector<size_t>{ 2, 0, 1 }));
+    EXPECT_EQ(result.sortIndexes("status.restarts", true), (std::vector<size_t>{ 0, 2, 1 }));
+
+    const json rows = result.rowsAsJson({ 2 });
+    ASSERT_EQ(rows.size(), 1u);
+    EXPECT_EQ(rows[0]["metadata.name"], "dns");
+    EXPECT_TRUE(rows[0]["status.ready"].is_null());
+
+}
+
+
+
+TEST(ColumnarResultTest, DictionaryEncodesLowCardinalityStrings) {
+
+    ColumnarResult result({ "metadata.namespace", "metadata.name" });
+    const std::vector<std::string> namespaces = { "default", "kube-system", "default", "monitoring", "default", "kube-system" };
+    for( size_t i = 0; i < namespaces.size(); i++ ){
+        result.append( makePod( "pod-" + std::to_string(i), namespaces[i], nullptr, nullptr ) );
+    }
+    result.finish();
+
+    // 3 distinct of 6 is within max_dictionary_ratio: one code per row into a dictionary in first-seen order
+    const auto& k8s_namespace = result.getColumn("metadata.namespace");
+    EXPECT_EQ(k8s_namespace.type, Type::DICTIONARY);
+    EXPECT_EQ(k8s_namespace.dictionary, (std::vector<std::string>{ "default", "kube-system", "monitoring" }));
+    EXPECT_EQ(k8s_namespace.codes, (std::vector<uint32_t>{ 0, 1, 0, 2, 0, 1 }));
+    EXPECT_EQ(k8s_namespace.at(3), "monitoring");
+    EXPECT_TRUE(k8s_namespace.string_values.empty());
+
+    // every name is distinct, so finish() drops its dictionary
+    const auto& name = result.getColumn("metadata.name");
+    EXPECT_EQ(name.type, Type::STRING);
+    EXPECT_TRUE(name.dictionary.empty());
+    EXPECT_TRUE(name.codes.empty());
+    EXPECT_EQ(name.string_values[4], "pod-4");
+
+    EXPECT_EQ(result.countBy("metadata.namespace"), (std::map<std::string, size_t>{ {"default", 3}, {"kube-system", 2}, {"monitoring", 1} }));
+    EXPECT_EQ(result.sortIndexes("metadata.namespace"), (std::vector<size_t>{ 0, 2, 4, 1, 5, 3 }));
+
+    const json columnar = result.asJson();
+    EXPECT_EQ(columnar["columns"][0]["type"], "dictionary");
+    EXPECT_EQ(columnar["columns"][1]["type"], "string");
+    EXPECT_EQ(columnar["data"]["metadata.namespace"][5], "kube-system");
+
+}
+
+
+
+TEST(ColumnarResultTest, WidensColumnsToFitTheirValues) {
+
+    // int64, then a double: the integers become doubles
+    ColumnarResult numbers({ "status.restarts" });
+    numbers.append( makePod("a", "default", 1, nullptr) );
+    numbers.append( makePod("b", "default", nullptr, nullptr) );
+    numbers.append( makePod("c", "default", 2.5, nullptr) );
+    numbers.append( makePod("d", "default", 4, nullptr) );
+    numbers.finish();
+
+    const auto& restarts = numbers.getColumn("status.restarts");
+    EXPECT_EQ(restarts.type, Type::DOUBLE);
+    EXPECT_TRUE(restarts.int_values.empty());
+    EXPECT_EQ(restarts.double_values, (std::vector<double>{ 1.0, 0.0, 2.5, 4.0 }));
+    EXPECT_TRUE(restarts.isNull(1));
+    EXPECT_DOUBLE_EQ(numbers.sum("status.restarts"), 7.5);
+
+    // a string among numbers, and an object among strings, fall back to json text that reads back as the original values
+    ColumnarResult mixed({ "status.restarts", "status.ready" });
+    mixed.append( makePod("a", "default", 1, "yes") );
+    mixed.append( makePod("b", "default", "many", json::object({ {"since", "today"} })) );
+    mixed.append( makePod("c", "default", nullptr, "yes") );
+    mixed.finish();
+
+    const auto& mixed_restarts = mixed.getColumn("status.restarts");
+    EXPECT_EQ(mixed_restarts.type, Type::JSON);
+    EXPECT_EQ(mixed_restarts.at(0), 1);
+    EXPECT_EQ(mixed_restarts.at(1), "many");
+    EXPECT_TRUE(mixed_restarts.isNull(2));
+
+    const auto& mixed_ready = mixed.getColumn("status.ready");
+    EXPECT_EQ(mixed_ready.type, Type::JSON);
+    EXPECT_TRUE(mixed_ready.dictionary.empty());
+    EXPECT_EQ(mixed_ready.at(0), "yes");
+    EXPECT_EQ(mixed_ready.at(1), json::object({ {"since", "today"} }));
+    EXPECT_EQ(mixed_ready.at(2), "yes");
+
+}
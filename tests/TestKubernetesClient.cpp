@@ -0,0 +1,878 @@
+#include "KubernetesClient.h"
+#include "ContinuousQuery.h"
+#include "Tracer.h"
+#include "AllocationTracker.h"
+#include "apps/PodApp.h"
+#include "apps/NodesApp.h"
+#include "apps/QueryApp.h"
+#include "apps/EventsApp.h"
+#include "apps/BenchApp.h"
+#include "apps/ExportApp.h"
+
+#include "MockApiServer.h"
+#include "TlsProxy.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <set>
+#include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+#include "json.hpp"
+using json = nlohmann::json;
+
+using kubepp::KubernetesClient;
+using kubepp::ResourceDescription;
+using kubepp::mock::MockApiServer;
+
+
+// end-to-end tests of the client, queries and apps against the in-process mock apiserver
+class KubernetesClientTest : public ::testing::Test{
+
+    protected:
+        void SetUp() override{
+            this->server.useAsKubeconfig();
+        }
+
+        static json makeConfigMap( const std::string& name, const std::string& value = "1" ){
+            return {
+                {"apiVersion", "v1"},
+                {"kind", "ConfigMap"},
+                {"metadata", { {"namespace", "default"}, {"name", name}, {"labels", { {"app", "web"} }} }},
+                {"data", { {"value", value} }}
+            };
+        }
+
+        size_t countRequests( const std::string& path ){
+            size_t count = 0;
+            for( const auto& request : this->server.getRequests() ){
+                count += request.path == path;
+            }
+            return count;
+        }
+
+        MockApiServer server;
+
+};
+
+
+
+TEST_F(KubernetesClientTest, DiscoversRegisteredResources) {
+
+    KubernetesClient client;
+    const json resources = client.getApiResources();
+
+    bool found_pods = false;
+    bool found_deployments = false;
+    for( const json& resource : resources ){
+        found_pods |= resource["apiVersion"] == "v1" && resource["name"] == "pods";
+        found_deployments |= resource["apiVersion"] == "apps/v1" && resource["name"] == "deployments";
+    }
+
+    EXPECT_TRUE(found_pods);
+    EXPECT_TRUE(found_deployments);
+
+}
+
+
+
+TEST_F(KubernetesClientTest, QueryListsEveryPage) {
+
+    this->server.setPods(25);
+
+    KubernetesClient client;
+    client.setPageSize(10);
+
+    const json pods = client.runQuery("SELECT * FROM Pod");
+
+    ASSERT_EQ(pods.size(), 25u);
+    EXPECT_EQ(pods[0]["kind"], "Pod");
+    EXPECT_EQ(pods[0]["apiVersion"], "v1");
+    EXPECT_EQ(this->countRequests("/api/v1/pods"), 3u);
+
+}
+
+
+
+TEST_F(KubernetesClientTest, QueryRelistsWhenAContinueTokenExpires) {
+
+    this->server.setPods(25);
+
+    KubernetesClient client;
+    client.setPageSize(10);
+
+    // the continue token of the second page expires once the first page is delivered
+    std::set<std::string> names;
+    size_t rows = 0;
+    client.streamQuery( "SELECT metadata.name FROM Pod", [&]( json& row ){
+        names.insert( row["metadata.name"].get<std::string>() );
+        if( ++rows == 10 ){
+            this->server.injectError( "/api/v1/pods", 410 );
+        }
+    });
+
+    // started over without the token, skipping the 10 pods already delivered: nothing is missing or delivered twice
+    EXPECT_EQ(rows, 25u);
+    EXPECT_EQ(names.size(), 25u);
+    EXPECT_EQ(this->countRequests("/api/v1/pods"), 5u);
+
+}
+
+
+
+TEST_F(KubernetesClientTest, QueryRelistResumesAfterTheLastListedKey) {
+
+    this->server.setPods(25);
+
+    KubernetesClient client;
+    client.setPageSize(10);
+
+    // the first page ends at default/pod-17 ( key order ); of the pods created before the restart, only the one sorting after it
+    // is still ahead of the list
+    std::vector<std::string> names;
+    client.streamQuery( "SELECT metadata.name FROM Pod", [&]( json& row ){
+        names.push_back( row["metadata.name"].get<std::string>() );
+        if( names.size() == 10 ){
+            this->server.addResource( MockApiServer::makePod("default", "pod-00") );
+            this->server.addResource( MockApiServer::makePod("default", "pod-9a") );
+            this->server.injectError( "/api/v1/pods", 410 );
+        }
+    });
+
+    ASSERT_EQ(names.size(), 26u);
+    EXPECT_EQ(names[9], "pod-17");
+    EXPECT_EQ(names[10], "pod-18");
+    EXPECT_EQ(std::count( names.begin(), names.end(), "pod-00" ), 0);
+    EXPECT_EQ(names.back(), "pod-9a");
+
+}
+
+
+
+TEST_F(KubernetesClientTest, QueryFiltersAndProjects) {
+
+    this->server.setPods(30);
+
+    KubernetesClient client;
+    const json rows = client.runQuery( "SELECT metadata.name, status.phase FROM Pod WHERE metadata.namespace = ? AND status.phase = 'Pending'", {"default"} );
+
+    // pods 0, 10 and 20 are Pending; only pod-0 of them is in default
+    ASSERT_EQ(rows.size(), 1u);
+    EXPECT_EQ(rows[0]["metadata.name"], "pod-0");
+    EXPECT_EQ(rows[0]["status.phase"], "Pending");
+    EXPECT_EQ(this->countRequests("/api/v1/namespaces/default/pods"), 1u);
+
+}
+
+
+
+TEST_F(KubernetesClientTest, QueryKeepsQuotedValuesOutOfSelectors) {
+
+    this->server.addResource( makeConfigMap("spaced", "foo bar") );
+    this->server.addResource( makeConfigMap("joined", "foobar") );
+
+    KubernetesClient client;
+
+    // the space in the quoted value is kept
+    const json rows = client.runQuery("SELECT metadata.name FROM ConfigMap WHERE data.value = 'foo bar'");
+    ASSERT_EQ(rows.size(), 1u);
+    EXPECT_EQ(rows[0]["metadata.name"], "spaced");
+
+    // a bound value that would add selector terms is filtered client-side instead
+    kubepp::QueryPlan plan( kubepp::Query("SELECT * FROM ConfigMap WHERE metadata.name = ? AND metadata.labels.app = ?") );
+    plan.bind({ "spaced,metadata.name!=joined", "web" });
+    EXPECT_EQ(plan.getListOptions().field_selector, "");
+    EXPECT_EQ(plan.getListOptions().label_selector, "app=web");
+
+    EXPECT_TRUE(client.runQuery( "SELECT metadata.name FROM ConfigMap WHERE metadata.name = ?", {"spaced,metadata.name!=joined"} ).empty());
+    EXPECT_EQ(client.runQuery( "SELECT metadata.name FROM ConfigMap WHERE metadata.name = 'spaced,x'" ).size(), 0u);
+    EXPECT_EQ(client.runQuery( "SELECT metadata.name FROM ConfigMap WHERE metadata.name = ?", {"spaced"} ).size(), 1u);
+
+}
+
+
+
+TEST_F(KubernetesClientTest, QueryKeepsOperatorsInQuotedValues) {
+
+    this->server.addResource( makeConfigMap("unequal", "a!=b") );
+    this->server.addResource( makeConfigMap("equal", "a==b") );
+
+    KubernetesClient client;
+
+    json rows = client.runQuery("SELECT metadata.name FROM ConfigMap WHERE data.value = 'a!=b'");
+    ASSERT_EQ(rows.size(), 1u);
+    EXPECT_EQ(rows[0]["metadata.name"], "unequal");
+
+    rows = client.runQuery("SELECT metadata.name FROM ConfigMap WHERE data.value!='a!=b'");
+    ASSERT_EQ(rows.size(), 1u);
+    EXPECT_EQ(rows[0]["metadata.name"], "equal");
+
+    rows = client.runQuery("SELECT metadata.name FROM ConfigMap WHERE data.value == \"a==b\"");
+    ASSERT_EQ(rows.size(), 1u);
+    EXPECT_EQ(rows[0]["metadata.name"], "equal");
+
+}
+
+
+
+TEST_F(KubernetesClientTest, QueryEndsTheWhereClauseAtLimit) {
+
+    this->server.addResource( makeConfigMap("settings") );
+
+    const kubepp::Query query("SELECT metadata.name FROM ConfigMap WHERE data.value = '1' LIMIT 5");
+    EXPECT_EQ(query.where, std::vector<std::string>({ "data.value", "=", "'1'" }));
+    EXPECT_EQ(query.limit, std::vector<std::string>({ "5" }));
+
+    KubernetesClient client;
+    EXPECT_EQ(client.runQuery("SELECT metadata.name FROM ConfigMap WHERE data.value = '1' LIMIT 5").size(), 1u);
+
+}
+
+
+
+TEST_F(KubernetesClientTest, CreatesPatchesAndDeletes) {
+
+    KubernetesClient client;
+
+    const json created = client.createResources( makeConfigMap("settings") );
+    EXPECT_EQ(created["metadata"]["name"], "settings");
+    EXPECT_FALSE(this->server.getResource("v1", "ConfigMap", "default", "settings").is_null());
+
+    ResourceDescription config_map( std::string("ConfigMap") );
+    config_map.k8s_namespace = "default";
+    config_map.name = "settings";
+
+    const json patch = json::array({ { {"op", "replace"}, {"path", "/data/value"}, {"value", "2"} } });
+    client.patchGenericResource( config_map, patch );
+    EXPECT_EQ(client.getGenericResource(config_map)["data"]["value"], "2");
+
+    client.deleteResources( makeConfigMap("settings") );
+    EXPECT_TRUE(this->server.getResource("v1", "ConfigMap", "default", "settings").is_null());
+
+}
+
+
+
+TEST_F(KubernetesClientTest, RecordsErrorsAndLatency) {
+
+    this->server.setLatency( std::chrono::milliseconds(20) );
+    this->server.injectError( "/api/v1/configmaps", 503 );
+
+    // the 503 is recorded rather than retried
+    kubepp::RetryPolicy no_retries;
+    no_retries.max_retries = 0;
+
+    KubernetesClient client;
+    client.setRetryPolicy(no_retries);
+    ResourceDescription config_maps( std::string("ConfigMap") );
+
+    const json failed = client.getGenericResources( config_maps, kubepp::ListOptions() );
+    EXPECT_EQ(failed["kind"], "Status");
+    EXPECT_EQ(failed["code"], 503);
+
+    const json listed = client.getGenericResources( config_maps, kubepp::ListOptions() );
+    EXPECT_EQ(listed["kind"], "ConfigMapList");
+
+    const kubepp::QueryStats stats = client.getStats();
+    EXPECT_EQ(stats.api_calls, 2u);
+    EXPECT_EQ(stats.error_responses, 1u);
+    EXPECT_GE(stats.fetch_ms, 40.0);
+
+}
+
+
+
+TEST_F(KubernetesClientTest, WatchQueryFollowsChanges) {
+
+    this->server.addResource( makeConfigMap("first") );
+
+    KubernetesClient client;
+    kubepp::ContinuousQuery continuous_query( kubepp::Query("SELECT metadata.name FROM ConfigMap") );
+
+    std::vector<json> deltas;
+
+    std::thread writer( [this](){
+        while( this->server.getOpenWatchCount() == 0 ){
+            std::this_thread::sleep_for( std::chrono::milliseconds(10) );
+        }
+        this->server.addResource( makeConfigMap("second") );
+        this->server.removeResource( makeConfigMap("first") );
+    });
+
+    client.watchQuery( continuous_query, [&]( const json& delta ){
+        deltas.push_back(delta);
+        return deltas.size() < 3;
+    });
+    writer.join();
+
+    ASSERT_EQ(deltas.size(), 3u);
+    EXPECT_EQ(deltas[0]["type"], "ADDED");
+    EXPECT_EQ(deltas[0]["object"]["metadata.name"], "first");
+    EXPECT_EQ(deltas[1]["type"], "ADDED");
+    EXPECT_EQ(deltas[1]["object"]["metadata.name"], "second");
+    EXPECT_EQ(deltas[2]["type"], "DELETED");
+    EXPECT_EQ(continuous_query.size(), 1u);
+
+}
+
+
+
+TEST_F(KubernetesClientTest, WatchQueryRelistsWhenExpired) {
+
+    KubernetesClient client;
+    kubepp::ContinuousQuery continuous_query( kubepp::Query("SELECT metadata.name FROM ConfigMap") );
+
+    std::vector<json> deltas;
+
+    // the watch is closed and the change compacted away before the client reconnects ( delayed by the latency ),
+    // so it only shows up in the re-list after the 410 Expired event
+    std::thread writer( [this](){
+        while( this->server.getOpenWatchCount() == 0 ){
+            std::this_thread::sleep_for( std::chrono::milliseconds(10) );
+        }
+        this->server.setLatency( std::chrono::milliseconds(200) );
+        this->server.closeWatches();
+        this->server.addResource( makeConfigMap("late") );
+        this->server.compactHistory();
+    });
+
+    client.watchQuery( continuous_query, [&]( const json& delta ){
+        deltas.push_back(delta);
+        return false;
+    });
+    writer.join();
+
+    ASSERT_EQ(deltas.size(), 1u);
+    EXPECT_EQ(deltas[0]["object"]["metadata.name"], "late");
+
+    size_t lists = 0;
+    for( const auto& request : this->server.getRequests() ){
+        lists += request.path == "/api/v1/configmaps" && !request.query.count("watch");
+    }
+    EXPECT_EQ(lists, 2u);
+
+}
+
+
+
+TEST_F(KubernetesClientTest, WatchQueryStopsOnErrorsRetryingCantFix) {
+
+    KubernetesClient client;
+    size_t deltas = 0;
+    auto count_deltas = [&deltas]( const json& ){
+        deltas++;
+        return true;
+    };
+
+    // a 403 isn't listed again: the watch throws instead of retrying forever
+    this->server.injectError( "/api/v1/configmaps", 403 );
+    kubepp::ContinuousQuery forbidden_query( kubepp::Query("SELECT metadata.name FROM ConfigMap") );
+    EXPECT_THROW(client.watchQuery( forbidden_query, count_deltas ), std::runtime_error);
+    EXPECT_EQ(countRequests("/api/v1/configmaps"), 1u);
+
+    // with several kinds, one kind's failure stops the others' watches too
+    this->server.addResource( makeConfigMap("settings") );
+    this->server.injectError( "/api/v1/pods", 404 );
+    kubepp::ContinuousQuery missing_query( kubepp::Query("SELECT metadata.name FROM ConfigMap, Pod") );
+    EXPECT_THROW(client.watchQuery( missing_query, count_deltas ), std::runtime_error);
+    EXPECT_EQ(countRequests("/api/v1/pods"), 1u);
+    EXPECT_LE(deltas, 1u);
+
+}
+
+
+
+TEST_F(KubernetesClientTest, AppsPrintFromTheApiserver) {
+
+    this->server.setPods(3);
+    this->server.addResource({ {"apiVersion", "v1"}, {"kind", "Node"}, {"metadata", { {"name", "node-a"} }} });
+
+    ::testing::internal::CaptureStdout();
+    kubepp::apps::PodApp().displayPods();
+    const std::string pods_table = ::testing::internal::GetCapturedStdout();
+    EXPECT_NE(pods_table.find("pod-2"), std::string::npos);
+
+    ::testing::internal::CaptureStdout();
+    kubepp::apps::NodesApp().run("json");
+    const std::string nodes = ::testing::internal::GetCapturedStdout();
+    EXPECT_NE(nodes.find("node-a"), std::string::npos);
+
+    ::testing::internal::CaptureStdout();
+    kubepp::apps::QueryApp().run("SELECT metadata.name FROM Pod WHERE metadata.namespace = 'kube-system'");
+    const json rows = json::parse( ::testing::internal::GetCapturedStdout() );
+    ASSERT_EQ(rows.size(), 1u);
+    EXPECT_EQ(rows[0]["metadata.name"], "pod-1");
+
+    // Event isn't served by the mock: an empty result, not an error
+    ::testing::internal::CaptureStdout();
+    kubepp::apps::EventsApp().run();
+    EXPECT_EQ(json::parse( ::testing::internal::GetCapturedStdout() ), json::array());
+
+}
+
+
+
+TEST_F(KubernetesClientTest, ExportsChangesSinceASnapshot) {
+
+    this->server.addResource( makeConfigMap("kept") );
+    json changed = this->server.addResource( makeConfigMap("changed") );
+    this->server.addResource( makeConfigMap("removed") );
+    const json deployment = { {"apiVersion", "apps/v1"}, {"kind", "Deployment"}, {"metadata", { {"namespace", "default"}, {"name", "web"} }} };
+    this->server.addResource(deployment);
+
+    ::testing::internal::CaptureStdout();
+    kubepp::apps::ExportApp().exportAllResources("snapshot");
+    const std::string snapshot_path = ::testing::TempDir() + "kubepp_changes_since.snap";
+    {
+        std::ofstream snapshot_file( snapshot_path, std::ios::binary | std::ios::trunc );
+        snapshot_file << ::testing::internal::GetCapturedStdout();
+    }
+
+    changed["data"]["value"] = "2";
+    this->server.addResource(changed);
+    this->server.removeResource( makeConfigMap("removed") );
+    this->server.addResource( makeConfigMap("added") );
+
+    // the deployment is gone too, but its list fails: it's left out of the deletions and the export fails after writing the rest
+    this->server.removeResource(deployment);
+    this->server.injectError( "/apis/apps/v1/deployments", 403 );
+
+    ::testing::internal::CaptureStdout();
+    EXPECT_THROW(kubepp::apps::ExportApp().exportAllResources( "ndjson", "", snapshot_path ), std::runtime_error);
+    std::istringstream deltas( ::testing::internal::GetCapturedStdout() );
+
+    std::map<std::string, std::string> types;
+    std::string line;
+    while( std::getline(deltas, line) ){
+        const json delta = json::parse(line);
+        types[ delta["object"]["kind"].get<std::string>() + "/" + delta["object"]["metadata"]["name"].get<std::string>() ] = delta["type"];
+    }
+    EXPECT_EQ(types, (std::map<std::string, std::string>{ {"ConfigMap/added", "ADDED"}, {"ConfigMap/changed", "MODIFIED"}, {"ConfigMap/removed", "DELETED"} }));
+
+    // the deltas are ndjson only
+    EXPECT_THROW(kubepp::apps::ExportApp().exportAllResources( "json", "", snapshot_path ), std::runtime_error);
+
+    std::remove( snapshot_path.c_str() );
+
+}
+
+
+
+TEST_F(KubernetesClientTest, ExportKeepsCustomResourcesWhenTheCrdListFails) {
+
+    this->server.addResourceType({ "example.com/v1", "Widget", "widgets", true });
+    this->server.addResource({
+        {"apiVersion", "apiextensions.k8s.io/v1"},
+        {"kind", "CustomResourceDefinition"},
+        {"metadata", { {"name", "widgets.example.com"} }},
+        {"spec", { {"group", "example.com"}, {"versions", { { {"name", "v1"} } }} }}
+    });
+    const json widget = { {"apiVersion", "example.com/v1"}, {"kind", "Widget"}, {"metadata", { {"namespace", "default"}, {"name", "gadget"} }} };
+    this->server.addResource(widget);
+    this->server.addResource( makeConfigMap("settings") );
+
+    ::testing::internal::CaptureStdout();
+    kubepp::apps::ExportApp().exportAllResources("snapshot");
+    const std::string snapshot_path = ::testing::TempDir() + "kubepp_crd_list_fails.snap";
+    {
+        std::ofstream snapshot_file( snapshot_path, std::ios::binary | std::ios::trunc );
+        snapshot_file << ::testing::internal::GetCapturedStdout();
+    }
+
+    // without the CRDs the widget's group isn't discovered: it mustn't be reported deleted
+    this->server.injectError( "/apis/apiextensions.k8s.io/v1/customresourcedefinitions", 403, 10 );
+
+    ::testing::internal::CaptureStdout();
+    try{
+        kubepp::apps::ExportApp().exportAllResources( "ndjson", "", snapshot_path );
+        ADD_FAILURE() << "the export should fail";
+    }catch( const std::runtime_error& e ){
+        EXPECT_NE(std::string(e.what()).find("CustomResourceDefinitions"), std::string::npos) << e.what();
+    }
+    std::istringstream deltas( ::testing::internal::GetCapturedStdout() );
+
+    std::string line;
+    while( std::getline(deltas, line) ){
+        EXPECT_NE(json::parse(line)["type"], "DELETED") << line;
+    }
+
+    std::remove( snapshot_path.c_str() );
+
+}
+
+
+
+TEST_F(KubernetesClientTest, ExportsPrometheusMetrics) {
+
+    this->server.setPods(3);
+    this->server.injectError( "/api/v1/namespaces/default/pods/missing", 404 );
+
+    // the metrics are process wide, so earlier tests' calls are already counted
+    kubepp::ClientMetrics& metrics = KubernetesClient::getMetrics();
+    kubepp::ClientMetrics::Series& list_pods = metrics.getSeries( kubepp::ClientMetrics::Verb::LIST, "pods" );
+    kubepp::ClientMetrics::Series& get_pods = metrics.getSeries( kubepp::ClientMetrics::Verb::GET, "pods" );
+    const uint64_t lists_before = list_pods.latency.getCount();
+    const uint64_t gets_before = get_pods.latency.getCount();
+    const uint64_t get_errors_before = get_pods.errors.load();
+
+    KubernetesClient client;
+    client.runQuery("SELECT * FROM Pod");
+
+    ResourceDescription missing_pod( std::string("Pod") );
+    missing_pod.k8s_namespace = "default";
+    missing_pod.name = "missing";
+    client.getGenericResource(missing_pod);
+
+    EXPECT_EQ(list_pods.latency.getCount(), lists_before + 1);
+    EXPECT_EQ(get_pods.latency.getCount(), gets_before + 1);
+    EXPECT_EQ(get_pods.errors.load(), get_errors_before + 1);
+    EXPECT_EQ(get_pods.in_flight.load(), 0);
+
+    const std::string exposition = metrics.toPrometheus();
+
+    EXPECT_NE(exposition.find("kubepp_client_request_duration_seconds_bucket{verb=\"list\",resource=\"pods\",le=\"+Inf\"} " + std::to_string( lists_before + 1 ) + "\n"), std::string::npos);
+    EXPECT_NE(exposition.find("kubepp_client_request_errors_total{verb=\"get\",resource=\"pods\"} " + std::to_string( get_errors_before + 1 ) + "\n"), std::string::npos);
+
+}
+
+
+
+TEST_F(KubernetesClientTest, TracesQueryPhases) {
+
+    this->server.setPods(5);
+
+    KubernetesClient client;
+    kubepp::Tracer::start();
+    client.runQuery("SELECT * FROM Pod");
+    kubepp::Tracer::stop();
+
+    std::ostringstream trace;
+    kubepp::Tracer::write(trace);
+    const json events = json::parse( trace.str() )["traceEvents"];
+
+    std::set<std::string> names;
+    for( const json& event : events ){
+        EXPECT_EQ(event["ph"], "X");
+        EXPECT_TRUE(event.contains("tid"));
+        names.insert( event["name"].get<std::string>() );
+    }
+
+    for( const std::string name : { "query", "list Pod", "page", "fetch", "cJSON parse", "json convert", "filter", "deliver" } ){
+        EXPECT_TRUE(names.count(name)) << name;
+    }
+
+}
+
+
+
+TEST_F(KubernetesClientTest, CountsAllocationsPerSubsystem) {
+
+    if( !kubepp::AllocationTracker::isEnabled() ){
+        GTEST_SKIP() << "configure with -DKUBEPP_TRACK_ALLOCATIONS=ON";
+    }
+
+    this->server.setPods(20);
+
+    KubernetesClient client;
+    const json explanation = client.runQuery("EXPLAIN ANALYZE SELECT metadata.name FROM Pod");
+
+    const json& allocations = explanation["analysis"]["allocations"];
+    EXPECT_GT(allocations["cjson"]["allocations"].get<size_t>(), 0u);
+    EXPECT_GT(allocations["cjson"]["bytes"].get<size_t>(), 0u);
+    EXPECT_GT(allocations["query"]["allocations"].get<size_t>(), 0u);
+
+    const json totals = KubernetesClient::getProcessStats().asJson()["allocations"];
+    EXPECT_GE(totals["cjson"]["allocations"].get<size_t>(), allocations["cjson"]["allocations"].get<size_t>());
+
+    // what the caller does with the rows isn't counted as the query's
+    auto streamQueryAllocations = []( size_t allocations_per_row ){
+        KubernetesClient stream_client;
+        stream_client.streamQuery( "SELECT metadata.name FROM Pod", [allocations_per_row]( json& ){
+            std::vector<std::unique_ptr<int>> allocated;
+            for( size_t i = 0; i < allocations_per_row; i++ ){
+                allocated.push_back( std::make_unique<int>(1) );
+            }
+        });
+        return stream_client.getStats().asJson()["allocations"]["query"]["allocations"].get<size_t>();
+    };
+    EXPECT_LT(streamQueryAllocations(1000), streamQueryAllocations(0) + 1000);
+
+}
+
+
+
+TEST_F(KubernetesClientTest, BenchReportsRatesAndLatencies) {
+
+    this->server.setPods(20);
+
+    kubepp::apps::BenchApp bench;
+    const json report = bench.runStreams({
+        "list,kind=Pod,qps=40,concurrency=2,limit=5",
+        "patch,kind=Pod,qps=20",
+        "watch,kind=Pod,timeout=1",
+        "get,kind=Pod,name=missing,qps=20"
+    }, 1.0 );
+
+    ASSERT_EQ(report["streams"].size(), 4u);
+
+    const json& list = report["streams"][0];
+    EXPECT_GT(list["requests"].get<size_t>(), 10u);
+    EXPECT_EQ(list["errors"], 0);
+    EXPECT_GT(list["latency_ms"]["p50"].get<double>(), 0.0);
+    EXPECT_LE(list["latency_ms"]["p50"].get<double>(), list["latency_ms"]["p99"].get<double>());
+
+    const json& patch = report["streams"][1];
+    EXPECT_GT(patch["requests"].get<size_t>(), 5u);
+    EXPECT_EQ(patch["errors"], 0);
+
+    // the patches show up as MODIFIED events on the watch
+    const json& watch = report["streams"][2];
+    EXPECT_GT(watch["events"].get<size_t>(), 0u);
+    EXPECT_EQ(watch["errors"], 0);
+
+    const json& get = report["streams"][3];
+    EXPECT_GT(get["requests"].get<size_t>(), 5u);
+    EXPECT_EQ(get["errors"], get["requests"]);
+    EXPECT_EQ(get["error_rate"], 1.0);
+    EXPECT_EQ(get["status_counts"]["404"], get["requests"]);
+
+    EXPECT_THROW( bench.runStreams({ "delete,kind=Pod" }, 1.0 ), std::runtime_error );
+
+}
+
+
+
+TEST_F(KubernetesClientTest, BenchMeasuresLatencyFromTheScheduledSendTime) {
+
+    this->server.setPods(5);
+
+    // a get is due every 50ms but takes 150ms: the worker falls behind, and the time requests waited to be sent counts
+    this->server.setLatency( std::chrono::milliseconds(150) );
+
+    kubepp::apps::BenchApp bench;
+    const json report = bench.runStreams({ "get,kind=Pod,qps=20" }, 1.0 );
+
+    const json& get = report["streams"][0];
+    EXPECT_GE(get["service_time_ms"]["p50"].get<double>(), 150.0);
+    EXPECT_LT(get["service_time_ms"]["p50"].get<double>(), 400.0);
+    EXPECT_GT(get["latency_ms"]["max"].get<double>(), 2 * get["service_time_ms"]["max"].get<double>());
+    EXPECT_GE(get["latency_ms"]["p50"].get<double>(), get["service_time_ms"]["p50"].get<double>());
+
+    // the requests that were due but never sent are reported rather than dropped
+    EXPECT_GT(get["unsent"].get<size_t>(), 5u);
+    EXPECT_EQ(get["requests"].get<size_t>() + get["unsent"].get<size_t>(), 20u);
+
+}
+
+
+
+TEST_F(KubernetesClientTest, RateLimitsRequestsPerPriority) {
+
+    this->server.setPods(30);
+
+    // 20 requests per second with no burst: 6 pages take at least 5 waits of 50ms
+    auto rate_limiter = std::make_shared<kubepp::RateLimiter>( &KubernetesClient::getMetrics() );
+    rate_limiter->configure( kubepp::RateLimiter::Priority::INTERACTIVE, 20.0, 1.0 );
+
+    KubernetesClient client;
+    client.setRateLimiter(rate_limiter);
+    client.setPageSize(5);
+
+    const auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ(client.runQuery("SELECT * FROM Pod").size(), 30u);
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(240));
+
+    const kubepp::QueryStats stats = client.getStats();
+    EXPECT_GE(stats.throttled_requests, 5u);
+    EXPECT_GE(stats.throttled_ms, 240.0);
+
+    // the background bucket is separate, and unlimited
+    KubernetesClient background_client;
+    background_client.setRateLimiter(rate_limiter);
+    background_client.setPriority( kubepp::RateLimiter::Priority::BACKGROUND );
+    background_client.setPageSize(5);
+    background_client.runQuery("SELECT * FROM Pod");
+    EXPECT_EQ(background_client.getStats().throttled_requests, 0u);
+
+    const std::string metrics = KubernetesClient::getMetrics().toPrometheus();
+    EXPECT_NE(metrics.find("kubepp_client_rate_limited_requests_total{priority=\"interactive\"}"), std::string::npos);
+
+}
+
+
+
+TEST_F(KubernetesClientTest, RetriesWithBackoffAndRetryAfter) {
+
+    this->server.setPods(10);
+
+    kubepp::RetryPolicy retry_policy;
+    retry_policy.initial_delay = std::chrono::milliseconds(10);
+    retry_policy.max_delay = std::chrono::milliseconds(50);
+
+    // a 429 asking for a second in its Retry-After header ( its body is plain text ), then a 503: the list is retried twice and nothing is missing
+    this->server.injectError( "/api/v1/pods", 429, 1, 1 );
+    this->server.injectError( "/api/v1/pods", 503 );
+
+    KubernetesClient client;
+    client.setRetryPolicy(retry_policy);
+
+    const auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ(client.runQuery("SELECT * FROM Pod").size(), 10u);
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(1000));
+    EXPECT_EQ(client.getStats().retries, 2u);
+    EXPECT_EQ(countRequests("/api/v1/pods"), 3u);
+
+    // a patch isn't retried after a 503, which the apiserver may have applied, but is after a 429
+    this->server.addResource( makeConfigMap("settings") );
+    const std::string settings_path = "/api/v1/namespaces/default/configmaps/settings";
+    const json patch = json::array({ { {"op", "add"}, {"path", "/data/other"}, {"value", "2"} } });
+    ResourceDescription settings( std::string("ConfigMap") );
+    settings.k8s_namespace = "default";
+    settings.name = "settings";
+
+    this->server.injectError( settings_path, 503 );
+    EXPECT_EQ(client.patchGenericResource( settings, patch )["code"], 503);
+    EXPECT_EQ(countRequests(settings_path), 1u);
+
+    this->server.injectError( settings_path, 429 );
+    EXPECT_EQ(client.patchGenericResource( settings, patch )["data"]["other"], "2");
+    EXPECT_EQ(countRequests(settings_path), 3u);
+
+    // a query's retries share a budget; once it's spent the failure is returned
+    retry_policy.query_retries = 1;
+    KubernetesClient budget_client;
+    budget_client.setRetryPolicy(retry_policy);
+    this->server.injectError( "/api/v1/pods", 503, 5 );
+    EXPECT_TRUE(budget_client.runQuery("SELECT * FROM Pod").empty());
+    EXPECT_EQ(budget_client.getStats().retries, 1u);
+
+    const std::string metrics = KubernetesClient::getMetrics().toPrometheus();
+    EXPECT_NE(metrics.find("kubepp_client_request_retries_total{"), std::string::npos);
+
+}
+
+
+
+TEST_F(KubernetesClientTest, ReusesConnections) {
+
+    this->server.addResource( makeConfigMap("settings") );
+    ResourceDescription settings( std::string("ConfigMap") );
+    settings.k8s_namespace = "default";
+    settings.name = "settings";
+
+    // the first request on this thread's session connects to the new server; the rest reuse the connection
+    KubernetesClient client;
+    for( int i = 0; i < 5; i++ ){
+        EXPECT_EQ(client.getGenericResource(settings)["metadata"]["name"], "settings");
+    }
+    EXPECT_EQ(client.getStats().api_calls, 5u);
+    EXPECT_EQ(client.getStats().connections_opened, 1u);
+    EXPECT_EQ(client.getStats().tls_handshakes, 0u);
+
+    kubepp::HttpSession::setConnectionReuse(false);
+    KubernetesClient fresh_client;
+    for( int i = 0; i < 5; i++ ){
+        fresh_client.getGenericResource(settings);
+    }
+    kubepp::HttpSession::setConnectionReuse(true);
+    EXPECT_EQ(fresh_client.getStats().connections_opened, 5u);
+
+}
+
+
+
+TEST_F(KubernetesClientTest, ResumesTlsSessionsOnNewConnections) {
+
+    this->server.addResource( makeConfigMap("settings") );
+    ResourceDescription settings( std::string("ConfigMap") );
+    settings.k8s_namespace = "default";
+    settings.name = "settings";
+
+    kubepp::mock::TlsProxy proxy( this->server.getPort() );
+    this->server.useAsKubeconfig( proxy.getUrl() );
+
+    // this thread's session makes the full handshake; another thread's session opens a connection of its own, which resumes
+    // the TLS session from the shared cache
+    KubernetesClient client;
+    EXPECT_EQ(client.getGenericResource(settings)["metadata"]["name"], "settings");
+    std::thread( [&](){
+        EXPECT_EQ(client.getGenericResource(settings)["metadata"]["name"], "settings");
+    }).join();
+
+    EXPECT_EQ(client.getStats().connections_opened, 2u);
+    EXPECT_EQ(client.getStats().tls_handshakes, 1u);
+    EXPECT_EQ(client.getStats().tls_resumptions, 1u);
+    EXPECT_EQ(proxy.getHandshakeCount(), 2u);
+    EXPECT_EQ(proxy.getResumedSessionCount(), 1u);
+
+}
+
+
+
+TEST_F(KubernetesClientTest, ListsRecordedProtobufResponses) {
+
+    // tests/data/protobuf: lists as the apiserver encodes them, and the json it sends for the same lists
+    auto readTestData = []( const std::string& name ){
+        std::ifstream file( std::string(KUBEPP_TEST_DATA_DIR) + "/protobuf/" + name, std::ios::binary );
+        std::ostringstream contents;
+        contents << file.rdbuf();
+        return contents.str();
+    };
+
+    for( const auto& [path, name] : std::map<std::string, std::string>{ {"/api/v1/pods", "pod-list"}, {"/apis/apps/v1/deployments", "deployment-list"} } ){
+        const std::string protobuf = readTestData( name + ".pb" );
+        const std::string json_body = readTestData( name + ".json" );
+        ASSERT_FALSE(protobuf.empty()) << name;
+        this->server.setHandler( path, [protobuf, json_body]( const MockApiServer::Request& request ){
+            MockApiServer::Response response;
+            const auto accept = request.headers.find("accept");
+            if( accept != request.headers.end() && accept->second.find("application/vnd.kubernetes.protobuf") != std::string::npos ){
+                response.content_type = "application/vnd.kubernetes.protobuf";
+                response.body = protobuf;
+            }else{
+                response.body = json_body;
+            }
+            return response;
+        });
+    }
+
+    KubernetesClient json_client;
+    json_client.setProtobuf(false);
+
+    const std::vector<std::string> queries = { "SELECT * FROM Pod", "SELECT * FROM Deployment" };
+    std::vector<json> expected;
+    for( const std::string& query : queries ){
+        expected.push_back( json_client.runQuery(query) );
+    }
+    ASSERT_EQ(expected[0].size(), 2u);
+    ASSERT_EQ(expected[1].size(), 2u);
+
+    KubernetesClient client;
+    kubepp::Tracer::start();
+    for( size_t i = 0; i < queries.size(); i++ ){
+        EXPECT_EQ(client.runQuery( queries[i] ), expected[i]) << queries[i];
+    }
+    kubepp::Tracer::stop();
+
+    std::ostringstream trace;
+    kubepp::Tracer::write(trace);
+    size_t decodes = 0;
+    for( const json& event : json::parse( trace.str() )["traceEvents"] ){
+        decodes += event["name"] == "protobuf decode";
+    }
+    EXPECT_EQ(decodes, 2u);
+
+    // filters see the same values either way: hostNetwork's false is dropped like in json, a pointer's zero is kept
+    EXPECT_TRUE(client.runQuery("SELECT metadata.name FROM Pod WHERE spec.hostNetwork = 'false'").empty());
+    EXPECT_EQ(client.runQuery("SELECT metadata.name FROM Deployment WHERE spec.replicas = 0").size(), 1u);
+
+}
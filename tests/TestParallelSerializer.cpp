@@ -0,0 +1,80 @@
+#include "ParallelSerializer.h"
+#include <gtest/gtest.h>
+
+#include <string>
+#include <sstream>
+
+#include "json.hpp"
+using json = nlohmann::json;
+
+using kubepp::ParallelSerializer;
+
+
+// more elements than min_parallel_size, over an uneven number of shards, with nested, unicode and escaped values
+static json makeLargeArray(){
+
+    json array = json::array();
+    const size_t size = ParallelSerializer::min_parallel_size + 3 * ParallelSerializer::shard_size + 7;
+
+    for( size_t i = 0; i < size; i++ ){
+        switch( i % 5 ){
+            case 0:
+                array.push_back({
+                    {"apiVersion", "v1"},
+                    {"kind", "ConfigMap"},
+                    {"metadata", { {"name", "settings-" + std::to_string(i)}, {"labels", { {"app", "web"}, {"tier", json::object()} }} }},
+                    {"data", { {"greeting", "grüße, 世界 🚀"}, {"escaped", "tab\tquote\"backslash\\newline\ncontrol\x01"} }}
+                });
+                break;
+            case 1:
+                array.push_back( json::array({ i, -static_cast<int64_t>(i), i * 0.25, 1e-7, true, nullptr, json::array(), json::array({ json::array({ "deep" }) }) }) );
+                break;
+            case 2:
+                array.push_back( "ünïcödé " + std::to_string(i) );
+                break;
+            case 3:
+                array.push_back( static_cast<uint64_t>(1) << 63 );
+                break;
+            default:
+                array.push_back( json::object() );
+        }
+    }
+
+    return array;
+
+}
+
+
+
+TEST(ParallelSerializerTest, MatchesDumpForLargeArrays) {
+
+    const json array = makeLargeArray();
+    ASSERT_GT(array.size(), ParallelSerializer::min_parallel_size);
+
+    for( int indent : { -1, 0, 4 } ){
+        const std::string expected = array.dump(indent);
+        for( size_t thread_count : { 1u, 2u, 3u, 8u } ){
+            EXPECT_EQ(ParallelSerializer::dump( array, indent, thread_count ), expected) << "indent " << indent << ", " << thread_count << " threads";
+        }
+
+        std::ostringstream output;
+        ParallelSerializer::write( array, output, indent );
+        EXPECT_EQ(output.str(), expected) << "indent " << indent;
+    }
+
+}
+
+
+
+TEST(ParallelSerializerTest, MatchesDumpForOtherValues) {
+
+    // small arrays and non-arrays are dumped on the calling thread
+    const json small = json::array({ "grüße", json::object({ {"a", json::array({ 1, 2.5 })} }) });
+    EXPECT_EQ(ParallelSerializer::dump( small, 4 ), small.dump(4));
+
+    const json object = { {"items", makeLargeArray()} };
+    EXPECT_EQ(ParallelSerializer::dump( object, 4 ), object.dump(4));
+
+    EXPECT_EQ(ParallelSerializer::dump( json::array(), 4 ), json::array().dump(4));
+
+}
@@ -0,0 +1,255 @@
+#include "Snapshot.h"
+#include <gtest/gtest.h>
+
+#include <string>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "json.hpp"
+using json = nlohmann::json;
+
+using kubepp::Snapshot;
+using kubepp::SnapshotWriter;
+using kubepp::SnapshotReader;
+
+
+class SnapshotTest : public ::testing::TestWithParam<Snapshot::Encoding> {
+
+    protected:
+        void SetUp() override{
+            // parameterized test names are "<test>/<index>"
+            std::string name = ::testing::UnitTest::GetInstance()->current_test_info()->name();
+            std::replace( name.begin(), name.end(), '/', '_' );
+            this->path = ::testing::TempDir() + "kubepp_" + name + ".snap";
+        }
+
+        void TearDown() override{
+            std::remove( this->path.c_str() );
+        }
+
+        static json makeObject( const std::string& api_version, const std::string& kind, const std::string& k8s_namespace, const std::string& name ){
+            json metadata = { {"name", name}, {"uid", "uid-" + kind + "-" + name}, {"resourceVersion", "7"}, {"labels", { {"app", "web"} }} };
+            if( !k8s_namespace.empty() ){
+                metadata["namespace"] = k8s_namespace;
+            }
+            return { {"apiVersion", api_version}, {"kind", kind}, {"metadata", metadata}, {"data", { {"note", "café ✓"}, {"count", 3}, {"ratio", 0.5}, {"enabled", true} }} };
+        }
+
+        // a snapshot of pods and configmaps in two namespaces, and a namespace, added out of key order
+        std::string writeSnapshot( Snapshot::Encoding encoding ){
+            std::ostringstream output;
+            SnapshotWriter writer( output, encoding );
+            writer.add( makeObject("v1", "Pod", "kube-system", "dns") );
+            writer.add( makeObject("v1", "ConfigMap", "default", "settings") );
+            writer.add( makeObject("v1", "Pod", "default", "web-1") );
+            writer.add( makeObject("v1", "Namespace", "", "default") );
+            writer.add( makeObject("v1", "Pod", "default", "web-0") );
+            writer.finish();
+            EXPECT_EQ(writer.size(), 5u);
+            return output.str();
+        }
+
+        void writeFile( const std::string& bytes ){
+            std::ofstream file( this->path, std::ios::binary | std::ios::trunc );
+            file.write( bytes.data(), static_cast<std::streamsize>(bytes.size()) );
+        }
+
+        static void writeU64( std::string& bytes, size_t offset, uint64_t value ){
+            for( int i = 0; i < 8; i++ ){
+                bytes[offset + i] = static_cast<char>( (value >> (8 * i)) & 0xff );
+            }
+        }
+
+        std::string path;
+
+};
+
+
+
+TEST_P(SnapshotTest, RoundTripsObjects) {
+
+    this->writeFile( this->writeSnapshot( GetParam() ) );
+    SnapshotReader reader( this->path );
+
+    ASSERT_EQ(reader.size(), 5u);
+
+    const json pod = reader.find( "Pod", "default", "web-1" );
+    EXPECT_EQ(pod, makeObject("v1", "Pod", "default", "web-1"));
+    EXPECT_EQ(pod["data"]["note"], "café ✓");
+
+    EXPECT_EQ(reader.find( "Namespace", "", "default" ), makeObject("v1", "Namespace", "", "default"));
+    EXPECT_TRUE(reader.find( "Pod", "default", "missing" ).is_null());
+
+    const size_t position = reader.findPosition( "Pod", "kube-system", "dns", "v1" );
+    ASSERT_NE(position, SnapshotReader::npos);
+    const auto fields = reader.getKeyFields(position);
+    EXPECT_EQ(fields[Snapshot::UID], "uid-Pod-dns");
+    EXPECT_EQ(fields[Snapshot::RESOURCE_VERSION], "7");
+    EXPECT_EQ(reader.findPosition( "Pod", "kube-system", "dns", "v2" ), SnapshotReader::npos);
+
+}
+
+
+
+TEST_P(SnapshotTest, LooksUpByKindAndNamespace) {
+
+    this->writeFile( this->writeSnapshot( GetParam() ) );
+    SnapshotReader reader( this->path );
+
+    std::vector<std::string> names;
+    auto collect = [&names]( json& resource ){
+        names.push_back( resource["metadata"]["namespace"].get<std::string>() + "/" + resource["metadata"]["name"].get<std::string>() );
+        return true;
+    };
+
+    // in key order: namespace, then name
+    reader.forEach( "Pod", "", collect );
+    EXPECT_EQ(names, (std::vector<std::string>{ "default/web-0", "default/web-1", "kube-system/dns" }));
+
+    names.clear();
+    reader.forEach( "Pod", "default", collect );
+    EXPECT_EQ(names, (std::vector<std::string>{ "default/web-0", "default/web-1" }));
+
+    names.clear();
+    reader.forEach( "Pod", "kube", collect );
+    EXPECT_TRUE(names.empty());
+
+    const json rows = reader.runQuery( "SELECT metadata.name FROM Pod WHERE metadata.namespace = 'default'" );
+    ASSERT_EQ(rows.size(), 2u);
+    EXPECT_EQ(rows[0]["metadata.name"], "web-0");
+
+    // the same rows, one at a time
+    json streamed = json::array();
+    reader.streamQuery( "SELECT metadata.name FROM Pod WHERE metadata.namespace = 'default'", [&streamed]( json& row ){
+        streamed.push_back(row);
+    });
+    EXPECT_EQ(streamed, rows);
+
+}
+
+
+
+TEST_P(SnapshotTest, RejectsTruncatedAndCorruptFiles) {
+
+    const std::string bytes = this->writeSnapshot( GetParam() );
+
+    // cut anywhere, the footer is missing
+    for( size_t size : { size_t(0), Snapshot::header_size, bytes.size() / 2, bytes.size() - 1 } ){
+        this->writeFile( bytes.substr(0, size) );
+        EXPECT_THROW(SnapshotReader reader( this->path ), std::runtime_error) << "truncated to " << size << " bytes";
+    }
+
+    const size_t footer_offset = bytes.size() - Snapshot::footer_size;
+    const uint64_t index_offset = [&](){
+        uint64_t value = 0;
+        for( int i = 7; i >= 0; i-- ){
+            value = (value << 8) | static_cast<uint8_t>( bytes[footer_offset + i] );
+        }
+        return value;
+    }();
+
+    // a payload running into the index
+    std::string corrupt = bytes;
+    writeU64( corrupt, index_offset, index_offset - 1 );
+    this->writeFile(corrupt);
+    EXPECT_THROW(SnapshotReader reader( this->path ), std::runtime_error);
+
+    // a key past the keys region
+    corrupt = bytes;
+    writeU64( corrupt, index_offset + 16, Snapshot::footer_size + bytes.size() );
+    this->writeFile(corrupt);
+    EXPECT_THROW(SnapshotReader reader( this->path ), std::runtime_error);
+
+    // more objects than the index has room for
+    corrupt = bytes;
+    writeU64( corrupt, footer_offset + 8, UINT64_MAX / Snapshot::index_entry_size + 1 );
+    this->writeFile(corrupt);
+    EXPECT_THROW(SnapshotReader reader( this->path ), std::runtime_error);
+
+    this->writeFile(bytes);
+    EXPECT_NO_THROW(SnapshotReader reader( this->path ));
+
+}
+
+
+
+TEST_P(SnapshotTest, ComparesOnlyVersion2Snapshots) {
+
+    std::string bytes = this->writeSnapshot( GetParam() );
+    this->writeFile(bytes);
+    {
+        SnapshotReader reader( this->path );
+        EXPECT_EQ(reader.getVersion(), 2u);
+        EXPECT_NO_THROW(kubepp::SnapshotComparison comparison(reader));
+
+        // nothing was seen: everything is deleted, except the kinds that weren't listed completely
+        kubepp::SnapshotComparison comparison(reader);
+        kubepp::ResourceDescription pods;
+        pods.api_group_version = "v1";
+        pods.kind = "Pod";
+        EXPECT_EQ(comparison.getDeleted().size(), 5u);
+        EXPECT_EQ(comparison.getDeleted({ pods }).size(), 2u);
+
+        // an empty apiVersion and kind ( the CustomResourceDefinitions couldn't be listed ) keeps everything
+        kubepp::ResourceDescription any_group_version;
+        any_group_version.api_group_version = "";
+        EXPECT_TRUE(comparison.getDeleted({ any_group_version }).empty());
+    }
+
+    // version 1 indexes have no uids or resourceVersions: still queryable, but every object would compare as recreated
+    bytes[8] = 1;
+    this->writeFile(bytes);
+    SnapshotReader reader( this->path );
+    EXPECT_EQ(reader.getVersion(), 1u);
+    EXPECT_EQ(reader.find( "Pod", "default", "web-0" )["metadata"]["name"], "web-0");
+    EXPECT_THROW(kubepp::SnapshotComparison comparison(reader), std::runtime_error);
+
+}
+
+
+
+TEST_P(SnapshotTest, KeepsObjectsOfGroupsThatWerentListed) {
+
+    std::ostringstream output;
+    SnapshotWriter writer( output, GetParam() );
+    writer.add( makeObject("v1", "Pod", "default", "web-0") );
+    writer.add( makeObject("apps/v1", "Deployment", "default", "web") );
+    writer.add( makeObject("example.com/v1", "Widget", "default", "gadget") );
+    writer.finish();
+    this->writeFile( output.str() );
+
+    SnapshotReader reader( this->path );
+    kubepp::SnapshotComparison comparison(reader);
+
+    auto getDeletedKinds = [&comparison]( const std::vector<kubepp::ResourceDescription>& incomplete_lists ){
+        std::vector<std::string> kinds;
+        for( const json& delta : comparison.getDeleted(incomplete_lists) ){
+            kinds.push_back( delta["object"]["kind"].get<std::string>() );
+        }
+        std::sort( kinds.begin(), kinds.end() );
+        return kinds;
+    };
+
+    kubepp::ResourceDescription apps;
+    apps.api_group_version = "apps/v1";
+    EXPECT_EQ(getDeletedKinds({ apps }), (std::vector<std::string>{ "Pod", "Widget" }));
+
+    // the default ResourceDescription is core v1, not every group version
+    EXPECT_EQ(getDeletedKinds({ kubepp::ResourceDescription() }), (std::vector<std::string>{ "Deployment", "Widget" }));
+
+    kubepp::ResourceDescription any_group_version;
+    any_group_version.api_group_version = "";
+    EXPECT_TRUE(getDeletedKinds({ any_group_version }).empty());
+
+}
+
+
+
+INSTANTIATE_TEST_SUITE_P(Encodings, SnapshotTest, ::testing::Values( Snapshot::Encoding::CBOR, Snapshot::Encoding::MESSAGE_PACK ), []( const ::testing::TestParamInfo<Snapshot::Encoding>& info ){
+    return info.param == Snapshot::Encoding::CBOR ? std::string("CBOR") : std::string("MessagePack");
+});
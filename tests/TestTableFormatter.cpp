@@ -0,0 +1,140 @@
+#include "TableFormatter.h"
+#include <gtest/gtest.h>
+
+#include <string>
+#include <sstream>
+#include <vector>
+
+#include "json.hpp"
+using json = nlohmann::json;
+
+using kubepp::TableFormatter;
+using kubepp::TableWriter;
+
+
+static std::vector<std::string> getLines( const std::string& text ){
+
+    std::vector<std::string> lines;
+    std::istringstream stream(text);
+    std::string line;
+    while( std::getline(stream, line) ){
+        lines.push_back(line);
+    }
+    return lines;
+
+}
+
+
+static json makeTablePage( const std::vector<std::pair<std::string, std::string>>& rows, bool namespaced ){
+
+    json page = {
+        {"kind", "Table"},
+        {"columnDefinitions", {
+            { {"name", "Name"}, {"type", "string"}, {"priority", 0} },
+            { {"name", "Containers"}, {"type", "string"}, {"priority", 1} },
+            { {"name", "Status"}, {"type", "string"}, {"priority", 0} }
+        }},
+        {"rows", json::array()}
+    };
+
+    for( const auto& [name, status] : rows ){
+        json metadata = { {"name", name} };
+        if( namespaced ){
+            metadata["namespace"] = "default";
+        }
+        page["rows"].push_back({ {"cells", { name, "nginx", status }}, {"object", { {"metadata", metadata} }} });
+    }
+
+    return page;
+
+}
+
+
+
+TEST(TableFormatterTest, PrintsEachWindowAsItFills) {
+
+    std::ostringstream output;
+    TableFormatter formatter( output, { "NAME", "STATUS", "AGE" }, 2 );
+
+    formatter.addRow({ "a", "Running", "5d" });
+    EXPECT_EQ(output.str(), "");
+
+    // the window is full: printed with widths from its rows and the headers
+    formatter.addRow({ "web-0", "Pending", "3h" });
+    EXPECT_EQ(getLines( output.str() ), (std::vector<std::string>{
+        "NAME    STATUS    AGE",
+        "a       Running   5d",
+        "web-0   Pending   3h"
+    }));
+
+    // a wider name in a later window grows its column and shifts only the columns after it; widths never shrink
+    formatter.addRow({ "a-much-longer-name", "Running", "1m" });
+    formatter.addRow({ "b", "Failed", "12s" });
+    formatter.finish();
+
+    const std::vector<std::string> lines = getLines( output.str() );
+    ASSERT_EQ(lines.size(), 5u);
+    EXPECT_EQ(lines[3], "a-much-longer-name   Running   1m");
+    EXPECT_EQ(lines[4], "b                    Failed    12s");
+
+}
+
+
+
+TEST(TableFormatterTest, PrintsTheHeaderOfAnEmptyTable) {
+
+    std::ostringstream output;
+    TableFormatter formatter( output, { "NAME", "STATUS" } );
+    formatter.finish();
+
+    EXPECT_EQ(output.str(), "NAME   STATUS\n");
+
+}
+
+
+
+TEST(TableFormatterTest, GetsCellsFromPaths) {
+
+    const auto columns = TableFormatter::getKindColumns("Pod");
+    EXPECT_EQ(TableFormatter::getHeaders(columns), (std::vector<std::string>{ "NAMESPACE", "NAME", "STATUS", "NODE", "IP", "AGE" }));
+
+    const json pod = { {"metadata", { {"namespace", "default"}, {"name", "web-0"}, {"creationTimestamp", "2000-01-01T00:00:00Z"} }}, {"status", { {"phase", "Running"} }} };
+    const std::vector<std::string> cells = TableFormatter::getCells( columns, pod );
+
+    ASSERT_EQ(cells.size(), 6u);
+    EXPECT_EQ(cells[1], "web-0");
+    EXPECT_EQ(cells[3], "<none>");
+    EXPECT_EQ(cells[5].back(), 'd');
+
+}
+
+
+
+TEST(TableFormatterTest, WritesTablePagesAsTheyArrive) {
+
+    std::ostringstream output;
+    TableWriter writer(output);
+
+    // the priority 1 column is left out, and the rows' namespaces make a NAMESPACE column
+    writer.addPage( makeTablePage( {}, true ) );
+    writer.addPage( makeTablePage( { {"web-0", "Running"}, {"web-1", "Pending"} }, true ) );
+    writer.addPage( makeTablePage( { {"a-much-longer-name", "Running"} }, true ) );
+    writer.finish();
+
+    EXPECT_EQ(getLines( output.str() ), (std::vector<std::string>{
+        "NAMESPACE   NAME                 STATUS",
+        "default     web-0                Running",
+        "default     web-1                Pending",
+        "default     a-much-longer-name   Running"
+    }));
+
+    // cluster-scoped rows have no NAMESPACE column; a table without rows prints its header
+    std::ostringstream nodes;
+    TableFormatter::writeTable( makeTablePage( { {"node-a", "Ready"} }, false ), nodes );
+    EXPECT_EQ(nodes.str(), "NAME     STATUS\nnode-a   Ready\n");
+
+    std::ostringstream empty;
+    TableFormatter::writeTable( makeTablePage( {}, false ), empty );
+    EXPECT_EQ(empty.str(), "NAME   STATUS\n");
+
+}
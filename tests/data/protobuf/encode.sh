@@ -0,0 +1,17 @@
+#!/bin/sh
+# Encodes each <name>.txtpb ( a response in protobuf text format, every non-pointer field written like the apiserver's
+# gogo marshalling does ) into <name>.pb, the bytes the apiserver sends for application/vnd.kubernetes.protobuf.
+#
+#     tests/data/protobuf/encode.sh <a directory holding k8s.io/api and k8s.io/apimachinery checkouts>
+set -e
+
+proto_root="$1"
+cd "$(dirname "$0")"
+
+encode(){
+    printf 'k8s\000' > "$1.pb"
+    protoc -I "$proto_root" -I . --encode="kubepp.tests.$2" responses.proto < "$1.txtpb" >> "$1.pb"
+}
+
+encode pod-list PodListResponse
+encode deployment-list DeploymentListResponse
@@ -0,0 +1,1455 @@
+#include "MockApiServer.h"
+
+#include <stdexcept>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdlib>
+#include <ctime>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+
+namespace kubepp::mock {
+
+
+    namespace {
+
+        string urlDecode( const string& value ){
+
+            string decoded;
+            decoded.reserve(value.size());
+
+            for( size_t i = 0; i < value.size(); i++ ){
+                if( value[i] == '%' && i + 2 < value.size() ){
+                    decoded += static_cast<char>( std::stoi(value.substr(i + 1, 2), nullptr, 16) );
+                    i += 2;
+                }else if( value[i] == '+' ){
+                    decoded += ' ';
+                }else{
+                    decoded += value[i];
+                }
+            }
+
+            return decoded;
+
+        }
+
+
+        vector<string> split( const string& value, char delimiter ){
+
+            vector<string> parts;
+            size_t start = 0;
+
+            while( start <= value.size() ){
+                size_t end = value.find(delimiter, start);
+                if( end == string::npos ){
+                    end = value.size();
+                }
+                if( end > start ){
+                    parts.push_back( value.substr(start, end - start) );
+                }
+                start = end + 1;
+            }
+
+            return parts;
+
+        }
+
+
+        string getTimestamp(){
+
+            const std::time_t now = std::time(nullptr);
+            std::tm utc{};
+            gmtime_r( &now, &utc );
+
+            char buffer[32];
+            std::strftime( buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%SZ", &utc );
+            return buffer;
+
+        }
+
+
+        // "metadata.name" style lookups for field selectors
+        const json* lookup( const json& resource, const string& path ){
+
+            const json* current = &resource;
+
+            for( const string& key : split(path, '.') ){
+                if( !current->is_object() || !current->contains(key) ){
+                    return nullptr;
+                }
+                current = &(*current)[key];
+            }
+
+            return current;
+
+        }
+
+
+        // "a=b,c!=d,e,!f" against a map of strings; "==" is the same as "="
+        bool matchesSelector( const string& selector, const std::function<const json*(const string&)>& get_value ){
+
+            for( const string& requirement : split(selector, ',') ){
+
+                const size_t not_equals_pos = requirement.find("!=");
+                const size_t equals_pos = requirement.find('=');
+
+                if( not_equals_pos != string::npos ){
+                    const json* value = get_value( requirement.substr(0, not_equals_pos) );
+                    if( value && value->is_string() && value->get<string>() == requirement.substr(not_equals_pos + 2) ){
+                        return false;
+                    }
+                }else if( equals_pos != string::npos ){
+                    const size_t value_pos = ( requirement.compare(equals_pos, 2, "==") == 0 ) ? equals_pos + 2 : equals_pos + 1;
+                    const json* value = get_value( requirement.substr(0, equals_pos) );
+                    if( !value || !value->is_string() || value->get<string>() != requirement.substr(value_pos) ){
+                        return false;
+                    }
+                }else if( !requirement.empty() && requirement[0] == '!' ){
+                    if( get_value(requirement.substr(1)) ){
+                        return false;
+                    }
+                }else if( !get_value(requirement) ){
+                    return false;
+                }
+
+            }
+
+            return true;
+
+        }
+
+
+        json toPartialObjectMetadata( const json& resource ){
+
+            return { {"apiVersion", "meta.k8s.io/v1"}, {"kind", "PartialObjectMetadata"}, {"metadata", resource["metadata"]} };
+
+        }
+
+    }
+
+    MockApiServer::MockApiServer(){
+
+        this->resource_types = {
+            { "v1", "Pod", "pods", true },
+            { "v1", "Node", "nodes", false },
+            { "v1", "Namespace", "namespaces", false },
+            { "v1", "ConfigMap", "configmaps", true },
+            { "v1", "Secret", "secrets", true },
+            { "v1", "Service", "services", true },
+            { "apps/v1", "Deployment", "deployments", true },
+            { "apiextensions.k8s.io/v1", "CustomResourceDefinition", "customresourcedefinitions", false }
+        };
+
+        this->listen_fd = ::socket( AF_INET, SOCK_STREAM, 0 );
+        if( this->listen_fd < 0 ){
+            throw std::runtime_error( string("Cannot create the mock apiserver socket: ") + std::strerror(errno) );
+        }
+
+        const int enable = 1;
+        ::setsockopt( this->listen_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable) );
+
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = 0;
+
+        if( ::bind(this->listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(this->listen_fd, 64) != 0 ){
+            ::close(this->listen_fd);
+            throw std::runtime_error( string("Cannot listen on 127.0.0.1: ") + std::strerror(errno) );
+        }
+
+        socklen_t address_length = sizeof(address);
+        ::getsockname( this->listen_fd, reinterpret_cast<sockaddr*>(&address), &address_length );
+        this->port = ntohs(address.sin_port);
+
+        this->accept_thread = std::thread( &MockApiServer::acceptConnections, this );
+
+    }
+
+
+
+    MockApiServer::~MockApiServer(){
+
+        this->stopping = true;
+
+        // wakes accept(), every blocked recv() and every idle watch
+        ::shutdown( this->listen_fd, SHUT_RDWR );
+        if( this->accept_thread.joinable() ){
+            this->accept_thread.join();
+        }
+        ::close( this->listen_fd );
+
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            for( int fd : this->connection_fds ){
+                ::shutdown( fd, SHUT_RDWR );
+            }
+        }
+        this->events_changed.notify_all();
+
+        for( std::thread& connection_thread : this->connection_threads ){
+            connection_thread.join();
+        }
+
+        if( !this->kubeconfig_path.empty() ){
+            std::remove( this->kubeconfig_path.c_str() );
+        }
+
+    }
+
+
+
+    int MockApiServer::getPort() const{
+
+        return this->port;
+
+    }
+
+
+
+    string MockApiServer::getUrl() const{
+
+        return "http://127.0.0.1:" + std::to_string(this->port);
+
+    }
+
+
+
+    void MockApiServer::useAsKubeconfig( const string& server_url ){
+
+        if( this->kubeconfig_path.empty() ){
+            char path_template[] = "/tmp/kubepp-mock-kubeconfig-XXXXXX";
+            const int fd = ::mkstemp(path_template);
+            if( fd < 0 ){
+                throw std::runtime_error( string("Cannot create the mock kubeconfig: ") + std::strerror(errno) );
+            }
+            ::close(fd);
+            this->kubeconfig_path = path_template;
+        }
+
+        std::ofstream kubeconfig( this->kubeconfig_path, std::ios::trunc );
+        kubeconfig << "apiVersion: v1\n"
+                   << "kind: Config\n"
+                   << "clusters:\n"
+                   << "- name: mock\n"
+                   << "  cluster:\n"
+                   << "    server: " << ( server_url.empty() ? this->getUrl() : server_url ) << "\n"
+                   << ( server_url.rfind("https://", 0) == 0 ? "    insecure-skip-tls-verify: true\n" : "" )
+                   << "users:\n"
+                   << "- name: mock\n"
+                   << "  user:\n"
+                   << "    token: mock-token\n"
+                   << "contexts:\n"
+                   << "- name: mock\n"
+                   << "  context:\n"
+                   << "    cluster: mock\n"
+                   << "    user: mock\n"
+                   << "current-context: mock\n";
+        kubeconfig.close();
+
+        ::setenv( "KUBECONFIG", this->kubeconfig_path.c_str(), 1 );
+
+    }
+
+
+
+    void MockApiServer::addResourceType( const ResourceType& resource_type ){
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->resource_types.push_back(resource_type);
+
+    }
+
+
+
+    json MockApiServer::addResource( json resource ){
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        const ResourceType* resource_type = this->findResourceTypeLocked( resource.value("apiVersion", ""), resource.value("kind", "") );
+        if( !resource_type ){
+            throw std::runtime_error( "The mock apiserver has no resource type " + resource.value("apiVersion", "") + ":" + resource.value("kind", "") + "." );
+        }
+
+        if( !resource.contains("metadata") || !resource["metadata"].contains("name") ){
+            throw std::runtime_error( "Mock resources need a metadata.name." );
+        }
+        if( resource_type->namespaced && !resource["metadata"].contains("namespace") ){
+            resource["metadata"]["namespace"] = "default";
+        }
+
+        const string key = MockApiServer::getObjectKey( resource["metadata"].value("namespace", ""), resource["metadata"]["name"].get<string>() );
+        const bool exists = this->collections[ MockApiServer::getCollectionKey(resource_type->group_version, resource_type->plural) ].count(key) > 0;
+
+        return this->storeLocked( *resource_type, std::move(resource), exists ? "MODIFIED" : "ADDED" );
+
+    }
+
+
+
+    bool MockApiServer::removeResource( const json& resource ){
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        const ResourceType* resource_type = this->findResourceTypeLocked( resource.value("apiVersion", ""), resource.value("kind", "") );
+        if( !resource_type || !resource.contains("metadata") ){
+            return false;
+        }
+
+        const string collection_key = MockApiServer::getCollectionKey( resource_type->group_version, resource_type->plural );
+        auto& collection = this->collections[collection_key];
+        auto stored = collection.find( MockApiServer::getObjectKey(resource["metadata"].value("namespace", ""), resource["metadata"].value("name", "")) );
+        if( stored == collection.end() ){
+            return false;
+        }
+
+        json removed = std::move(stored->second);
+        collection.erase(stored);
+
+        removed["metadata"]["resourceVersion"] = std::to_string( ++this->resource_version );
+        this->recordEventLocked( collection_key, "DELETED", removed );
+        return true;
+
+    }
+
+
+
+    json MockApiServer::getResource( const string& group_version, const string& kind, const string& k8s_namespace, const string& name ) const{
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        const ResourceType* resource_type = this->findResourceTypeLocked( group_version, kind );
+        if( !resource_type ){
+            return json();
+        }
+
+        auto collection = this->collections.find( MockApiServer::getCollectionKey(resource_type->group_version, resource_type->plural) );
+        if( collection == this->collections.end() ){
+            return json();
+        }
+
+        auto stored = collection->second.find( MockApiServer::getObjectKey(k8s_namespace, name) );
+        return ( stored == collection->second.end() ) ? json() : stored->second;
+
+    }
+
+
+
+    void MockApiServer::setPods( size_t count, const vector<string>& namespaces ){
+
+        map<string, json> pods;
+
+        for( size_t i = 0; i < count; i++ ){
+            const string& k8s_namespace = namespaces[ i % namespaces.size() ];
+            json pod = MockApiServer::makePod( k8s_namespace, "pod-" + std::to_string(i), i );
+            pod["metadata"]["resourceVersion"] = std::to_string( this->resource_version + i + 1 );
+            pods.emplace( MockApiServer::getObjectKey(k8s_namespace, pod["metadata"]["name"].get<string>()), std::move(pod) );
+        }
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->resource_version += count;
+        this->collections[ MockApiServer::getCollectionKey("v1", "pods") ] = std::move(pods);
+        this->list_cache.clear();
+
+        // the bulk replacement isn't in the watch history
+        this->events.clear();
+        this->compacted_resource_version = this->resource_version;
+
+    }
+
+
+
+    void MockApiServer::clearResources(){
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->collections.clear();
+        this->list_cache.clear();
+        this->events.clear();
+        this->compacted_resource_version = this->resource_version;
+
+    }
+
+
+
+    void MockApiServer::setHandler( const string& path_prefix, const std::function<Response(const Request&)>& handler ){
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->handlers.emplace_back( path_prefix, handler );
+
+    }
+
+
+
+    void MockApiServer::setLatency( std::chrono::milliseconds latency ){
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->latency = latency;
+
+    }
+
+
+
+    void MockApiServer::injectError( const string& path_prefix, int status_code, size_t count, int retry_after_seconds ){
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        InjectedError injected_error;
+        injected_error.path_prefix = path_prefix;
+        injected_error.status_code = status_code;
+        injected_error.remaining = count;
+        injected_error.retry_after_seconds = retry_after_seconds;
+        this->injected_errors.push_back(injected_error);
+
+    }
+
+
+
+    void MockApiServer::closeWatches(){
+
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->watch_generation++;
+        }
+        this->events_changed.notify_all();
+
+    }
+
+
+
+    void MockApiServer::compactHistory(){
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->events.clear();
+        this->compacted_resource_version = this->resource_version;
+
+    }
+
+
+
+    size_t MockApiServer::getOpenWatchCount() const{
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return this->open_watches;
+
+    }
+
+
+
+    size_t MockApiServer::getRequestCount() const{
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return this->request_count;
+
+    }
+
+
+
+    vector<MockApiServer::Request> MockApiServer::getRequests() const{
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return vector<Request>( this->requests.begin(), this->requests.end() );
+
+    }
+
+
+
+    json MockApiServer::makePod( const string& k8s_namespace, const string& name, size_t index ){
+
+        char uid[40];
+        std::snprintf( uid, sizeof(uid), "10000000-0000-4000-8000-%012zx", index );
+
+        const string app = "app-" + std::to_string(index % 50);
+
+        return {
+            {"apiVersion", "v1"},
+            {"kind", "Pod"},
+            {"metadata", {
+                {"name", name},
+                {"namespace", k8s_namespace},
+                {"uid", uid},
+                {"resourceVersion", std::to_string(index + 1)},
+                {"creationTimestamp", "2024-01-01T00:00:00Z"},
+                {"labels", { {"app.kubernetes.io/name", app}, {"tier", index % 3 ? "web" : "worker"} }},
+                {"annotations", { {"example.com/owner", "team-" + std::to_string(index % 5)} }}
+            }},
+            {"spec", {
+                {"nodeName", "node-" + std::to_string(index % 100)},
+                {"serviceAccountName", "default"},
+                {"restartPolicy", "Always"},
+                {"containers", {
+                    {
+                        {"name", "app"},
+                        {"image", "registry.example.com/" + app + ":" + std::to_string(index % 7)},
+                        {"ports", { { {"containerPort", 8080}, {"protocol", "TCP"} } }},
+                        {"resources", { {"requests", { {"cpu", "100m"}, {"memory", "128Mi"} }} }}
+                    },
+                    {
+                        {"name", "sidecar"},
+                        {"image", "registry.example.com/sidecar:1.0"}
+                    }
+                }}
+            }},
+            {"status", {
+                {"phase", index % 10 ? "Running" : "Pending"},
+                {"podIP", "10.0." + std::to_string((index / 250) % 256) + "." + std::to_string(index % 250 + 1)},
+                {"conditions", {
+                    { {"type", "Ready"}, {"status", index % 10 ? "True" : "False"} }
+                }},
+                {"containerStatuses", {
+                    { {"name", "app"}, {"ready", index % 10 != 0}, {"restartCount", index % 4} },
+                    { {"name", "sidecar"}, {"ready", true}, {"restartCount", 0} }
+                }}
+            }}
+        };
+
+    }
+
+
+
+    void MockApiServer::acceptConnections(){
+
+        while( !this->stopping ){
+
+            const int fd = ::accept( this->listen_fd, nullptr, nullptr );
+            if( fd < 0 ){
+                if( errno == EINTR ){
+                    continue;
+                }
+                return;
+            }
+
+            const int enable = 1;
+            ::setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable) );
+
+            std::lock_guard<std::mutex> lock(this->mutex);
+            if( this->stopping ){
+                ::close(fd);
+                return;
+            }
+            this->connection_fds.push_back(fd);
+            this->connection_threads.emplace_back( &MockApiServer::serveConnection, this, fd );
+
+        }
+
+    }
+
+
+
+    void MockApiServer::serveConnection( int fd ){
+
+        // keep-alive: requests are served in order until the client closes the connection
+        string buffer;
+        Request request;
+
+        while( !this->stopping && this->readRequest(fd, buffer, request) ){
+
+            std::chrono::milliseconds delay;
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->request_count++;
+                this->requests.push_back(request);
+                if( this->requests.size() > MockApiServer::max_recorded_requests ){
+                    this->requests.pop_front();
+                }
+                delay = this->latency;
+            }
+
+            if( delay.count() > 0 ){
+                std::this_thread::sleep_for(delay);
+            }
+
+            // a watch holds the connection until it ends
+            Target target;
+            Response error;
+            if( request.method == "GET" && MockApiServer::isWatch(request) && this->findTarget(request, target, error) && target.name.empty() ){
+                // injected errors and handlers answer instead of the stream
+                Response routed = this->route(request);
+                if( routed.status != 200 || !routed.body.empty() ){
+                    this->writeResponse( fd, routed );
+                    continue;
+                }
+                this->watch( fd, request, target );
+                break;
+            }
+
+            this->writeResponse( fd, this->route(request) );
+
+            if( request.headers.count("connection") && request.headers["connection"] == "close" ){
+                break;
+            }
+
+        }
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->connection_fds.erase( std::remove(this->connection_fds.begin(), this->connection_fds.end(), fd), this->connection_fds.end() );
+        ::close(fd);
+
+    }
+
+
+
+    bool MockApiServer::readRequest( int fd, string& buffer, Request& request ){
+
+        char chunk[16384];
+
+        size_t header_end;
+        while( ( header_end = buffer.find("\r\n\r\n") ) == string::npos ){
+            const ssize_t received = ::recv( fd, chunk, sizeof(chunk), 0 );
+            if( received <= 0 ){
+                return false;
+            }
+            buffer.append( chunk, received );
+        }
+
+        request = Request();
+
+        std::istringstream header_stream( buffer.substr(0, header_end) );
+        string request_line;
+        std::getline( header_stream, request_line );
+
+        std::istringstream request_line_stream(request_line);
+        string target;
+        request_line_stream >> request.method >> target;
+
+        const size_t query_pos = target.find('?');
+        request.path = urlDecode( target.substr(0, query_pos) );
+        if( query_pos != string::npos ){
+            for( const string& parameter : split(target.substr(query_pos + 1), '&') ){
+                const size_t equals_pos = parameter.find('=');
+                request.query[ urlDecode(parameter.substr(0, equals_pos)) ] = ( equals_pos == string::npos ) ? "" : urlDecode( parameter.substr(equals_pos + 1) );
+            }
+        }
+
+        string header_line;
+        while( std::getline(header_stream, header_line) ){
+            if( !header_line.empty() && header_line.back() == '\r' ){
+                header_line.pop_back();
+            }
+            const size_t colon_pos = header_line.find(':');
+            if( colon_pos == string::npos ){
+                continue;
+            }
+            string name = header_line.substr(0, colon_pos);
+            std::transform( name.begin(), name.end(), name.begin(), ::tolower );
+            const size_t value_pos = header_line.find_first_not_of(' ', colon_pos + 1);
+            request.headers[name] = ( value_pos == string::npos ) ? "" : header_line.substr(value_pos);
+        }
+
+        buffer.erase( 0, header_end + 4 );
+
+        const size_t content_length = request.headers.count("content-length") ? std::stoul(request.headers["content-length"]) : 0;
+        while( buffer.size() < content_length ){
+            const ssize_t received = ::recv( fd, chunk, sizeof(chunk), 0 );
+            if( received <= 0 ){
+                return false;
+            }
+            buffer.append( chunk, received );
+        }
+
+        request.body = buffer.substr(0, content_length);
+        buffer.erase(0, content_length);
+
+        return true;
+
+    }
+
+
+
+    void MockApiServer::writeResponse( int fd, const Response& response ){
+
+        string message = "HTTP/1.1 " + std::to_string(response.status) + " " + MockApiServer::getStatusReason(response.status) + "\r\n"
+                         "Content-Type: " + response.content_type + "\r\n"
+                         "Content-Length: " + std::to_string(response.body.size()) + "\r\n";
+        for( const auto& [name, value] : response.headers ){
+            message += name + ": " + value + "\r\n";
+        }
+        message += "\r\n";
+        message += response.body;
+
+        MockApiServer::sendAll( fd, message );
+
+    }
+
+
+
+    bool MockApiServer::sendAll( int fd, const string& data ){
+
+        size_t sent = 0;
+        while( sent < data.size() ){
+            const ssize_t written = ::send( fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL );
+            if( written <= 0 ){
+                return false;
+            }
+            sent += written;
+        }
+        return true;
+
+    }
+
+
+
+    MockApiServer::Response MockApiServer::route( const Request& request ){
+
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+
+            for( InjectedError& injected_error : this->injected_errors ){
+                if( injected_error.remaining == 0 || request.path.rfind(injected_error.path_prefix, 0) != 0 ){
+                    continue;
+                }
+                injected_error.remaining--;
+                Response response = MockApiServer::status( injected_error.status_code, MockApiServer::getStatusReason(injected_error.status_code), "injected by the mock apiserver" );
+                if( injected_error.status_code == 429 ){
+                    // like the apiserver's max-in-flight and priority and fairness filters: plain text, the delay only in the header
+                    response.content_type = "text/plain; charset=utf-8";
+                    response.body = "Too many requests, please try again later.\n";
+                    if( injected_error.retry_after_seconds > 0 ){
+                        response.headers["Retry-After"] = std::to_string(injected_error.retry_after_seconds);
+                    }
+                }
+                return response;
+            }
+
+            for( const auto& [path_prefix, handler] : this->handlers ){
+                if( request.path.rfind(path_prefix, 0) == 0 ){
+                    auto handler_copy = handler;
+                    lock.unlock();
+                    return handler_copy(request);
+                }
+            }
+        }
+
+        const vector<string> segments = split( request.path, '/' );
+
+        if( segments.empty() || ( segments[0] != "api" && segments[0] != "apis" ) ){
+            return MockApiServer::status( 404, "NotFound", "the server could not find the requested resource" );
+        }
+
+        if( segments.size() <= ( segments[0] == "api" ? 2u : 3u ) ){
+            return this->discovery(request);
+        }
+
+        Target target;
+        Response error;
+        if( !this->findTarget(request, target, error) ){
+            return error;
+        }
+
+        if( request.method == "GET" ){
+            // the connection serves the watch stream itself
+            if( MockApiServer::isWatch(request) ){
+                return Response();
+            }
+            return target.name.empty() ? this->list(request, target) : this->get(target);
+        }
+        if( request.method == "POST" && target.name.empty() ){
+            return this->create( request, target );
+        }
+        if( request.method == "PUT" && !target.name.empty() ){
+            return this->replace( request, target );
+        }
+        if( request.method == "PATCH" && !target.name.empty() ){
+            return this->patch( request, target );
+        }
+        if( request.method == "DELETE" && !target.name.empty() ){
+            return this->remove(target);
+        }
+
+        return MockApiServer::status( 405, "MethodNotAllowed", "the server does not allow this method on the requested resource" );
+
+    }
+
+
+
+    bool MockApiServer::findTarget( const Request& request, Target& target, Response& error ) const{
+
+        const vector<string> segments = split( request.path, '/' );
+        error = MockApiServer::status( 404, "NotFound", "the server could not find the requested resource" );
+
+        if( segments.empty() || ( segments[0] != "api" && segments[0] != "apis" ) ){
+            return false;
+        }
+
+        // /api/v1/... or /apis/<group>/<version>/...
+        const size_t prefix_length = ( segments[0] == "api" ) ? 2 : 3;
+        if( segments.size() <= prefix_length ){
+            return false;
+        }
+
+        const string group_version = ( segments[0] == "api" ) ? segments[1] : segments[1] + "/" + segments[2];
+        const vector<string> rest( segments.begin() + prefix_length, segments.end() );
+
+        string plural;
+
+        if( rest.size() >= 3 && rest.size() <= 4 && rest[0] == "namespaces" ){
+            target.k8s_namespace = rest[1];
+            plural = rest[2];
+            target.name = ( rest.size() == 4 ) ? rest[3] : "";
+        }else if( rest.size() <= 2 ){
+            plural = rest[0];
+            target.name = ( rest.size() == 2 ) ? rest[1] : "";
+        }else{
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        auto found = std::find_if( this->resource_types.begin(), this->resource_types.end(), [&]( const ResourceType& candidate ){
+            return candidate.group_version == group_version && candidate.plural == plural;
+        });
+        if( found == this->resource_types.end() ){
+            return false;
+        }
+
+        target.type = *found;
+        return true;
+
+    }
+
+
+
+    MockApiServer::Response MockApiServer::discovery( const Request& request ){
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        Response response;
+
+        if( request.path == "/api" || request.path == "/api/" ){
+            response.body = json({ {"kind", "APIVersions"}, {"versions", {"v1"}} }).dump();
+            return response;
+        }
+
+        if( request.path == "/apis" || request.path == "/apis/" ){
+
+            map<string, vector<string>> group_versions;
+            for( const ResourceType& resource_type : this->resource_types ){
+                const size_t slash_pos = resource_type.group_version.find('/');
+                if( slash_pos == string::npos ){
+                    continue;
+                }
+                vector<string>& versions = group_versions[ resource_type.group_version.substr(0, slash_pos) ];
+                const string version = resource_type.group_version.substr(slash_pos + 1);
+                if( std::find(versions.begin(), versions.end(), version) == versions.end() ){
+                    versions.push_back(version);
+                }
+            }
+
+            json groups = json::array();
+            for( const auto& [group, versions] : group_versions ){
+                json group_json = { {"name", group}, {"versions", json::array()} };
+                for( const string& version : versions ){
+                    group_json["versions"].push_back({ {"groupVersion", group + "/" + version}, {"version", version} });
+                }
+                group_json["preferredVersion"] = group_json["versions"][0];
+                groups.push_back( std::move(group_json) );
+            }
+
+            response.body = json({ {"kind", "APIGroupList"}, {"apiVersion", "v1"}, {"groups", groups} }).dump();
+            return response;
+
+        }
+
+        const string group_version = request.path.substr( request.path.find('/', 1) + 1 );
+
+        json resources = json::array();
+        for( const ResourceType& resource_type : this->resource_types ){
+            if( resource_type.group_version != group_version ){
+                continue;
+            }
+            resources.push_back({
+                {"name", resource_type.plural},
+                {"singularName", ""},
+                {"namespaced", resource_type.namespaced},
+                {"kind", resource_type.kind},
+                {"verbs", {"create", "delete", "deletecollection", "get", "list", "patch", "update", "watch"}}
+            });
+        }
+
+        if( resources.empty() ){
+            return MockApiServer::status( 404, "NotFound", "the server could not find the requested resource" );
+        }
+
+        response.body = json({ {"kind", "APIResourceList"}, {"apiVersion", "v1"}, {"groupVersion", group_version}, {"resources", resources} }).dump();
+        return response;
+
+    }
+
+
+
+    MockApiServer::Response MockApiServer::list( const Request& request, const Target& target ){
+
+        const string accept = request.headers.count("accept") ? request.headers.at("accept") : "";
+        const bool as_table = accept.find("as=Table") != string::npos;
+        const bool as_metadata = accept.find("as=PartialObjectMetadataList") != string::npos;
+
+        string cache_key = request.path + "|" + ( as_table ? "table" : as_metadata ? "metadata" : "" );
+        for( const auto& [name, value] : request.query ){
+            cache_key += "&" + name + "=" + value;
+        }
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        Response response;
+
+        auto cached = this->list_cache.find(cache_key);
+        if( cached != this->list_cache.end() ){
+            response.body = cached->second;
+            return response;
+        }
+
+        const size_t limit = request.query.count("limit") ? std::stoul(request.query.at("limit")) : 0;
+        size_t offset = 0;
+        if( request.query.count("continue") && !request.query.at("continue").empty() ){
+            try{
+                offset = std::stoul( request.query.at("continue") );
+            }catch( const std::exception& ){
+                return MockApiServer::status( 400, "BadRequest", "invalid continue token" );
+            }
+        }
+
+        json items = json::array();
+        string continue_token;
+        size_t position = 0;
+
+        auto collection = this->collections.find( MockApiServer::getCollectionKey(target.type.group_version, target.type.plural) );
+        if( collection != this->collections.end() ){
+
+            for( const auto& [key, resource] : collection->second ){
+
+                if( !target.k8s_namespace.empty() && resource["metadata"].value("namespace", "") != target.k8s_namespace ){
+                    continue;
+                }
+                if( !MockApiServer::matchesSelectors(resource, request) ){
+                    continue;
+                }
+                if( position++ < offset ){
+                    continue;
+                }
+                if( limit && items.size() == limit ){
+                    continue_token = std::to_string( offset + limit );
+                    break;
+                }
+
+                if( as_table ){
+                    items.push_back({
+                        {"cells", { resource["metadata"].value("name", ""), resource["metadata"].value("creationTimestamp", "") }},
+                        {"object", toPartialObjectMetadata(resource)}
+                    });
+                }else if( as_metadata ){
+                    items.push_back( toPartialObjectMetadata(resource) );
+                }else{
+                    // list items don't repeat apiVersion and kind
+                    json item = resource;
+                    item.erase("apiVersion");
+                    item.erase("kind");
+                    items.push_back( std::move(item) );
+                }
+
+            }
+
+        }
+
+        json metadata = { {"resourceVersion", std::to_string(this->resource_version)} };
+        if( !continue_token.empty() ){
+            metadata["continue"] = continue_token;
+        }
+
+        if( as_table ){
+            response.body = json({
+                {"apiVersion", "meta.k8s.io/v1"},
+                {"kind", "Table"},
+                {"metadata", metadata},
+                {"columnDefinitions", {
+                    { {"name", "Name"}, {"type", "string"}, {"format", "name"}, {"description", "Name must be unique within a namespace."}, {"priority", 0} },
+                    { {"name", "Created At"}, {"type", "date"}, {"format", ""}, {"description", "CreationTimestamp of the object."}, {"priority", 0} }
+                }},
+                {"rows", std::move(items)}
+            }).dump();
+        }else{
+            response.body = json({
+                {"apiVersion", as_metadata ? "meta.k8s.io/v1" : target.type.group_version},
+                {"kind", as_metadata ? "PartialObjectMetadataList" : target.type.kind + "List"},
+                {"metadata", metadata},
+                {"items", std::move(items)}
+            }).dump();
+        }
+
+        this->list_cache.emplace( cache_key, response.body );
+        return response;
+
+    }
+
+
+
+    MockApiServer::Response MockApiServer::get( const Target& target ){
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        auto collection = this->collections.find( MockApiServer::getCollectionKey(target.type.group_version, target.type.plural) );
+        if( collection != this->collections.end() ){
+            auto resource = collection->second.find( MockApiServer::getObjectKey(target.k8s_namespace, target.name) );
+            if( resource != collection->second.end() ){
+                Response response;
+                response.body = resource->second.dump();
+                return response;
+            }
+        }
+
+        return MockApiServer::status( 404, "NotFound", target.type.plural + " \"" + target.name + "\" not found" );
+
+    }
+
+
+
+    MockApiServer::Response MockApiServer::create( const Request& request, const Target& target ){
+
+        json resource = json::parse( request.body, nullptr, false );
+        if( !resource.is_object() ){
+            return MockApiServer::status( 400, "BadRequest", "the request body is not a json object" );
+        }
+
+        json& metadata = resource["metadata"];
+        if( !metadata.is_object() ){
+            metadata = json::object();
+        }
+
+        if( target.type.namespaced ){
+            if( target.k8s_namespace.empty() ){
+                return MockApiServer::status( 404, "NotFound", "the server could not find the requested resource" );
+            }
+            if( metadata.contains("namespace") && metadata["namespace"] != target.k8s_namespace ){
+                return MockApiServer::status( 400, "BadRequest", "the namespace of the provided object does not match the namespace sent on the request" );
+            }
+            metadata["namespace"] = target.k8s_namespace;
+        }else{
+            metadata.erase("namespace");
+        }
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        if( !metadata.contains("name") && metadata.contains("generateName") ){
+            metadata["name"] = metadata["generateName"].get<string>() + std::to_string(this->next_uid);
+        }
+        if( !metadata.contains("name") || !metadata["name"].is_string() ){
+            return MockApiServer::status( 400, "Invalid", "name or generateName is required" );
+        }
+
+        const string name = metadata["name"].get<string>();
+        if( this->collections[ MockApiServer::getCollectionKey(target.type.group_version, target.type.plural) ].count(MockApiServer::getObjectKey(target.k8s_namespace, name)) ){
+            return MockApiServer::status( 409, "AlreadyExists", target.type.plural + " \"" + name + "\" already exists" );
+        }
+
+        resource["apiVersion"] = target.type.group_version;
+        resource["kind"] = target.type.kind;
+        metadata.erase("uid");
+        metadata.erase("resourceVersion");
+        metadata.erase("creationTimestamp");
+
+        Response response;
+        response.status = 201;
+        response.body = this->storeLocked( target.type, std::move(resource), "ADDED" ).dump();
+        return response;
+
+    }
+
+
+
+    MockApiServer::Response MockApiServer::replace( const Request& request, const Target& target ){
+
+        json resource = json::parse( request.body, nullptr, false );
+        if( !resource.is_object() || !resource.contains("metadata") || !resource["metadata"].is_object() ){
+            return MockApiServer::status( 400, "BadRequest", "the request body is not a json object with metadata" );
+        }
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        auto& collection = this->collections[ MockApiServer::getCollectionKey(target.type.group_version, target.type.plural) ];
+        auto stored = collection.find( MockApiServer::getObjectKey(target.k8s_namespace, target.name) );
+        if( stored == collection.end() ){
+            return MockApiServer::status( 404, "NotFound", target.type.plural + " \"" + target.name + "\" not found" );
+        }
+
+        // optimistic concurrency: a stale resourceVersion is a conflict
+        json& metadata = resource["metadata"];
+        if( metadata.contains("resourceVersion") && metadata["resourceVersion"] != stored->second["metadata"]["resourceVersion"] ){
+            return MockApiServer::status( 409, "Conflict", "Operation cannot be fulfilled on " + target.type.plural + " \"" + target.name + "\": the object has been modified; please apply your changes to the latest version and try again" );
+        }
+
+        resource["apiVersion"] = target.type.group_version;
+        resource["kind"] = target.type.kind;
+        metadata["name"] = target.name;
+        if( target.type.namespaced ){
+            metadata["namespace"] = target.k8s_namespace;
+        }
+        metadata["uid"] = stored->second["metadata"]["uid"];
+        metadata["creationTimestamp"] = stored->second["metadata"]["creationTimestamp"];
+
+        Response response;
+        response.body = this->storeLocked( target.type, std::move(resource), "MODIFIED" ).dump();
+        return response;
+
+    }
+
+
+
+    MockApiServer::Response MockApiServer::patch( const Request& request, const Target& target ){
+
+        json patch = json::parse( request.body, nullptr, false );
+        if( patch.is_discarded() ){
+            return MockApiServer::status( 400, "BadRequest", "the patch is not valid json" );
+        }
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        auto& collection = this->collections[ MockApiServer::getCollectionKey(target.type.group_version, target.type.plural) ];
+        auto stored = collection.find( MockApiServer::getObjectKey(target.k8s_namespace, target.name) );
+        if( stored == collection.end() ){
+            return MockApiServer::status( 404, "NotFound", target.type.plural + " \"" + target.name + "\" not found" );
+        }
+
+        json resource = stored->second;
+        const string content_type = request.headers.count("content-type") ? request.headers.at("content-type") : "";
+
+        try{
+            if( content_type.find("json-patch+json") != string::npos ){
+                resource = resource.patch(patch);
+            }else{
+                // merge and strategic merge patches; lists are replaced rather than merged by key
+                resource.merge_patch(patch);
+            }
+        }catch( const std::exception& e ){
+            return MockApiServer::status( 422, "Invalid", e.what() );
+        }
+
+        // identity fields can't be patched
+        resource["apiVersion"] = stored->second["apiVersion"];
+        resource["kind"] = stored->second["kind"];
+        resource["metadata"]["name"] = stored->second["metadata"]["name"];
+        resource["metadata"]["uid"] = stored->second["metadata"]["uid"];
+        if( target.type.namespaced ){
+            resource["metadata"]["namespace"] = stored->second["metadata"]["namespace"];
+        }
+
+        Response response;
+        response.body = this->storeLocked( target.type, std::move(resource), "MODIFIED" ).dump();
+        return response;
+
+    }
+
+
+
+    MockApiServer::Response MockApiServer::remove( const Target& target ){
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        const string collection_key = MockApiServer::getCollectionKey( target.type.group_version, target.type.plural );
+        auto& collection = this->collections[collection_key];
+        auto stored = collection.find( MockApiServer::getObjectKey(target.k8s_namespace, target.name) );
+        if( stored == collection.end() ){
+            return MockApiServer::status( 404, "NotFound", target.type.plural + " \"" + target.name + "\" not found" );
+        }
+
+        json removed = std::move(stored->second);
+        collection.erase(stored);
+
+        removed["metadata"]["resourceVersion"] = std::to_string( ++this->resource_version );
+        this->recordEventLocked( collection_key, "DELETED", removed );
+
+        Response response;
+        response.body = removed.dump();
+        return response;
+
+    }
+
+
+
+    void MockApiServer::watch( int fd, const Request& request, const Target& target ){
+
+        const string collection_key = MockApiServer::getCollectionKey( target.type.group_version, target.type.plural );
+
+        auto matches = [&]( const json& object ){
+            if( !target.k8s_namespace.empty() && object["metadata"].value("namespace", "") != target.k8s_namespace ){
+                return false;
+            }
+            return MockApiServer::matchesSelectors(object, request);
+        };
+
+        auto send_event = [&]( const string& type, const json& object ){
+            const string line = json({ {"type", type}, {"object", object} }).dump() + "\n";
+            std::ostringstream chunk;
+            chunk << std::hex << line.size() << "\r\n" << line << "\r\n";
+            return MockApiServer::sendAll( fd, chunk.str() );
+        };
+
+        const string header = "HTTP/1.1 200 OK\r\n"
+                              "Content-Type: application/json\r\n"
+                              "Transfer-Encoding: chunked\r\n"
+                              "\r\n";
+        if( !MockApiServer::sendAll(fd, header) ){
+            return;
+        }
+
+        const auto deadline = request.query.count("timeoutSeconds")
+                              ? std::chrono::steady_clock::now() + std::chrono::seconds( std::stoul(request.query.at("timeoutSeconds")) )
+                              : std::chrono::steady_clock::time_point::max();
+
+        const string requested_version = request.query.count("resourceVersion") ? request.query.at("resourceVersion") : "";
+
+        std::unique_lock<std::mutex> lock(this->mutex);
+
+        this->open_watches++;
+        const uint64_t generation = this->watch_generation;
+        uint64_t cursor = 0;
+        bool open = true;
+
+        if( requested_version.empty() || requested_version == "0" ){
+
+            // "any version": the current objects as ADDED events, then the changes
+            vector<json> initial;
+            auto collection = this->collections.find(collection_key);
+            if( collection != this->collections.end() ){
+                for( const auto& [key, object] : collection->second ){
+                    if( matches(object) ){
+                        initial.push_back(object);
+                    }
+                }
+            }
+            cursor = this->resource_version;
+
+            lock.unlock();
+            for( const json& object : initial ){
+                if( !( open = send_event("ADDED", object) ) ){
+                    break;
+                }
+            }
+            lock.lock();
+
+        }else{
+
+            try{
+                cursor = std::stoull(requested_version);
+            }catch( const std::exception& ){
+                cursor = 0;
+            }
+
+            if( cursor < this->compacted_resource_version ){
+                const Response expired = MockApiServer::status( 410, "Expired", "too old resource version: " + requested_version + " (" + std::to_string(this->compacted_resource_version) + ")" );
+                lock.unlock();
+                send_event( "ERROR", json::parse(expired.body) );
+                open = false;
+                lock.lock();
+            }
+
+        }
+
+        while( open && !this->stopping && generation == this->watch_generation && std::chrono::steady_clock::now() < deadline ){
+
+            vector<WatchEvent> pending;
+            for( const WatchEvent& event : this->events ){
+                if( event.resource_version > cursor && event.collection_key == collection_key && matches(event.object) ){
+                    pending.push_back(event);
+                }
+            }
+            if( !this->events.empty() ){
+                cursor = std::max( cursor, this->events.back().resource_version );
+            }
+
+            if( !pending.empty() ){
+                lock.unlock();
+                for( const WatchEvent& event : pending ){
+                    if( !( open = send_event(event.type, event.object) ) ){
+                        break;
+                    }
+                }
+                lock.lock();
+                continue;
+            }
+
+            this->events_changed.wait_for( lock, std::chrono::milliseconds(100) );
+
+            // notice clients that went away while the stream was idle
+            char probe;
+            const ssize_t peeked = ::recv( fd, &probe, 1, MSG_PEEK | MSG_DONTWAIT );
+            if( peeked == 0 || ( peeked < 0 && errno != EAGAIN && errno != EWOULDBLOCK ) ){
+                open = false;
+            }
+
+        }
+
+        this->open_watches--;
+        lock.unlock();
+
+        if( open ){
+            MockApiServer::sendAll( fd, "0\r\n\r\n" );
+        }
+
+    }
+
+
+
+    json MockApiServer::storeLocked( const ResourceType& resource_type, json resource, const string& event_type ){
+
+        json& metadata = resource["metadata"];
+
+        if( !metadata.contains("uid") ){
+            char uid[40];
+            std::snprintf( uid, sizeof(uid), "00000000-0000-4000-8000-%012llx", static_cast<unsigned long long>(this->next_uid++) );
+            metadata["uid"] = uid;
+        }
+        if( !metadata.contains("creationTimestamp") ){
+            metadata["creationTimestamp"] = getTimestamp();
+        }
+        metadata["resourceVersion"] = std::to_string( ++this->resource_version );
+
+        const string collection_key = MockApiServer::getCollectionKey( resource_type.group_version, resource_type.plural );
+        const string key = MockApiServer::getObjectKey( metadata.value("namespace", ""), metadata["name"].get<string>() );
+
+        this->collections[collection_key][key] = resource;
+        this->recordEventLocked( collection_key, event_type, resource );
+
+        return resource;
+
+    }
+
+
+
+    void MockApiServer::recordEventLocked( const string& collection_key, const string& type, const json& object ){
+
+        WatchEvent event;
+        event.resource_version = this->resource_version;
+        event.collection_key = collection_key;
+        event.type = type;
+        event.object = object;
+        this->events.push_back( std::move(event) );
+
+        if( this->events.size() > MockApiServer::max_watch_events ){
+            this->compacted_resource_version = this->events.front().resource_version;
+            this->events.pop_front();
+        }
+
+        this->list_cache.clear();
+        this->events_changed.notify_all();
+
+    }
+
+
+
+    const MockApiServer::ResourceType* MockApiServer::findResourceTypeLocked( const string& group_version, const string& kind ) const{
+
+        for( const ResourceType& resource_type : this->resource_types ){
+            if( resource_type.group_version == group_version && resource_type.kind == kind ){
+                return &resource_type;
+            }
+        }
+        return nullptr;
+
+    }
+
+
+
+    MockApiServer::Response MockApiServer::status( int code, const string& reason, const string& message ){
+
+        Response response;
+        response.status = code;
+        response.body = json({
+            {"kind", "Status"},
+            {"apiVersion", "v1"},
+            {"metadata", json::object()},
+            {"status", "Failure"},
+            {"message", message},
+            {"reason", reason},
+            {"code", code}
+        }).dump();
+        return response;
+
+    }
+
+
+
+    string MockApiServer::getStatusReason( int code ){
+
+        switch( code ){
+            case 200: return "OK";
+            case 201: return "Created";
+            case 400: return "BadRequest";
+            case 404: return "NotFound";
+            case 405: return "MethodNotAllowed";
+            case 409: return "Conflict";
+            case 410: return "Expired";
+            case 422: return "Invalid";
+            case 429: return "TooManyRequests";
+            case 500: return "InternalError";
+            case 503: return "ServiceUnavailable";
+            case 504: return "Timeout";
+            default: return "Unknown";
+        }
+
+    }
+
+
+
+    bool MockApiServer::matchesSelectors( const json& resource, const Request& request ){
+
+        auto label_selector = request.query.find("labelSelector");
+        if( label_selector != request.query.end() && !label_selector->second.empty() ){
+            const json* labels = lookup( resource, "metadata.labels" );
+            const bool matches = matchesSelector( label_selector->second, [&]( const string& key ) -> const json* {
+                if( !labels || !labels->contains(key) ){
+                    return nullptr;
+                }
+                return &(*labels)[key];
+            });
+            if( !matches ){
+                return false;
+            }
+        }
+
+        auto field_selector = request.query.find("fieldSelector");
+        if( field_selector != request.query.end() && !field_selector->second.empty() ){
+            const bool matches = matchesSelector( field_selector->second, [&]( const string& path ){
+                return lookup( resource, path );
+            });
+            if( !matches ){
+                return false;
+            }
+        }
+
+        return true;
+
+    }
+
+
+
+    bool MockApiServer::isWatch( const Request& request ){
+
+        auto watch = request.query.find("watch");
+        return watch != request.query.end() && ( watch->second == "true" || watch->second == "1" );
+
+    }
+
+
+
+    string MockApiServer::getCollectionKey( const string& group_version, const string& plural ){
+
+        return group_version + "/" + plural;
+
+    }
+
+
+
+    string MockApiServer::getObjectKey( const string& k8s_namespace, const string& name ){
+
+        return k8s_namespace + "/" + name;
+
+    }
+
+
+}
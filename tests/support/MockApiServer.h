@@ -0,0 +1,217 @@
+#pragma once
+
+
+#include <string>
+using std::string;
+
+#include <vector>
+using std::vector;
+
+#include <map>
+using std::map;
+
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+#include "json.hpp"
+using json = nlohmann::json;
+
+
+namespace kubepp::mock {
+
+
+    /*
+        A stand-in apiserver for tests and benchmarks, served over plain HTTP on 127.0.0.1.
+
+        It answers discovery ( /api, /apis, /api/v1, /apis/<group>/<version> ) for the registered resource types and
+        keeps objects in memory: create ( POST ), get, replace ( PUT ), patch ( merge, strategic merge and json patch ) and
+        delete, lists with limit/continue pagination, simple equality label and field selectors, Table and
+        PartialObjectMetadataList responses, and chunked watch streams from a resourceVersion. Unknown paths get a
+        404 Status, like the real apiserver.
+
+        Latency and error responses can be injected to exercise retries and timeouts. useAsKubeconfig() points new
+        KubernetesClient instances at it.
+    */
+    class MockApiServer{
+
+        public:
+
+            class Request{
+                public:
+                    string method;
+                    string path;
+                    map<string, string> query;
+                    map<string, string> headers;    // lower-case names
+                    string body;
+            };
+
+            class Response{
+                public:
+                    int status = 200;
+                    string content_type = "application/json";
+                    map<string, string> headers;
+                    string body;
+            };
+
+            class ResourceType{
+                public:
+                    string group_version;   // "v1", "apps/v1"
+                    string kind;
+                    string plural;
+                    bool namespaced = true;
+            };
+
+            MockApiServer();
+            ~MockApiServer();
+
+            MockApiServer( const MockApiServer& ) = delete;
+            MockApiServer& operator=( const MockApiServer& ) = delete;
+
+            int getPort() const;
+            string getUrl() const;
+
+            /* Writes a kubeconfig for this server ( or for a proxy in front of it, skipping TLS verification for https ) to a temporary file and sets KUBECONFIG to it. */
+            void useAsKubeconfig( const string& server_url = "" );
+
+            /* Core v1 Pod, Node, Namespace, ConfigMap, Secret, Service, apps/v1 Deployment and CustomResourceDefinition are registered by default. */
+            void addResourceType( const ResourceType& resource_type );
+
+            /* Stores or replaces an object ( apiVersion, kind and metadata.name required ); uid, resourceVersion and creationTimestamp are filled in. Watches see ADDED or MODIFIED. */
+            json addResource( json resource );
+
+            /* Removes an object; watches see DELETED. Returns false if it didn't exist. */
+            bool removeResource( const json& resource );
+
+            /* The stored object, or null. */
+            json getResource( const string& group_version, const string& kind, const string& k8s_namespace, const string& name ) const;
+
+            /* Replaces every Pod with count synthetic pods spread over the given namespaces, without watch events. */
+            void setPods( size_t count, const vector<string>& namespaces = { "default", "kube-system", "monitoring" } );
+
+            void clearResources();
+
+            /* Handles every request whose path starts with the prefix instead of the store. */
+            void setHandler( const string& path_prefix, const std::function<Response(const Request&)>& handler );
+
+            /* Delays every response ( and the start of every watch stream ) by this much. */
+            void setLatency( std::chrono::milliseconds latency );
+
+            /* The next count requests under the path prefix fail with this status code; a 429 has a plain text body and, with retry_after_seconds, a Retry-After header. */
+            void injectError( const string& path_prefix, int status_code, size_t count = 1, int retry_after_seconds = 0 );
+
+            /* Ends every open watch stream, like the apiserver's watch timeout. */
+            void closeWatches();
+
+            /* Forgets the watch history; watches from an older resourceVersion get a 410 Expired ERROR event. */
+            void compactHistory();
+
+            size_t getOpenWatchCount() const;
+
+            /* Every request served so far; the last max_recorded_requests of them are kept. */
+            size_t getRequestCount() const;
+            vector<Request> getRequests() const;
+
+            /* Builds a synthetic pod like the ones setPods stores. */
+            static json makePod( const string& k8s_namespace, const string& name, size_t index = 0 );
+
+            static constexpr size_t max_recorded_requests = 10000;
+            static constexpr size_t max_watch_events = 10000;
+
+
+        protected:
+
+            class Target{
+                public:
+                    ResourceType type;
+                    string k8s_namespace;
+                    string name;
+            };
+
+            class WatchEvent{
+                public:
+                    uint64_t resource_version = 0;
+                    string collection_key;
+                    string type;
+                    json object;
+            };
+
+            class InjectedError{
+                public:
+                    string path_prefix;
+                    int status_code = 500;
+                    size_t remaining = 0;
+                    int retry_after_seconds = 0;
+            };
+
+            void acceptConnections();
+            void serveConnection( int fd );
+            bool readRequest( int fd, string& buffer, Request& request );
+            void writeResponse( int fd, const Response& response );
+            static bool sendAll( int fd, const string& data );
+
+            Response route( const Request& request );
+            bool findTarget( const Request& request, Target& target, Response& error ) const;
+
+            Response discovery( const Request& request );
+            Response list( const Request& request, const Target& target );
+            Response get( const Target& target );
+            Response create( const Request& request, const Target& target );
+            Response replace( const Request& request, const Target& target );
+            Response patch( const Request& request, const Target& target );
+            Response remove( const Target& target );
+            void watch( int fd, const Request& request, const Target& target );
+
+            /* Stores the object and records the watch event; the mutex must be held. */
+            json storeLocked( const ResourceType& resource_type, json resource, const string& event_type );
+            void recordEventLocked( const string& collection_key, const string& type, const json& object );
+            const ResourceType* findResourceTypeLocked( const string& group_version, const string& kind ) const;
+
+            static Response status( int code, const string& reason, const string& message );
+            static string getStatusReason( int code );
+            static bool matchesSelectors( const json& resource, const Request& request );
+            static bool isWatch( const Request& request );
+            static string getCollectionKey( const string& group_version, const string& plural );
+            static string getObjectKey( const string& k8s_namespace, const string& name );
+
+            int listen_fd = -1;
+            int port = 0;
+            string kubeconfig_path;
+
+            std::atomic<bool> stopping{false};
+            std::thread accept_thread;
+            vector<std::thread> connection_threads;
+            vector<int> connection_fds;
+
+            mutable std::mutex mutex;
+            std::condition_variable events_changed;
+
+            vector<ResourceType> resource_types;
+            map<string, map<string, json>> collections;     // collection key -> "<namespace>/<name>" -> object
+            vector<std::pair<string, std::function<Response(const Request&)>>> handlers;
+            vector<InjectedError> injected_errors;
+            std::chrono::milliseconds latency{0};
+
+            std::deque<Request> requests;
+            size_t request_count = 0;
+
+            uint64_t resource_version = 1;
+            uint64_t next_uid = 1;
+
+            // watch history; watches from before compacted_resource_version have expired
+            std::deque<WatchEvent> events;
+            uint64_t compacted_resource_version = 0;
+            uint64_t watch_generation = 0;
+            size_t open_watches = 0;
+
+            // rendered list bodies, valid until the store changes
+            map<string, string> list_cache;
+
+    };
+
+
+}
@@ -0,0 +1,291 @@
+#include "TlsProxy.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+
+
+namespace kubepp::mock {
+
+
+    namespace {
+
+        string getOpenSslError(){
+
+            char message[256];
+            ERR_error_string_n( ERR_get_error(), message, sizeof(message) );
+            return message;
+
+        }
+
+    }
+
+
+
+    TlsProxy::TlsProxy( int backend_port )
+        :backend_port(backend_port)
+    {
+
+        this->context = SSL_CTX_new( TLS_server_method() );
+        if( !this->context ){
+            throw std::runtime_error( "Cannot create the TLS proxy's context: " + getOpenSslError() );
+        }
+
+        // a self-signed certificate for 127.0.0.1, valid for a day
+        EVP_PKEY* key = EVP_EC_gen("P-256");
+        X509* certificate = X509_new();
+        if( !key || !certificate ){
+            EVP_PKEY_free(key);
+            X509_free(certificate);
+            SSL_CTX_free(this->context);
+            throw std::runtime_error( "Cannot create the TLS proxy's certificate: " + getOpenSslError() );
+        }
+
+        X509_set_version( certificate, 2 );
+        ASN1_INTEGER_set( X509_get_serialNumber(certificate), 1 );
+        X509_gmtime_adj( X509_getm_notBefore(certificate), 0 );
+        X509_gmtime_adj( X509_getm_notAfter(certificate), 24 * 60 * 60 );
+        X509_set_pubkey( certificate, key );
+        X509_NAME* name = X509_get_subject_name(certificate);
+        X509_NAME_add_entry_by_txt( name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("127.0.0.1"), -1, -1, 0 );
+        X509_set_issuer_name( certificate, name );
+
+        const bool configured = X509_sign( certificate, key, EVP_sha256() ) > 0
+                             && SSL_CTX_use_certificate( this->context, certificate ) == 1
+                             && SSL_CTX_use_PrivateKey( this->context, key ) == 1;
+        X509_free(certificate);
+        EVP_PKEY_free(key);
+        if( !configured ){
+            SSL_CTX_free(this->context);
+            throw std::runtime_error( "Cannot create the TLS proxy's certificate: " + getOpenSslError() );
+        }
+
+        // OpenSSL writes with write(), not send( MSG_NOSIGNAL ); a client closing its connection mustn't end the test process
+        std::signal( SIGPIPE, SIG_IGN );
+
+        static const unsigned char session_id_context[] = "kubepp-mock";
+        SSL_CTX_set_session_id_context( this->context, session_id_context, sizeof(session_id_context) - 1 );
+
+        this->listen_fd = ::socket( AF_INET, SOCK_STREAM, 0 );
+        if( this->listen_fd < 0 ){
+            SSL_CTX_free(this->context);
+            throw std::runtime_error( string("Cannot create the TLS proxy socket: ") + std::strerror(errno) );
+        }
+
+        const int enable = 1;
+        ::setsockopt( this->listen_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable) );
+
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = 0;
+
+        if( ::bind(this->listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(this->listen_fd, 64) != 0 ){
+            ::close(this->listen_fd);
+            SSL_CTX_free(this->context);
+            throw std::runtime_error( string("Cannot listen on 127.0.0.1: ") + std::strerror(errno) );
+        }
+
+        socklen_t address_length = sizeof(address);
+        ::getsockname( this->listen_fd, reinterpret_cast<sockaddr*>(&address), &address_length );
+        this->port = ntohs(address.sin_port);
+
+        this->accept_thread = std::thread( &TlsProxy::acceptConnections, this );
+
+    }
+
+
+
+    TlsProxy::~TlsProxy(){
+
+        this->stopping = true;
+
+        // wakes accept() and every connection's poll()
+        ::shutdown( this->listen_fd, SHUT_RDWR );
+        if( this->accept_thread.joinable() ){
+            this->accept_thread.join();
+        }
+        ::close( this->listen_fd );
+
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            for( int fd : this->connection_fds ){
+                ::shutdown( fd, SHUT_RDWR );
+            }
+        }
+
+        for( std::thread& connection_thread : this->connection_threads ){
+            connection_thread.join();
+        }
+
+        SSL_CTX_free( this->context );
+
+    }
+
+
+
+    int TlsProxy::getPort() const{
+
+        return this->port;
+
+    }
+
+
+
+    string TlsProxy::getUrl() const{
+
+        return "https://127.0.0.1:" + std::to_string(this->port);
+
+    }
+
+
+
+    size_t TlsProxy::getHandshakeCount() const{
+
+        return this->handshakes.load();
+
+    }
+
+
+
+    size_t TlsProxy::getResumedSessionCount() const{
+
+        return this->resumed_sessions.load();
+
+    }
+
+
+
+    void TlsProxy::acceptConnections(){
+
+        while( !this->stopping ){
+
+            const int fd = ::accept( this->listen_fd, nullptr, nullptr );
+            if( fd < 0 ){
+                if( errno == EINTR ){
+                    continue;
+                }
+                return;
+            }
+
+            const int enable = 1;
+            ::setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable) );
+
+            std::lock_guard<std::mutex> lock(this->mutex);
+            if( this->stopping ){
+                ::close(fd);
+                return;
+            }
+            this->connection_fds.push_back(fd);
+            this->connection_threads.emplace_back( &TlsProxy::serveConnection, this, fd );
+
+        }
+
+    }
+
+
+
+    void TlsProxy::serveConnection( int client_fd ){
+
+        SSL* ssl = SSL_new( this->context );
+        SSL_set_fd( ssl, client_fd );
+
+        if( SSL_accept(ssl) == 1 ){
+
+            this->handshakes++;
+            if( SSL_session_reused(ssl) == 1 ){
+                this->resumed_sessions++;
+            }
+
+            const int backend_fd = ::socket( AF_INET, SOCK_STREAM, 0 );
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            address.sin_port = htons( static_cast<uint16_t>(this->backend_port) );
+
+            if( backend_fd >= 0 && ::connect(backend_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0 ){
+                {
+                    std::lock_guard<std::mutex> lock(this->mutex);
+                    this->connection_fds.push_back(backend_fd);
+                }
+                this->forward( ssl, client_fd, backend_fd );
+                SSL_shutdown(ssl);
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->connection_fds.erase( std::remove(this->connection_fds.begin(), this->connection_fds.end(), backend_fd), this->connection_fds.end() );
+            }
+            if( backend_fd >= 0 ){
+                ::close(backend_fd);
+            }
+
+        }
+
+        SSL_free(ssl);
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->connection_fds.erase( std::remove(this->connection_fds.begin(), this->connection_fds.end(), client_fd), this->connection_fds.end() );
+        ::close(client_fd);
+
+    }
+
+
+
+    void TlsProxy::forward( SSL* ssl, int client_fd, int backend_fd ){
+
+        char chunk[16384];
+
+        while( !this->stopping ){
+
+            // a record already read off the socket doesn't make it readable again
+            if( SSL_pending(ssl) == 0 ){
+                pollfd fds[2] = { { client_fd, POLLIN, 0 }, { backend_fd, POLLIN, 0 } };
+                if( ::poll( fds, 2, -1 ) < 0 ){
+                    if( errno == EINTR ){
+                        continue;
+                    }
+                    return;
+                }
+
+                if( fds[1].revents & ( POLLIN | POLLHUP | POLLERR ) ){
+                    const ssize_t received = ::recv( backend_fd, chunk, sizeof(chunk), 0 );
+                    if( received <= 0 || SSL_write( ssl, chunk, static_cast<int>(received) ) <= 0 ){
+                        return;
+                    }
+                    continue;
+                }
+
+                if( !( fds[0].revents & ( POLLIN | POLLHUP | POLLERR ) ) ){
+                    continue;
+                }
+            }
+
+            const int received = SSL_read( ssl, chunk, sizeof(chunk) );
+            if( received <= 0 ){
+                return;
+            }
+            for( ssize_t sent = 0; sent < received; ){
+                const ssize_t written = ::send( backend_fd, chunk + sent, received - sent, MSG_NOSIGNAL );
+                if( written <= 0 ){
+                    return;
+                }
+                sent += written;
+            }
+
+        }
+
+    }
+
+
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+
+#include <string>
+using std::string;
+
+#include <vector>
+using std::vector;
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+#include <openssl/ssl.h>
+
+
+namespace kubepp::mock {
+
+
+    /*
+        Terminates TLS for a plain HTTP server on 127.0.0.1 ( eg. a MockApiServer ), so tests can make https connections.
+
+        The certificate is self-signed, made when the proxy starts, so clients have to skip verification ( see
+        MockApiServer::useAsKubeconfig ). Session tickets are on, like the apiserver's, and the proxy counts the
+        handshakes it accepted and how many of them resumed an earlier session.
+    */
+    class TlsProxy{
+
+        public:
+            TlsProxy( int backend_port );
+            ~TlsProxy();
+
+            TlsProxy( const TlsProxy& ) = delete;
+            TlsProxy& operator=( const TlsProxy& ) = delete;
+
+            int getPort() const;
+            string getUrl() const;
+
+            size_t getHandshakeCount() const;
+            size_t getResumedSessionCount() const;
+
+
+        protected:
+            void acceptConnections();
+            void serveConnection( int client_fd );
+
+            /* Copies bytes both ways until either side closes. */
+            void forward( SSL* ssl, int client_fd, int backend_fd );
+
+            int backend_port;
+            int listen_fd = -1;
+            int port = 0;
+
+            SSL_CTX* context = nullptr;
+
+            std::atomic<bool> stopping{false};
+            std::atomic<size_t> handshakes{0};
+            std::atomic<size_t> resumed_sessions{0};
+
+            std::thread accept_thread;
+            vector<std::thread> connection_threads;
+            vector<int> connection_fds;
+            mutable std::mutex mutex;
+
+    };
+
+
+}
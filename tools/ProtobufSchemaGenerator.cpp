@@ -0,0 +1,481 @@
+#include <string>
+using std::string;
+
+#include <vector>
+using std::vector;
+
+#include <map>
+using std::map;
+
+#include <set>
+using std::set;
+
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <sstream>
+#include <stdexcept>
+
+
+// Writes the message schemas of ProtobufDecoder ( src/ProtobufSchemas.inc, included by src/Protobuf.cpp ) from the
+// generated.proto files of k8s.io/api and k8s.io/apimachinery, so field numbers and names come from upstream. The output is
+// checked in; the regenerate_protobuf_schemas target runs this with KUBEPP_K8S_API_DIR and KUBEPP_K8S_APIMACHINERY_DIR:
+//
+//     kubepp_protobuf_schemas <output> <prefix>=<generated.proto>[:<root>,<root>...] ...
+//     eg. meta=apimachinery/pkg/apis/meta/v1/generated.proto:Status,ListMeta v1=api/core/v1/generated.proto apps/v1=api/apps/v1/generated.proto
+//
+// Schemas are named "<prefix>.<message>" ( eg. "v1.Pod", "apps/v1.Deployment", "meta.ObjectMeta" ). Every message of a file
+// without roots is written, and of the others only those reachable from its roots.
+
+
+namespace {
+
+    class ProtoField{
+        public:
+            string label;           // optional or repeated
+            string type;            // the value type of a map
+            string map_key_type;    // empty unless a map
+            string name;
+            uint32_t number = 0;
+            bool optional_marker = false;   // documented "+optional": omitempty in json
+    };
+
+
+    class ProtoMessage{
+        public:
+            string name;
+            vector<ProtoField> fields;
+    };
+
+
+    class ProtoFile{
+        public:
+            string prefix;
+            string package;
+            set<string> roots;
+            map<string, ProtoMessage> messages;
+    };
+
+
+    // apimachinery messages whose json isn't an object of their fields
+    const map<string, string> special_types = {
+        {"k8s.io.apimachinery.pkg.apis.meta.v1.Time", "TIME"},
+        {"k8s.io.apimachinery.pkg.apis.meta.v1.MicroTime", "MICRO_TIME"},
+        {"k8s.io.apimachinery.pkg.apis.meta.v1.Duration", "DURATION"},
+        {"k8s.io.apimachinery.pkg.apis.meta.v1.FieldsV1", "RAW_JSON"},
+        {"k8s.io.apimachinery.pkg.runtime.RawExtension", "RAW_JSON"},
+        {"k8s.io.apimachinery.pkg.api.resource.Quantity", "QUANTITY"},
+        {"k8s.io.apimachinery.pkg.util.intstr.IntOrString", "INT_OR_STRING"}
+    };
+
+    const map<string, string> scalar_types = {
+        {"string", "STRING"},
+        {"bytes", "BYTES"},
+        {"bool", "BOOL"},
+        {"int32", "INT32"},
+        {"int64", "INT64"}
+    };
+
+    // Go pointers to scalars ( eg. *bool ): written only when set, and then kept in json even when zero ( immutable: false, replicas: 0 ).
+    // The .proto doesn't say which fields are pointers; "+optional" covers pointers and omitempty values alike
+    const set<string> pointer_fields = {
+        "k8s.io.api.apps.v1.DaemonSetSpec.revisionHistoryLimit",
+        "k8s.io.api.apps.v1.DaemonSetStatus.collisionCount",
+        "k8s.io.api.apps.v1.DeploymentSpec.progressDeadlineSeconds",
+        "k8s.io.api.apps.v1.DeploymentSpec.replicas",
+        "k8s.io.api.apps.v1.DeploymentSpec.revisionHistoryLimit",
+        "k8s.io.api.apps.v1.DeploymentStatus.collisionCount",
+        "k8s.io.api.apps.v1.ReplicaSetSpec.replicas",
+        "k8s.io.api.apps.v1.RollingUpdateStatefulSetStrategy.partition",
+        "k8s.io.api.apps.v1.StatefulSetSpec.replicas",
+        "k8s.io.api.apps.v1.StatefulSetSpec.revisionHistoryLimit",
+        "k8s.io.api.apps.v1.StatefulSetStatus.collisionCount",
+        "k8s.io.api.core.v1.ClientIPConfig.timeoutSeconds",
+        "k8s.io.api.core.v1.ConfigMap.immutable",
+        "k8s.io.api.core.v1.ConfigMapEnvSource.optional",
+        "k8s.io.api.core.v1.ConfigMapKeySelector.optional",
+        "k8s.io.api.core.v1.ConfigMapProjection.optional",
+        "k8s.io.api.core.v1.ConfigMapVolumeSource.defaultMode",
+        "k8s.io.api.core.v1.ConfigMapVolumeSource.optional",
+        "k8s.io.api.core.v1.Container.restartPolicy",
+        "k8s.io.api.core.v1.ContainerStatus.started",
+        "k8s.io.api.core.v1.CSIVolumeSource.fsType",
+        "k8s.io.api.core.v1.CSIVolumeSource.readOnly",
+        "k8s.io.api.core.v1.DownwardAPIVolumeFile.mode",
+        "k8s.io.api.core.v1.DownwardAPIVolumeSource.defaultMode",
+        "k8s.io.api.core.v1.EphemeralContainerCommon.restartPolicy",
+        "k8s.io.api.core.v1.GRPCAction.service",
+        "k8s.io.api.core.v1.KeyToPath.mode",
+        "k8s.io.api.core.v1.PersistentVolumeClaimSpec.storageClassName",
+        "k8s.io.api.core.v1.PersistentVolumeClaimSpec.volumeAttributesClassName",
+        "k8s.io.api.core.v1.PersistentVolumeClaimSpec.volumeMode",
+        "k8s.io.api.core.v1.PersistentVolumeSpec.volumeMode",
+        "k8s.io.api.core.v1.PodSecurityContext.fsGroup",
+        "k8s.io.api.core.v1.PodSecurityContext.fsGroupChangePolicy",
+        "k8s.io.api.core.v1.PodSecurityContext.runAsGroup",
+        "k8s.io.api.core.v1.PodSecurityContext.runAsNonRoot",
+        "k8s.io.api.core.v1.PodSecurityContext.runAsUser",
+        "k8s.io.api.core.v1.PodSpec.activeDeadlineSeconds",
+        "k8s.io.api.core.v1.PodSpec.automountServiceAccountToken",
+        "k8s.io.api.core.v1.PodSpec.enableServiceLinks",
+        "k8s.io.api.core.v1.PodSpec.hostUsers",
+        "k8s.io.api.core.v1.PodSpec.preemptionPolicy",
+        "k8s.io.api.core.v1.PodSpec.priority",
+        "k8s.io.api.core.v1.PodSpec.runtimeClassName",
+        "k8s.io.api.core.v1.PodSpec.setHostnameAsFQDN",
+        "k8s.io.api.core.v1.PodSpec.shareProcessNamespace",
+        "k8s.io.api.core.v1.PodSpec.terminationGracePeriodSeconds",
+        "k8s.io.api.core.v1.Probe.terminationGracePeriodSeconds",
+        "k8s.io.api.core.v1.ProjectedVolumeSource.defaultMode",
+        "k8s.io.api.core.v1.Secret.immutable",
+        "k8s.io.api.core.v1.SecretEnvSource.optional",
+        "k8s.io.api.core.v1.SecretKeySelector.optional",
+        "k8s.io.api.core.v1.SecretProjection.optional",
+        "k8s.io.api.core.v1.SecretVolumeSource.defaultMode",
+        "k8s.io.api.core.v1.SecretVolumeSource.optional",
+        "k8s.io.api.core.v1.SecurityContext.allowPrivilegeEscalation",
+        "k8s.io.api.core.v1.SecurityContext.privileged",
+        "k8s.io.api.core.v1.SecurityContext.procMount",
+        "k8s.io.api.core.v1.SecurityContext.readOnlyRootFilesystem",
+        "k8s.io.api.core.v1.SecurityContext.runAsGroup",
+        "k8s.io.api.core.v1.SecurityContext.runAsNonRoot",
+        "k8s.io.api.core.v1.SecurityContext.runAsUser",
+        "k8s.io.api.core.v1.ServiceAccount.automountServiceAccountToken",
+        "k8s.io.api.core.v1.ServiceAccountTokenProjection.expirationSeconds",
+        "k8s.io.api.core.v1.ServicePort.appProtocol",
+        "k8s.io.api.core.v1.ServiceSpec.allocateLoadBalancerNodePorts",
+        "k8s.io.api.core.v1.ServiceSpec.internalTrafficPolicy",
+        "k8s.io.api.core.v1.ServiceSpec.ipFamilyPolicy",
+        "k8s.io.api.core.v1.ServiceSpec.loadBalancerClass",
+        "k8s.io.api.core.v1.ServiceSpec.trafficDistribution",
+        "k8s.io.api.core.v1.Toleration.tolerationSeconds",
+        "k8s.io.api.core.v1.TopologySpreadConstraint.minDomains",
+        "k8s.io.api.core.v1.TopologySpreadConstraint.nodeAffinityPolicy",
+        "k8s.io.api.core.v1.TopologySpreadConstraint.nodeTaintsPolicy",
+        "k8s.io.apimachinery.pkg.apis.meta.v1.ListMeta.remainingItemCount",
+        "k8s.io.apimachinery.pkg.apis.meta.v1.ObjectMeta.deletionGracePeriodSeconds",
+        "k8s.io.apimachinery.pkg.apis.meta.v1.OwnerReference.blockOwnerDeletion",
+        "k8s.io.apimachinery.pkg.apis.meta.v1.OwnerReference.controller"
+    };
+
+    // embedded Go structs ( json:",inline" ): their fields appear in the parent's json; the .proto doesn't say so. LocalObjectReference
+    // is embedded wherever it appears ( ConfigMap and Secret sources, selectors and projections ), as "localObjectReference"
+    const set<string> embedded_fields = {
+        "k8s.io.api.core.v1.Volume.volumeSource",
+        "k8s.io.api.core.v1.Probe.handler",
+        "k8s.io.api.core.v1.PersistentVolumeSpec.persistentVolumeSource",
+        "k8s.io.api.core.v1.EphemeralContainer.ephemeralContainerCommon"
+    };
+
+
+
+    string trim( const string& text ){
+
+        const size_t start = text.find_first_not_of(" \t\r");
+        if( start == string::npos ){
+            return "";
+        }
+        return text.substr( start, text.find_last_not_of(" \t\r") - start + 1 );
+
+    }
+
+
+
+    ProtoFile parseFile( const string& path ){
+
+        std::ifstream input(path);
+        if( !input ){
+            throw std::runtime_error("Can't read " + path + ".");
+        }
+
+        static const std::regex package_line( R"(^package\s+([\w.]+)\s*;$)" );
+        static const std::regex message_line( R"(^message\s+(\w+)\s*\{$)" );
+        static const std::regex field_line( R"(^(optional|repeated|required)?\s*(map\s*<\s*([\w.]+)\s*,\s*([\w.]+)\s*>|\.?[\w.]+)\s+(\w+)\s*=\s*(\d+)\s*(\[[^\]]*\])?\s*;$)" );
+
+        ProtoFile file;
+        ProtoMessage* message = nullptr;
+        string comment;
+        string line;
+        size_t line_number = 0;
+
+        while( std::getline(input, line) ){
+
+            line_number++;
+            line = trim(line);
+
+            const auto fail = [&]( const string& reason ){
+                throw std::runtime_error( path + ":" + std::to_string(line_number) + ": " + reason );
+            };
+
+            if( line.rfind("//", 0) == 0 ){
+                comment += line + "\n";
+                continue;
+            }
+
+            std::smatch match;
+
+            if( line.empty() || line.rfind("syntax", 0) == 0 || line.rfind("import", 0) == 0 || line.rfind("option ", 0) == 0 || line.rfind("reserved ", 0) == 0 ){
+                // options and reserved numbers don't change what's decoded
+            }else if( std::regex_match(line, match, package_line) ){
+                file.package = match[1];
+            }else if( std::regex_match(line, match, message_line) ){
+                if( message ){
+                    fail("nested messages aren't supported");
+                }
+                message = &file.messages[ match[1] ];
+                message->name = match[1];
+            }else if( line == "}" ){
+                if( !message ){
+                    fail("unexpected }");
+                }
+                message = nullptr;
+            }else if( message && std::regex_match(line, match, field_line) ){
+                ProtoField field;
+                field.label = match[1];
+                field.map_key_type = match[3];
+                field.type = field.map_key_type.empty() ? string( match[2] ) : string( match[4] );
+                if( !field.type.empty() && field.type[0] == '.' ){
+                    field.type = field.type.substr(1);
+                }
+                field.name = match[5];
+                field.number = static_cast<uint32_t>( std::stoul( match[6] ) );
+                field.optional_marker = comment.find("+optional") != string::npos;
+                message->fields.push_back(field);
+            }else{
+                fail("can't parse '" + line + "' ( enums, oneofs and extensions aren't supported )");
+            }
+
+            comment.clear();
+
+        }
+
+        if( file.package.empty() ){
+            throw std::runtime_error(path + " has no package.");
+        }
+
+        return file;
+
+    }
+
+
+
+    class SchemaWriter{
+
+        public:
+            SchemaWriter( vector<ProtoFile>& files )
+                :files(files)
+            {
+                for( ProtoFile& file : this->files ){
+                    this->files_by_package[file.package] = &file;
+                }
+            }
+
+
+            string write(){
+
+                for( const ProtoFile& file : this->files ){
+                    for( const auto& [name, message] : file.messages ){
+                        if( file.roots.empty() || file.roots.count(name) ){
+                            this->addMessage( file, name );
+                        }
+                    }
+                }
+
+                string output = "// Generated by tools/ProtobufSchemaGenerator.cpp from the k8s.io/api and k8s.io/apimachinery generated.proto files; don't edit, build regenerate_protobuf_schemas.\n";
+                for( const auto& [schema_name, entries] : this->schemas ){
+                    output += "{\"" + schema_name + "\", {\n";
+                    for( size_t i = 0; i < entries.size(); i++ ){
+                        output += "    " + entries[i] + ( i + 1 < entries.size() ? ",\n" : "\n" );
+                    }
+                    output += "}},\n";
+                }
+                return output;
+
+            }
+
+
+        protected:
+
+            /* The file and message a type refers to, relative to the package it's used in. */
+            std::pair<const ProtoFile*, string> resolve( const ProtoFile& from, const string& type ) const{
+
+                const size_t dot = type.rfind('.');
+                if( dot == string::npos ){
+                    return { &from, type };
+                }
+
+                auto it = this->files_by_package.find( type.substr(0, dot) );
+                if( it == this->files_by_package.end() ){
+                    throw std::runtime_error("The type " + type + " isn't in the given files; add its generated.proto.");
+                }
+                return { it->second, type.substr(dot + 1) };
+
+            }
+
+
+            void addMessage( const ProtoFile& file, const string& message_name ){
+
+                const string schema_name = file.prefix + "." + message_name;
+                if( this->schemas.count(schema_name) ){
+                    return;
+                }
+
+                auto message_it = file.messages.find(message_name);
+                if( message_it == file.messages.end() ){
+                    throw std::runtime_error("There is no message " + message_name + " in " + file.package + ".");
+                }
+
+                vector<string>& entries = this->schemas[schema_name];
+
+                for( const ProtoField& field : message_it->second.fields ){
+                    entries.push_back( "{" + std::to_string(field.number) + ", " + this->getField( file, message_name, field ) + "}" );
+                }
+
+            }
+
+
+            /* The Protobuf.cpp helper call that builds the field ( field, repeated, message, messageMap, keepZero, embedded ). */
+            string getField( const ProtoFile& file, const string& message_name, const ProtoField& field ){
+
+                const string name = "\"" + field.name + "\"";
+                const bool repeated = field.label == "repeated";
+
+                if( !field.map_key_type.empty() ){
+                    if( field.map_key_type != "string" ){
+                        throw std::runtime_error(file.package + "." + message_name + "." + field.name + ": only string map keys are supported.");
+                    }
+                    if( field.type == "string" ){
+                        return "field(" + name + ", Type::STRING_MAP)";
+                    }
+                    if( field.type == "bytes" ){
+                        return "field(" + name + ", Type::BYTES_MAP)";
+                    }
+                    if( special_types.count( this->getFullName(file, field.type) ) && special_types.at( this->getFullName(file, field.type) ) == "QUANTITY" ){
+                        return "field(" + name + ", Type::QUANTITY_MAP)";
+                    }
+                    return "messageMap(" + name + ", \"" + this->getSchemaName(file, field.type) + "\")";
+                }
+
+                string built;
+
+                if( scalar_types.count(field.type) ){
+                    built = string( repeated ? "repeated(" : "field(" ) + name + ", Type::" + scalar_types.at(field.type) + ")";
+                    // the apiserver writes every non-pointer field, zero or not, but its json leaves out the zero values of omitempty ones
+                    if( !repeated && ( !field.optional_marker || pointer_fields.count( file.package + "." + message_name + "." + field.name ) ) ){
+                        built = "keepZero(" + built + ")";
+                    }
+                }else if( special_types.count( this->getFullName(file, field.type) ) ){
+                    built = string( repeated ? "repeated(" : "field(" ) + name + ", Type::" + special_types.at( this->getFullName(file, field.type) ) + ")";
+                }else{
+                    built = "message(" + name + ", \"" + this->getSchemaName(file, field.type) + "\"" + ( repeated ? ", true" : "" ) + ")";
+                    if( embedded_fields.count( file.package + "." + message_name + "." + field.name ) || field.name == "localObjectReference" ){
+                        built = "embedded(" + built + ")";
+                    }
+                }
+
+                return built;
+
+            }
+
+
+            string getFullName( const ProtoFile& file, const string& type ) const{
+
+                if( scalar_types.count(type) ){
+                    return type;
+                }
+                return type.find('.') == string::npos ? file.package + "." + type : type;
+
+            }
+
+
+            /* Adds the schema of a message type and returns its name. */
+            string getSchemaName( const ProtoFile& file, const string& type ){
+
+                if( scalar_types.count(type) ){
+                    throw std::runtime_error("Unsupported protobuf type " + type + ".");
+                }
+
+                const auto [type_file, message_name] = this->resolve(file, type);
+                this->addMessage( *type_file, message_name );
+                return type_file->prefix + "." + message_name;
+
+            }
+
+
+            vector<ProtoFile>& files;
+            map<string, ProtoFile*> files_by_package;
+            map<string, vector<string>> schemas;
+
+    };
+
+}
+
+
+
+int main( int argc, char** argv ){
+
+    if( argc < 3 ){
+        std::cerr << "Usage: " << argv[0] << " <output> <prefix>=<generated.proto>[:<root>,<root>...] ..." << std::endl;
+        return 2;
+    }
+
+    try{
+
+        vector<ProtoFile> files;
+
+        for( int i = 2; i < argc; i++ ){
+
+            const string argument = argv[i];
+            const size_t equals_pos = argument.find('=');
+            if( equals_pos == string::npos ){
+                throw std::runtime_error("Expected <prefix>=<generated.proto>, got '" + argument + "'.");
+            }
+
+            string path = argument.substr(equals_pos + 1);
+            string roots;
+            const size_t colon_pos = path.rfind(':');
+            if( colon_pos != string::npos && path.find('/', colon_pos) == string::npos ){
+                roots = path.substr(colon_pos + 1);
+                path = path.substr(0, colon_pos);
+            }
+
+            ProtoFile file = parseFile(path);
+            file.prefix = argument.substr(0, equals_pos);
+
+            std::istringstream root_names(roots);
+            string root;
+            while( std::getline(root_names, root, ',') ){
+                if( !root.empty() ){
+                    file.roots.insert(root);
+                }
+            }
+
+            files.push_back( std::move(file) );
+
+        }
+
+        SchemaWriter writer(files);
+        const string output = writer.write();
+
+        // leave an unchanged file alone, so Protobuf.cpp isn't rebuilt for nothing
+        std::ifstream existing( argv[1], std::ios::binary );
+        std::stringstream existing_output;
+        existing_output << existing.rdbuf();
+        if( existing && existing_output.str() == output ){
+            return 0;
+        }
+
+        std::ofstream out( argv[1], std::ios::binary | std::ios::trunc );
+        out << output;
+        if( !out ){
+            throw std::runtime_error("Can't write " + string(argv[1]) + ".");
+        }
+
+    }catch( const std::exception& e ){
+        std::cerr << "kubepp_protobuf_schemas: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+
+}